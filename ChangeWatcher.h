@@ -0,0 +1,53 @@
+/****************************** Module Header ******************************\
+Module Name:  ChangeWatcher.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares ChangeWatcher, which reports the directories under a set
+of watched roots whose entries have changed (created, deleted, renamed or
+resized), so that an index of their sizes can be kept up to date without
+rescanning. When the system drops events, the root they were lost under is
+reported instead, to be rescanned as a whole.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+struct ChangeEvent
+{
+	std::wstring path;	// the changed directory, or the root events were lost under
+	bool overflow;		// path must be rescanned recursively
+
+	ChangeEvent(const std::wstring &p, bool o) : path(p), overflow(o) {}
+};
+
+class ChangeWatcher
+{
+public:
+	virtual ~ChangeWatcher() {}
+
+	// Start watching root and everything below it
+	virtual bool Watch(const std::wstring &root) = 0;
+
+	// Wait up to timeoutMs for changes and append them to events. The same
+	// directory may be reported several times. A directory below a root that
+	// cannot be watched is reported once as an overflow, and so is one made
+	// or moved in, whose parent's listing does not tell it from a directory
+	// of the same name it replaced. Returns false on error.
+	virtual bool Wait(unsigned timeoutMs, std::vector<ChangeEvent> &events) = 0;
+};
+
+// A watcher using the change notifications of the running system
+// (ReadDirectoryChangesW on Windows, inotify on Linux)
+std::unique_ptr<ChangeWatcher> CreateSystemChangeWatcher();
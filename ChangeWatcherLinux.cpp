@@ -0,0 +1,177 @@
+/****************************** Module Header ******************************\
+Module Name:  ChangeWatcherLinux.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The inotify ChangeWatcher. inotify watches single directories, so every
+directory below a root gets its own watch, and directories created later
+are added as their creation is reported. Each root has its own inotify
+instance, so a queue overflow only costs a rescan of that root.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#ifdef __linux__
+
+#include "ChangeWatcher.h"
+#include "FileSystem.h"
+#include "Utf8.h"
+#include <map>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | \
+	IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+class InotifyChangeWatcher : public ChangeWatcher
+{
+public:
+	virtual ~InotifyChangeWatcher()
+	{
+		for (size_t i = 0; i < m_roots.size(); ++i)
+			close(m_roots[i]->fd);
+		for (size_t i = 0; i < m_roots.size(); ++i)
+			delete m_roots[i];
+	}
+
+	virtual bool Watch(const std::wstring &root)
+	{
+		int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0)
+			return false;
+		Root *r = new Root;
+		r->path = root;
+		r->fd = fd;
+		if (!AddTree(*r, root))
+		{
+			close(fd);
+			delete r;
+			return false;
+		}
+		m_roots.push_back(r);
+		return true;
+	}
+
+	virtual bool Wait(unsigned timeoutMs, std::vector<ChangeEvent> &events)
+	{
+		std::vector<pollfd> fds(m_roots.size());
+		for (size_t i = 0; i < m_roots.size(); ++i)
+		{
+			fds[i].fd = m_roots[i]->fd;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+		// Directories that could not be watched are reported once, as lost
+		// events, so that they are rescanned at least
+		bool unwatched = false;
+		for (size_t i = 0; i < m_roots.size(); ++i)
+		{
+			Root &root = *m_roots[i];
+			for (size_t j = 0; j < root.unwatched.size(); ++j)
+				events.push_back(ChangeEvent(root.unwatched[j], true));
+			unwatched |= !root.unwatched.empty();
+			root.unwatched.clear();
+		}
+		int n = poll(fds.empty() ? NULL : &fds[0], fds.size(), unwatched ? 0 : (int)timeoutMs);
+		if (n < 0)
+			return errno == EINTR;
+		for (size_t i = 0; i < fds.size(); ++i)
+		{
+			if (fds[i].revents & POLLIN)
+				Read(*m_roots[i], events);
+		}
+		return true;
+	}
+
+private:
+	struct Root
+	{
+		std::wstring path;
+		int fd;
+		std::map<int, std::wstring> dirs;	// watch descriptor -> directory
+		std::vector<std::wstring> unwatched;	// not reported yet
+	};
+
+	// Watch dir and all directories below it. Directories below the root
+	// that cannot be watched, e.g. past the watch limit or unreadable, are
+	// kept to be reported.
+	bool AddTree(Root &root, const std::wstring &dir)
+	{
+		int wd = inotify_add_watch(root.fd, WideToUtf8(dir).c_str(), WATCH_MASK);
+		if (wd < 0)
+		{
+			// Gone already, its parent reports that
+			if (errno != ENOENT && dir != root.path)
+				root.unwatched.push_back(dir);
+			return false;
+		}
+		root.dirs[wd] = dir;
+		std::vector<DirEntry> entries;
+		if (!SystemFileSystem().ReadDir(dir, entries, NULL))
+			return true;
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			if (entries[i].isDir)
+				AddTree(root, JoinPath(dir, entries[i].name));
+		}
+		return true;
+	}
+
+	void Read(Root &root, std::vector<ChangeEvent> &events)
+	{
+		char buf[64 * (sizeof(inotify_event) + NAME_MAX + 1)]
+			__attribute__((aligned(__alignof__(inotify_event))));
+		for (;;)
+		{
+			ssize_t len = read(root.fd, buf, sizeof(buf));
+			if (len <= 0)
+				break;
+			for (char *p = buf; p < buf + len; )
+			{
+				const inotify_event *ev = reinterpret_cast<const inotify_event *>(p);
+				p += sizeof(inotify_event) + ev->len;
+				if (ev->mask & IN_Q_OVERFLOW)
+				{
+					events.push_back(ChangeEvent(root.path, true));
+					continue;
+				}
+				std::map<int, std::wstring>::iterator dir = root.dirs.find(ev->wd);
+				if (dir == root.dirs.end())
+					continue;
+				if (ev->mask & IN_IGNORED)
+				{
+					// The directory is gone, its parent reports that
+					root.dirs.erase(dir);
+					continue;
+				}
+				events.push_back(ChangeEvent(dir->second, false));
+				if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)) && ev->len)
+				{
+					// Rescanned, as it may have filled before it was watched,
+					// and may replace a directory of the same name
+					std::wstring added = JoinPath(dir->second, Utf8ToWide(ev->name));
+					AddTree(root, added);
+					events.push_back(ChangeEvent(added, true));
+				}
+			}
+		}
+	}
+
+	std::vector<Root *> m_roots;
+};
+
+std::unique_ptr<ChangeWatcher> CreateSystemChangeWatcher()
+{
+	return std::unique_ptr<ChangeWatcher>(new InotifyChangeWatcher);
+}
+
+#endif
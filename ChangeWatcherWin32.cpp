@@ -0,0 +1,159 @@
+/****************************** Module Header ******************************\
+Module Name:  ChangeWatcherWin32.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The ReadDirectoryChangesW ChangeWatcher. One overlapped request per root
+watches its whole subtree. A request that completes with no data, or with
+ERROR_NOTIFY_ENUM_DIR, means its buffer overflowed and changes were lost.
+
+The USN journal would survive restarts of the watcher, but it needs an
+elevated volume handle, which the index builder does not have.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#ifdef _WIN32
+
+#include "ChangeWatcher.h"
+#include "FileSystem.h"
+#include <windows.h>
+
+#define WATCH_FILTER (FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE)
+#define WATCH_BUFFER_SIZE (64 * 1024)	// the limit for network shares
+
+class Win32ChangeWatcher : public ChangeWatcher
+{
+public:
+	virtual ~Win32ChangeWatcher()
+	{
+		for (size_t i = 0; i < m_roots.size(); ++i)
+		{
+			Root *root = m_roots[i];
+			CancelIoEx(root->hDir, &root->overlapped);
+			DWORD bytes;
+			GetOverlappedResult(root->hDir, &root->overlapped, &bytes, TRUE);
+			CloseHandle(root->hDir);
+			CloseHandle(root->overlapped.hEvent);
+			delete root;
+		}
+	}
+
+	virtual bool Watch(const std::wstring &root)
+	{
+		if (m_roots.size() >= MAXIMUM_WAIT_OBJECTS)
+			return false;
+		HANDLE hDir = CreateFileW(root.c_str(), FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+			FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+		if (hDir == INVALID_HANDLE_VALUE)
+			return false;
+		Root *r = new Root;
+		r->path = root;
+		r->hDir = hDir;
+		r->buffer.resize(WATCH_BUFFER_SIZE / sizeof(DWORD));
+		ZeroMemory(&r->overlapped, sizeof(r->overlapped));
+		r->overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+		if (!r->overlapped.hEvent || !Request(*r))
+		{
+			if (r->overlapped.hEvent)
+				CloseHandle(r->overlapped.hEvent);
+			CloseHandle(hDir);
+			delete r;
+			return false;
+		}
+		m_roots.push_back(r);
+		return true;
+	}
+
+	virtual bool Wait(unsigned timeoutMs, std::vector<ChangeEvent> &events)
+	{
+		if (m_roots.empty())
+		{
+			Sleep(timeoutMs);
+			return true;
+		}
+		std::vector<HANDLE> handles;
+		for (size_t i = 0; i < m_roots.size(); ++i)
+			handles.push_back(m_roots[i]->overlapped.hEvent);
+		DWORD ret = WaitForMultipleObjects((DWORD)handles.size(), &handles[0], FALSE, timeoutMs);
+		if (ret == WAIT_TIMEOUT)
+			return true;
+		if (ret >= WAIT_OBJECT_0 + handles.size())
+			return false;
+		// Collect every root that has completed, not just the first
+		for (size_t i = 0; i < m_roots.size(); ++i)
+		{
+			if (WaitForSingleObject(handles[i], 0) == WAIT_OBJECT_0)
+				Read(*m_roots[i], events);
+		}
+		return true;
+	}
+
+private:
+	struct Root
+	{
+		std::wstring path;
+		HANDLE hDir;
+		OVERLAPPED overlapped;
+		std::vector<DWORD> buffer;	// DWORD aligned, as required
+	};
+
+	bool Request(Root &root)
+	{
+		ResetEvent(root.overlapped.hEvent);
+		return ReadDirectoryChangesW(root.hDir, &root.buffer[0], (DWORD)(root.buffer.size() * sizeof(DWORD)),
+			TRUE, WATCH_FILTER, NULL, &root.overlapped, NULL) != 0;
+	}
+
+	void Read(Root &root, std::vector<ChangeEvent> &events)
+	{
+		DWORD bytes = 0;
+		if (!GetOverlappedResult(root.hDir, &root.overlapped, &bytes, FALSE) || bytes == 0)
+			events.push_back(ChangeEvent(root.path, true));
+		else
+		{
+			const BYTE *p = reinterpret_cast<const BYTE *>(&root.buffer[0]);
+			for (;;)
+			{
+				const FILE_NOTIFY_INFORMATION *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(p);
+				std::wstring name(info->FileName, info->FileNameLength / sizeof(wchar_t));
+				// The entries of the directory containing name have changed
+				size_t sep = name.rfind(L'\\');
+				events.push_back(ChangeEvent(sep == std::wstring::npos ?
+					root.path : JoinPath(root.path, name.substr(0, sep)), false));
+				// A directory made or moved in may replace one of the same
+				// name, which the listing of its parent does not tell
+				if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+				{
+					std::wstring added = JoinPath(root.path, name);
+					DWORD attributes = GetFileAttributesW(added.c_str());
+					if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) &&
+						!(attributes & FILE_ATTRIBUTE_REPARSE_POINT))
+						events.push_back(ChangeEvent(added, true));
+				}
+				if (!info->NextEntryOffset)
+					break;
+				p += info->NextEntryOffset;
+			}
+		}
+		// If the root itself is gone there is nothing more to watch
+		if (!Request(root))
+			ResetEvent(root.overlapped.hEvent);
+	}
+
+	std::vector<Root *> m_roots;
+};
+
+std::unique_ptr<ChangeWatcher> CreateSystemChangeWatcher()
+{
+	return std::unique_ptr<ChangeWatcher>(new Win32ChangeWatcher);
+}
+
+#endif
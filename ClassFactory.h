@@ -1,42 +1,42 @@
-/****************************** Module Header ******************************\
-Module Name:  ClassFactory.h
-Project:      DiskUsageTip
-Copyright (c) Microsoft Corporation.
-
-The file declares the class factory for the FileContextMenuExt COM class. 
-
-This source is subject to the Microsoft Public License.
-See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
-All other rights reserved.
-
-THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
-EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED 
-WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
-\***************************************************************************/
-
-#pragma once
-
-#include <unknwn.h>     // For IClassFactory
-#include <windows.h>
-
-
-class ClassFactory : public IClassFactory
-{
-public:
-    // IUnknown
-    IFACEMETHODIMP QueryInterface(REFIID riid, void **ppv);
-    IFACEMETHODIMP_(ULONG) AddRef();
-    IFACEMETHODIMP_(ULONG) Release();
-
-    // IClassFactory
-    IFACEMETHODIMP CreateInstance(IUnknown *pUnkOuter, REFIID riid, void **ppv);
-    IFACEMETHODIMP LockServer(BOOL fLock);
-
-    ClassFactory();
-
-protected:
-    ~ClassFactory();
-
-private:
-    long m_cRef;
+/****************************** Module Header ******************************\
+Module Name:  ClassFactory.h
+Project:      DiskUsageTip
+Copyright (c) Microsoft Corporation.
+
+The file declares the class factory for the FileContextMenuExt COM class. 
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED 
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <unknwn.h>     // For IClassFactory
+#include <windows.h>
+
+
+class ClassFactory : public IClassFactory
+{
+public:
+    // IUnknown
+    IFACEMETHODIMP QueryInterface(REFIID riid, void **ppv);
+    IFACEMETHODIMP_(ULONG) AddRef();
+    IFACEMETHODIMP_(ULONG) Release();
+
+    // IClassFactory
+    IFACEMETHODIMP CreateInstance(IUnknown *pUnkOuter, REFIID riid, void **ppv);
+    IFACEMETHODIMP LockServer(BOOL fLock);
+
+    ClassFactory();
+
+protected:
+    ~ClassFactory();
+
+private:
+    long m_cRef;
 };
\ No newline at end of file
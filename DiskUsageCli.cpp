@@ -0,0 +1,669 @@
+/****************************** Module Header ******************************\
+Module Name:  DiskUsageCli.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The command line front end, for scripts monitoring many machines. It reports
+the volumes holding any number of paths, and optionally the size of each
+path, through the same volume queries, folder scanner and report renderer
+the shell extension uses. Records are written out as JSON lines or CSV as
+soon as they are known, and the whole run ends by a deadline: volumes that
+have not answered and folders still being scanned by then are reported as
+such. Paths on different disks are scanned at the same time, each disk at
+the concurrency its latency allows. With --throttle the scans stay out of
+the way of the programs using the disks, at low I/O priority and a capped
+rate that backs off when the disks slow down. With --uring the files of
+each folder are stat'ed through io_uring, many at once. With --estimate
+each path is first estimated from a sample of its folders, which is
+reported at once, ahead of the exact size its scan reports when done. With
+--progress the running totals of each scan are reported as it goes.
+Interrupted, it stops the scans, reports the folders not done as still
+being scanned and ends.
+
+With --collect it runs instead as the collector of the shell extension,
+querying all volumes every so often and publishing them in the volume
+snapshot, until it is stopped.
+
+Built by CMake as the diskusage target along with the core library, or by
+the DiskUsageCli project of the Visual Studio solution:
+./diskusage [options] path...
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "DiskUsageCore.h"
+#include "VolumeList.h"
+#include "ReportWriter.h"
+#include "Utf8.h"
+#include "Trace.h"
+#include "VolumeSnapshot.h"
+#include "IoScheduler.h"
+#include "ScanThrottle.h"
+#include "SizeEstimator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <set>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <signal.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+#define DEFAULT_TIMEOUT_MS 10000
+#define DEFAULT_SCAN_JOBS 1
+#define DEFAULT_COLLECT_INTERVAL_MS 5000
+// Longest wait for scans before looking whether the run was interrupted
+#define INTERRUPT_CHECK_MS 20
+
+// Exit codes
+#define EXIT_ALL_OK 0
+#define EXIT_INCOMPLETE 1	// a volume or folder failed or missed the deadline
+#define EXIT_USAGE 2
+
+static const char g_usage[] =
+	"Usage: diskusage [options] path...\n"
+	"       diskusage --collect [--interval=MS]\n"
+	"Reports the volumes holding the paths, and with --scan the size of the paths.\n"
+	"A path of - reads more paths from standard input, one per line.\n"
+	"\n"
+	"  --format=json|csv  JSON lines (the default) or CSV\n"
+	"  --timeout=MS       end the run after MS milliseconds, 0 for no limit\n"
+	"                     (default 10000)\n"
+	"  --scan             scan the paths for their size, files and folders\n"
+	"  --top=N            with --scan, also report the N largest folders and files\n"
+	"  --progress=MS      with --scan, report what each scan found so far every MS\n"
+	"                     milliseconds\n"
+	"  --estimate=MS      estimate the size of each path from MS milliseconds of\n"
+	"                     sampling its folders, reported before any scan is done\n"
+	"  --jobs=N           paths scanned at once on each disk (default 1)\n"
+	"  --threads=N        threads per scan (default: 32 / jobs)\n"
+	"  --cross-volumes    scan into other volumes mounted below the paths\n"
+	"  --uring            with --scan, stat the files of each folder many at once\n"
+	"                     through io_uring, where the system has it\n"
+	"  --throttle[=N]     scan at low I/O priority, reading at most N folders and\n"
+	"                     files per second on each disk (default 500), fewer\n"
+	"                     while the disk is slow to answer\n"
+	"  --all-volumes      report every volume, not only those holding the paths\n"
+	"  --trace=FILE       write where the time went to FILE, as Chrome trace JSON\n"
+	"  --collect          publish all volumes for the shell extension every\n"
+	"                     interval, until interrupted\n"
+	"  --interval=MS      with --collect, milliseconds between rounds (default 5000)\n"
+	"\n"
+	"Exits with 0 if everything was reported in time, 1 if a volume or folder\n"
+	"failed or missed the deadline or the run was interrupted, 2 on bad usage.\n";
+
+struct Options
+{
+	bool csv;
+	unsigned timeoutMs;
+	bool scan;
+	unsigned top;
+	unsigned progressMs;	// 0 for no progress records
+	unsigned estimateMs;
+	unsigned jobs;
+	unsigned threads;
+	bool crossVolumes;
+	bool uring;
+	unsigned throttle;	// requests per second of each disk, 0 for no limit
+	bool allVolumes;
+	std::wstring traceFile;
+	bool collect;
+	unsigned intervalMs;
+	std::vector<std::wstring> paths;
+
+	Options() : csv(false), timeoutMs(DEFAULT_TIMEOUT_MS), scan(false), top(0), progressMs(0), estimateMs(0),
+		jobs(DEFAULT_SCAN_JOBS), threads(0), crossVolumes(false), uring(false), throttle(0), allVolumes(false),
+		collect(false), intervalMs(DEFAULT_COLLECT_INTERVAL_MS) {}
+};
+
+static bool ParseUnsigned(const std::wstring &text, unsigned &value)
+{
+	if (text.empty())
+		return false;
+	wchar_t *end = NULL;
+	unsigned long parsed = wcstoul(text.c_str(), &end, 10);
+	if (*end || parsed > 0xFFFFFFFFUL)
+		return false;
+	value = (unsigned)parsed;
+	return true;
+}
+
+// Add the paths listed one per line on standard input
+static void ReadPaths(std::vector<std::wstring> &paths)
+{
+	char buf[4096];
+	std::string line;
+	while (fgets(buf, sizeof(buf), stdin))
+	{
+		line += buf;
+		if (line[line.size() - 1] != '\n' && !feof(stdin))
+			continue;	// longer than buf
+		while (!line.empty() && (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r'))
+			line.erase(line.size() - 1);
+		if (!line.empty())
+			paths.push_back(Utf8ToWide(line));
+		line.clear();
+	}
+}
+
+static bool ParseOptions(const std::vector<std::wstring> &args, Options &options)
+{
+	bool readStdin = false;
+	bool optionsEnd = false;
+	for (size_t i = 0; i < args.size(); ++i)
+	{
+		const std::wstring &arg = args[i];
+		if (optionsEnd || arg.size() < 2 || arg[0] != L'-')
+		{
+			if (arg == L"-")
+				readStdin = true;
+			else
+				options.paths.push_back(arg);
+			continue;
+		}
+		size_t equals = arg.find(L'=');
+		std::wstring name = arg.substr(0, equals);
+		std::wstring value = equals == std::wstring::npos ? std::wstring() : arg.substr(equals + 1);
+		bool hasValue = equals != std::wstring::npos;
+		if (name == L"--")
+			optionsEnd = true;
+		else if (name == L"--format" && (value == L"json" || value == L"csv"))
+			options.csv = value == L"csv";
+		else if (name == L"--timeout" && ParseUnsigned(value, options.timeoutMs))
+			;
+		else if (name == L"--top" && ParseUnsigned(value, options.top))
+			;
+		else if (name == L"--progress" && ParseUnsigned(value, options.progressMs) && options.progressMs)
+			;
+		else if (name == L"--estimate" && ParseUnsigned(value, options.estimateMs) && options.estimateMs)
+			;
+		else if (name == L"--jobs" && ParseUnsigned(value, options.jobs) && options.jobs)
+			;
+		else if (name == L"--threads" && ParseUnsigned(value, options.threads))
+			;
+		else if (name == L"--scan" && !hasValue)
+			options.scan = true;
+		else if (name == L"--cross-volumes" && !hasValue)
+			options.crossVolumes = true;
+		else if (name == L"--uring" && !hasValue)
+			options.uring = true;
+		else if (name == L"--throttle" && !hasValue)
+			options.throttle = ScanThrottle::DEFAULT_RATE;
+		else if (name == L"--throttle" && ParseUnsigned(value, options.throttle) && options.throttle)
+			;
+		else if (name == L"--all-volumes" && !hasValue)
+			options.allVolumes = true;
+		else if (name == L"--trace" && !value.empty())
+			options.traceFile = value;
+		else if (name == L"--collect" && !hasValue)
+			options.collect = true;
+		else if (name == L"--interval" && ParseUnsigned(value, options.intervalMs) && options.intervalMs)
+			;
+		else
+		{
+			fprintf(stderr, "diskusage: bad option %s\n", WideToUtf8(arg).c_str());
+			return false;
+		}
+	}
+	if (readStdin)
+		ReadPaths(options.paths);
+	if (options.collect)
+		return options.paths.empty();
+	return !options.paths.empty() || options.allVolumes;
+}
+
+// The absolute form of path, with links resolved where the system does that
+// cheaply, for finding the volume holding it
+static std::wstring AbsolutePath(const std::wstring &path)
+{
+#ifdef _WIN32
+	wchar_t buf[MAX_PATH];
+	DWORD len = GetFullPathNameW(path.c_str(), MAX_PATH, buf, NULL);
+	if (len == 0 || len >= MAX_PATH)
+		return path;
+	return std::wstring(buf, len);
+#else
+	char *real = realpath(WideToUtf8(path).c_str(), NULL);
+	if (!real)
+		return path;
+	std::wstring result = Utf8ToWide(real);
+	free(real);
+	return result;
+#endif
+}
+
+// Write out and clear what has been rendered into out
+static void Flush(ReportBuffer &out)
+{
+	static std::string bytes;
+	bytes.clear();
+	AppendUtf8(bytes, out.c_str(), out.Length());
+	fwrite(bytes.data(), 1, bytes.size(), stdout);
+	fflush(stdout);
+	out.Clear();
+}
+
+// The folders to scan, shared by the scan jobs and the main thread
+struct ScanQueue
+{
+	struct Folder
+	{
+		std::wstring path;
+		bool ok;
+		ScanTotals totals;
+		std::vector<ScanItem> topDirs;
+		std::vector<ScanItem> topFiles;
+		FolderScanner *scanner;	// while it is being scanned
+		ScanProgress progress;	// the latest, while progressed
+		bool progressed;
+		bool done;
+
+		Folder() : ok(false), scanner(NULL), progressed(false), done(false) {}
+	};
+
+	std::mutex lock;
+	std::condition_variable cond;
+	std::vector<Folder> folders;
+	std::deque<size_t> progressed;	// with progress not reported yet
+	std::deque<size_t> finished;	// scanned, but not reported yet
+	bool cancel;
+
+	ScanQueue() : cancel(false) {}
+};
+
+// Scan a folder, as a job of the device it is on
+static void ScanJob(ScanQueue &queue, size_t index, const Options &options, unsigned threads, FileSystem &fs)
+{
+	std::unique_lock<std::mutex> lock(queue.lock);
+	if (queue.cancel)
+		return;
+	ScanQueue::Folder &folder = queue.folders[index];
+	FolderScanner scanner(fs, threads);
+	scanner.SetTopCount(options.top);
+	scanner.SetCrossVolumes(options.crossVolumes);
+	scanner.SetLowPriority(options.throttle != 0);
+	if (options.progressMs)
+	{
+		// Only the latest progress of a folder is kept for the main thread
+		// to report, however far behind it is
+		scanner.SetProgressCallback([&queue, &folder, index](const ScanProgress &progress) {
+			std::lock_guard<std::mutex> lock(queue.lock);
+			folder.progress = progress;
+			if (!folder.progressed)
+			{
+				folder.progressed = true;
+				queue.progressed.push_back(index);
+			}
+			queue.cond.notify_all();
+		}, options.progressMs);
+	}
+	folder.scanner = &scanner;
+	lock.unlock();
+
+	ScanTotals totals;
+	bool ok;
+	{
+		TraceSpan span("Scan", folder.path.c_str());
+		ok = scanner.Scan(folder.path, totals);
+	}
+
+	lock.lock();
+	folder.scanner = NULL;
+	folder.ok = ok;
+	folder.totals = totals;
+	folder.topDirs = scanner.TopDirs();
+	folder.topFiles = scanner.TopFiles();
+	folder.done = true;
+	queue.finished.push_back(index);
+	queue.cond.notify_all();
+}
+
+// The throttles of the disks scanned, each made on its first scan
+typedef std::map<std::wstring, std::shared_ptr<ScanThrottle> > Throttles;
+
+// The throttle of device, NULL if the scans are not throttled
+static std::shared_ptr<ScanThrottle> DeviceThrottle(Throttles &throttles, const std::wstring &device,
+	const Options &options)
+{
+	if (!options.throttle)
+		return std::shared_ptr<ScanThrottle>();
+	std::shared_ptr<ScanThrottle> &throttle = throttles[device];
+	if (!throttle)
+		throttle = std::make_shared<ScanThrottle>(options.throttle);
+	return throttle;
+}
+
+// Tell how each disk was throttled, for tuning the rate
+static void ReportThrottles(const Throttles &throttles)
+{
+	for (Throttles::const_iterator it = throttles.begin(); it != throttles.end(); ++it)
+	{
+		ScanThrottleStats stats;
+		it->second->GetStats(stats);
+		fprintf(stderr, "diskusage: %s: %llu requests in %.1f s, %.0f/s, throttled %.1f s, "
+			"%u backoffs, now %.0f/s, latency %.0f us (%.0f us alone)\n", WideToUtf8(it->first).c_str(),
+			stats.requests, stats.seconds, stats.requestsPerSecond, stats.throttledSeconds, stats.backoffs,
+			stats.rate, stats.meanLatencyUs, stats.baselineUs);
+	}
+}
+
+// Write the spans traced during the run, if asked to
+static void SaveTrace(const Options &options)
+{
+	if (!options.traceFile.empty() && !Trace::Save(options.traceFile))
+		fprintf(stderr, "diskusage: cannot write %s\n", WideToUtf8(options.traceFile).c_str());
+}
+
+static volatile sig_atomic_t g_interrupted;
+
+static void Interrupt(int)
+{
+	// Asked twice, it does not wait for anything
+	if (g_interrupted)
+		_exit(EXIT_INCOMPLETE);
+	g_interrupted = 1;
+}
+
+// Publish all volumes every interval until interrupted. A volume that does
+// not answer within the round keeps what it last answered, with its current
+// status, so a hung volume neither holds up the others nor loses its space.
+static int Collect(const Options &options)
+{
+	signal(SIGINT, Interrupt);
+	signal(SIGTERM, Interrupt);
+	VolumeSnapshotWriter writer;
+	std::map<std::wstring, VolumeRecord> answered;
+	std::vector<VolumeRecord> records;
+	QueryClock::time_point next = QueryClock::now();
+	while (!g_interrupted)
+	{
+		next += std::chrono::milliseconds(options.intervalMs);
+		{
+			TraceSpan span("CollectRound");
+			if (!CollectVolumes(SystemVolumeBackend(), VolumeQuery::Global(), next, records))
+				records.clear();
+			std::map<std::wstring, VolumeRecord> seen;
+			for (size_t i = 0; i < records.size(); ++i)
+			{
+				VolumeRecord &record = records[i];
+				if (record.status == VolumeQuery::QUERY_OK)
+					seen[record.volname] = record;
+				else
+				{
+					auto last = answered.find(record.volname);
+					if (last == answered.end())
+						continue;
+					VolumeQuery::Status status = record.status;
+					record = last->second;
+					record.status = status;
+					seen[record.volname] = last->second;
+				}
+			}
+			answered.swap(seen);	// forgets the volumes gone since
+			if (!writer.Publish(records, options.intervalMs))
+				fputs("diskusage: cannot publish the volumes\n", stderr);
+		}
+
+		// Wait in short steps, to notice being interrupted
+		QueryClock::time_point now = QueryClock::now();
+		if (next < now)
+			next = now;	// the round overran, don't try to catch up
+		while (!g_interrupted && QueryClock::now() < next)
+			std::this_thread::sleep_for(std::min<QueryClock::duration>(next - QueryClock::now(),
+				std::chrono::milliseconds(100)));
+	}
+	SaveTrace(options);
+	return EXIT_ALL_OK;
+}
+
+static int Run(const std::vector<std::wstring> &args)
+{
+	Options options;
+	if (!ParseOptions(args, options))
+	{
+		fputs(g_usage, stderr);
+		return EXIT_USAGE;
+	}
+	if (!options.traceFile.empty())
+		Trace::Enable(true);
+	if (options.collect)
+		return Collect(options);
+	// No limit is a deadline far enough away, which the waits below can
+	// still compute with
+	QueryClock::time_point deadline = QueryClock::now() + (options.timeoutMs ?
+		std::chrono::milliseconds(options.timeoutMs) : std::chrono::hours(24 * 365));
+	int result = EXIT_ALL_OK;
+
+	// The volumes holding the paths, each once, in the order of the paths
+	std::shared_ptr<const MountTable> table = MountTable::Current();
+	std::vector<std::wstring> volnames;
+	std::vector<std::wstring> pathVolumes(options.paths.size());
+	std::set<std::wstring> selected;
+	std::wstring volname;
+	for (size_t i = 0; i < options.paths.size(); ++i)
+	{
+		bool isMount;
+		if (!ResolveVolume(*table, AbsolutePath(options.paths[i]), volname, isMount))
+		{
+			fprintf(stderr, "diskusage: no volume holds %s\n", WideToUtf8(options.paths[i]).c_str());
+			result = EXIT_INCOMPLETE;
+			continue;
+		}
+		pathVolumes[i] = volname;
+		if (selected.insert(volname).second)
+			volnames.push_back(volname);
+	}
+
+	// Start the scans before querying the volumes, so they run meanwhile.
+	// Each disk has a queue of its own, so a slow one holds up only the
+	// paths on it.
+	ScanQueue queue;
+	Throttles throttles;
+	IoScheduler scheduler(SystemVolumeBackend(), options.uring ? UringFileSystem() : SystemFileSystem(),
+		IoScheduler::DEFAULT_MAX_CONCURRENCY, options.jobs);
+	unsigned threads = options.threads;
+	if (!threads)
+		threads = std::max(IoScheduler::DEFAULT_MAX_CONCURRENCY / options.jobs, 1u);
+	// A path on no known volume is a device of its own
+	std::vector<std::wstring> pathDevices(options.paths.size());
+	for (size_t i = 0; i < options.paths.size(); ++i)
+		pathDevices[i] = pathVolumes[i].empty() ? options.paths[i] : scheduler.DeviceOf(pathVolumes[i]);
+	if (options.scan && !options.paths.empty())
+	{
+		// Interrupting the run stops the scans, instead of the process with
+		// them
+		signal(SIGINT, Interrupt);
+		signal(SIGTERM, Interrupt);
+		queue.folders.resize(options.paths.size());
+		for (size_t i = 0; i < options.paths.size(); ++i)
+			queue.folders[i].path = options.paths[i];
+		for (size_t i = 0; i < options.paths.size(); ++i)
+		{
+			std::shared_ptr<ScanThrottle> throttle = DeviceThrottle(throttles, pathDevices[i], options);
+			scheduler.Submit(pathDevices[i], [&queue, i, &options, threads, throttle](FileSystem &fs) {
+				if (!throttle)
+				{
+					ScanJob(queue, i, options, threads, fs);
+					return;
+				}
+				ThrottledFileSystem throttled(fs, *throttle);
+				ScanJob(queue, i, options, threads, throttled);
+			});
+		}
+	}
+
+	std::vector<VolumeRecord> records;
+	if (options.allVolumes)
+	{
+		if (!CollectVolumes(SystemVolumeBackend(), VolumeQuery::Global(), deadline, records))
+		{
+			fputs("diskusage: cannot list the volumes\n", stderr);
+			result = EXIT_INCOMPLETE;
+		}
+	}
+	else
+		QueryVolumes(SystemVolumeBackend(), VolumeQuery::Global(), volnames, deadline, records);
+
+	ReportBuffer out;
+	JsonReportEmitter json(out, true);
+	CsvReportEmitter csv(out);
+	ReportEmitter &report = options.csv ? (ReportEmitter &)csv : (ReportEmitter &)json;
+	report.Begin();
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const VolumeRecord &record = records[i];
+		bool isSelected = selected.count(record.volname) != 0;
+		if (isSelected && record.status != VolumeQuery::QUERY_OK)
+			result = EXIT_INCOMPLETE;
+		report.Volume(record, isSelected, record.hasSpace ? &record.space : NULL);
+	}
+	Flush(out);
+
+	// Estimate the paths while they are being scanned, on the same disks and
+	// throttles. One whose scan is done already needs no estimate.
+	for (size_t i = 0; options.estimateMs && i < options.paths.size(); ++i)
+	{
+		QueryClock::time_point now = QueryClock::now();
+		if (now >= deadline || g_interrupted)
+			break;
+		if (options.scan)
+		{
+			std::lock_guard<std::mutex> lock(queue.lock);
+			if (queue.folders[i].done)
+				continue;
+		}
+		std::shared_ptr<ScanThrottle> throttle = DeviceThrottle(throttles, pathDevices[i], options);
+		FileSystem &fs = scheduler.FileSystemOf(pathDevices[i]);
+		std::unique_ptr<ThrottledFileSystem> throttled;
+		if (throttle)
+			throttled.reset(new ThrottledFileSystem(fs, *throttle));
+		SizeEstimator estimator(throttled ? (FileSystem &)*throttled : fs, options.paths[i], threads);
+		unsigned budgetMs = (unsigned)std::min<long long>(options.estimateMs,
+			std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count());
+		SizeEstimate estimate;
+		bool readable = estimator.Refine(budgetMs);
+		if (!readable || !estimator.GetEstimate(estimate))
+		{
+			fprintf(stderr, readable ? "diskusage: %s is too slow to estimate\n" : "diskusage: cannot read %s\n",
+				WideToUtf8(options.paths[i]).c_str());
+			result = EXIT_INCOMPLETE;
+			continue;
+		}
+		report.Estimate(options.paths[i], estimate);
+		Flush(out);
+	}
+
+	// Report the folders as their scans go and finish, and those still being
+	// scanned at the deadline or when interrupted as such
+	bool timedOut = false;
+	bool interrupted = false;
+	size_t reported = 0;
+	std::unique_lock<std::mutex> lock(queue.lock);
+	while (reported < queue.folders.size())
+	{
+		if (g_interrupted)
+		{
+			interrupted = true;
+			break;
+		}
+		while (!queue.progressed.empty())
+		{
+			ScanQueue::Folder &folder = queue.folders[queue.progressed.front()];
+			queue.progressed.pop_front();
+			folder.progressed = false;
+			if (!folder.done)
+				report.Progress(folder.path, folder.progress);
+		}
+		if (out.Length())
+			Flush(out);
+		if (queue.finished.empty())
+		{
+			QueryClock::time_point now = QueryClock::now();
+			if (now >= deadline)
+			{
+				timedOut = true;
+				break;
+			}
+			// A signal cannot wake the wait, so it is cut short to look
+			queue.cond.wait_until(lock, std::min<QueryClock::time_point>(deadline,
+				now + std::chrono::milliseconds(INTERRUPT_CHECK_MS)));
+			continue;
+		}
+		const ScanQueue::Folder &folder = queue.folders[queue.finished.front()];
+		queue.finished.pop_front();
+		++reported;
+		if (!folder.ok)
+			result = EXIT_INCOMPLETE;
+		report.Folder(folder.path, &folder.totals, folder.topDirs, folder.topFiles);
+		Flush(out);
+	}
+	if (timedOut || interrupted)
+	{
+		queue.cancel = true;
+		std::vector<ScanItem> none;
+		for (size_t i = 0; i < queue.folders.size(); ++i)
+		{
+			ScanQueue::Folder &folder = queue.folders[i];
+			if (folder.scanner)
+				folder.scanner->Cancel();
+			if (folder.done)
+				continue;	// reported already
+			report.Folder(folder.path, NULL, none, none);
+		}
+		result = EXIT_INCOMPLETE;
+	}
+	lock.unlock();
+	report.End();
+	Flush(out);
+
+	if (timedOut)
+	{
+		// A scan stuck in a dead network share cannot be waited for, and
+		// neither can a hung volume query. Leave them behind.
+		ReportThrottles(throttles);
+		SaveTrace(options);
+		fflush(stderr);
+		_exit(result);
+	}
+	ReportThrottles(throttles);
+	SaveTrace(options);
+	return result;
+}
+
+#ifdef _WIN32
+
+int wmain(int argc, wchar_t *argv[])
+{
+	// CSV lines end in CRLF already, and the output is UTF-8
+	_setmode(_fileno(stdout), _O_BINARY);
+	return Run(std::vector<std::wstring>(argv + 1, argv + argc));
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::wstring> args;
+	for (int i = 1; i < argc; ++i)
+		args.push_back(Utf8ToWide(argv[i]));
+	return Run(args);
+}
+
+#endif
@@ -0,0 +1,625 @@
+/****************************** Module Header ******************************\
+Module Name:  DiskUsageCore.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of the disk usage engine.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "DiskUsageCore.h"
+#include "VolumeList.h"
+#include "IoScheduler.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdarg.h>
+#include <stdio.h>
+#include <wchar.h>
+
+bool ResolveVolume(const MountTable &table, const std::wstring &path, std::wstring &volname, bool &isMount)
+{
+	TraceSpan span("ResolveVolume", path.c_str());
+	const MountPoint *mount = table.Lookup(path);
+	if (mount)
+	{
+		volname = mount->volname;
+		isMount = MountTable::IsMountPath(*mount, path);
+		return true;
+	}
+
+#ifdef _WIN32
+	// Drives without a volume GUID name (e.g. network drives) are not in the
+	// table. Their roots are queried by drive letter.
+	size_t len = path.size();
+	if ((len == 2 || len == 3) && path[1] == L':' && (len == 2 || path[2] == L'\\'))
+	{
+		wchar_t root[] = { path[0], L':', L'\\', 0 };
+		volname = root;
+		isMount = true;
+		return true;
+	}
+#endif
+	return false;
+}
+
+bool ResolveVolume(const std::wstring &path, std::wstring &volname, bool &isMount)
+{
+	return ResolveVolume(*MountTable::Current(), path, volname, isMount);
+}
+
+std::wstring FormatSize(unsigned long long bytes)
+{
+	ReportBuffer buf(40);
+	buf.AppendSize(bytes);
+	return buf.c_str();
+}
+
+TipSettings::TipSettings() :
+	queryTimeout(DEFAULT_QUERY_TIMEOUT),
+	detailQueryTimeout(DEFAULT_DETAIL_QUERY_TIMEOUT),
+	folderScanTimeout(DEFAULT_FOLDER_SCAN_TIMEOUT),
+	folderEstimateTimeout(DEFAULT_FOLDER_ESTIMATE_TIMEOUT),
+	scanThreads(DEFAULT_SCAN_THREADS),
+	detailScanTimeout(DEFAULT_DETAIL_SCAN_TIMEOUT),
+	detailTopCount(DEFAULT_DETAIL_TOP_COUNT),
+	volumeFormat(L"%ls of %ls free (%0.2f%%)"),
+	pendingText(L"Free space (pending)"),
+	folderFormat(L"Folder: %ls (%ls on disk) in %llu files, %llu folders"),
+	estimateFormat(L"Folder: about %ls (+/- %ls) in %llu files, %llu folders"),
+	selectionFormat(L"%u volumes: %ls of %ls free (%0.2f%%)"),
+	snapshot(NULL)
+{
+}
+
+// printf into a string, cut short at 200 characters
+static std::wstring FormatTip(const wchar_t *format, ...)
+{
+	wchar_t buf[200];
+	va_list args;
+	va_start(args, format);
+	int len = vswprintf(buf, sizeof(buf) / sizeof(buf[0]), format, args);
+	va_end(args);
+	if (len < 0)
+	{
+		// Too long, the buffer holds an unterminated prefix at best
+		buf[sizeof(buf) / sizeof(buf[0]) - 1] = 0;
+		return std::wstring(buf, wcsnlen(buf, sizeof(buf) / sizeof(buf[0]) - 1));
+	}
+	return std::wstring(buf, len);
+}
+
+std::wstring FormatVolumeTip(const wchar_t *format, const VolumeSpace &space)
+{
+	TraceSpan span("FormatVolumeTip");
+	std::wstring tb = FormatSize(space.TotalBytes());
+	std::wstring fb = FormatSize(space.FreeBytes());
+	return FormatTip(format, fb.c_str(), tb.c_str(),
+		space.totalClusters ? (double)space.freeClusters / space.totalClusters * 100 : 0.0);
+}
+
+// Query a volume and format its tip, called by VolumeCache on a miss or after
+// expiry, possibly from a background thread
+static bool LoadVolumeEntry(VolumeBackend &backend, const wchar_t *format, const std::wstring &volname,
+	VolumeCacheEntry &entry)
+{
+	TraceSpan span("LoadVolumeEntry", volname.c_str());
+	if (!backend.QuerySpace(volname.c_str(), entry.space))
+		return false;
+	if (format)
+		entry.tip = FormatVolumeTip(format, entry.space);
+	return true;
+}
+
+// A volume load started by the cache loader of GetVolumeEntries. Loads
+// started by background refreshes of stale entries are not waited for, so
+// only those made on the calling thread are recorded.
+struct StartedLoad
+{
+	std::thread::id caller;
+	std::shared_ptr<QueryTicket> ticket;
+	VolumeQuery::Status status;
+	StartedLoad() : caller(std::this_thread::get_id()), status(VolumeQuery::QUERY_FAILED) {}
+};
+
+void GetVolumeEntries(VolumeBackend &backend, const wchar_t *format, const std::vector<std::wstring> &volnames,
+	unsigned timeoutMs, std::vector<VolumeCacheEntry> &entries, std::vector<VolumeQuery::Status> &statuses)
+{
+	TraceSpan span("GetVolumeEntries");
+	entries.assign(volnames.size(), VolumeCacheEntry());
+	statuses.assign(volnames.size(), VolumeQuery::QUERY_OK);
+	std::vector<std::shared_ptr<QueryTicket> > tickets(volnames.size());
+	for (size_t i = 0; i < volnames.size(); ++i)
+	{
+		// The loader only starts the query, which stores its result itself.
+		// It may also be run by a background refresh after we return, so it
+		// must not refer to anything on our stack.
+		std::shared_ptr<StartedLoad> started = std::make_shared<StartedLoad>();
+		VolumeBackend *pbackend = &backend;
+		bool cached = VolumeCache::Global().Get(volnames[i],
+			[pbackend, format, started](const std::wstring &name, VolumeCacheEntry &) -> bool {
+				VolumeQuery::Status status;
+				std::shared_ptr<QueryTicket> ticket = VolumeQuery::Global().Start(name,
+					[pbackend, format, name]() -> bool {
+						VolumeCacheEntry result;
+						if (!LoadVolumeEntry(*pbackend, format, name, result))
+							return false;
+						VolumeCache::Global().Put(name, result);
+						return true;
+					},
+					status);
+				if (std::this_thread::get_id() == started->caller)
+				{
+					started->ticket = ticket;
+					started->status = status;
+				}
+				return false;
+			},
+			entries[i]);
+		tickets[i] = started->ticket;
+		if (!cached)
+			statuses[i] = started->status;
+	}
+
+	// A stale entry returned while reloading in place stays valid if the
+	// reload does not complete in time
+	QueryClock::time_point deadline = QueryClock::now() + std::chrono::milliseconds(timeoutMs);
+	for (size_t i = 0; i < volnames.size(); ++i)
+	{
+		if (!tickets[i])
+			continue;	// fresh from the cache, or not started
+		if (!tickets[i]->WaitUntil(deadline))
+		{
+			VolumeQuery::Global().TimedOut(volnames[i]);
+			if (statuses[i] != VolumeQuery::QUERY_OK)
+				statuses[i] = VolumeQuery::QUERY_PENDING;
+		}
+		else if (tickets[i]->Succeeded() && VolumeCache::Global().Peek(volnames[i], entries[i]))
+			statuses[i] = VolumeQuery::QUERY_OK;
+		else if (statuses[i] != VolumeQuery::QUERY_OK)
+			statuses[i] = VolumeQuery::QUERY_FAILED;
+	}
+}
+
+bool GetVolumeEntry(VolumeBackend &backend, const wchar_t *format, const std::wstring &volname,
+	unsigned timeoutMs, VolumeCacheEntry &entry, VolumeQuery::Status &status)
+{
+	std::vector<VolumeCacheEntry> entries;
+	std::vector<VolumeQuery::Status> statuses;
+	GetVolumeEntries(backend, format, std::vector<std::wstring>(1, volname), timeoutMs, entries, statuses);
+	entry = entries[0];
+	status = statuses[0];
+	return status == VolumeQuery::QUERY_OK;
+}
+
+// Get the entries of volumes for the menu, from the snapshot of the
+// collector where it has them and from GetVolumeEntries otherwise
+static void GetTipEntries(VolumeBackend &backend, const TipSettings &settings,
+	const std::vector<std::wstring> &volnames, std::vector<VolumeCacheEntry> &entries,
+	std::vector<VolumeQuery::Status> &statuses)
+{
+	if (!settings.snapshot)
+	{
+		GetVolumeEntries(backend, settings.volumeFormat, volnames, settings.queryTimeout, entries, statuses);
+		return;
+	}
+	entries.assign(volnames.size(), VolumeCacheEntry());
+	statuses.assign(volnames.size(), VolumeQuery::QUERY_OK);
+	std::vector<std::wstring> missing;
+	{
+		TraceSpan span("SnapshotLookup");
+		for (size_t i = 0; i < volnames.size(); ++i)
+		{
+			if (settings.snapshot->GetSpace(volnames[i], entries[i].space))
+				entries[i].tip = FormatVolumeTip(settings.volumeFormat, entries[i].space);
+			else
+			{
+				statuses[i] = VolumeQuery::QUERY_PENDING;
+				missing.push_back(volnames[i]);
+			}
+		}
+	}
+	if (missing.empty())
+		return;
+
+	std::vector<VolumeCacheEntry> queried;
+	std::vector<VolumeQuery::Status> queriedStatuses;
+	GetVolumeEntries(backend, settings.volumeFormat, missing, settings.queryTimeout, queried, queriedStatuses);
+	for (size_t i = 0, m = 0; i < volnames.size(); ++i)
+	{
+		if (statuses[i] != VolumeQuery::QUERY_PENDING)
+			continue;
+		entries[i] = queried[m];
+		statuses[i] = queriedStatuses[m];
+		++m;
+	}
+}
+
+// The same for a single volume
+static bool GetTipEntry(VolumeBackend &backend, const TipSettings &settings, const std::wstring &volname,
+	VolumeCacheEntry &entry, VolumeQuery::Status &status)
+{
+	std::vector<VolumeCacheEntry> entries;
+	std::vector<VolumeQuery::Status> statuses;
+	GetTipEntries(backend, settings, std::vector<std::wstring>(1, volname), entries, statuses);
+	entry = entries[0];
+	status = statuses[0];
+	return status == VolumeQuery::QUERY_OK;
+}
+
+// The file system to scan path through, sharing the I/O limit of its device
+// with every other scan of the process
+static FileSystem &ScanFileSystem(const std::wstring &path)
+{
+	std::wstring volname;
+	bool isMount;
+	if (!ResolveVolume(path, volname, isMount))
+		return SystemFileSystem();
+	IoScheduler &scheduler = IoScheduler::Global();
+	return scheduler.FileSystemOf(scheduler.DeviceOf(volname));
+}
+
+// Scans run as queries keyed apart from the volumes. The path of a mount
+// point is also the name of its volume, whose space queries would otherwise
+// hold the scan back, and a scan timing out would back the volume off.
+#define SCAN_QUERY_PREFIX L"scan|"
+
+bool ScanFolder(const std::wstring &path, unsigned threads, unsigned timeoutMs, ScanTotals &totals)
+{
+	TraceSpan span("ScanFolder", path.c_str());
+	std::shared_ptr<FolderScanner> scanner = std::make_shared<FolderScanner>(ScanFileSystem(path), threads);
+	std::shared_ptr<ScanTotals> result = std::make_shared<ScanTotals>();
+	VolumeQuery::Status status = VolumeQuery::Global().Run(SCAN_QUERY_PREFIX + path,
+		[scanner, path, result]() { return scanner->Scan(path, *result); },
+		QueryClock::now() + std::chrono::milliseconds(timeoutMs));
+	if (status != VolumeQuery::QUERY_OK)
+	{
+		scanner->Cancel();
+		return false;
+	}
+	totals = *result;
+	return true;
+}
+
+// The last completed report of every folder asked for. Never destroyed, as
+// scans still running may add to it at process exit.
+static std::mutex g_folderReportLock;
+static std::map<std::wstring, FolderReport> *g_folderReports;
+
+bool GetFolderReport(const std::wstring &path, unsigned threads, unsigned topCount, unsigned timeoutMs,
+	FolderReport &report)
+{
+	TraceSpan span("GetFolderReport", path.c_str());
+	std::shared_ptr<FolderScanner> scanner = std::make_shared<FolderScanner>(ScanFileSystem(path), threads);
+	scanner->SetTopCount(topCount);
+	VolumeQuery::Global().Run(SCAN_QUERY_PREFIX + path,
+		[scanner, path]() -> bool {
+			FolderReport result;
+			if (!scanner->Scan(path, result.totals))
+				return false;
+			result.topFiles = scanner->TopFiles();
+			result.topDirs = scanner->TopDirs();
+			std::lock_guard<std::mutex> lock(g_folderReportLock);
+			if (!g_folderReports)
+				g_folderReports = new std::map<std::wstring, FolderReport>;
+			(*g_folderReports)[path] = result;
+			return true;
+		},
+		QueryClock::now() + std::chrono::milliseconds(timeoutMs));
+
+	std::lock_guard<std::mutex> lock(g_folderReportLock);
+	if (!g_folderReports)
+		return false;
+	auto it = g_folderReports->find(path);
+	if (it == g_folderReports->end())
+		return false;
+	report = it->second;
+	return true;
+}
+
+// The estimators of the folders estimated last, most recent first. Each
+// keeps what its walks listed, up to SizeEstimator::MAX_LISTED directories.
+#define MAX_ESTIMATORS 4
+static std::mutex g_estimatorLock;
+static std::list<std::shared_ptr<SizeEstimator> > *g_estimators;
+
+// Refines run as queries of their own, keyed apart from the scans of the
+// folder too, so that a refine stuck in a listing holds its worker only
+#define ESTIMATE_QUERY_PREFIX L"estimate|"
+
+// A refine of the estimate of a folder, running on a query worker
+struct EstimateJob
+{
+	std::shared_ptr<SizeEstimator> estimator;	// NULL if a report of the folder made it pointless
+	SizeEstimate reported;						// then the totals of the report
+	std::shared_ptr<QueryTicket> ticket;		// NULL if the last refine of the folder still runs
+	std::shared_ptr<std::atomic<bool> > stop;
+};
+
+// Start refining the estimate of path for budgetMs
+static void StartEstimate(const std::wstring &path, unsigned threads, unsigned budgetMs, EstimateJob &job)
+{
+	{
+		std::lock_guard<std::mutex> lock(g_folderReportLock);
+		if (g_folderReports)
+		{
+			auto it = g_folderReports->find(path);
+			if (it != g_folderReports->end())
+			{
+				job.reported = SizeEstimate();
+				job.reported.totals = it->second.totals;
+				job.reported.exact = true;
+			}
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(g_estimatorLock);
+		if (!g_estimators)
+			g_estimators = new std::list<std::shared_ptr<SizeEstimator> >;
+		for (auto it = g_estimators->begin(); it != g_estimators->end(); ++it)
+		{
+			if ((*it)->Root() != path)
+				continue;
+			if (!job.reported.exact)
+				job.estimator = *it;
+			g_estimators->erase(it);
+			break;
+		}
+		if (job.reported.exact)
+			return;	// the estimate is not needed any more
+		if (!job.estimator)
+			job.estimator = std::make_shared<SizeEstimator>(ScanFileSystem(path), path, threads);
+		g_estimators->push_front(job.estimator);
+		if (g_estimators->size() > MAX_ESTIMATORS)
+			g_estimators->pop_back();
+	}
+
+	// Not VolumeQuery::Run(): a refine ending a little past the deadline it
+	// was given is not a folder to back off from
+	std::shared_ptr<SizeEstimator> estimator = job.estimator;
+	std::shared_ptr<std::atomic<bool> > stop = std::make_shared<std::atomic<bool> >(false);
+	VolumeQuery::Status status;
+	job.stop = stop;
+	job.ticket = VolumeQuery::Global().Start(ESTIMATE_QUERY_PREFIX + path,
+		[estimator, stop, budgetMs]() { return estimator->Refine(budgetMs, stop.get()); }, status);
+}
+
+// Stop the refine, if it is still running, and have it give up the listings
+// in progress. Not SizeEstimator::Cancel(), which would stop the refines of
+// later calls too.
+static void StopEstimate(EstimateJob &job)
+{
+	if (job.stop)
+		*job.stop = true;
+}
+
+// Wait for the refine until deadline, then stop it and read whatever
+// estimate there is
+static bool FinishEstimate(EstimateJob &job, QueryClock::time_point deadline, SizeEstimate &estimate)
+{
+	if (!job.estimator)
+	{
+		estimate = job.reported;
+		return true;
+	}
+	bool failed = job.ticket && job.ticket->WaitUntil(deadline) && !job.ticket->Succeeded();
+	StopEstimate(job);
+	return !failed && job.estimator->GetEstimate(estimate);
+}
+
+bool EstimateFolder(const std::wstring &path, unsigned threads, unsigned budgetMs, SizeEstimate &estimate)
+{
+	TraceSpan span("EstimateFolder", path.c_str());
+	QueryClock::time_point deadline = QueryClock::now() + std::chrono::milliseconds(budgetMs);
+	EstimateJob job;
+	StartEstimate(path, threads, budgetMs, job);
+	return FinishEstimate(job, deadline, estimate);
+}
+
+bool BuildItemTip(VolumeBackend &backend, const MountTable &table, const TipSettings &settings,
+	const FolderIndexLookup &index, const std::wstring &path, std::wstring &volname, std::wstring &tip)
+{
+	TraceSpan span("BuildItemTip", path.c_str());
+	bool isMount = false;
+	volname.clear();
+	ResolveVolume(table, path, volname, isMount);
+	VolumeCacheEntry entry;
+	VolumeQuery::Status status;
+	if (isMount)
+	{
+		if (GetTipEntry(backend, settings, volname, entry, status))
+		{
+			tip.swap(entry.tip);
+			return true;
+		}
+		if (status != VolumeQuery::QUERY_PENDING)
+			return false;
+		// Slow volume, e.g. a remote one. Don't hold up the menu.
+		tip = settings.pendingText;
+		return true;
+	}
+
+	// A plain folder, show its recursive size if it is indexed or can be had
+	// quickly. The estimate walks while the scan runs, so that a folder too
+	// large to scan in time has one by the end of the same window.
+	QueryClock::time_point deadline = QueryClock::now() + std::chrono::milliseconds(settings.folderScanTimeout);
+	ScanTotals totals;
+	bool indexed;
+	{
+		TraceSpan span("FolderIndexLookup", path.c_str());
+		indexed = index && index(path, totals);
+	}
+	EstimateJob estimating;
+	if (!indexed && settings.folderEstimateTimeout)
+	{
+		StartEstimate(path, settings.scanThreads,
+			std::min(settings.folderEstimateTimeout, settings.folderScanTimeout), estimating);
+	}
+	if (indexed ||
+		ScanFolder(path, settings.scanThreads, settings.folderScanTimeout, totals))
+	{
+		StopEstimate(estimating);
+		std::wstring sb = FormatSize(totals.bytes);
+		std::wstring sa = FormatSize(totals.allocated);
+		tip = FormatTip(settings.folderFormat, sb.c_str(), sa.c_str(), totals.files, totals.dirs);
+		return true;
+	}
+	SizeEstimate estimate;
+	if (settings.folderEstimateTimeout && FinishEstimate(estimating, deadline, estimate))
+	{
+		std::wstring sb = FormatSize(estimate.totals.bytes);
+		std::wstring se = FormatSize(estimate.error.bytes);
+		std::wstring sa = FormatSize(estimate.totals.allocated);
+		tip = estimate.exact ?
+			FormatTip(settings.folderFormat, sb.c_str(), sa.c_str(), estimate.totals.files, estimate.totals.dirs) :
+			FormatTip(settings.estimateFormat, sb.c_str(), se.c_str(), estimate.totals.files, estimate.totals.dirs);
+		return true;
+	}
+	// Too large to size in time, show the free space of its volume, as far
+	// as it is known by the end of the window: from the cache, or a query
+	// that answers in what is left of it
+	TipSettings fallback = settings;
+	QueryClock::time_point now = QueryClock::now();
+	fallback.queryTimeout = now < deadline ?
+		(unsigned)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() : 0;
+	if (!volname.empty() &&
+		GetTipEntry(backend, fallback, volname, entry, status))
+	{
+		tip.swap(entry.tip);
+		return true;
+	}
+	return false;
+}
+
+bool BuildSelectionTip(VolumeBackend &backend, const TipSettings &settings,
+	const std::set<std::wstring> &volnameSet, std::wstring &tip)
+{
+	TraceSpan span("BuildSelectionTip");
+	std::vector<std::wstring> volnames(volnameSet.begin(), volnameSet.end());
+	if (volnames.empty())
+		return false;
+	std::vector<VolumeCacheEntry> entries;
+	std::vector<VolumeQuery::Status> statuses;
+	GetTipEntries(backend, settings, volnames, entries, statuses);
+
+	// All items on one volume, show its own tip
+	if (volnames.size() == 1)
+	{
+		if (statuses[0] == VolumeQuery::QUERY_OK)
+		{
+			tip.swap(entries[0].tip);
+			return true;
+		}
+		if (statuses[0] != VolumeQuery::QUERY_PENDING)
+			return false;
+		tip = settings.pendingText;
+		return true;
+	}
+
+	// Volumes that did not answer in time are left out of the sum
+	unsigned answered = 0;
+	bool pending = false;
+	unsigned long long freeBytes = 0, totalBytes = 0;
+	for (size_t i = 0; i < volnames.size(); ++i)
+	{
+		if (statuses[i] == VolumeQuery::QUERY_OK)
+		{
+			++answered;
+			freeBytes += entries[i].space.FreeBytes();
+			totalBytes += entries[i].space.TotalBytes();
+		}
+		else if (statuses[i] == VolumeQuery::QUERY_PENDING)
+			pending = true;
+	}
+	if (!answered || !totalBytes)
+	{
+		if (!pending)
+			return false;
+		tip = settings.pendingText;
+		return true;
+	}
+
+	std::wstring fb = FormatSize(freeBytes);
+	std::wstring tb = FormatSize(totalBytes);
+	tip = FormatTip(settings.selectionFormat, answered, fb.c_str(), tb.c_str(),
+		(double)freeBytes / totalBytes * 100);
+	return true;
+}
+
+bool BuildDetailReport(VolumeBackend &backend, const TipSettings &settings,
+	const std::set<std::wstring> &selected, const std::wstring *folder, ReportEmitter &report)
+{
+	TraceSpan span("BuildDetailReport");
+	// All volumes in the system, as the collector last saw them, or else
+	// queried in parallel
+	std::vector<VolumeRecord> records;
+	bool published;
+	{
+		TraceSpan span("SnapshotVolumes");
+		published = settings.snapshot && settings.snapshot->GetVolumes(records);
+	}
+	if (!published && !CollectVolumes(backend, VolumeQuery::Global(),
+			QueryClock::now() + std::chrono::milliseconds(settings.detailQueryTimeout), records))
+		return false;
+
+	TraceSpan render("RenderReport");
+	report.Begin();
+	for (auto rec = records.begin(); rec != records.end(); ++rec)
+	{
+		if (rec->status == VolumeQuery::QUERY_FAILED)
+			fwprintf(stderr, L"Device query failed for %ls\n", rec->volname.c_str());
+		else if (rec->status == VolumeQuery::QUERY_OK && VolumeRecord::WantInformation(rec->type) && !rec->hasInformation)
+			fwprintf(stderr, L"Volume information query failed for %ls\n", rec->volname.c_str());
+
+		const VolumeSpace *space = NULL;
+		VolumeCacheEntry entry;
+		if (rec->status != VolumeQuery::QUERY_OK)
+		{
+			// Slow or unreachable volume. Show the last known free space, if
+			// any, rather than waiting for it. The collector keeps it.
+			if (rec->hasSpace)
+				space = &rec->space;
+			else if (VolumeCache::Global().Peek(rec->volname, entry))
+				space = &entry.space;
+		}
+		else if (VolumeRecord::WantSpace(rec->type) && rec->hasSpace)
+		{
+			// Keep the menu cache warm as well
+			entry.space = rec->space;
+			entry.tip = FormatVolumeTip(settings.volumeFormat, rec->space);
+			VolumeCache::Global().Put(rec->volname, entry);
+			space = &rec->space;
+		}
+		report.Volume(*rec, selected.count(rec->volname) != 0, space);
+	}
+
+	// What takes up the space of the selection, if it is a single item
+	if (settings.detailTopCount && folder)
+	{
+		FolderReport result;
+		SizeEstimate estimate;
+		if (GetFolderReport(*folder, settings.scanThreads, settings.detailTopCount, settings.detailScanTimeout,
+				result))
+			report.Folder(*folder, &result.totals, result.topDirs, result.topFiles);
+		else if (settings.folderEstimateTimeout &&
+				EstimateFolder(*folder, settings.scanThreads, settings.folderEstimateTimeout, estimate))
+			report.Estimate(*folder, estimate);
+		else
+			report.Folder(*folder, NULL, result.topDirs, result.topFiles);
+	}
+	report.End();
+	return true;
+}
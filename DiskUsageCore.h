@@ -0,0 +1,148 @@
+/****************************** Module Header ******************************\
+Module Name:  DiskUsageCore.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares the disk usage engine the shell extension and the command
+line front end are built on: finding the volume holding a path, the cached
+and deadline-bounded free space of volumes, deadline-bounded folder scans,
+estimates of folders too large to scan in time, and from them the context
+menu text and the detail view. It only talks to the system through the
+volume backend, the mount table and the file system interface, so it builds
+and runs on Windows and Linux alike.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "MountTable.h"
+#include "VolumeCache.h"
+#include "VolumeQuery.h"
+#include "VolumeSnapshot.h"
+#include "FolderScanner.h"
+#include "SizeEstimator.h"
+#include "ReportWriter.h"
+#include <string>
+#include <vector>
+#include <set>
+#include <functional>
+
+// Default deadlines, in milliseconds, and limits of TipSettings
+#define DEFAULT_QUERY_TIMEOUT         300   // volume queries while building the menu
+#define DEFAULT_DETAIL_QUERY_TIMEOUT  2000  // volume queries while building the detail view
+#define DEFAULT_FOLDER_SCAN_TIMEOUT   200   // plain folder in the menu, its estimate and volume included
+#define DEFAULT_FOLDER_ESTIMATE_TIMEOUT 100 // estimate walked during the scan, 0 for none
+#define DEFAULT_SCAN_THREADS          4
+#define DEFAULT_DETAIL_SCAN_TIMEOUT   2000  // scan of the selection for the detail view
+#define DEFAULT_DETAIL_TOP_COUNT      10    // largest files and folders shown
+
+// What the context menu item and the detail view show, and how long they
+// wait for it. The formats are printf formats taking strings as %ls.
+struct TipSettings
+{
+	unsigned queryTimeout;
+	unsigned detailQueryTimeout;
+	unsigned folderScanTimeout;
+	unsigned folderEstimateTimeout;
+	unsigned scanThreads;
+	unsigned detailScanTimeout;
+	unsigned detailTopCount;
+	const wchar_t *volumeFormat;	// free size, total size, free percentage
+	const wchar_t *pendingText;		// while the volumes have not answered
+	const wchar_t *folderFormat;	// size, size on disk, files, folders
+	const wchar_t *estimateFormat;	// size, its margin of error, files, folders
+	const wchar_t *selectionFormat;	// volumes, free size, total size, free percentage
+	// Where a collector publishes the volumes, tried before querying them.
+	// NULL to always query.
+	VolumeSnapshot *snapshot;
+
+	TipSettings();
+};
+
+// Find the volume holding path in the mount table, without touching the
+// disk. isMount receives whether path is where the volume is mounted (a drive
+// root or a mounted folder) rather than a folder inside it.
+bool ResolveVolume(const MountTable &table, const std::wstring &path, std::wstring &volname, bool &isMount);
+// The same in the mount table of the running system
+bool ResolveVolume(const std::wstring &path, std::wstring &volname, bool &isMount);
+
+// Human readable size, like "1.50 GB"
+std::wstring FormatSize(unsigned long long bytes);
+
+// The menu text of a volume, see TipSettings::volumeFormat
+std::wstring FormatVolumeTip(const wchar_t *format, const VolumeSpace &space);
+
+// Get the cache entries of several volumes of backend, with their tips in
+// format. Those missing from the cache are loaded in parallel on the query
+// workers, one query per volume, all waited for at most timeoutMs together.
+// A load that times out puts its result into the cache once it completes, so
+// it is there for the next caller. statuses[i] is QUERY_OK if entries[i] is
+// valid, otherwise it tells why not.
+void GetVolumeEntries(VolumeBackend &backend, const wchar_t *format, const std::vector<std::wstring> &volnames,
+	unsigned timeoutMs, std::vector<VolumeCacheEntry> &entries, std::vector<VolumeQuery::Status> &statuses);
+// Get the cache entry of a single volume, see GetVolumeEntries
+bool GetVolumeEntry(VolumeBackend &backend, const wchar_t *format, const std::wstring &volname,
+	unsigned timeoutMs, VolumeCacheEntry &entry, VolumeQuery::Status &status);
+
+// Scan a folder with threads threads, giving up after timeoutMs. The scan
+// runs as a query keyed by the folder path, so a folder too large to finish
+// in time is not rescanned on every call but backed off like a slow volume.
+bool ScanFolder(const std::wstring &path, unsigned threads, unsigned timeoutMs, ScanTotals &totals);
+
+// Estimate the totals of a folder from threads threads walking down it for
+// budgetMs, see SizeEstimator. The walks of earlier calls for the folder are
+// kept, so every call refines the estimate further. The walks run as a query
+// keyed by the folder: a call returns by budgetMs with the estimate as far as
+// it got, even if a listing hangs, and while the walks of an earlier call
+// still run it only reads their estimate. Once a GetFolderReport() of the
+// folder has completed, its exact totals are returned instead.
+bool EstimateFolder(const std::wstring &path, unsigned threads, unsigned budgetMs, SizeEstimate &estimate);
+
+// Totals and largest entries of a folder
+struct FolderReport
+{
+	ScanTotals totals;
+	std::vector<ScanItem> topFiles;
+	std::vector<ScanItem> topDirs;
+};
+
+// Scan a folder for its totals and its topCount largest entries, waiting at
+// most timeoutMs. A scan that takes longer stores its report when done, and
+// until then the report of an earlier scan, if any, is returned.
+bool GetFolderReport(const std::wstring &path, unsigned threads, unsigned topCount, unsigned timeoutMs,
+	FolderReport &report);
+
+// Looks the totals of a folder up in an index such as SizeIndex
+typedef std::function<bool(const std::wstring &path, ScanTotals &totals)> FolderIndexLookup;
+
+// Build the menu text of a single selected item: the free space of its
+// volume if the item is where the volume is mounted, otherwise its size,
+// from index if that has it, from a quick scan or else an estimate, and
+// failing all of them the free space of the volume holding it. A folder
+// takes settings.folderScanTimeout at most: the estimate walks while the
+// scan runs, and the volume is only waited for in what is left after.
+// volname receives that volume, empty if there is none. Returns false if
+// there is nothing to show.
+bool BuildItemTip(VolumeBackend &backend, const MountTable &table, const TipSettings &settings,
+	const FolderIndexLookup &index, const std::wstring &path, std::wstring &volname, std::wstring &tip);
+
+// Build the menu text of several selected items on the volumes volnames,
+// each queried once: the combined free space of those that answer in time.
+// Returns false if there is nothing to show.
+bool BuildSelectionTip(VolumeBackend &backend, const TipSettings &settings,
+	const std::set<std::wstring> &volnames, std::wstring &tip);
+
+// Render the detail view into report: every volume of backend, queried in
+// parallel, marked if it is in selected, and what takes up the space of
+// folder unless it is NULL. Volumes that answer also warm the volume cache
+// for the menu. A folder still being scanned is estimated meanwhile. Returns
+// false if the volumes cannot be listed.
+bool BuildDetailReport(VolumeBackend &backend, const TipSettings &settings,
+	const std::set<std::wstring> &selected, const std::wstring *folder, ReportEmitter &report);
@@ -1,65 +1,70 @@
-/****************************** Module Header ******************************\
-Module Name:  DiskUsageTipExt.h
-Project:      DiskUsageTip
-Copyright (c) Aulddays.
-Copyright (c) Microsoft Corporation.
-
-The code declares DiskUsageTipExt Shell context menu handler. 
-
-This source is subject to the Microsoft Public License.
-See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
-All other rights reserved.
-
-THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
-EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED 
-WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
-\***************************************************************************/
-
-#pragma once
-
-#include <windows.h>
-#include <shlobj.h>     // For IShellExtInit and IContextMenu
-#include <vector>
-
-class DiskUsageTipExt : public IShellExtInit, public IContextMenu
-{
-public:
-    // IUnknown
-    IFACEMETHODIMP QueryInterface(REFIID riid, void **ppv);
-    IFACEMETHODIMP_(ULONG) AddRef();
-    IFACEMETHODIMP_(ULONG) Release();
-
-    // IShellExtInit
-    IFACEMETHODIMP Initialize(LPCITEMIDLIST pidlFolder, LPDATAOBJECT pDataObj, HKEY hKeyProgID);
-
-    // IContextMenu
-    IFACEMETHODIMP QueryContextMenu(HMENU hMenu, UINT indexMenu, UINT idCmdFirst, UINT idCmdLast, UINT uFlags);
-    IFACEMETHODIMP InvokeCommand(LPCMINVOKECOMMANDINFO pici);
-    IFACEMETHODIMP GetCommandString(UINT_PTR idCommand, UINT uFlags, UINT *pwReserved, LPSTR pszName, UINT cchMax);
-	
-	 DiskUsageTipExt(void);
-
-protected:
-	~DiskUsageTipExt(void);
-
-private:
-    // Reference count of component.
-    long m_cRef;
-
-    // The name of the selected file.
-    wchar_t m_szSelectedFile[MAX_PATH];
-	 // disk usage tip
-	 std::vector<wchar_t> m_diskUsageTip;
-
-    // The method that handles the menu click.
-	 void OnShowDetail(HWND hWnd);
-
-    PWSTR m_pszMenuText;
-    HANDLE m_hMenuBmp;
-    PCSTR m_pszVerb;
-    PCWSTR m_pwszVerb;
-    PCSTR m_pszVerbCanonicalName;
-    PCWSTR m_pwszVerbCanonicalName;
-    PCSTR m_pszVerbHelpText;
-    PCWSTR m_pwszVerbHelpText;
+/****************************** Module Header ******************************\
+Module Name:  DiskUsageTipExt.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+Copyright (c) Microsoft Corporation.
+
+The code declares DiskUsageTipExt Shell context menu handler. 
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED 
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <windows.h>
+#include <shlobj.h>     // For IShellExtInit and IContextMenu
+#include <vector>
+#include <set>
+#include <string>
+
+class DiskUsageTipExt : public IShellExtInit, public IContextMenu
+{
+public:
+    // IUnknown
+    IFACEMETHODIMP QueryInterface(REFIID riid, void **ppv);
+    IFACEMETHODIMP_(ULONG) AddRef();
+    IFACEMETHODIMP_(ULONG) Release();
+
+    // IShellExtInit
+    IFACEMETHODIMP Initialize(LPCITEMIDLIST pidlFolder, LPDATAOBJECT pDataObj, HKEY hKeyProgID);
+
+    // IContextMenu
+    IFACEMETHODIMP QueryContextMenu(HMENU hMenu, UINT indexMenu, UINT idCmdFirst, UINT idCmdLast, UINT uFlags);
+    IFACEMETHODIMP InvokeCommand(LPCMINVOKECOMMANDINFO pici);
+    IFACEMETHODIMP GetCommandString(UINT_PTR idCommand, UINT uFlags, UINT *pwReserved, LPSTR pszName, UINT cchMax);
+	
+	 DiskUsageTipExt(void);
+
+protected:
+	~DiskUsageTipExt(void);
+
+private:
+    // Reference count of component.
+    long m_cRef;
+
+    // The name of the selected file.
+    wchar_t m_szSelectedFile[MAX_PATH];
+	 // Number of selected items, the first of which is m_szSelectedFile
+	 UINT m_selectionCount;
+	 // The volumes holding the selected items
+	 std::set<std::wstring> m_selectedVolumes;
+	 // disk usage tip
+	 std::vector<wchar_t> m_diskUsageTip;
+
+    // The method that handles the menu click.
+	 void OnShowDetail(HWND hWnd);
+
+    HANDLE m_hMenuBmp;
+    PCSTR m_pszVerb;
+    PCWSTR m_pwszVerb;
+    PCSTR m_pszVerbCanonicalName;
+    PCWSTR m_pwszVerbCanonicalName;
+    PCSTR m_pszVerbHelpText;
+    PCWSTR m_pwszVerbHelpText;
 };
\ No newline at end of file
@@ -0,0 +1,130 @@
+/****************************** Module Header ******************************\
+Module Name:  FaultInjectingBackend.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of FaultInjectingBackend.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "FaultInjectingBackend.h"
+#include <chrono>
+
+FaultInjectingBackend::FaultInjectingBackend(VolumeBackend &target) :
+m_target(target),
+m_blocked(0),
+m_released(false)
+{
+}
+
+FaultInjectingBackend::~FaultInjectingBackend()
+{
+	Release();
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (m_blocked > 0)
+		m_cond.wait(lock);
+}
+
+void FaultInjectingBackend::SetFault(const std::wstring &volname, FaultType type, unsigned delayMs)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	Fault &fault = m_faults[volname];
+	fault.type = type;
+	fault.delayMs = delayMs;
+	m_released = false;
+}
+
+void FaultInjectingBackend::ClearFaults()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_faults.clear();
+}
+
+void FaultInjectingBackend::Release()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_released = true;
+	m_cond.notify_all();
+}
+
+unsigned FaultInjectingBackend::Blocked()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_blocked;
+}
+
+bool FaultInjectingBackend::Inject(const wchar_t *volname)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	auto it = m_faults.find(volname);
+	if (it == m_faults.end())
+		it = m_faults.find(std::wstring());
+	if (it == m_faults.end())
+		return true;
+
+	Fault fault = it->second;
+	bool ok = true;
+	++m_blocked;
+	switch (fault.type)
+	{
+	case FAULT_DELAY:
+		// A Release() also cuts delays short
+		m_cond.wait_for(lock, std::chrono::milliseconds(fault.delayMs), [this]() { return m_released; });
+		break;
+	case FAULT_FAIL:
+		ok = false;
+		break;
+	case FAULT_HANG:
+		m_cond.wait(lock, [this]() { return m_released; });
+		ok = false;
+		break;
+	default:
+		break;
+	}
+	--m_blocked;
+	m_cond.notify_all();
+	return ok;
+}
+
+bool FaultInjectingBackend::EnumVolumes(std::vector<std::wstring> &volnames)
+{
+	// Not specific to a volume, only the default fault applies
+	return Inject(L"") && m_target.EnumVolumes(volnames);
+}
+
+bool FaultInjectingBackend::QueryDevice(const wchar_t *volname, std::wstring &device)
+{
+	return Inject(volname) && m_target.QueryDevice(volname, device);
+}
+
+VolumeType FaultInjectingBackend::QueryType(const wchar_t *volname)
+{
+	return Inject(volname) ? m_target.QueryType(volname) : VOLUME_UNKNOWN;
+}
+
+bool FaultInjectingBackend::QueryPaths(const wchar_t *volname, std::vector<std::wstring> &paths)
+{
+	return Inject(volname) && m_target.QueryPaths(volname, paths);
+}
+
+bool FaultInjectingBackend::QuerySpace(const wchar_t *volname, VolumeSpace &space)
+{
+	return Inject(volname) && m_target.QuerySpace(volname, space);
+}
+
+bool FaultInjectingBackend::QueryInformation(const wchar_t *volname, std::wstring &label, std::wstring &filesystem)
+{
+	return Inject(volname) && m_target.QueryInformation(volname, label, filesystem);
+}
+
+bool FaultInjectingBackend::QueryDisks(const wchar_t *volname, std::vector<std::wstring> &disks)
+{
+	return Inject(volname) && m_target.QueryDisks(volname, disks);
+}
@@ -0,0 +1,76 @@
+/****************************** Module Header ******************************\
+Module Name:  FaultInjectingBackend.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares FaultInjectingBackend, a VolumeBackend that forwards to
+another backend but can delay, fail or hang the queries of chosen volumes.
+It reproduces slow and dead volumes (e.g. an unreachable SMB share) so that
+the deadline handling of VolumeQuery can be exercised on any machine.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "VolumeBackend.h"
+#include <map>
+#include <mutex>
+#include <condition_variable>
+
+class FaultInjectingBackend : public VolumeBackend
+{
+public:
+	enum FaultType
+	{
+		FAULT_NONE,
+		FAULT_DELAY,	// sleep delayMs, then forward
+		FAULT_FAIL,		// fail immediately
+		FAULT_HANG,		// block until Release() is called, then fail
+	};
+
+	explicit FaultInjectingBackend(VolumeBackend &target);
+	// Releases all hung calls
+	~FaultInjectingBackend();
+
+	// Set the fault of a volume. An empty volname sets the default fault for
+	// volumes without one of their own. Setting a fault undoes Release().
+	void SetFault(const std::wstring &volname, FaultType type, unsigned delayMs = 0);
+	void ClearFaults();
+	// Unblock all calls currently hung and let later ones through
+	void Release();
+
+	// Number of calls currently blocked in a delay or hang
+	unsigned Blocked();
+
+	virtual bool EnumVolumes(std::vector<std::wstring> &volnames);
+	virtual bool QueryDevice(const wchar_t *volname, std::wstring &device);
+	virtual VolumeType QueryType(const wchar_t *volname);
+	virtual bool QueryPaths(const wchar_t *volname, std::vector<std::wstring> &paths);
+	virtual bool QuerySpace(const wchar_t *volname, VolumeSpace &space);
+	virtual bool QueryInformation(const wchar_t *volname, std::wstring &label, std::wstring &filesystem);
+	virtual bool QueryDisks(const wchar_t *volname, std::vector<std::wstring> &disks);
+
+private:
+	struct Fault
+	{
+		FaultType type;
+		unsigned delayMs;
+	};
+
+	// Apply the fault of volname, returns false if the call should fail
+	bool Inject(const wchar_t *volname);
+
+	VolumeBackend &m_target;
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	std::map<std::wstring, Fault> m_faults;
+	unsigned m_blocked;
+	bool m_released;
+};
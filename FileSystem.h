@@ -0,0 +1,106 @@
+/****************************** Module Header ******************************\
+Module Name:  FileSystem.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares the file system interface the folder scanner walks
+directories through. There is a Win32 implementation and a POSIX one, so the
+scanner can be built, run and measured on Linux as well.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+#ifdef _WIN32
+#define PATH_SEPARATOR L'\\'
+#else
+#define PATH_SEPARATOR L'/'
+#endif
+
+struct DirEntry
+{
+	std::wstring name;
+	bool isDir;		// a directory to descend into
+	bool isLink;	// symbolic link or reparse point, never followed
+	unsigned long long size;	// logical size, 0 for directories
+	// Space taken on disk, less than size for sparse, compressed or cloned
+	// files, more for small files rounded up to whole clusters
+	unsigned long long allocated;
+	// Last write time in the system's own units, 0 if not known. Listing
+	// a directory changes its own time. Listings may leave this 0 for
+	// directories if it costs an extra call.
+	unsigned long long mtime;
+	// Identity, for telling hard links and repeated directories apart. All
+	// 0 if not known, which listings leave them for directories and for
+	// everything on Windows, where finding them means opening each file.
+	unsigned long long device;
+	unsigned long long fileId;
+	unsigned links;		// hard links to the file
+};
+
+class FileSystem
+{
+public:
+	virtual ~FileSystem() {}
+
+	// Read the entries of directory path, without "." and "..". If self is
+	// not NULL it receives what is known of the directory itself, at least
+	// its identity where the system has one. Returns false if the directory
+	// cannot be read, or if cancel is set meanwhile, which long listings check
+	// as they go.
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *cancel = NULL) = 0;
+
+	// Get the attributes of a single file or directory, without following
+	// links. entry.name is left alone. Returns false if path does not exist.
+	virtual bool Stat(const std::wstring &path, DirEntry &entry) = 0;
+};
+
+// The file system of the running system
+FileSystem &SystemFileSystem();
+
+// The file system of the running system through io_uring, which stats the
+// files of a listing many at once from the one thread. It is worth it where
+// each stat waits on a device or a server. Where io_uring is not available,
+// as on Windows, this is SystemFileSystem().
+FileSystem &UringFileSystem();
+
+// Runs the I/O of the calling thread at the lowest priority while it exists:
+// background mode on Windows, which lowers its CPU priority as well, and the
+// idle I/O class on Linux, which the I/O schedulers of the system may or may
+// not honor. The thread gets its own priority back afterwards.
+class LowIoPriority
+{
+public:
+	explicit LowIoPriority(bool lower = true);
+	~LowIoPriority();
+
+private:
+	int m_previous;	// to restore, -1 if nothing was changed
+
+	LowIoPriority(const LowIoPriority &);
+	LowIoPriority &operator =(const LowIoPriority &);
+};
+
+// Append name to directory path dir
+inline std::wstring JoinPath(const std::wstring &dir, const std::wstring &name)
+{
+	std::wstring path;
+	path.reserve(dir.size() + name.size() + 1);
+	path = dir;
+	if (!path.empty() && path[path.size() - 1] != PATH_SEPARATOR)
+		path += PATH_SEPARATOR;
+	path += name;
+	return path;
+}
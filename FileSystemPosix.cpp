@@ -0,0 +1,167 @@
+/****************************** Module Header ******************************\
+Module Name:  FileSystemPosix.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+POSIX implementation of the file system interface. Paths are UTF-8 on disk.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#ifndef _WIN32
+
+#include "FileSystem.h"
+#include "Utf8.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// From linux/ioprio.h, which not every system has
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+// Entries listed between looks at the cancel flag
+#define CANCEL_CHECK_ENTRIES 64
+
+class PosixFileSystem : public FileSystem
+{
+public:
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *cancel)
+	{
+		entries.clear();
+		int fd = open(WideToUtf8(path).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd < 0)
+			return false;
+		if (self)
+		{
+			// Of the directory actually opened, e.g. the root of a volume
+			// mounted here
+			struct stat st;
+			if (fstat(fd, &st) != 0)
+			{
+				close(fd);
+				return false;
+			}
+			Fill(st, *self);
+		}
+		DIR *dir = fdopendir(fd);
+		if (!dir)
+		{
+			close(fd);
+			return false;
+		}
+
+		struct dirent *ent;
+		while ((ent = readdir(dir)) != NULL)
+		{
+			// Every entry of a large directory may need a stat
+			if (cancel && entries.size() % CANCEL_CHECK_ENTRIES == 0 && *cancel)
+			{
+				closedir(dir);
+				return false;
+			}
+			const char *name = ent->d_name;
+			if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+				continue;
+
+			entries.resize(entries.size() + 1);
+			DirEntry &entry = entries.back();
+			entry.name.clear();
+			AppendWide(entry.name, name, strlen(name));
+			entry.isDir = false;
+			entry.isLink = false;
+			entry.size = 0;
+			entry.allocated = 0;
+			entry.mtime = 0;
+			entry.device = 0;
+			entry.fileId = 0;
+			entry.links = 0;
+
+			// Directories need no stat, only their contents count
+			if (ent->d_type == DT_DIR)
+			{
+				entry.isDir = true;
+				continue;
+			}
+			if (ent->d_type == DT_LNK)
+			{
+				entry.isLink = true;
+				continue;
+			}
+
+			struct stat st;
+			if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+				continue;	// vanished meanwhile, count it as empty
+			Fill(st, entry);
+		}
+		closedir(dir);	// closes fd as well
+		return true;
+	}
+
+	virtual bool Stat(const std::wstring &path, DirEntry &entry)
+	{
+		struct stat st;
+		if (fstatat(AT_FDCWD, WideToUtf8(path).c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0)
+			return false;
+		Fill(st, entry);
+		return true;
+	}
+
+private:
+	static void Fill(const struct stat &st, DirEntry &entry)
+	{
+		entry.isDir = S_ISDIR(st.st_mode);
+		entry.isLink = S_ISLNK(st.st_mode);
+		entry.size = entry.isDir || entry.isLink ? 0 : (unsigned long long)st.st_size;
+		// st_blocks is always in 512-byte units
+		entry.allocated = entry.isDir || entry.isLink ? 0 : (unsigned long long)st.st_blocks * 512;
+		entry.mtime = (unsigned long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+		entry.device = (unsigned long long)st.st_dev;
+		entry.fileId = (unsigned long long)st.st_ino;
+		entry.links = (unsigned)st.st_nlink;
+	}
+};
+
+static PosixFileSystem g_systemFileSystem;
+
+FileSystem &SystemFileSystem()
+{
+	return g_systemFileSystem;
+}
+
+// The priority of IOPRIO_WHO_PROCESS 0 is that of the calling thread alone
+LowIoPriority::LowIoPriority(bool lower) :
+m_previous(-1)
+{
+#ifdef SYS_ioprio_set
+	if (!lower)
+		return;
+	int previous = (int)syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+	if (previous >= 0 &&
+		syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) == 0)
+		m_previous = previous;
+#else
+	(void)lower;
+#endif
+}
+
+LowIoPriority::~LowIoPriority()
+{
+#ifdef SYS_ioprio_set
+	if (m_previous >= 0)
+		syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, m_previous);
+#endif
+}
+
+#endif
@@ -0,0 +1,531 @@
+/****************************** Module Header ******************************\
+Module Name:  FileSystemUring.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+io_uring implementation of the file system interface for Linux. A listing
+opens the directory and stats it through the ring in one system call, reads
+the names with getdents64, which io_uring has no operation for, and then
+stats the files of each batch of names through the ring, keeping up to a
+ring's worth in flight and refilling it as completions come back. The kernel
+runs the stats of a ring concurrently, so one scan thread has many requests
+outstanding on the disk or the server, where the POSIX implementation has
+one per thread.
+
+The ring is driven by the system calls directly, as liburing is not
+everywhere. Each listing takes a ring of its own from a pool, as a ring is
+not meant to be used by several threads at once. Where io_uring is not
+available, before Linux 5.6, where it is disabled or where a sandbox
+forbids it, UringFileSystem() is SystemFileSystem().
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#ifndef _WIN32
+
+#include "FileSystem.h"
+#include "Utf8.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+// Requests in flight per ring
+#define RING_DEPTH 64
+// Bytes of names read per getdents64 call, whose files are stat'ed before
+// the next call reuses the buffer
+#define DENTS_BUFFER 32768
+// Times a ring short of memory is tried again before it is given up on
+#define SUBMIT_RETRIES 100
+
+#pragma region Ring
+
+// The rings shared with the kernel: the application produces submissions
+// and consumes completions, so it owns the tail of the one and the head of
+// the other, and reads the opposite ends with acquire semantics
+class Ring
+{
+public:
+	Ring() : m_fd(-1), m_entries(0), m_sq(NULL), m_sqSize(0), m_cq(NULL), m_cqSize(0), m_sqes(NULL), m_queued(0) {}
+
+	~Ring()
+	{
+		if (m_sqes)
+			munmap(m_sqes, m_entries * sizeof(io_uring_sqe));
+		if (m_cq && m_cq != m_sq)
+			munmap(m_cq, m_cqSize);
+		if (m_sq)
+			munmap(m_sq, m_sqSize);
+		if (m_fd >= 0)
+			close(m_fd);
+	}
+
+	bool Init(unsigned entries)
+	{
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		m_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+		if (m_fd < 0)
+			return false;
+		m_entries = params.sq_entries;
+		m_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		// Since 5.4 both rings are in one mapping
+		bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single)
+			m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+		m_sq = Map(m_sqSize, IORING_OFF_SQ_RING);
+		if (!m_sq)
+			return false;
+		m_cq = single ? m_sq : Map(m_cqSize, IORING_OFF_CQ_RING);
+		if (!m_cq)
+			return false;
+		m_sqes = (io_uring_sqe *)Map(m_entries * sizeof(io_uring_sqe), IORING_OFF_SQES);
+		if (!m_sqes)
+			return false;
+
+		m_sqHead = (unsigned *)((char *)m_sq + params.sq_off.head);
+		m_sqTail = (unsigned *)((char *)m_sq + params.sq_off.tail);
+		m_sqMask = *(unsigned *)((char *)m_sq + params.sq_off.ring_mask);
+		m_sqArray = (unsigned *)((char *)m_sq + params.sq_off.array);
+		m_cqHead = (unsigned *)((char *)m_cq + params.cq_off.head);
+		m_cqTail = (unsigned *)((char *)m_cq + params.cq_off.tail);
+		m_cqMask = *(unsigned *)((char *)m_cq + params.cq_off.ring_mask);
+		m_cqes = (io_uring_cqe *)((char *)m_cq + params.cq_off.cqes);
+		return true;
+	}
+
+	// Whether the kernel has every operation the listings use, added along
+	// with the probe itself in 5.6
+	bool Supports()
+	{
+		size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+		std::vector<unsigned long long> buffer((size + sizeof(unsigned long long) - 1) / sizeof(unsigned long long));
+		io_uring_probe *probe = (io_uring_probe *)&buffer[0];
+		if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+			return false;
+		const unsigned char ops[] = { IORING_OP_OPENAT, IORING_OP_STATX };
+		for (size_t i = 0; i < sizeof(ops); ++i)
+		{
+			if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+				return false;
+		}
+		return true;
+	}
+
+	unsigned Entries() const { return m_entries; }
+
+	// The next submission to fill in. There is room for Entries() in flight.
+	io_uring_sqe *Next()
+	{
+		unsigned tail = *m_sqTail + m_queued++;
+		io_uring_sqe *sqe = &m_sqes[tail & m_sqMask];
+		memset(sqe, 0, sizeof(*sqe));
+		m_sqArray[tail & m_sqMask] = tail & m_sqMask;
+		return sqe;
+	}
+
+	// Submit what was filled in and wait for at least wait completions.
+	// Returns false if the kernel would not take all the submissions, which
+	// leaves Unsubmitted() of them behind, never to be sent. The ring cannot
+	// be used for anything but Wait() after that.
+	bool Submit(unsigned wait)
+	{
+		__atomic_store_n(m_sqTail, *m_sqTail + m_queued, __ATOMIC_RELEASE);
+		m_queued = 0;
+		for (unsigned busy = 0; ; )
+		{
+			unsigned submit = Unsubmitted();
+			int done = (int)syscall(__NR_io_uring_enter, m_fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0,
+				NULL, 0);
+			if (done >= 0 && (unsigned)done == submit)
+				return true;
+			if (done < 0 && errno == EINTR)
+				continue;
+			// Short of memory for the requests: give the kernel a moment
+			if (!(done >= 0 || errno == EAGAIN || errno == EBUSY) || ++busy > SUBMIT_RETRIES)
+				return false;
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+
+	unsigned Unsubmitted() const
+	{
+		return *m_sqTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+	}
+
+	// Wait for completions without submitting anything
+	void Wait()
+	{
+		while (syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno == EINTR)
+			;
+	}
+
+	// Take the next completion, false if there is none yet
+	bool Reap(io_uring_cqe &cqe)
+	{
+		unsigned head = *m_cqHead;
+		if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+			return false;
+		cqe = m_cqes[head & m_cqMask];
+		__atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+private:
+	void *Map(size_t size, unsigned long long offset)
+	{
+		void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, (off_t)offset);
+		return p == MAP_FAILED ? NULL : p;
+	}
+
+	int m_fd;
+	unsigned m_entries;
+	void *m_sq;
+	size_t m_sqSize;
+	void *m_cq;
+	size_t m_cqSize;
+	io_uring_sqe *m_sqes;
+	unsigned *m_sqHead;
+	unsigned *m_sqTail;
+	unsigned m_sqMask;
+	unsigned *m_sqArray;
+	unsigned *m_cqHead;
+	unsigned *m_cqTail;
+	unsigned m_cqMask;
+	io_uring_cqe *m_cqes;
+	unsigned m_queued;	// filled in, not yet made visible to the kernel
+
+	Ring(const Ring &);
+	Ring &operator =(const Ring &);
+};
+
+#pragma endregion
+
+
+#pragma region IoUringFileSystem
+
+// As getdents64 returns them, which no header declares
+struct LinuxDirent64
+{
+	unsigned long long d_ino;
+	long long d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+
+class IoUringFileSystem : public FileSystem
+{
+public:
+	// first is the ring the kernel was probed with
+	explicit IoUringFileSystem(Ring *first) : m_fallback(SystemFileSystem())
+	{
+		m_rings.push_back(first);
+	}
+
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *cancel)
+	{
+		Ring *ring = Take();
+		if (!ring)
+			return m_fallback.ReadDir(path, entries, self, cancel);
+		Listing listing;
+		Result result = List(*ring, WideToUtf8(path), entries, self, cancel, listing);
+		if (result == RING_FAILED)
+		{
+			delete ring;
+			return m_fallback.ReadDir(path, entries, self, cancel);
+		}
+		Give(ring);
+		return result == LISTED;
+	}
+
+	virtual bool Stat(const std::wstring &path, DirEntry &entry)
+	{
+		// A single call gains nothing from the ring
+		return m_fallback.Stat(path, entry);
+	}
+
+private:
+	enum Result { LISTED, FAILED, RING_FAILED };
+
+	// The state of one listing, on the stack of the thread doing it
+	struct Listing
+	{
+		struct statx stats[RING_DEPTH];
+		size_t index[RING_DEPTH];	// of the entry each stat is for
+		unsigned free[RING_DEPTH];	// slots of stats not in use
+		unsigned freeCount;
+		unsigned long long buffer[DENTS_BUFFER / sizeof(unsigned long long)];
+	};
+
+	static const LinuxDirent64 *Dirent(const Listing &listing, long offset)
+	{
+		return (const LinuxDirent64 *)((const char *)listing.buffer + offset);
+	}
+
+	static bool IsDots(const char *name)
+	{
+		return name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+	}
+
+	// After a failed Submit(), wait for those of inFlight requests that
+	// were sent, as they write into the listing
+	static Result Abandon(Ring &ring, unsigned inFlight)
+	{
+		inFlight -= ring.Unsubmitted();
+		io_uring_cqe cqe;
+		while (inFlight)
+		{
+			if (ring.Reap(cqe))
+				--inFlight;
+			else
+				ring.Wait();
+		}
+		return RING_FAILED;
+	}
+
+	Result List(Ring &ring, const std::string &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *cancel, Listing &listing)
+	{
+		entries.clear();
+
+		// Open the directory and stat it in one go. Both follow a link at
+		// path alike, so the stat is of the directory opened.
+		io_uring_sqe *sqe = ring.Next();
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (unsigned long long)(uintptr_t)path.c_str();
+		sqe->open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+		sqe->user_data = RING_DEPTH;
+		if (self)
+		{
+			sqe = ring.Next();
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (unsigned long long)(uintptr_t)path.c_str();
+			sqe->len = STATX_BASIC_STATS;
+			sqe->off = (unsigned long long)(uintptr_t)&listing.stats[0];
+			sqe->user_data = 0;
+		}
+		unsigned expected = self ? 2 : 1;
+		bool submitted = ring.Submit(expected);
+		if (!submitted)
+			expected -= ring.Unsubmitted();
+		int fd = -1, statResult = 0;
+		for (unsigned reaped = 0; reaped < expected; )
+		{
+			io_uring_cqe cqe;
+			if (!ring.Reap(cqe))
+			{
+				ring.Wait();
+				continue;
+			}
+			++reaped;
+			if (cqe.user_data == RING_DEPTH)
+				fd = cqe.res;
+			else
+				statResult = cqe.res;
+		}
+		if (!submitted)
+		{
+			// The directory may have been opened all the same
+			if (fd >= 0)
+				close(fd);
+			return RING_FAILED;
+		}
+		if (fd < 0)
+			return FAILED;
+		if (self)
+		{
+			if (statResult < 0)
+			{
+				close(fd);
+				return FAILED;
+			}
+			Fill(listing.stats[0], *self);
+		}
+
+		Result result = LISTED;
+		for (;;)
+		{
+			if (cancel && *cancel)
+			{
+				result = FAILED;
+				break;
+			}
+			long read = syscall(SYS_getdents64, fd, listing.buffer, sizeof(listing.buffer));
+			if (read <= 0)
+			{
+				result = read == 0 ? LISTED : FAILED;
+				break;
+			}
+			size_t first = entries.size();
+			for (long offset = 0; offset < read; )
+			{
+				const LinuxDirent64 *ent = Dirent(listing, offset);
+				offset += ent->d_reclen;
+				if (IsDots(ent->d_name))
+					continue;
+				entries.resize(entries.size() + 1);
+				DirEntry &entry = entries.back();
+				entry.name.clear();
+				AppendWide(entry.name, ent->d_name, strlen(ent->d_name));
+				entry.isDir = ent->d_type == DT_DIR;
+				entry.isLink = ent->d_type == DT_LNK;
+				entry.size = 0;
+				entry.allocated = 0;
+				entry.mtime = 0;
+				entry.device = 0;
+				entry.fileId = 0;
+				entry.links = 0;
+			}
+			result = StatFiles(ring, fd, entries, first, read, cancel, listing);
+			if (result != LISTED)
+				break;
+		}
+		close(fd);
+		return result;
+	}
+
+	// Stat the files among entries from first on, whose names are in the
+	// read bytes of listing.buffer in the same order. Directories need no
+	// stat, only their contents count, and links are never followed.
+	Result StatFiles(Ring &ring, int fd, std::vector<DirEntry> &entries, size_t first, long read,
+		const std::atomic<bool> *cancel, Listing &listing)
+	{
+		listing.freeCount = std::min<unsigned>(RING_DEPTH, ring.Entries());
+		for (unsigned i = 0; i < listing.freeCount; ++i)
+			listing.free[i] = i;
+		unsigned inFlight = 0;
+		size_t index = first;
+		long offset = 0;
+		bool cancelled = false;
+		for (;;)
+		{
+			// Fill the free slots, unless cancelled, which leaves only the
+			// requests in flight to wait for
+			cancelled = cancelled || (cancel && *cancel);
+			unsigned queued = 0;
+			while (listing.freeCount && offset < read && !cancelled)
+			{
+				const LinuxDirent64 *ent = Dirent(listing, offset);
+				offset += ent->d_reclen;
+				if (IsDots(ent->d_name))
+					continue;
+				size_t i = index++;
+				if (ent->d_type == DT_DIR || ent->d_type == DT_LNK)
+					continue;
+				unsigned slot = listing.free[--listing.freeCount];
+				listing.index[slot] = i;
+				io_uring_sqe *sqe = ring.Next();
+				sqe->opcode = IORING_OP_STATX;
+				sqe->fd = fd;
+				sqe->addr = (unsigned long long)(uintptr_t)ent->d_name;
+				sqe->len = STATX_BASIC_STATS;
+				sqe->off = (unsigned long long)(uintptr_t)&listing.stats[slot];
+				sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+				sqe->user_data = slot;
+				++queued;
+			}
+			inFlight += queued;
+			if (!inFlight)
+				return cancelled ? FAILED : LISTED;
+			if (!ring.Submit(1))
+				return Abandon(ring, inFlight);
+			io_uring_cqe cqe;
+			while (ring.Reap(cqe))
+			{
+				unsigned slot = (unsigned)cqe.user_data;
+				// A file gone meanwhile is counted as empty
+				if (cqe.res == 0)
+					Fill(listing.stats[slot], entries[listing.index[slot]]);
+				listing.free[listing.freeCount++] = slot;
+				--inFlight;
+			}
+		}
+	}
+
+	// Like the POSIX implementation fills them from a stat
+	static void Fill(const struct statx &stx, DirEntry &entry)
+	{
+		entry.isDir = S_ISDIR(stx.stx_mode);
+		entry.isLink = S_ISLNK(stx.stx_mode);
+		entry.size = entry.isDir || entry.isLink ? 0 : stx.stx_size;
+		entry.allocated = entry.isDir || entry.isLink ? 0 : stx.stx_blocks * 512;
+		entry.mtime = (unsigned long long)stx.stx_mtime.tv_sec * 1000000000 + stx.stx_mtime.tv_nsec;
+		entry.device = (unsigned long long)makedev(stx.stx_dev_major, stx.stx_dev_minor);
+		entry.fileId = stx.stx_ino;
+		entry.links = stx.stx_nlink;
+	}
+
+	// A ring for the calling thread, NULL if no more can be made
+	Ring *Take()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (!m_rings.empty())
+			{
+				Ring *ring = m_rings.back();
+				m_rings.pop_back();
+				return ring;
+			}
+		}
+		Ring *ring = new Ring;
+		if (!ring->Init(RING_DEPTH))
+		{
+			delete ring;
+			return NULL;
+		}
+		return ring;
+	}
+
+	void Give(Ring *ring)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_rings.push_back(ring);
+	}
+
+	FileSystem &m_fallback;
+	std::mutex m_lock;
+	std::vector<Ring *> m_rings;	// not in use, kept for the next listings
+};
+
+#pragma endregion
+
+static std::once_flag g_uringOnce;
+static FileSystem *g_uringFileSystem;
+
+FileSystem &UringFileSystem()
+{
+	std::call_once(g_uringOnce, []() {
+		Ring *ring = new Ring;
+		if (ring->Init(RING_DEPTH) && ring->Supports())
+			g_uringFileSystem = new IoUringFileSystem(ring);
+		else
+		{
+			delete ring;
+			g_uringFileSystem = &SystemFileSystem();
+		}
+	});
+	return *g_uringFileSystem;
+}
+
+#endif
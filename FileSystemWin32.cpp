@@ -0,0 +1,197 @@
+/****************************** Module Header ******************************\
+Module Name:  FileSystemWin32.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Win32 implementation of the file system interface.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#ifdef _WIN32
+
+#include "FileSystem.h"
+#include <windows.h>
+
+// Long paths need the \\?\ prefix
+static std::wstring LongPath(const std::wstring &path, size_t extra)
+{
+	std::wstring result;
+	if (path.size() + extra >= MAX_PATH && path.compare(0, 4, L"\\\\?\\"))
+		result = L"\\\\?\\";
+	result += path;
+	return result;
+}
+
+static unsigned long long FileTime(const FILETIME &ft)
+{
+	return ((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+class Win32FileSystem : public FileSystem
+{
+public:
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *cancel)
+	{
+		entries.clear();
+
+		// Listing through a directory handle returns the allocation size and
+		// file id of every entry with the names, where FindFirstFile would
+		// need a GetCompressedFileSizeW call per file
+		HANDLE hdir = CreateFileW(LongPath(path, 0).c_str(), FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+		if (hdir == INVALID_HANDLE_VALUE)
+			return false;
+
+		BY_HANDLE_FILE_INFORMATION info;
+		bool identified = GetFileInformationByHandle(hdir, &info) != FALSE;
+		if (self)
+		{
+			self->isDir = true;
+			self->isLink = false;
+			self->size = 0;
+			self->allocated = 0;
+			self->mtime = identified ? FileTime(info.ftLastWriteTime) : 0;
+			self->device = identified ? info.dwVolumeSerialNumber : 0;
+			self->fileId = identified ?
+				((unsigned long long)info.nFileIndexHigh << 32) | info.nFileIndexLow : 0;
+			self->links = 0;
+		}
+
+		// 64 KB is the most a network redirector returns per call
+		std::vector<unsigned long long> buffer(64 * 1024 / sizeof(unsigned long long));
+		FILE_INFO_BY_HANDLE_CLASS infoClass = FileIdBothDirectoryRestartInfo;
+		while (GetFileInformationByHandleEx(hdir, infoClass, &buffer[0],
+			(DWORD)(buffer.size() * sizeof(buffer[0]))))
+		{
+			infoClass = FileIdBothDirectoryInfo;
+			// Between calls, each of which can take long on a network share
+			if (cancel && *cancel)
+			{
+				CloseHandle(hdir);
+				return false;
+			}
+			const BYTE *next = (const BYTE *)&buffer[0];
+			for (;;)
+			{
+				const FILE_ID_BOTH_DIR_INFO *fi = (const FILE_ID_BOTH_DIR_INFO *)next;
+				const wchar_t *name = fi->FileName;
+				size_t length = fi->FileNameLength / sizeof(wchar_t);
+				if (!(name[0] == L'.' && (length == 1 || (length == 2 && name[1] == L'.'))))
+				{
+					entries.resize(entries.size() + 1);
+					DirEntry &entry = entries.back();
+					entry.name.assign(name, length);
+					// Junctions, mount points and symbolic links lead elsewhere
+					entry.isLink = (fi->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+					entry.isDir = (fi->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 && !entry.isLink;
+					entry.size = entry.isDir ? 0 : (unsigned long long)fi->EndOfFile.QuadPart;
+					entry.allocated = entry.isDir ? 0 : (unsigned long long)fi->AllocationSize.QuadPart;
+					entry.mtime = (unsigned long long)fi->LastWriteTime.QuadPart;
+					entry.device = 0;
+					entry.fileId = 0;
+					entry.links = 0;
+				}
+				if (!fi->NextEntryOffset)
+					break;
+				next += fi->NextEntryOffset;
+			}
+		}
+		DWORD error = GetLastError();
+		CloseHandle(hdir);
+		return error == ERROR_NO_MORE_FILES;
+	}
+
+	virtual bool Stat(const std::wstring &path, DirEntry &entry)
+	{
+		// Like the listing, take the allocation size from the file system
+		// rather than guess it from the attributes. Opening for no access
+		// reads the attributes of files in use too, and the reparse point
+		// itself is opened rather than followed.
+		std::wstring longPath = LongPath(path, 0);
+		HANDLE hfile = CreateFileW(longPath.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, NULL);
+		if (hfile != INVALID_HANDLE_VALUE)
+		{
+			FILE_BASIC_INFO basic;
+			FILE_STANDARD_INFO standard;
+			bool ok = GetFileInformationByHandleEx(hfile, FileBasicInfo, &basic, sizeof(basic)) &&
+				GetFileInformationByHandleEx(hfile, FileStandardInfo, &standard, sizeof(standard));
+			CloseHandle(hfile);
+			if (ok)
+			{
+				entry.isLink = (basic.FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+				entry.isDir = standard.Directory && !entry.isLink;
+				entry.size = entry.isDir ? 0 : (unsigned long long)standard.EndOfFile.QuadPart;
+				entry.allocated = entry.isDir ? 0 : (unsigned long long)standard.AllocationSize.QuadPart;
+				entry.mtime = (unsigned long long)basic.LastWriteTime.QuadPart;
+				entry.device = 0;
+				entry.fileId = 0;
+				entry.links = 0;
+				return true;
+			}
+		}
+
+		// Some system files, e.g. the page file, cannot be opened at all. Fall
+		// back to the attribute data, which has no allocation size: compressed
+		// or sparse files report what they take on disk, anything else its
+		// logical size.
+		WIN32_FILE_ATTRIBUTE_DATA fad;
+		if (!GetFileAttributesExW(longPath.c_str(), GetFileExInfoStandard, &fad))
+			return false;
+		entry.isLink = (fad.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+		entry.isDir = (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 && !entry.isLink;
+		entry.size = entry.isDir ? 0 : ((unsigned long long)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+		entry.allocated = entry.size;
+		if (!entry.isDir && !entry.isLink && (fad.dwFileAttributes &
+			(FILE_ATTRIBUTE_COMPRESSED | FILE_ATTRIBUTE_SPARSE_FILE)))
+		{
+			DWORD high = 0;
+			DWORD low = GetCompressedFileSizeW(longPath.c_str(), &high);
+			if (low != INVALID_FILE_SIZE || GetLastError() == NO_ERROR)
+				entry.allocated = ((unsigned long long)high << 32) | low;
+		}
+		entry.mtime = FileTime(fad.ftLastWriteTime);
+		entry.device = 0;
+		entry.fileId = 0;
+		entry.links = 0;
+		return true;
+	}
+};
+
+static Win32FileSystem g_systemFileSystem;
+
+FileSystem &SystemFileSystem()
+{
+	return g_systemFileSystem;
+}
+
+FileSystem &UringFileSystem()
+{
+	return g_systemFileSystem;
+}
+
+// Fails with ERROR_THREAD_MODE_ALREADY_BACKGROUND if the thread is in
+// background mode already, which is then left for whoever put it there
+LowIoPriority::LowIoPriority(bool lower) :
+m_previous(-1)
+{
+	if (lower && SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN))
+		m_previous = 0;
+}
+
+LowIoPriority::~LowIoPriority()
+{
+	if (m_previous >= 0)
+		SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+}
+
+#endif
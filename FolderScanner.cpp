@@ -0,0 +1,536 @@
+/****************************** Module Header ******************************\
+Module Name:  FolderScanner.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of FolderScanner.
+
+A directory node stays alive until its own entries and all its subdirectories
+are done. pending counts those: one for the node itself plus one per
+subdirectory. Whoever drops it to zero adds the node's totals to its parent
+and continues with the parent, so totals flow up the tree without locks.
+
+Progress is published from a thread of its own. Totals only reach the root
+as whole subtrees complete, so each worker also keeps running totals of the
+directories it listed, which the publisher adds up under the worker locks.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "FolderScanner.h"
+#include "Trace.h"
+#include <deque>
+#include <thread>
+#include <algorithm>
+
+struct FolderScanner::Node
+{
+	std::wstring path;
+	Node *parent;
+	unsigned long long mtime;	// 0 if the parent listing did not tell
+	ScanTree::Index index;		// in m_tree, if there is one
+	std::atomic<long> pending;
+	std::atomic<unsigned long long> bytes;
+	std::atomic<unsigned long long> allocated;
+	std::atomic<unsigned long long> files;
+	std::atomic<unsigned long long> dirs;
+	std::atomic<unsigned long long> errors;
+
+	Node(const std::wstring &p, Node *par, unsigned long long t, ScanTree::Index i) :
+		path(p), parent(par), mtime(t), index(i), pending(1),
+		bytes(0), allocated(0), files(0), dirs(0), errors(0) {}
+
+	void Totals(ScanTotals &totals) const
+	{
+		totals.bytes = bytes;
+		totals.allocated = allocated;
+		totals.files = files;
+		totals.dirs = dirs;
+		totals.errors = errors;
+	}
+};
+
+struct FolderScanner::Worker
+{
+	std::mutex lock;
+	std::deque<Node *> tasks;
+	std::vector<DirEntry> entries;	// reused for every directory
+	DirectoryState state;			// likewise
+	std::vector<ScanItem> topFiles;	// min-heaps of at most m_topCount
+	std::vector<ScanItem> topDirs;
+	ScanTotals found;	// of the directories listed or reused, for progress
+};
+
+// Heap order putting the smallest item first
+static bool LargerItem(const ScanItem &a, const ScanItem &b)
+{
+	return a.bytes > b.bytes;
+}
+
+FolderScanner::FolderScanner(FileSystem &fs, unsigned threads) :
+m_fs(fs),
+m_threads(threads),
+m_progressInterval(DEFAULT_PROGRESS_INTERVAL),
+m_history(NULL),
+m_restat(false),
+m_topCount(0),
+m_tree(NULL),
+m_crossVolumes(false),
+m_lowPriority(false),
+m_rootDevice(0),
+m_root(NULL),
+m_outstanding(0),
+m_cancel(false),
+m_found(0),
+m_finished(false),
+m_listed(0),
+m_reused(0),
+m_duplicates(0),
+m_loops(0),
+m_otherVolumes(0)
+{
+	if (m_threads == 0)
+		m_threads = std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+FolderScanner::~FolderScanner()
+{
+}
+
+void FolderScanner::SetDirectoryCallback(const DirectoryCallback &callback)
+{
+	m_callback = callback;
+}
+
+void FolderScanner::SetProgressCallback(const ProgressCallback &callback, unsigned intervalMs)
+{
+	m_progress = callback;
+	m_progressInterval = std::max(intervalMs, 1u);
+}
+
+void FolderScanner::SetHistory(ScanHistory *history, bool restat)
+{
+	m_history = history;
+	m_restat = restat;
+}
+
+void FolderScanner::SetTopCount(unsigned count)
+{
+	m_topCount = count;
+}
+
+void FolderScanner::SetTree(ScanTree *tree)
+{
+	m_tree = tree;
+}
+
+void FolderScanner::SetCrossVolumes(bool cross)
+{
+	m_crossVolumes = cross;
+}
+
+void FolderScanner::SetLowPriority(bool low)
+{
+	m_lowPriority = low;
+}
+
+void FolderScanner::Cancel()
+{
+	m_cancel = true;
+}
+
+bool FolderScanner::Scan(const std::wstring &root, ScanTotals &totals)
+{
+	m_listed = 0;
+	m_reused = 0;
+	m_duplicates = 0;
+	m_loops = 0;
+	m_otherVolumes = 0;
+	m_seen.Clear();
+	m_rootDevice = 0;
+	for (unsigned i = 0; i < m_threads; ++i)
+		m_workers.push_back(new Worker);
+	m_root = new Node(root, NULL, 0, m_tree ? m_tree->SetRoot(root) : ScanTree::NO_INDEX);
+	m_outstanding = 1;
+	m_found = 1;
+	m_workers[0]->tasks.push_back(m_root);
+
+	std::thread publisher;
+	if (m_progress)
+	{
+		m_finished = false;
+		publisher = std::thread(&FolderScanner::Publish, this, std::chrono::steady_clock::now());
+	}
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i < m_threads; ++i)
+		threads.push_back(std::thread(&FolderScanner::Run, this, i));
+	Run(0);
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+	if (publisher.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_publishLock);
+			m_finished = true;
+		}
+		m_publishCond.notify_all();
+		publisher.join();
+	}
+
+	Merge(m_workers, &Worker::topFiles, m_topCount, m_topFiles);
+	Merge(m_workers, &Worker::topDirs, m_topCount, m_topDirs);
+	m_root->Totals(totals);
+	delete m_root;
+	m_root = NULL;
+	for (size_t i = 0; i < m_workers.size(); ++i)
+		delete m_workers[i];
+	m_workers.clear();
+
+	// An unreadable root is the only error of a scan that found nothing
+	return !m_cancel && !(totals.errors && !totals.files && !totals.dirs);
+}
+
+void FolderScanner::Run(unsigned index)
+{
+	Worker &worker = *m_workers[index];
+	LowIoPriority priority(m_lowPriority);
+	unsigned idle = 0;
+	while (m_outstanding > 0)
+	{
+		Node *node = NULL;
+		{
+			std::lock_guard<std::mutex> lock(worker.lock);
+			if (!worker.tasks.empty())
+			{
+				// Own tasks depth first, the most recently found directory
+				node = worker.tasks.back();
+				worker.tasks.pop_back();
+			}
+		}
+		if (node || Steal(index, node))
+		{
+			idle = 0;
+			Process(worker, node);
+			--m_outstanding;
+			continue;
+		}
+
+		// Nothing to do until some other worker finds more directories
+		if (++idle < 64)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+}
+
+bool FolderScanner::Steal(unsigned thief, Node *&node)
+{
+	for (unsigned i = 1; i < m_threads; ++i)
+	{
+		Worker &victim = *m_workers[(thief + i) % m_threads];
+		std::lock_guard<std::mutex> lock(victim.lock);
+		if (!victim.tasks.empty())
+		{
+			// The oldest task is closest to the root, likely the largest
+			node = victim.tasks.front();
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void FolderScanner::Process(Worker &worker, Node *node)
+{
+	// After a cancel, tasks are only drained so that every node is freed
+	if (!m_cancel && !(m_history && !m_topCount && !m_tree && Reuse(worker, node)))
+		List(worker, node);
+
+	if (--node->pending == 0)
+		Complete(worker, node);
+}
+
+void FolderScanner::List(Worker &worker, Node *node)
+{
+	// Take the time before listing, so that a change made meanwhile makes
+	// the next scan list the directory again
+	if (m_history && !node->mtime)
+	{
+		DirEntry self;
+		if (m_fs.Stat(node->path, self))
+			node->mtime = self.mtime;
+	}
+	++m_listed;
+	DirEntry self;
+	bool listed;
+	{
+		TraceSpan span("ReadDir", node->path.c_str());
+		listed = m_fs.ReadDir(node->path, worker.entries, &self, &m_cancel);
+	}
+	if (!listed)
+	{
+		node->errors += 1;
+		std::lock_guard<std::mutex> lock(worker.lock);
+		worker.found.errors += 1;
+		return;
+	}
+	if (self.fileId)
+	{
+		// The root is listed before any other directory is queued
+		if (node == m_root)
+			m_rootDevice = self.device;
+		else if (!m_crossVolumes && self.device != m_rootDevice)
+		{
+			++m_otherVolumes;
+			return;
+		}
+		if (!m_seen.Insert(self.device, self.fileId))
+		{
+			++m_loops;
+			return;
+		}
+	}
+
+	// Children are added in one go, so that they are contiguous
+	ScanTree::Index first = ScanTree::NO_INDEX;
+	if (m_tree)
+		first = m_tree->AddChildren(node->index, worker.entries);
+
+	DirectoryState &state = worker.state;
+	if (m_history)
+	{
+		state.subdirs.clear();
+		state.files.clear();
+	}
+	unsigned long long bytes = 0, allocated = 0, files = 0, dirs = 0;
+	for (size_t i = 0; i < worker.entries.size(); ++i)
+	{
+		const DirEntry &entry = worker.entries[i];
+		if (!entry.isDir)
+		{
+			// Count the size of a hard-linked file at its first link only
+			if (entry.links > 1 && entry.fileId && !m_seen.Insert(entry.device, entry.fileId))
+			{
+				++m_duplicates;
+				continue;
+			}
+			bytes += entry.size;
+			allocated += entry.allocated;
+			++files;
+			if (m_topCount)
+				Offer(worker, &Worker::topFiles, node->path, &entry.name, entry.size);
+			if (m_history && m_restat)
+				state.files.push_back(entry.name);
+			continue;
+		}
+		++dirs;
+		if (m_history)
+			state.subdirs.push_back(entry.name);
+		Push(worker, node, entry.name, entry.mtime, m_tree ? first + (ScanTree::Index)i : ScanTree::NO_INDEX);
+	}
+	node->bytes += bytes;
+	node->allocated += allocated;
+	node->files += files;
+	node->dirs += dirs;
+	{
+		std::lock_guard<std::mutex> lock(worker.lock);
+		worker.found.bytes += bytes;
+		worker.found.allocated += allocated;
+		worker.found.files += files;
+		worker.found.dirs += dirs;
+	}
+
+	if (m_history && node->mtime)
+	{
+		state.mtime = node->mtime;
+		state.own.bytes = bytes;
+		state.own.allocated = allocated;
+		state.own.files = files;
+		state.own.dirs = dirs;
+		state.own.errors = 0;
+		m_history->Update(node->path, state);
+	}
+}
+
+bool FolderScanner::Reuse(Worker &worker, Node *node)
+{
+	if (!node->mtime)
+	{
+		DirEntry self;
+		if (!m_fs.Stat(node->path, self) || !self.isDir)
+			return false;
+		node->mtime = self.mtime;
+	}
+	DirectoryState &state = worker.state;
+	if (!node->mtime || !m_history->Find(node->path, state) || state.mtime != node->mtime)
+		return false;
+
+	if (m_restat)
+	{
+		// Recorded by a scan that did not keep file names
+		if (state.files.size() != state.own.files)
+			return false;
+		unsigned long long bytes = 0, allocated = 0;
+		DirEntry entry;
+		for (size_t i = 0; i < state.files.size(); ++i)
+		{
+			// Gone or replaced by a directory without touching the parent?
+			// Then the parent's time cannot be trusted either.
+			if (!m_fs.Stat(JoinPath(node->path, state.files[i]), entry) || entry.isDir)
+				return false;
+			bytes += entry.size;
+			allocated += entry.allocated;
+		}
+		if (bytes != state.own.bytes || allocated != state.own.allocated)
+		{
+			state.own.bytes = bytes;
+			state.own.allocated = allocated;
+			m_history->Update(node->path, state);
+		}
+	}
+
+	++m_reused;
+	node->bytes += state.own.bytes;
+	node->allocated += state.own.allocated;
+	node->files += state.own.files;
+	node->dirs += state.subdirs.size();
+	{
+		std::lock_guard<std::mutex> lock(worker.lock);
+		worker.found.bytes += state.own.bytes;
+		worker.found.allocated += state.own.allocated;
+		worker.found.files += state.own.files;
+		worker.found.dirs += state.subdirs.size();
+	}
+	for (size_t i = 0; i < state.subdirs.size(); ++i)
+		Push(worker, node, state.subdirs[i], 0, ScanTree::NO_INDEX);
+	return true;
+}
+
+void FolderScanner::Push(Worker &worker, Node *node, const std::wstring &name, unsigned long long mtime,
+	ScanTree::Index index)
+{
+	Node *child = new Node(JoinPath(node->path, name), node, mtime, index);
+	++node->pending;
+	++m_outstanding;
+	++m_found;
+	std::lock_guard<std::mutex> lock(worker.lock);
+	worker.tasks.push_back(child);
+}
+
+void FolderScanner::Complete(Worker &worker, Node *node)
+{
+	while (node)
+	{
+		Node *parent = node->parent;
+		if (m_callback && !m_cancel)
+		{
+			ScanTotals totals;
+			node->Totals(totals);
+			m_callback(node->path, totals);
+		}
+		if (m_tree && !m_cancel)
+			m_tree->SetBytes(node->index, node->bytes);
+		if (parent && m_topCount && !m_cancel)
+			Offer(worker, &Worker::topDirs, node->path, NULL, node->bytes);
+		if (parent)
+		{
+			parent->bytes += node->bytes;
+			parent->allocated += node->allocated;
+			parent->files += node->files;
+			parent->dirs += node->dirs;
+			parent->errors += node->errors;
+		}
+		if (node != m_root)
+			delete node;
+		if (!parent || --parent->pending != 0)
+			break;
+		node = parent;
+	}
+}
+
+void FolderScanner::Offer(Worker &worker, std::vector<ScanItem> Worker::*heap, const std::wstring &dir,
+	const std::wstring *name, unsigned long long bytes)
+{
+	// Most items are turned away here, before any path is built. Only this
+	// worker changes its heaps, so the lock is for the publisher alone.
+	std::vector<ScanItem> &items = worker.*heap;
+	if (items.size() >= m_topCount && bytes <= items.front().bytes)
+		return;
+	ScanItem item(name ? JoinPath(dir, *name) : dir, bytes);
+	std::lock_guard<std::mutex> lock(worker.lock);
+	if (items.size() >= m_topCount)
+	{
+		std::pop_heap(items.begin(), items.end(), LargerItem);
+		items.pop_back();
+	}
+	items.push_back(item);
+	std::push_heap(items.begin(), items.end(), LargerItem);
+}
+
+void FolderScanner::Merge(const std::vector<Worker *> &workers, std::vector<ScanItem> Worker::*heap,
+	unsigned count, std::vector<ScanItem> &top, bool locked)
+{
+	top.clear();
+	for (size_t i = 0; i < workers.size(); ++i)
+	{
+		std::unique_lock<std::mutex> lock(workers[i]->lock, std::defer_lock);
+		if (locked)
+			lock.lock();
+		top.insert(top.end(), (workers[i]->*heap).begin(), (workers[i]->*heap).end());
+	}
+	std::sort(top.begin(), top.end(), LargerItem);
+	if (top.size() > count)
+		top.resize(count);
+}
+
+void FolderScanner::Publish(std::chrono::steady_clock::time_point start)
+{
+	std::chrono::steady_clock::time_point next = start;
+	std::unique_lock<std::mutex> lock(m_publishLock);
+	for (;;)
+	{
+		// At fixed times, however long the callback takes, but never two at
+		// once
+		next += std::chrono::milliseconds(m_progressInterval);
+		if (m_publishCond.wait_until(lock, next, [this]() { return m_finished; }))
+			return;
+		lock.unlock();
+		ScanProgress progress;
+		Snapshot(progress);
+		progress.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		m_progress(progress);
+		lock.lock();
+		next = std::max(next, std::chrono::steady_clock::now());
+	}
+}
+
+void FolderScanner::Snapshot(ScanProgress &progress)
+{
+	// Found before outstanding, so that directories found in between count
+	// as not done yet rather than as done
+	progress.dirsFound = m_found;
+	long long outstanding = m_outstanding;
+	progress.dirsDone = progress.dirsFound - std::min<unsigned long long>(std::max(outstanding, 0LL),
+		progress.dirsFound);
+	for (size_t i = 0; i < m_workers.size(); ++i)
+	{
+		std::lock_guard<std::mutex> lock(m_workers[i]->lock);
+		const ScanTotals &found = m_workers[i]->found;
+		progress.totals.bytes += found.bytes;
+		progress.totals.allocated += found.allocated;
+		progress.totals.files += found.files;
+		progress.totals.dirs += found.dirs;
+		progress.totals.errors += found.errors;
+	}
+	if (m_topCount)
+	{
+		Merge(m_workers, &Worker::topFiles, m_topCount, progress.topFiles, true);
+		Merge(m_workers, &Worker::topDirs, m_topCount, progress.topDirs, true);
+	}
+}
@@ -0,0 +1,232 @@
+/****************************** Module Header ******************************\
+Module Name:  FolderScanner.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares FolderScanner, which computes the recursive size, file
+count and directory count of a folder. Every directory is one task. Each
+worker thread keeps its own deque of tasks, works depth first from its back
+and, when it runs dry, steals from the front of another worker's deque, so
+large subtrees are split up between threads as they are discovered.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "FileSystem.h"
+#include "ScanTree.h"
+#include "IdentitySet.h"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+struct ScanTotals
+{
+	unsigned long long bytes;
+	unsigned long long allocated;	// on disk
+	unsigned long long files;
+	unsigned long long dirs;	// subdirectories, the scanned one not included
+	unsigned long long errors;	// directories that could not be read
+
+	ScanTotals() : bytes(0), allocated(0), files(0), dirs(0), errors(0) {}
+
+	// Space on disk per byte of file data, 0 if there is no data
+	double AllocationRatio() const { return bytes ? (double)allocated / bytes : 0; }
+};
+
+// A file or directory with its (recursive) size
+struct ScanItem
+{
+	std::wstring path;
+	unsigned long long bytes;
+
+	ScanItem() : bytes(0) {}
+	ScanItem(const std::wstring &p, unsigned long long b) : path(p), bytes(b) {}
+};
+
+// What a running scan has found so far
+struct ScanProgress
+{
+	// Of the directories listed so far. Their subdirectories are counted in
+	// dirs as soon as they are found, the rest once they are listed too.
+	ScanTotals totals;
+	// The largest files found and directories completed so far, largest
+	// first, while SetTopCount() is on
+	std::vector<ScanItem> topFiles;
+	std::vector<ScanItem> topDirs;
+	unsigned long long dirsFound;	// the root included
+	unsigned long long dirsDone;	// of those, listed or skipped
+	double seconds;		// since the scan started
+
+	ScanProgress() : dirsFound(0), dirsDone(0), seconds(0) {}
+
+	// Share of the directories found so far that are done. More are found
+	// as the scan goes, so it can go down as well as up.
+	double Done() const { return dirsFound ? (double)dirsDone / dirsFound : 0; }
+};
+
+// A directory as of its last listing, kept for incremental scans
+struct DirectoryState
+{
+	unsigned long long mtime;
+	ScanTotals own;		// files directly in the directory, and its subdirectory count
+	std::vector<std::wstring> subdirs;	// names
+	std::vector<std::wstring> files;	// names, only kept for re-stat scans
+
+	DirectoryState() : mtime(0) {}
+};
+
+// Where incremental scans keep directory states from one scan to the next.
+// Called from all worker threads at once.
+class ScanHistory
+{
+public:
+	virtual ~ScanHistory() {}
+
+	// Get the state of path from the last scan, false if there is none
+	virtual bool Find(const std::wstring &path, DirectoryState &state) = 0;
+
+	// Record the state of path after it was listed or re-stat'ed
+	virtual void Update(const std::wstring &path, const DirectoryState &state) = 0;
+};
+
+class FolderScanner
+{
+public:
+	// Called once for every directory when its whole subtree has been
+	// scanned, from the worker thread that finished it
+	typedef std::function<void(const std::wstring &path, const ScanTotals &totals)> DirectoryCallback;
+	// Called every interval during scans, from a thread of its own
+	typedef std::function<void(const ScanProgress &progress)> ProgressCallback;
+
+	enum { DEFAULT_PROGRESS_INTERVAL = 100 };	// ms
+
+	// threads 0 uses one thread per core
+	explicit FolderScanner(FileSystem &fs, unsigned threads = 0);
+	~FolderScanner();
+
+	void SetDirectoryCallback(const DirectoryCallback &callback);
+
+	// Publish what was found so far every intervalMs while Scan() runs. The
+	// workers keep running while callback does, but the next one waits for
+	// it. Not called after Scan() returns. NULL turns it off.
+	void SetProgressCallback(const ProgressCallback &callback,
+		unsigned intervalMs = DEFAULT_PROGRESS_INTERVAL);
+
+	// Make scans incremental. A directory whose modification time matches
+	// its state in history has had no entries added, removed or renamed, so
+	// the state is used instead of listing it. Files changed in place do
+	// not touch the directory, so with restat their sizes are still read one
+	// by one. NULL turns incremental scans off.
+	void SetHistory(ScanHistory *history, bool restat = false);
+
+	// Scan root recursively using the calling thread and threads - 1 more.
+	// Returns false if root cannot be read or the scan was cancelled.
+	bool Scan(const std::wstring &root, ScanTotals &totals);
+
+	// Track the count largest files and directories (the root not included)
+	// during scans, 0 turns it off. Each worker keeps its own bounded heaps,
+	// merged when the scan ends, so memory stays O(count) per thread.
+	// Incremental scans do not see the files of unlisted directories, so
+	// they list every directory while this is on.
+	void SetTopCount(unsigned count);
+
+	// Record every entry found into tree, which Scan() resets first. NULL
+	// turns it off. Like SetTopCount() it makes incremental scans list every
+	// directory.
+	void SetTree(ScanTree *tree);
+
+	// The largest files and directories of the last Scan(), largest first
+	const std::vector<ScanItem> &TopFiles() const { return m_topFiles; }
+	const std::vector<ScanItem> &TopDirs() const { return m_topDirs; }
+
+	// Whether to descend into other volumes mounted below the root. Off by
+	// default. Volumes mounted on Windows are reparse points, which are never
+	// followed either way.
+	void SetCrossVolumes(bool cross);
+
+	// Run the scan threads, the calling one included, at low I/O priority,
+	// see LowIoPriority. Off by default.
+	void SetLowPriority(bool low);
+
+	// Make a running Scan() stop soon, from any thread. Listings in progress
+	// give up between entries and queued directories are dropped, so all the
+	// threads are done within milliseconds, unless stuck in a system call
+	// that does not return, e.g. on a share that went away. The scanner stays
+	// cancelled: a Scan() started later, e.g. by a query that was still
+	// queued, returns false at once.
+	void Cancel();
+
+	// Directories listed, and taken from history unlisted, by the last Scan()
+	unsigned long long Listed() const { return m_listed; }
+	unsigned long long Reused() const { return m_reused; }
+	// Hard links to files already counted, directories reached again (a
+	// loop) and mount points of other volumes skipped by the last Scan()
+	unsigned long long Duplicates() const { return m_duplicates; }
+	unsigned long long Loops() const { return m_loops; }
+	unsigned long long OtherVolumes() const { return m_otherVolumes; }
+
+private:
+	struct Node;
+	struct Worker;
+
+	void Run(unsigned index);
+	bool Steal(unsigned thief, Node *&node);
+	void Process(Worker &worker, Node *node);
+	void List(Worker &worker, Node *node);
+	bool Reuse(Worker &worker, Node *node);
+	void Push(Worker &worker, Node *node, const std::wstring &name, unsigned long long mtime,
+		ScanTree::Index index);
+	void Complete(Worker &worker, Node *node);
+	// Offer an item to a heap of the top m_topCount items of worker
+	void Offer(Worker &worker, std::vector<ScanItem> Worker::*heap, const std::wstring &dir,
+		const std::wstring *name, unsigned long long bytes);
+	static void Merge(const std::vector<Worker *> &workers, std::vector<ScanItem> Worker::*heap,
+		unsigned count, std::vector<ScanItem> &top, bool locked = false);
+	void Publish(std::chrono::steady_clock::time_point start);
+	void Snapshot(ScanProgress &progress);
+
+	FileSystem &m_fs;
+	unsigned m_threads;
+	DirectoryCallback m_callback;
+	ProgressCallback m_progress;
+	unsigned m_progressInterval;
+	ScanHistory *m_history;
+	bool m_restat;
+	unsigned m_topCount;
+	ScanTree *m_tree;
+	bool m_crossVolumes;
+	bool m_lowPriority;
+	IdentitySet m_seen;
+	unsigned long long m_rootDevice;	// 0 if not known
+	std::vector<ScanItem> m_topFiles;
+	std::vector<ScanItem> m_topDirs;
+
+	std::vector<Worker *> m_workers;
+	Node *m_root;
+	std::atomic<long long> m_outstanding;	// tasks queued or being processed
+	std::atomic<bool> m_cancel;
+	std::atomic<unsigned long long> m_found;	// directories, the root included
+	std::mutex m_publishLock;
+	std::condition_variable m_publishCond;
+	bool m_finished;	// guarded by m_publishLock
+	std::atomic<unsigned long long> m_listed;
+	std::atomic<unsigned long long> m_reused;
+	std::atomic<unsigned long long> m_duplicates;
+	std::atomic<unsigned long long> m_loops;
+	std::atomic<unsigned long long> m_otherVolumes;
+
+	FolderScanner(const FolderScanner &);
+	FolderScanner &operator =(const FolderScanner &);
+};
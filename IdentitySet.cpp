@@ -0,0 +1,106 @@
+/****************************** Module Header ******************************\
+Module Name:  IdentitySet.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of IdentitySet.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "IdentitySet.h"
+
+#define SHARD_INITIAL_SLOTS 64
+
+IdentitySet::IdentitySet()
+{
+}
+
+// splitmix64 finalizer over both halves. A collision would merge two files,
+// at odds of about n^2 / 2^65 for n identities.
+uint64_t IdentitySet::Key(uint64_t device, uint64_t fileId)
+{
+	uint64_t key = fileId ^ (device * 0x9e3779b97f4a7c15ULL);
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return key ? key : 1;
+}
+
+void IdentitySet::Grow(Shard &shard)
+{
+	std::vector<uint64_t> slots(shard.slots.empty() ? SHARD_INITIAL_SLOTS : shard.slots.size() * 2, 0);
+	size_t mask = slots.size() - 1;
+	for (size_t i = 0; i < shard.slots.size(); ++i)
+	{
+		uint64_t key = shard.slots[i];
+		if (!key)
+			continue;
+		// The low bits chose the shard, so probe with the high ones
+		size_t slot = (size_t)(key >> SHARD_BITS) & mask;
+		while (slots[slot])
+			slot = (slot + 1) & mask;
+		slots[slot] = key;
+	}
+	shard.slots.swap(slots);
+}
+
+bool IdentitySet::Insert(uint64_t device, uint64_t fileId)
+{
+	uint64_t key = Key(device, fileId);
+	Shard &shard = m_shards[key & (SHARDS - 1)];
+	std::lock_guard<std::mutex> lock(shard.lock);
+	// At most half full
+	if ((shard.count + 1) * 2 > shard.slots.size())
+		Grow(shard);
+	size_t mask = shard.slots.size() - 1;
+	size_t slot = (size_t)(key >> SHARD_BITS) & mask;
+	for (; shard.slots[slot]; slot = (slot + 1) & mask)
+	{
+		if (shard.slots[slot] == key)
+			return false;
+	}
+	shard.slots[slot] = key;
+	++shard.count;
+	return true;
+}
+
+void IdentitySet::Clear()
+{
+	for (unsigned i = 0; i < SHARDS; ++i)
+	{
+		std::lock_guard<std::mutex> lock(m_shards[i].lock);
+		std::vector<uint64_t>().swap(m_shards[i].slots);
+		m_shards[i].count = 0;
+	}
+}
+
+size_t IdentitySet::Size()
+{
+	size_t size = 0;
+	for (unsigned i = 0; i < SHARDS; ++i)
+	{
+		std::lock_guard<std::mutex> lock(m_shards[i].lock);
+		size += m_shards[i].count;
+	}
+	return size;
+}
+
+size_t IdentitySet::MemoryBytes()
+{
+	size_t bytes = 0;
+	for (unsigned i = 0; i < SHARDS; ++i)
+	{
+		std::lock_guard<std::mutex> lock(m_shards[i].lock);
+		bytes += m_shards[i].slots.capacity() * sizeof(uint64_t);
+	}
+	return bytes;
+}
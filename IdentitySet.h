@@ -0,0 +1,60 @@
+/****************************** Module Header ******************************\
+Module Name:  IdentitySet.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares IdentitySet, the set of files and directories a scan has
+already seen, by (device, file id). It keeps hard-linked files from being
+counted once per link and directories reached twice, e.g. through a bind
+mount of one of their ancestors, from being walked again.
+
+Identities are mixed into a single 64-bit key, so a set entry is 8 bytes.
+The set is split into shards by key, each an open addressing table with its
+own lock, so that scanner threads rarely wait for one another.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+
+class IdentitySet
+{
+public:
+	IdentitySet();
+
+	// Add an identity. Returns false if it was there already. Thread safe.
+	bool Insert(uint64_t device, uint64_t fileId);
+
+	void Clear();
+	size_t Size();
+	size_t MemoryBytes();
+
+private:
+	enum { SHARD_BITS = 6, SHARDS = 1 << SHARD_BITS };
+
+	struct Shard
+	{
+		std::mutex lock;
+		std::vector<uint64_t> slots;	// 0 is empty
+		size_t count;
+		Shard() : count(0) {}
+	};
+
+	static uint64_t Key(uint64_t device, uint64_t fileId);
+	static void Grow(Shard &shard);
+
+	Shard m_shards[SHARDS];
+
+	IdentitySet(const IdentitySet &);
+	IdentitySet &operator =(const IdentitySet &);
+};
@@ -0,0 +1,142 @@
+/****************************** Module Header ******************************\
+Module Name:  IndexBuilder.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of the directory size index builder.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "IndexBuilder.h"
+#include "SizeIndex.h"
+#include "FolderScanner.h"
+#include "IndexUpdater.h"
+#include "ScanThrottle.h"
+#include "ChangeWatcher.h"
+#include "Reg.h"
+#include <shlobj.h>
+#include <shellapi.h>
+#pragma comment(lib, "shell32.lib")
+
+#define DEFAULT_INDEX_WRITE_INTERVAL  10000
+#define DEFAULT_INDEX_RESCAN_INTERVAL (24 * 60 * 60 * 1000)
+
+bool GetSizeIndexPath(std::wstring &path)
+{
+	wchar_t dir[MAX_PATH];
+	if (FAILED(SHGetFolderPathW(NULL, CSIDL_LOCAL_APPDATA | CSIDL_FLAG_CREATE, NULL, SHGFP_TYPE_CURRENT, dir)))
+		return false;
+	path = dir;
+	path += L"\\DiskUsageTip";
+	CreateDirectoryW(path.c_str(), NULL);
+	path += L"\\sizes.idx";
+	return true;
+}
+
+bool BuildSizeIndex(const std::vector<std::wstring> &roots, unsigned threads, unsigned throttle)
+{
+	std::wstring filename;
+	if (!GetSizeIndexPath(filename))
+		return false;
+
+	ScanThrottle rate(throttle);
+	ThrottledFileSystem throttled(SystemFileSystem(), rate);
+	SizeIndexBuilder builder;
+	FolderScanner scanner(throttle ? (FileSystem &)throttled : SystemFileSystem(), threads);
+	scanner.SetDirectoryCallback([&builder](const std::wstring &path, const ScanTotals &totals) {
+		builder.Add(path, totals);
+	});
+	for (size_t i = 0; i < roots.size(); ++i)
+	{
+		// An unreadable root is skipped, the others are still worth indexing
+		ScanTotals totals;
+		scanner.Scan(roots[i], totals);
+	}
+	return builder.Write(filename);
+}
+
+bool WatchSizeIndex(const std::vector<std::wstring> &roots, unsigned threads, unsigned throttle,
+	unsigned writeIntervalMs, unsigned rescanIntervalMs, bool restat)
+{
+	std::wstring filename;
+	if (!GetSizeIndexPath(filename))
+		return false;
+
+	// Watch before scanning, so that nothing changed during the scan is missed
+	std::unique_ptr<ChangeWatcher> watcher = CreateSystemChangeWatcher();
+	ScanThrottle rate(throttle);
+	ThrottledFileSystem throttled(SystemFileSystem(), rate);
+	IndexUpdater updater(throttle ? (FileSystem &)throttled : SystemFileSystem(), threads);
+	updater.SetRestat(restat);
+	for (size_t i = 0; i < roots.size(); ++i)
+	{
+		if (watcher->Watch(roots[i]))
+			updater.AddRoot(roots[i]);
+	}
+	if (!updater.Write(filename))
+		return false;
+
+	DWORD lastWrite = GetTickCount();
+	DWORD lastRescan = lastWrite;
+	bool dirty = false;
+	std::vector<ChangeEvent> events;
+	for (;;)
+	{
+		events.clear();
+		if (!watcher->Wait(writeIntervalMs, events))
+			return false;
+		if (updater.Apply(events))
+			dirty = true;
+		// Catch whatever notifications miss, e.g. changes made over the
+		// network to a share. Only changed directories are listed.
+		if (rescanIntervalMs && GetTickCount() - lastRescan >= rescanIntervalMs)
+		{
+			for (size_t i = 0; i < roots.size(); ++i)
+				dirty |= updater.Rescan(roots[i]);
+			lastRescan = GetTickCount();
+		}
+		if (dirty && GetTickCount() - lastWrite >= writeIntervalMs)
+		{
+			updater.Write(filename);
+			lastWrite = GetTickCount();
+			dirty = false;
+		}
+	}
+}
+
+extern "C" void CALLBACK BuildIndexW(HWND hwnd, HINSTANCE hinst, LPWSTR lpszCmdLine, int nCmdShow)
+{
+	if (!lpszCmdLine || !*lpszCmdLine)
+		return;
+	int argc = 0;
+	LPWSTR *argv = CommandLineToArgvW(lpszCmdLine, &argc);
+	if (!argv)
+		return;
+	std::vector<std::wstring> roots(argv, argv + argc);
+	LocalFree(argv);
+	bool watch = !roots.empty() && _wcsicmp(roots[0].c_str(), L"/watch") == 0;
+	if (watch)
+		roots.erase(roots.begin());
+	if (roots.empty())
+		return;
+
+	// The rundll32 process exists only for this, so put all of it, scanner
+	// threads included, into background mode for low CPU and I/O priority
+	SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN);
+	unsigned threads = GetSettingDword(L"IndexThreads", 0);
+	unsigned throttle = GetSettingDword(L"IndexThrottle", 0);
+	if (watch)
+		WatchSizeIndex(roots, threads, throttle,
+			GetSettingDword(L"IndexWriteInterval", DEFAULT_INDEX_WRITE_INTERVAL),
+			GetSettingDword(L"IndexRescanInterval", DEFAULT_INDEX_RESCAN_INTERVAL),
+			GetSettingDword(L"IndexRestat", 0) != 0);
+	else
+		BuildSizeIndex(roots, threads, throttle);
+}
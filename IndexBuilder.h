@@ -0,0 +1,48 @@
+/****************************** Module Header ******************************\
+Module Name:  IndexBuilder.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares the functions that build the directory size index of the
+extension, and the rundll32 entry point that runs them, e.g. from a
+scheduled task:
+
+rundll32.exe DiskUsageTip.dll,BuildIndex C:\ D:\Data
+
+With /watch first, the builder keeps running after the initial scan and
+applies file system changes to the index as they happen.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+
+// Get the file name of the index, %LOCALAPPDATA%\DiskUsageTip\sizes.idx,
+// which points at the generation of the index that is current, see SizeIndex
+bool GetSizeIndexPath(std::wstring &path);
+
+// Scan roots and replace the index with the totals of all their directories.
+// The index holds exactly the given roots, others indexed before are dropped.
+// throttle caps the directories and files read per second, see ScanThrottle,
+// 0 for no limit.
+bool BuildSizeIndex(const std::vector<std::wstring> &roots, unsigned threads, unsigned throttle);
+
+// Build the index as BuildSizeIndex() does, then keep it up to date from
+// change notifications, rewriting it at most every writeIntervalMs. Every
+// rescanIntervalMs (0 never) the roots are rescanned incrementally, with
+// restat see IndexUpdater::SetRestat(). Only returns on error.
+bool WatchSizeIndex(const std::vector<std::wstring> &roots, unsigned threads, unsigned throttle,
+	unsigned writeIntervalMs, unsigned rescanIntervalMs, bool restat);
+
+// rundll32 entry point, lpszCmdLine lists the roots to index
+extern "C" void CALLBACK BuildIndexW(HWND hwnd, HINSTANCE hinst, LPWSTR lpszCmdLine, int nCmdShow);
@@ -0,0 +1,331 @@
+/****************************** Module Header ******************************\
+Module Name:  IndexUpdater.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of IndexUpdater.
+
+Totals are unsigned, and a delta is applied as after - before, which wraps
+around for shrinking values and still gives the right result.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "IndexUpdater.h"
+#include "SizeIndex.h"
+#include <utility>
+
+static bool IsSeparator(wchar_t c)
+{
+#ifdef _WIN32
+	return c == L'\\' || c == L'/';
+#else
+	return c == L'/';
+#endif
+}
+
+// Strip trailing separators, except from a root ("/", "C:\")
+static std::wstring NormalizePath(const std::wstring &path)
+{
+	size_t len = path.size();
+	while (len > 1 && IsSeparator(path[len - 1]) && !(len == 3 && path[1] == L':'))
+		--len;
+	return path.substr(0, len);
+}
+
+// The parent of a normalized path, empty for a root
+static std::wstring ParentPath(const std::wstring &path)
+{
+	size_t pos = path.size();
+	while (pos > 0 && !IsSeparator(path[pos - 1]))
+		--pos;
+	if (pos == 0 || pos == path.size())
+		return std::wstring();
+	// Keep the separator of "/" and "C:\"
+	if (pos == 1 || (pos == 3 && path[1] == L':'))
+		return path.substr(0, pos);
+	return path.substr(0, pos - 1);
+}
+
+static bool SameTotals(const ScanTotals &a, const ScanTotals &b)
+{
+	return a.bytes == b.bytes && a.allocated == b.allocated && a.files == b.files && a.dirs == b.dirs && a.errors == b.errors;
+}
+
+// Lets FolderScanner find and update directories in the updater. All calls
+// come from scanner threads while ScanTree() holds m_lock.
+class IndexUpdater::History : public ScanHistory
+{
+public:
+	explicit History(IndexUpdater &updater) : m_updater(updater) {}
+
+	virtual bool Find(const std::wstring &path, DirectoryState &state)
+	{
+		std::lock_guard<std::mutex> lock(m_updater.m_scanLock);
+		DirectoryMap::const_iterator it = m_updater.m_dirs.find(path);
+		if (it == m_updater.m_dirs.end() || !it->second.mtime)
+			return false;
+		const Directory &dir = it->second;
+		state.mtime = dir.mtime;
+		state.own = dir.own;
+		state.subdirs.assign(dir.subdirs.begin(), dir.subdirs.end());
+		state.files = dir.files;
+		return true;
+	}
+
+	virtual void Update(const std::wstring &path, const DirectoryState &state)
+	{
+		std::lock_guard<std::mutex> lock(m_updater.m_scanLock);
+		Directory &dir = m_updater.m_dirs[path];
+		dir.mtime = state.mtime;
+		dir.own = state.own;
+		dir.subdirs.clear();
+		dir.subdirs.insert(state.subdirs.begin(), state.subdirs.end());
+		dir.files = state.files;
+	}
+
+private:
+	IndexUpdater &m_updater;
+};
+
+IndexUpdater::IndexUpdater(FileSystem &fs, unsigned threads) :
+m_fs(fs),
+m_threads(threads),
+m_restat(false),
+m_generation(0)
+{
+}
+
+void IndexUpdater::SetRestat(bool restat)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_restat = restat;
+}
+
+bool IndexUpdater::AddRoot(const std::wstring &root)
+{
+	std::wstring path = NormalizePath(root);
+	std::lock_guard<std::mutex> lock(m_lock);
+	ScanTotals totals;
+	if (!ScanTree(path, totals))
+		return false;
+	m_roots.insert(path);
+	return true;
+}
+
+bool IndexUpdater::Apply(const std::vector<ChangeEvent> &events)
+{
+	std::set<std::wstring> rescans, relists;
+	for (size_t i = 0; i < events.size(); ++i)
+		(events[i].overflow ? rescans : relists).insert(NormalizePath(events[i].path));
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	bool changed = false;
+	for (std::set<std::wstring>::iterator it = rescans.begin(); it != rescans.end(); ++it)
+		changed |= RescanTree(*it);
+	// Sorted, so parents come before their children. A child removed or
+	// scanned with its parent is then skipped or just listed once more.
+	for (std::set<std::wstring>::iterator it = relists.begin(); it != relists.end(); ++it)
+	{
+		bool rescanned = false;
+		for (std::wstring p = *it; !p.empty() && !rescanned; p = ParentPath(p))
+			rescanned = rescans.count(p) != 0;
+		if (!rescanned)
+			changed |= Relist(*it);
+	}
+	return changed;
+}
+
+bool IndexUpdater::DirectoryChanged(const std::wstring &path)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return Relist(NormalizePath(path));
+}
+
+bool IndexUpdater::Rescan(const std::wstring &path)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return RescanTree(NormalizePath(path));
+}
+
+bool IndexUpdater::Relist(const std::wstring &path)
+{
+	DirectoryMap::iterator it = m_dirs.find(path);
+	if (it == m_dirs.end())
+		return false;
+	// A directory that is gone is removed when its parent is listed
+	DirEntry self;
+	if (!m_fs.Stat(path, self) || !m_fs.ReadDir(path, m_entries, NULL))
+		return false;
+
+	ScanTotals own;
+	std::set<std::wstring> subdirs;
+	std::vector<std::wstring> files;
+	for (size_t i = 0; i < m_entries.size(); ++i)
+	{
+		const DirEntry &entry = m_entries[i];
+		if (entry.isDir)
+			subdirs.insert(entry.name);
+		else
+		{
+			own.bytes += entry.size;
+			own.allocated += entry.allocated;
+			++own.files;
+			if (m_restat)
+				files.push_back(entry.name);
+		}
+	}
+	own.dirs = subdirs.size();
+
+	Directory &dir = it->second;
+	for (std::set<std::wstring>::iterator name = dir.subdirs.begin(); name != dir.subdirs.end(); ++name)
+	{
+		if (!subdirs.count(*name))
+			EraseTree(JoinPath(path, *name));
+	}
+	for (std::set<std::wstring>::iterator name = subdirs.begin(); name != subdirs.end(); ++name)
+	{
+		ScanTotals totals;
+		if (!dir.subdirs.count(*name))
+			ScanTree(JoinPath(path, *name), totals);
+	}
+	dir.mtime = self.mtime;
+	dir.own = own;
+	dir.subdirs.swap(subdirs);
+	dir.files.swap(files);
+
+	ScanTotals total = own;
+	for (std::set<std::wstring>::iterator name = dir.subdirs.begin(); name != dir.subdirs.end(); ++name)
+	{
+		DirectoryMap::iterator child = m_dirs.find(JoinPath(path, *name));
+		if (child == m_dirs.end())
+			continue;
+		total.bytes += child->second.total.bytes;
+		total.allocated += child->second.total.allocated;
+		total.files += child->second.total.files;
+		total.dirs += child->second.total.dirs;
+		total.errors += child->second.total.errors;
+	}
+	if (SameTotals(total, dir.total))
+		return false;
+	ScanTotals before = dir.total;
+	dir.total = total;
+	Propagate(ParentPath(path), before, total);
+	return true;
+}
+
+bool IndexUpdater::RescanTree(const std::wstring &path)
+{
+	DirectoryMap::iterator it = m_dirs.find(path);
+	if (it == m_dirs.end() && !m_roots.count(path))
+		return false;
+	ScanTotals before;
+	if (it != m_dirs.end())
+		before = it->second.total;
+
+	ScanTotals after;
+	if (ScanTree(path, after))
+	{
+		Propagate(ParentPath(path), before, after);
+		return !SameTotals(before, after);
+	}
+	// Gone, so take it out of its parent as well
+	Propagate(ParentPath(path), before, ScanTotals());
+	Relist(ParentPath(path));
+	return true;
+}
+
+bool IndexUpdater::ScanTree(const std::wstring &path, ScanTotals &totals)
+{
+	// Directories the scan does not reach are gone
+	unsigned generation = ++m_generation;
+	History history(*this);
+	FolderScanner scanner(m_fs, m_threads);
+	scanner.SetHistory(&history, m_restat);
+	scanner.SetDirectoryCallback([this, generation](const std::wstring &p, const ScanTotals &t) {
+		std::lock_guard<std::mutex> lock(m_scanLock);
+		Directory &dir = m_dirs[p];
+		dir.total = t;
+		dir.generation = generation;
+	});
+	if (!scanner.Scan(path, totals))
+	{
+		EraseTree(path);
+		return false;
+	}
+
+	std::wstring prefix = path;
+	if (!IsSeparator(prefix[prefix.size() - 1]))
+		prefix += PATH_SEPARATOR;
+	for (DirectoryMap::iterator it = m_dirs.lower_bound(prefix);
+		it != m_dirs.end() && it->first.compare(0, prefix.size(), prefix) == 0; )
+	{
+		if (it->second.generation != generation)
+			m_dirs.erase(it++);
+		else
+			++it;
+	}
+	return true;
+}
+
+void IndexUpdater::EraseTree(const std::wstring &path)
+{
+	m_dirs.erase(path);
+	std::wstring prefix = path;
+	if (prefix.empty() || !IsSeparator(prefix[prefix.size() - 1]))
+		prefix += PATH_SEPARATOR;
+	DirectoryMap::iterator it = m_dirs.lower_bound(prefix);
+	DirectoryMap::iterator end = it;
+	while (end != m_dirs.end() && end->first.compare(0, prefix.size(), prefix) == 0)
+		++end;
+	m_dirs.erase(it, end);
+}
+
+void IndexUpdater::Propagate(const std::wstring &path, const ScanTotals &before, const ScanTotals &after)
+{
+	for (std::wstring p = path; !p.empty(); p = ParentPath(p))
+	{
+		DirectoryMap::iterator it = m_dirs.find(p);
+		if (it == m_dirs.end())
+			break;
+		ScanTotals &total = it->second.total;
+		total.bytes += after.bytes - before.bytes;
+		total.allocated += after.allocated - before.allocated;
+		total.files += after.files - before.files;
+		total.dirs += after.dirs - before.dirs;
+		total.errors += after.errors - before.errors;
+	}
+}
+
+bool IndexUpdater::Lookup(const std::wstring &path, ScanTotals &totals)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	DirectoryMap::const_iterator it = m_dirs.find(NormalizePath(path));
+	if (it == m_dirs.end())
+		return false;
+	totals = it->second.total;
+	return true;
+}
+
+bool IndexUpdater::Write(const std::wstring &filename)
+{
+	SizeIndexBuilder builder;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		for (DirectoryMap::const_iterator it = m_dirs.begin(); it != m_dirs.end(); ++it)
+			builder.Add(it->first, it->second.total);
+	}
+	return builder.Write(filename);
+}
+
+size_t IndexUpdater::Size()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_dirs.size();
+}
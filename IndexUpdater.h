@@ -0,0 +1,104 @@
+/****************************** Module Header ******************************\
+Module Name:  IndexUpdater.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares IndexUpdater, which keeps the directory totals of a set of
+roots in memory and brings them up to date from ChangeWatcher events. Every
+directory remembers its own files and subdirectories next to its recursive
+totals. A changed directory is listed again, without descending, and the
+difference to its old listing is added to it and all its ancestors. Only
+new subdirectories and roots whose events were lost are scanned, and those
+rescans are incremental: directories whose modification time is unchanged
+are not listed again.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "FolderScanner.h"
+#include "ChangeWatcher.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+
+class IndexUpdater
+{
+public:
+	// threads is used for the full scans, 0 uses one thread per core
+	explicit IndexUpdater(FileSystem &fs, unsigned threads = 0);
+
+	// Also re-read the sizes of the files in unchanged directories when
+	// rescanning, see FolderScanner::SetHistory()
+	void SetRestat(bool restat);
+
+	// Scan root in full and keep it up to date from then on
+	bool AddRoot(const std::wstring &root);
+
+	// Bring the totals up to date with a batch of events. Returns whether
+	// any totals changed.
+	bool Apply(const std::vector<ChangeEvent> &events);
+
+	// The entries of directory path have changed. Returns whether any totals
+	// changed.
+	bool DirectoryChanged(const std::wstring &path);
+
+	// Scan the subtree of path again, e.g. after events were lost. Only
+	// directories changed since they were last listed are listed again.
+	bool Rescan(const std::wstring &path);
+
+	bool Lookup(const std::wstring &path, ScanTotals &totals);
+
+	// Write all totals as a SizeIndex file
+	bool Write(const std::wstring &filename);
+
+	size_t Size();
+
+private:
+	struct Directory
+	{
+		unsigned long long mtime;	// as of the last listing
+		ScanTotals own;		// files directly in the directory, and its subdirectory count
+		ScanTotals total;	// the whole subtree
+		std::set<std::wstring> subdirs;	// names
+		std::vector<std::wstring> files;	// names, only kept with restat
+		unsigned generation;	// of the last scan that reached it
+		Directory() : mtime(0), generation(0) {}
+	};
+	typedef std::map<std::wstring, Directory> DirectoryMap;
+
+	class History;
+	friend class History;
+
+	// Unlocked implementations of DirectoryChanged() and Rescan()
+	bool Relist(const std::wstring &path);
+	bool RescanTree(const std::wstring &path);
+	// Scan path and update its subtree, returning its totals
+	bool ScanTree(const std::wstring &path, ScanTotals &totals);
+	// Remove the subtree of path, path itself included
+	void EraseTree(const std::wstring &path);
+	// Add after - before to the totals of path and its ancestors
+	void Propagate(const std::wstring &path, const ScanTotals &before, const ScanTotals &after);
+
+	FileSystem &m_fs;
+	unsigned m_threads;
+	bool m_restat;
+	std::mutex m_lock;	// held by every public method
+	std::mutex m_scanLock;	// held by scanner threads during ScanTree()
+	unsigned m_generation;
+	std::set<std::wstring> m_roots;
+	DirectoryMap m_dirs;
+	std::vector<DirEntry> m_entries;	// reused by DirectoryChanged()
+
+	IndexUpdater(const IndexUpdater &);
+	IndexUpdater &operator =(const IndexUpdater &);
+};
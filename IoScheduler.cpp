@@ -0,0 +1,330 @@
+/****************************** Module Header ******************************\
+Module Name:  IoScheduler.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of the I/O scheduler. The limit of a device is adjusted once
+per window of requests, after the gradient method of TCP Vegas and of
+adaptive concurrency limiters: the mean latency of the window against the
+baseline, the latency of the device unloaded, tells how much of it was
+queueing inside the device. The limit shrinks by that ratio and grows by one
+request on top, so where more in flight only queues up it settles just above
+the point it stopped helping. While there is no queueing it doubles.
+
+What the device does unloaded is measured, as BBR does, by running a window
+at a quarter of the limit every so often. The baseline is not allowed to
+simply follow the latency up, or queueing would become the new normal.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "IoScheduler.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Requests per window, at least, and at least twice the limit
+#define WINDOW_MIN_REQUESTS 16
+// Latency up to this many times the baseline is not counted as queueing
+#define LATENCY_TOLERANCE 1.25
+// Windows between measurements of the baseline, which follow a device that
+// got slower for good, e.g. once past what the cache held
+#define PROBE_INTERVAL_WINDOWS 32
+#define PROBE_LIMIT_DIVISOR 4
+// Weight of the new limit against the old one
+#define LIMIT_SMOOTHING 0.3
+// Time waited for a turn between looks at the cancel flag
+#define CANCEL_CHECK_US 1000
+
+#pragma region IoDevice
+
+IoDevice::IoDevice(const std::wstring &name, unsigned maxLimit) :
+m_name(name),
+m_maxLimit(std::max(maxLimit, 1u)),
+m_limit(std::min<double>(INITIAL_LIMIT, m_maxLimit)),
+m_inFlight(0),
+m_tickets(0),
+m_granted(0),
+m_windowCount(0),
+m_windowSum(0),
+m_windowPeak(0),
+m_windows(0),
+m_probing(true),
+m_baseline(0),
+m_latencySum(0)
+{
+	m_stats.name = name;
+}
+
+bool IoDevice::Acquire(const std::atomic<bool> *cancel)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	unsigned long long ticket = m_tickets++;
+	if (m_granted == ticket && m_inFlight < Limit())
+	{
+		++m_granted;
+		++m_inFlight;
+		m_windowPeak = std::max(m_windowPeak, m_inFlight);
+		return true;
+	}
+	++m_stats.waited;
+	TraceSpan span("IoWait", m_name.c_str());
+	while (ticket >= m_granted)
+	{
+		if (!cancel)
+			m_cond.wait(lock);
+		else if (*cancel)
+		{
+			// Skipped when its turn comes, the tickets behind keep their place
+			m_abandoned.insert(ticket);
+			return false;
+		}
+		else
+			m_cond.wait_for(lock, std::chrono::microseconds(CANCEL_CHECK_US));
+	}
+	return true;
+}
+
+void IoDevice::Release(long long latencyNs)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	--m_inFlight;
+	++m_stats.requests;
+	m_latencySum += (double)latencyNs;
+	++m_windowCount;
+	m_windowSum += (double)latencyNs;
+	if (m_windowCount >= std::max<unsigned>(WINDOW_MIN_REQUESTS, 2 * Limit()))
+		Adjust();
+
+	// Let the next in line through, as many as the limit allows now
+	bool granted = false;
+	while (m_granted < m_tickets && m_inFlight < Limit())
+	{
+		if (m_abandoned.erase(m_granted))
+		{
+			++m_granted;
+			continue;
+		}
+		++m_granted;
+		++m_inFlight;
+		granted = true;
+	}
+	m_windowPeak = std::max(m_windowPeak, m_inFlight);
+	if (granted)
+		m_cond.notify_all();
+}
+
+// Called with m_lock held
+unsigned IoDevice::Limit() const
+{
+	unsigned limit = (unsigned)m_limit;
+	if (m_probing && m_baseline)
+		limit /= PROBE_LIMIT_DIVISOR;
+	return std::max(limit, 1u);
+}
+
+// Called with m_lock held at the end of a window
+void IoDevice::Adjust()
+{
+	double mean = std::max(m_windowSum / m_windowCount, 1.0);
+	if (m_probing)
+	{
+		// The first window has nothing to compare to and runs at the
+		// initial limit
+		m_baseline = mean;
+		m_probing = false;
+		m_windows = 0;
+	}
+	else
+	{
+		m_baseline = std::min(m_baseline, mean);
+		double gradient = std::max(0.5, std::min(1.0, LATENCY_TOLERANCE * m_baseline / mean));
+		double target = gradient < 1 ? m_limit * gradient + 1 : m_limit * 2;
+		// A device that never had the limit in flight has not shown it could
+		// take more
+		if (m_windowPeak < (unsigned)m_limit)
+			target = std::min(target, m_limit);
+		m_limit = m_limit * (1 - LIMIT_SMOOTHING) + target * LIMIT_SMOOTHING;
+		m_limit = std::max(1.0, std::min(m_limit, (double)m_maxLimit));
+		m_stats.peakLimit = std::max(m_stats.peakLimit, (unsigned)m_limit);
+		m_probing = ++m_windows >= PROBE_INTERVAL_WINDOWS;
+	}
+
+	m_windowCount = 0;
+	m_windowSum = 0;
+	m_windowPeak = m_inFlight;
+}
+
+void IoDevice::GetStats(IoDeviceStats &stats)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	stats = m_stats;
+	stats.limit = (unsigned)m_limit;
+	stats.peakLimit = std::max(stats.peakLimit, stats.limit);
+	stats.meanLatencyUs = m_stats.requests ? m_latencySum / m_stats.requests / 1000 : 0;
+	stats.baselineUs = m_baseline / 1000;
+}
+
+#pragma endregion
+
+
+#pragma region ScheduledFileSystem
+
+bool ScheduledFileSystem::ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+	const std::atomic<bool> *cancel)
+{
+	if (!m_device.Acquire(cancel))
+	{
+		entries.clear();
+		return false;
+	}
+	long long start = Trace::Now();
+	bool ok = m_target.ReadDir(path, entries, self, cancel);
+	m_device.Release(Trace::Now() - start);
+	return ok;
+}
+
+bool ScheduledFileSystem::Stat(const std::wstring &path, DirEntry &entry)
+{
+	m_device.Acquire();
+	long long start = Trace::Now();
+	bool ok = m_target.Stat(path, entry);
+	m_device.Release(Trace::Now() - start);
+	return ok;
+}
+
+#pragma endregion
+
+
+#pragma region IoScheduler
+
+IoScheduler::IoScheduler(VolumeBackend &backend, FileSystem &fs, unsigned maxConcurrency, unsigned jobsPerDevice) :
+m_backend(backend),
+m_fs(fs),
+m_maxConcurrency(std::max(maxConcurrency, 1u)),
+m_jobsPerDevice(std::max(jobsPerDevice, 1u)),
+m_threads(0)
+{
+}
+
+IoScheduler::~IoScheduler()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (m_threads > 0)
+		m_cond.wait(lock);
+	for (auto it = m_devices.begin(); it != m_devices.end(); ++it)
+		delete it->second;
+}
+
+std::wstring IoScheduler::DeviceOf(const std::wstring &volname)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		auto it = m_volumeDevices.find(volname);
+		if (it != m_volumeDevices.end())
+			return it->second;
+	}
+
+	std::wstring device;
+	std::vector<std::wstring> disks;
+	if (m_backend.QueryDisks(volname.c_str(), disks))
+	{
+		// A volume spanning disks is a device of its own, as it keeps all
+		// of them busy at once
+		std::sort(disks.begin(), disks.end());
+		for (size_t i = 0; i < disks.size(); ++i)
+		{
+			if (i)
+				device += L'+';
+			device += disks[i];
+		}
+	}
+	else if (!m_backend.QueryDevice(volname.c_str(), device) || device.empty())
+		device = volname;
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_volumeDevices[volname] = device;
+	return device;
+}
+
+IoScheduler::Device &IoScheduler::Find(const std::wstring &device)
+{
+	Device *&found = m_devices[device];
+	if (!found)
+		found = new Device(device, m_fs, m_maxConcurrency);
+	return *found;
+}
+
+FileSystem &IoScheduler::FileSystemOf(const std::wstring &device)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return Find(device).fs;
+}
+
+void IoScheduler::Submit(const std::wstring &device, const Job &job)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	Device &found = Find(device);
+	found.jobs.push_back(job);
+	if (found.running < m_jobsPerDevice)
+	{
+		++found.running;
+		++m_threads;
+		std::thread(&IoScheduler::ThreadProc, this, &found).detach();
+	}
+}
+
+void IoScheduler::ThreadProc(Device *device)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (!device->jobs.empty())
+	{
+		Job job = device->jobs.front();
+		device->jobs.pop_front();
+		lock.unlock();
+		try
+		{
+			job(device->fs);
+		}
+		catch (...)
+		{
+		}
+		lock.lock();
+	}
+	--device->running;
+	--m_threads;
+	m_cond.notify_all();
+}
+
+void IoScheduler::GetStats(std::vector<IoDeviceStats> &stats)
+{
+	std::vector<Device *> devices;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		for (auto it = m_devices.begin(); it != m_devices.end(); ++it)
+			devices.push_back(it->second);
+	}
+	stats.resize(devices.size());
+	for (size_t i = 0; i < devices.size(); ++i)
+		devices[i]->io.GetStats(stats[i]);
+}
+
+static std::once_flag g_ioSchedulerOnce;
+static IoScheduler *g_ioScheduler;
+
+IoScheduler &IoScheduler::Global()
+{
+	std::call_once(g_ioSchedulerOnce, []() {
+		g_ioScheduler = new IoScheduler(SystemVolumeBackend(), SystemFileSystem());
+	});
+	return *g_ioScheduler;
+}
+
+#pragma endregion
@@ -0,0 +1,170 @@
+/****************************** Module Header ******************************\
+Module Name:  IoScheduler.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares the I/O scheduler that scans of several volumes run
+through at once. Volumes are grouped by the physical disks they are on, and
+every such device has a queue of its own for scan jobs and another for the
+directory listings of those jobs. How many listings a device has in flight
+follows the latency they see: it grows while latency stays near the lowest
+seen unloaded and shrinks as requests start queueing up in the device, so a
+spinning disk ends up with a couple, an SSD with many and a network share
+with as many as it answers in parallel.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "FileSystem.h"
+#include "VolumeBackend.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+struct IoDeviceStats
+{
+	std::wstring name;
+	unsigned limit;				// requests allowed in flight now
+	unsigned peakLimit;
+	unsigned long long requests;
+	unsigned long long waited;	// requests that queued for the limit
+	double meanLatencyUs;		// of all requests, queueing for the limit not included
+	double baselineUs;			// latency of an unloaded device, as learned
+
+	IoDeviceStats() : limit(0), peakLimit(0), requests(0), waited(0), meanLatencyUs(0), baselineUs(0) {}
+};
+
+// The requests of one device, let through in the order they come in while
+// fewer than the limit are in flight. Thread safe.
+class IoDevice
+{
+public:
+	enum { INITIAL_LIMIT = 2 };
+
+	IoDevice(const std::wstring &name, unsigned maxLimit);
+
+	// Wait for a turn to make a request, which must be followed by Release().
+	// Returns false, giving up the turn, if cancel is set meanwhile.
+	bool Acquire(const std::atomic<bool> *cancel = NULL);
+	// Finish a request that took latencyNs, and adjust the limit
+	void Release(long long latencyNs);
+
+	void GetStats(IoDeviceStats &stats);
+
+private:
+	// Requests allowed in flight now
+	unsigned Limit() const;
+	void Adjust();
+
+	std::wstring m_name;
+	unsigned m_maxLimit;
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	double m_limit;				// kept fractional so it moves smoothly
+	unsigned m_inFlight;
+	unsigned long long m_tickets;	// requests ever asked for
+	unsigned long long m_granted;	// requests ever let through
+	std::set<unsigned long long> m_abandoned;	// tickets cancelled before their turn
+	// The current window of requests
+	unsigned m_windowCount;
+	double m_windowSum;
+	unsigned m_windowPeak;		// most requests in flight
+	unsigned m_windows;			// since the last probe
+	bool m_probing;				// the window runs at a fraction of the limit
+	double m_baseline;			// ns, 0 until the first window
+	IoDeviceStats m_stats;
+	double m_latencySum;
+
+	IoDevice(const IoDevice &);
+	IoDevice &operator =(const IoDevice &);
+};
+
+// A file system whose calls are requests of device
+class ScheduledFileSystem : public FileSystem
+{
+public:
+	ScheduledFileSystem(FileSystem &target, IoDevice &device) : m_target(target), m_device(device) {}
+
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *cancel = NULL);
+	virtual bool Stat(const std::wstring &path, DirEntry &entry);
+
+private:
+	FileSystem &m_target;
+	IoDevice &m_device;
+};
+
+class IoScheduler
+{
+public:
+	// A job gets the file system to do its I/O through
+	typedef std::function<void(FileSystem &fs)> Job;
+
+	enum { DEFAULT_MAX_CONCURRENCY = 32, DEFAULT_JOBS_PER_DEVICE = 1 };
+
+	// Volumes of backend are scanned through fs. No device has more than
+	// maxConcurrency requests in flight, nor runs more than jobsPerDevice jobs
+	// at once.
+	IoScheduler(VolumeBackend &backend, FileSystem &fs, unsigned maxConcurrency = DEFAULT_MAX_CONCURRENCY,
+		unsigned jobsPerDevice = DEFAULT_JOBS_PER_DEVICE);
+	// Waits for the jobs started to return, cancel them first
+	~IoScheduler();
+
+	// The device volname is on: its disks, or where it is not on local disks
+	// its device name, so volumes of one server still share a device.
+	// Remembered per volume.
+	std::wstring DeviceOf(const std::wstring &volname);
+
+	// The file system to make requests of device through
+	FileSystem &FileSystemOf(const std::wstring &device);
+
+	// Queue job on device. Jobs of a device start in the order they were
+	// queued, each on a thread of its own.
+	void Submit(const std::wstring &device, const Job &job);
+
+	void GetStats(std::vector<IoDeviceStats> &stats);
+
+	// Scans of the running system, shared by the whole process
+	static IoScheduler &Global();
+
+private:
+	struct Device
+	{
+		IoDevice io;
+		ScheduledFileSystem fs;
+		std::deque<Job> jobs;
+		unsigned running;
+
+		Device(const std::wstring &name, FileSystem &target, unsigned maxConcurrency) :
+			io(name, maxConcurrency), fs(target, io), running(0) {}
+	};
+
+	Device &Find(const std::wstring &device);
+	void ThreadProc(Device *device);
+
+	VolumeBackend &m_backend;
+	FileSystem &m_fs;
+	unsigned m_maxConcurrency;
+	unsigned m_jobsPerDevice;
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	std::map<std::wstring, Device *> m_devices;	// never removed
+	std::map<std::wstring, std::wstring> m_volumeDevices;
+	unsigned m_threads;
+
+	IoScheduler(const IoScheduler &);
+	IoScheduler &operator =(const IoScheduler &);
+};
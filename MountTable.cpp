@@ -0,0 +1,284 @@
+/****************************** Module Header ******************************\
+Module Name:  MountTable.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of MountTable.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "MountTable.h"
+#include "MountWatcher.h"
+#include "Trace.h"
+#include "Utf8.h"
+#include <mutex>
+#include <thread>
+#include <wctype.h>
+
+MountTable::MountTable() : m_nodes(1)
+{
+}
+
+void MountTable::Split(const std::wstring &path, std::vector<std::wstring> &components)
+{
+	components.clear();
+	size_t pos = 0;
+#ifdef _WIN32
+	// Keep UNC paths (\\server\share) apart from rooted ones (\dir)
+	if (path.size() >= 2 && (path[0] == L'\\' || path[0] == L'/') && (path[1] == L'\\' || path[1] == L'/'))
+	{
+		components.push_back(L"\\\\");
+		pos = 2;
+	}
+#endif
+	while (pos < path.size())
+	{
+		size_t end = pos;
+#ifdef _WIN32
+		while (end < path.size() && path[end] != L'\\' && path[end] != L'/')
+			++end;
+#else
+		while (end < path.size() && path[end] != L'/')
+			++end;
+#endif
+		if (end > pos)
+		{
+			components.push_back(path.substr(pos, end - pos));
+#ifdef _WIN32
+			// Windows paths are case insensitive
+			std::wstring &component = components.back();
+			for (size_t i = 0; i < component.size(); ++i)
+				component[i] = towlower(component[i]);
+#endif
+		}
+		pos = end + 1;
+	}
+}
+
+void MountTable::Add(const std::wstring &path, const std::wstring &volname)
+{
+	std::vector<std::wstring> components;
+	Split(path, components);
+	unsigned node = 0;
+	for (size_t i = 0; i < components.size(); ++i)
+	{
+		std::map<std::wstring, unsigned>::iterator child = m_nodes[node].children.find(components[i]);
+		if (child == m_nodes[node].children.end())
+		{
+			unsigned index = (unsigned)m_nodes.size();
+			m_nodes[node].children[components[i]] = index;
+			m_nodes.push_back(Node());
+			node = index;
+		}
+		else
+			node = child->second;
+	}
+
+	MountPoint mount;
+	mount.path = path;
+	while (mount.path.size() > 1 && (mount.path[mount.path.size() - 1] == L'/'
+#ifdef _WIN32
+		|| mount.path[mount.path.size() - 1] == L'\\'
+#endif
+		))
+		mount.path.erase(mount.path.size() - 1);
+	mount.volname = volname;
+	if (m_nodes[node].mount >= 0)
+		m_mounts[m_nodes[node].mount] = mount;
+	else
+	{
+		m_nodes[node].mount = (int)m_mounts.size();
+		m_mounts.push_back(mount);
+	}
+}
+
+void MountTable::Clear()
+{
+	m_nodes.assign(1, Node());
+	m_mounts.clear();
+}
+
+bool MountTable::Load(VolumeBackend &backend)
+{
+	TraceSpan span("LoadMountTable");
+	std::vector<std::wstring> volnames;
+	if (!backend.EnumVolumes(volnames))
+		return false;
+	std::vector<std::wstring> paths;
+	for (size_t i = 0; i < volnames.size(); ++i)
+	{
+		if (!backend.QueryPaths(volnames[i].c_str(), paths))
+			continue;
+		for (size_t j = 0; j < paths.size(); ++j)
+			Add(paths[j], volnames[i]);
+	}
+	return true;
+}
+
+// Undo the octal escapes (e.g. \040 for a space) of a mountinfo field
+static std::wstring UnescapeMountField(const std::string &field)
+{
+	std::string bytes;
+	for (size_t i = 0; i < field.size(); ++i)
+	{
+		if (field[i] == '\\' && i + 3 < field.size() &&
+			field[i + 1] >= '0' && field[i + 1] <= '3' &&
+			field[i + 2] >= '0' && field[i + 2] <= '7' &&
+			field[i + 3] >= '0' && field[i + 3] <= '7')
+		{
+			bytes += (char)((field[i + 1] - '0') * 64 + (field[i + 2] - '0') * 8 + (field[i + 3] - '0'));
+			i += 3;
+		}
+		else
+			bytes += field[i];
+	}
+	return Utf8ToWide(bytes);
+}
+
+bool MountTable::ParseMountInfo(const std::string &text, std::vector<MountInfoEntry> &entries)
+{
+	// Fields: id, parent id, major:minor, root, mount point, options, any
+	// number of optional fields, "-", file system, source, super options
+	entries.clear();
+	bool ok = true;
+	std::vector<std::string> fields;
+	size_t pos = 0;
+	while (pos < text.size())
+	{
+		size_t eol = text.find('\n', pos);
+		if (eol == std::string::npos)
+			eol = text.size();
+		fields.clear();
+		size_t field = pos;
+		while (field < eol)
+		{
+			size_t end = text.find(' ', field);
+			if (end == std::string::npos || end > eol)
+				end = eol;
+			if (end > field)
+				fields.push_back(text.substr(field, end - field));
+			field = end + 1;
+		}
+		size_t separator = 6;
+		while (separator < fields.size() && fields[separator] != "-")
+			++separator;
+		if (separator + 2 < fields.size() && fields[4][0] == '/')
+		{
+			MountInfoEntry entry;
+			entry.path = UnescapeMountField(fields[4]);
+			entry.filesystem = UnescapeMountField(fields[separator + 1]);
+			entry.source = UnescapeMountField(fields[separator + 2]);
+			entries.push_back(entry);
+		}
+		else if (eol > pos)
+			ok = false;
+		pos = eol + 1;
+	}
+	return ok;
+}
+
+bool MountTable::LoadMountInfo(const std::string &text)
+{
+	// Mounts are listed in the order they were made, so later ones hide
+	// earlier ones at the same path
+	std::vector<MountInfoEntry> entries;
+	bool ok = ParseMountInfo(text, entries);
+	for (size_t i = 0; i < entries.size(); ++i)
+		Add(entries[i].path, entries[i].path);
+	return ok;
+}
+
+const MountPoint *MountTable::Lookup(const std::wstring &path) const
+{
+	std::vector<std::wstring> components;
+	Split(path, components);
+	unsigned node = 0;
+	int found = m_nodes[0].mount;
+	for (size_t i = 0; i < components.size(); ++i)
+	{
+		std::map<std::wstring, unsigned>::const_iterator child = m_nodes[node].children.find(components[i]);
+		if (child == m_nodes[node].children.end())
+			break;
+		node = child->second;
+		if (m_nodes[node].mount >= 0)
+			found = m_nodes[node].mount;
+	}
+	return found >= 0 ? &m_mounts[found] : NULL;
+}
+
+bool MountTable::IsMountPath(const MountPoint &mount, const std::wstring &path)
+{
+	std::vector<std::wstring> a, b;
+	Split(mount.path, a);
+	Split(path, b);
+	return a == b;
+}
+
+// The table of the running system. Never destroyed, like the other
+// process-wide state.
+static std::mutex g_mountTableLock;
+static std::shared_ptr<const MountTable> *g_mountTable;
+
+std::shared_ptr<const MountTable> MountTable::Current()
+{
+	std::lock_guard<std::mutex> lock(g_mountTableLock);
+	if (!g_mountTable)
+		g_mountTable = new std::shared_ptr<const MountTable>;
+	if (!*g_mountTable)
+	{
+		std::shared_ptr<MountTable> table = std::make_shared<MountTable>();
+		table->Load(SystemVolumeBackend());
+		*g_mountTable = table;
+	}
+	return *g_mountTable;
+}
+
+void MountTable::Invalidate()
+{
+	std::lock_guard<std::mutex> lock(g_mountTableLock);
+	if (g_mountTable)
+		g_mountTable->reset();
+}
+
+static bool g_mountMonitorStarted;
+
+bool MountTable::StartMonitor(const std::function<void()> &onChange)
+{
+	{
+		std::lock_guard<std::mutex> lock(g_mountTableLock);
+		if (g_mountMonitorStarted)
+			return false;
+		g_mountMonitorStarted = true;
+	}
+
+	// Created here so that failing to watch is reported to the caller. The
+	// thread owns it from then on and is never stopped.
+	std::unique_ptr<MountWatcher> created = CreateSystemMountWatcher();
+	if (!created)
+	{
+		std::lock_guard<std::mutex> lock(g_mountTableLock);
+		g_mountMonitorStarted = false;
+		return false;
+	}
+	MountWatcher *watcher = created.release();
+	std::thread([watcher, onChange]() {
+		bool changed;
+		while (watcher->Wait(MountWatcher::WAIT_FOREVER, changed))
+		{
+			if (!changed)
+				continue;
+			Invalidate();
+			if (onChange)
+				onChange();
+		}
+		delete watcher;
+	}).detach();
+	return true;
+}
@@ -0,0 +1,101 @@
+/****************************** Module Header ******************************\
+Module Name:  MountTable.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares MountTable, an in-memory map from mount paths (drive
+letters, mounted folders, Linux mount points) to the volumes mounted there.
+Paths are kept in a trie of path components, so the volume holding any path
+is found by a longest-prefix walk without touching the disk.
+
+The table of the running system is loaded once and shared by the whole
+process until Invalidate() is called, which StartMonitor() does whenever a
+volume is mounted or unmounted.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "VolumeBackend.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+
+// A line of /proc/self/mountinfo
+struct MountInfoEntry
+{
+	std::wstring path;			// mount point
+	std::wstring filesystem;	// e.g. "ext4"
+	std::wstring source;		// e.g. "/dev/sda1", "server:/export"
+};
+
+struct MountPoint
+{
+	std::wstring path;		// as reported, without a trailing separator
+	std::wstring volname;	// volume GUID path on Windows, mount point on Linux
+};
+
+class MountTable
+{
+public:
+	MountTable();
+
+	// Add a volume mounted at path. A later mount at the same path hides the
+	// earlier one, as it does in the system.
+	void Add(const std::wstring &path, const std::wstring &volname);
+	void Clear();
+
+	// Add the paths of all volumes of backend. Volumes whose paths cannot be
+	// queried are left out. Returns false if the volumes could not be listed.
+	bool Load(VolumeBackend &backend);
+
+	// Add the mount points listed in text, in the format of
+	// /proc/self/mountinfo. Returns false if a line could not be parsed.
+	bool LoadMountInfo(const std::string &text);
+	// Parse text in the format of /proc/self/mountinfo into entries, in the
+	// order the mounts were made. Returns false if a line could not be parsed.
+	static bool ParseMountInfo(const std::string &text, std::vector<MountInfoEntry> &entries);
+
+	// Find the mount holding path, the one with the longest path that is path
+	// or one of its ancestors. Returns NULL if there is none.
+	const MountPoint *Lookup(const std::wstring &path) const;
+
+	// Whether path is exactly the mount path of mount
+	static bool IsMountPath(const MountPoint &mount, const std::wstring &path);
+
+	size_t Size() const { return m_mounts.size(); }
+
+	// The table of the running system, loaded on first use. The table
+	// returned stays valid while it is held, even across Invalidate().
+	static std::shared_ptr<const MountTable> Current();
+	// Drop the table of the running system, so that the next Current() loads
+	// it again
+	static void Invalidate();
+	// Watch the mounts of the running system on a thread of its own for the
+	// rest of the process, calling Invalidate() and then onChange on every
+	// change. Returns false if they cannot be watched, or already are.
+	static bool StartMonitor(const std::function<void()> &onChange);
+
+private:
+	struct Node
+	{
+		std::map<std::wstring, unsigned> children;	// by folded component
+		int mount;	// index into m_mounts, -1 if nothing is mounted here
+		Node() : mount(-1) {}
+	};
+
+	// Split path into components folded for comparison
+	static void Split(const std::wstring &path, std::vector<std::wstring> &components);
+
+	std::vector<Node> m_nodes;	// m_nodes[0] is the root
+	std::vector<MountPoint> m_mounts;
+};
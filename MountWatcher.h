@@ -0,0 +1,47 @@
+/****************************** Module Header ******************************\
+Module Name:  MountWatcher.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares MountWatcher, which reports when volumes are mounted or
+unmounted (a USB disk or VHD attached, a network drive mapped etc.), so that
+the mount table and the volume caches can be dropped right then instead of
+being reloaded on a timer.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <memory>
+
+class MountWatcher
+{
+public:
+	enum { WAIT_FOREVER = 0xFFFFFFFF };
+
+	virtual ~MountWatcher() {}
+
+	// Wait up to timeoutMs for the mount table to change. changed receives
+	// whether it did. Returns false on error.
+	virtual bool Wait(unsigned timeoutMs, bool &changed) = 0;
+};
+
+// A watcher of the running system: device change broadcasts of volumes on
+// Windows, POLLPRI of /proc/self/mountinfo on Linux. Returns NULL if the
+// changes cannot be watched.
+std::unique_ptr<MountWatcher> CreateSystemMountWatcher();
+
+#ifdef __linux__
+// A watcher of another mountinfo file, e.g. /proc/<pid>/mountinfo of a
+// process in another mount namespace
+std::unique_ptr<MountWatcher> CreateMountInfoWatcher(const std::string &path);
+#endif
+
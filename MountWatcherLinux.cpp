@@ -0,0 +1,106 @@
+/****************************** Module Header ******************************\
+Module Name:  MountWatcherLinux.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The mountinfo MountWatcher. The kernel flags /proc/<pid>/mountinfo with
+POLLPRI whenever a mount or unmount changes the mount namespace of the
+process. The flag is cleared by reading the file again, which also lets
+wakeups that change nothing visible be told apart.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#ifdef __linux__
+
+#include "MountWatcher.h"
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+class MountInfoWatcher : public MountWatcher
+{
+public:
+	explicit MountInfoWatcher(int fd) : m_fd(fd)
+	{
+		ReadAll(m_text);
+	}
+
+	virtual ~MountInfoWatcher()
+	{
+		close(m_fd);
+	}
+
+	virtual bool Wait(unsigned timeoutMs, bool &changed)
+	{
+		changed = false;
+		pollfd fds;
+		fds.fd = m_fd;
+		fds.events = POLLPRI;
+		fds.revents = 0;
+		int n = poll(&fds, 1, (int)timeoutMs);
+		if (n < 0)
+			return errno == EINTR;
+		if (n == 0)
+			return true;
+		if (fds.revents & POLLNVAL)
+			return false;
+		if (!(fds.revents & (POLLPRI | POLLERR)))
+			return true;
+
+		std::string text;
+		if (!ReadAll(text))
+			return false;
+		changed = text != m_text;
+		m_text.swap(text);
+		return true;
+	}
+
+private:
+	// Read the whole file from the start, which rearms POLLPRI
+	bool ReadAll(std::string &text)
+	{
+		text.clear();
+		if (lseek(m_fd, 0, SEEK_SET) < 0)
+			return false;
+		char buf[4096];
+		for (;;)
+		{
+			ssize_t len = read(m_fd, buf, sizeof(buf));
+			if (len < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			if (len == 0)
+				return true;
+			text.append(buf, len);
+		}
+	}
+
+	int m_fd;
+	std::string m_text;	// contents as of the last change
+};
+
+std::unique_ptr<MountWatcher> CreateMountInfoWatcher(const std::string &path)
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return std::unique_ptr<MountWatcher>();
+	return std::unique_ptr<MountWatcher>(new MountInfoWatcher(fd));
+}
+
+std::unique_ptr<MountWatcher> CreateSystemMountWatcher()
+{
+	return CreateMountInfoWatcher("/proc/self/mountinfo");
+}
+
+#endif
@@ -0,0 +1,140 @@
+/****************************** Module Header ******************************\
+Module Name:  MountWatcherWin32.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The device change MountWatcher. Windows broadcasts WM_DEVICECHANGE to all
+top-level windows when a volume arrives or goes away, including network
+drives being mapped or disconnected. A hidden window on a thread of its own
+receives them. Message-only windows do not get broadcasts, so it has to be
+a real, if invisible, top-level window.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#ifdef _WIN32
+
+#include "MountWatcher.h"
+#include <windows.h>
+#include <dbt.h>
+#include <thread>
+
+static const wchar_t g_windowClass[] = L"DiskUsageTipMountWatcher";
+
+class DeviceChangeWatcher : public MountWatcher
+{
+public:
+	DeviceChangeWatcher() : m_hWnd(NULL),
+		m_hChanged(CreateEventW(NULL, FALSE, FALSE, NULL)),
+		m_hReady(CreateEventW(NULL, TRUE, FALSE, NULL))
+	{
+	}
+
+	virtual ~DeviceChangeWatcher()
+	{
+		if (m_hWnd)
+			PostMessageW(m_hWnd, WM_CLOSE, 0, 0);
+		if (m_thread.joinable())
+			m_thread.join();
+		CloseHandle(m_hChanged);
+		CloseHandle(m_hReady);
+	}
+
+	// Create the window and wait until it is ready to receive broadcasts
+	bool Start()
+	{
+		if (!m_hChanged || !m_hReady)
+			return false;
+		m_thread = std::thread(&DeviceChangeWatcher::ThreadProc, this);
+		WaitForSingleObject(m_hReady, INFINITE);
+		return m_hWnd != NULL;
+	}
+
+	virtual bool Wait(unsigned timeoutMs, bool &changed)
+	{
+		DWORD ret = WaitForSingleObject(m_hChanged, timeoutMs);
+		changed = ret == WAIT_OBJECT_0;
+		return ret != WAIT_FAILED;
+	}
+
+private:
+	void ThreadProc()
+	{
+		// The module this code is in, not the process
+		HMODULE hModule = NULL;
+		GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+			reinterpret_cast<LPCWSTR>(&g_windowClass), &hModule);
+
+		WNDCLASSEXW wc = { sizeof(wc) };
+		wc.lpfnWndProc = WndProc;
+		wc.hInstance = hModule;
+		wc.lpszClassName = g_windowClass;
+		if (!RegisterClassExW(&wc) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS)
+		{
+			SetEvent(m_hReady);
+			return;
+		}
+		HWND hWnd = CreateWindowExW(WS_EX_TOOLWINDOW, g_windowClass, L"", WS_POPUP,
+			0, 0, 0, 0, NULL, NULL, hModule, this);
+		m_hWnd = hWnd;
+		SetEvent(m_hReady);
+		if (!hWnd)
+			return;
+
+		MSG msg;
+		while (GetMessageW(&msg, NULL, 0, 0) > 0)
+		{
+			TranslateMessage(&msg);
+			DispatchMessageW(&msg);
+		}
+	}
+
+	static LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+	{
+		switch (uMsg)
+		{
+		case WM_NCCREATE:
+			SetWindowLongPtrW(hWnd, GWLP_USERDATA,
+				(LONG_PTR)reinterpret_cast<CREATESTRUCTW *>(lParam)->lpCreateParams);
+			break;
+		case WM_DEVICECHANGE:
+			if (wParam == DBT_DEVICEARRIVAL || wParam == DBT_DEVICEREMOVECOMPLETE)
+			{
+				const DEV_BROADCAST_HDR *hdr = reinterpret_cast<const DEV_BROADCAST_HDR *>(lParam);
+				DeviceChangeWatcher *self = reinterpret_cast<DeviceChangeWatcher *>(
+					GetWindowLongPtrW(hWnd, GWLP_USERDATA));
+				if (hdr && hdr->dbch_devicetype == DBT_DEVTYP_VOLUME && self)
+					SetEvent(self->m_hChanged);
+			}
+			return TRUE;
+		case WM_CLOSE:
+			DestroyWindow(hWnd);
+			return 0;
+		case WM_DESTROY:
+			PostQuitMessage(0);
+			return 0;
+		}
+		return DefWindowProcW(hWnd, uMsg, wParam, lParam);
+	}
+
+	HWND m_hWnd;
+	HANDLE m_hChanged;	// auto-reset, set on every volume arrival or removal
+	HANDLE m_hReady;
+	std::thread m_thread;
+};
+
+std::unique_ptr<MountWatcher> CreateSystemMountWatcher()
+{
+	std::unique_ptr<DeviceChangeWatcher> watcher(new DeviceChangeWatcher);
+	if (!watcher->Start())
+		return std::unique_ptr<MountWatcher>();
+	return std::move(watcher);
+}
+
+#endif
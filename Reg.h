@@ -1,119 +1,132 @@
-/****************************** Module Header ******************************\
-Module Name:  Reg.h
-Project:      DiskUsageTip
-Copyright (c) Microsoft Corporation.
-
-The file declares reusable helper functions to register and unregister
-in-process COM components and shell context menu handlers in the registry.
-
-RegisterInprocServer - register the in-process component in the registry.
-UnregisterInprocServer - unregister the in-process component in the registry.
-RegisterShellExtContextMenuHandler - register the context menu handler.
-UnregisterShellExtContextMenuHandler - unregister the context menu handler.
-
-This source is subject to the Microsoft Public License.
-See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
-All other rights reserved.
-
-THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
-EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
-WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
-\***************************************************************************/
-
-#pragma once
-
-#include <windows.h>
-
-
-//
-//   FUNCTION: RegisterInprocServer
-//
-//   PURPOSE: Register the in-process component in the registry.
-//
-//   PARAMETERS:
-//   * pszModule - Path of the module that contains the component
-//   * clsid - Class ID of the component
-//   * pszFriendlyName - Friendly name
-//   * pszThreadModel - Threading model
-//
-//   NOTE: The function creates the HKCR\CLSID\{<CLSID>} key in the registry.
-// 
-//   HKCR
-//   {
-//      NoRemove CLSID
-//      {
-//          ForceRemove {<CLSID>} = s '<Friendly Name>'
-//          {
-//              InprocServer32 = s '%MODULE%'
-//              {
-//                  val ThreadingModel = s '<Thread Model>'
-//              }
-//          }
-//      }
-//   }
-//
-HRESULT RegisterInprocServer(PCWSTR pszModule, const CLSID& clsid,
-	PCWSTR pszFriendlyName, PCWSTR pszThreadModel);
-
-
-//
-//   FUNCTION: UnregisterInprocServer
-//
-//   PURPOSE: Unegister the in-process component in the registry.
-//
-//   PARAMETERS:
-//   * clsid - Class ID of the component
-//
-//   NOTE: The function deletes the HKCR\CLSID\{<CLSID>} key in the registry.
-//
-HRESULT UnregisterInprocServer(const CLSID& clsid);
-
-
-//
-//   FUNCTION: RegisterShellExtContextMenuHandler
-//
-//   PURPOSE: Register the context menu handler.
-//
-//   PARAMETERS:
-//   * pszFileType - The file type that the context menu handler is 
-//     associated with. For example, '*' means all file types; '.txt' means 
-//     all .txt files. The parameter must not be NULL.
-//   * clsid - Class ID of the component
-//   * pszFriendlyName - Friendly name
-//
-//   NOTE: The function creates the following key in the registry.
-//
-//   HKCR
-//   {
-//      NoRemove <File Type>
-//      {
-//          NoRemove shellex
-//          {
-//              NoRemove ContextMenuHandlers
-//              {
-//                  {<CLSID>} = s '<Friendly Name>'
-//              }
-//          }
-//      }
-//   }
-//
-HRESULT RegisterShellExtContextMenuHandler(
-	PCWSTR pszFileType, const CLSID& clsid, PCWSTR pszFriendlyName);
-
-
-//
-//   FUNCTION: UnregisterShellExtContextMenuHandler
-//
-//   PURPOSE: Unregister the context menu handler.
-//
-//   PARAMETERS:
-//   * pszFileType - The file type that the context menu handler is 
-//     associated with. For example, '*' means all file types; '.txt' means 
-//     all .txt files. The parameter must not be NULL.
-//   * clsid - Class ID of the component
-//
-//   NOTE: The function removes the {<CLSID>} key under 
-//   HKCR\<File Type>\shellex\ContextMenuHandlers in the registry.
-//
-HRESULT UnregisterShellExtContextMenuHandler(
-	PCWSTR pszFileType, const CLSID& clsid);
\ No newline at end of file
+/****************************** Module Header ******************************\
+Module Name:  Reg.h
+Project:      DiskUsageTip
+Copyright (c) Microsoft Corporation.
+
+The file declares reusable helper functions to register and unregister
+in-process COM components and shell context menu handlers in the registry.
+
+RegisterInprocServer - register the in-process component in the registry.
+UnregisterInprocServer - unregister the in-process component in the registry.
+RegisterShellExtContextMenuHandler - register the context menu handler.
+UnregisterShellExtContextMenuHandler - unregister the context menu handler.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <windows.h>
+
+
+//
+//   FUNCTION: RegisterInprocServer
+//
+//   PURPOSE: Register the in-process component in the registry.
+//
+//   PARAMETERS:
+//   * pszModule - Path of the module that contains the component
+//   * clsid - Class ID of the component
+//   * pszFriendlyName - Friendly name
+//   * pszThreadModel - Threading model
+//
+//   NOTE: The function creates the HKCR\CLSID\{<CLSID>} key in the registry.
+// 
+//   HKCR
+//   {
+//      NoRemove CLSID
+//      {
+//          ForceRemove {<CLSID>} = s '<Friendly Name>'
+//          {
+//              InprocServer32 = s '%MODULE%'
+//              {
+//                  val ThreadingModel = s '<Thread Model>'
+//              }
+//          }
+//      }
+//   }
+//
+HRESULT RegisterInprocServer(PCWSTR pszModule, const CLSID& clsid,
+	PCWSTR pszFriendlyName, PCWSTR pszThreadModel);
+
+
+//
+//   FUNCTION: UnregisterInprocServer
+//
+//   PURPOSE: Unegister the in-process component in the registry.
+//
+//   PARAMETERS:
+//   * clsid - Class ID of the component
+//
+//   NOTE: The function deletes the HKCR\CLSID\{<CLSID>} key in the registry.
+//
+HRESULT UnregisterInprocServer(const CLSID& clsid);
+
+
+//
+//   FUNCTION: RegisterShellExtContextMenuHandler
+//
+//   PURPOSE: Register the context menu handler.
+//
+//   PARAMETERS:
+//   * pszFileType - The file type that the context menu handler is 
+//     associated with. For example, '*' means all file types; '.txt' means 
+//     all .txt files. The parameter must not be NULL.
+//   * clsid - Class ID of the component
+//   * pszFriendlyName - Friendly name
+//
+//   NOTE: The function creates the following key in the registry.
+//
+//   HKCR
+//   {
+//      NoRemove <File Type>
+//      {
+//          NoRemove shellex
+//          {
+//              NoRemove ContextMenuHandlers
+//              {
+//                  {<CLSID>} = s '<Friendly Name>'
+//              }
+//          }
+//      }
+//   }
+//
+HRESULT RegisterShellExtContextMenuHandler(
+	PCWSTR pszFileType, const CLSID& clsid, PCWSTR pszFriendlyName);
+
+
+//
+//   FUNCTION: UnregisterShellExtContextMenuHandler
+//
+//   PURPOSE: Unregister the context menu handler.
+//
+//   PARAMETERS:
+//   * pszFileType - The file type that the context menu handler is 
+//     associated with. For example, '*' means all file types; '.txt' means 
+//     all .txt files. The parameter must not be NULL.
+//   * clsid - Class ID of the component
+//
+//   NOTE: The function removes the {<CLSID>} key under 
+//   HKCR\<File Type>\shellex\ContextMenuHandlers in the registry.
+//
+HRESULT UnregisterShellExtContextMenuHandler(
+	PCWSTR pszFileType, const CLSID& clsid);
+
+//
+//   FUNCTION: GetSettingDword
+//
+//   PURPOSE: Read a DWORD setting of the extension.
+//
+//   PARAMETERS:
+//   * pszValueName - Name of the setting
+//   * dwDefault - Value returned if the setting is absent or not a DWORD
+//
+//   NOTE: Settings are read from the HKCU\Software\DiskUsageTip key.
+//
+DWORD GetSettingDword(PCWSTR pszValueName, DWORD dwDefault);
@@ -0,0 +1,680 @@
+/****************************** Module Header ******************************\
+Module Name:  ReportWriter.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of ReportBuffer and the report emitters.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "ReportWriter.h"
+#include <string.h>
+#include <wchar.h>
+
+#pragma region ReportBuffer
+
+ReportBuffer::ReportBuffer(size_t capacity) : m_buf(capacity + 1), m_length(0)
+{
+	m_buf[0] = 0;
+}
+
+void ReportBuffer::Grow(size_t extra)
+{
+	// Grow by half at least, so that appending stays amortized constant
+	size_t size = m_buf.size() + m_buf.size() / 2;
+	if (size < m_length + extra + 1)
+		size = m_length + extra + 1;
+	m_buf.resize(size);
+}
+
+void ReportBuffer::Append(const wchar_t *str, size_t len)
+{
+	if (m_length + len >= m_buf.size())
+		Grow(len);
+	memcpy(&m_buf[m_length], str, len * sizeof(wchar_t));
+	m_length += len;
+	m_buf[m_length] = 0;
+}
+
+void ReportBuffer::Append(const wchar_t *str)
+{
+	Append(str, wcslen(str));
+}
+
+void ReportBuffer::AppendUInt(unsigned long long value)
+{
+	wchar_t digits[20];
+	size_t count = 0;
+	do
+	{
+		digits[sizeof(digits) / sizeof(digits[0]) - ++count] = (wchar_t)(L'0' + value % 10);
+		value /= 10;
+	} while (value);
+	Append(digits + sizeof(digits) / sizeof(digits[0]) - count, count);
+}
+
+void ReportBuffer::AppendFixed(double value, unsigned decimals)
+{
+	if (value != value)
+	{
+		Append(L"nan", 3);
+		return;
+	}
+	if (value < 0)
+	{
+		Append(L'-');
+		value = -value;
+	}
+	unsigned long long scale = 1;
+	for (unsigned i = 0; i < decimals; ++i)
+		scale *= 10;
+	// Beyond this, scaling would overflow. Such values are not reported.
+	if (value >= 1e18 / scale)
+	{
+		Append(L"inf", 3);
+		return;
+	}
+	unsigned long long scaled = (unsigned long long)(value * scale + 0.5);
+	AppendUInt(scaled / scale);
+	if (!decimals)
+		return;
+	Append(L'.');
+	unsigned long long fraction = scaled % scale;
+	for (unsigned long long digit = scale / 10; digit; digit /= 10)
+	{
+		Append((wchar_t)(L'0' + fraction / digit));
+		fraction %= digit;
+	}
+}
+
+void ReportBuffer::AppendSize(unsigned long long bytes)
+{
+	static const wchar_t suffix[] = { 0, L'K', L'M', L'G', L'T', L'P', L'E', L'Z', L'Y' };
+	size_t idx = 0;
+	double dsize = (double)bytes;
+	for (idx = 0; idx < sizeof(suffix) / sizeof(suffix[0]) - 1; ++idx)
+	{
+		if (dsize >= 1024)
+			dsize /= 1024;
+		else
+			break;
+	}
+	AppendFixed(dsize, 2);
+	Append(L' ');
+	if (suffix[idx])
+		Append(suffix[idx]);
+	Append(L'B');
+}
+
+#pragma endregion
+
+
+static const wchar_t *g_typeNames[] = { L"UNKNOWN", L"ERROR", L"RemovableMedia", L"FixedMedia", L"Remote", L"CDROM", L"RAM-disk" };
+static const wchar_t *g_typeKeys[] = { L"unknown", L"no_root_dir", L"removable", L"fixed", L"remote", L"cdrom", L"ramdisk" };
+static const wchar_t *g_statusKeys[] = { L"ok", L"failed", L"pending", L"backoff" };
+
+static const wchar_t *TypeKey(VolumeType type)
+{
+	return (unsigned)type < sizeof(g_typeKeys) / sizeof(g_typeKeys[0]) ? g_typeKeys[type] : g_typeKeys[0];
+}
+
+#pragma region TextReportEmitter
+
+void TextReportEmitter::Begin()
+{
+	m_out.Clear();
+}
+
+void TextReportEmitter::Space(const VolumeSpace &space)
+{
+	unsigned long long fs = space.freeClusters;
+	unsigned long long ts = space.totalClusters;
+	m_out.Append(L"\x2003", 1);
+	m_out.AppendSize(space.TotalBytes());
+	m_out.Append(L"\x3000", 1);
+	m_out.AppendUInt(space.TotalBytes());
+	m_out.Append(L"\n\x2003\x2003\x2003" L"Free:\x2000\x3000", 11);
+	m_out.AppendFixed(ts ? (double)fs / ts * 100 : 0, 2);
+	m_out.Append(L"%\x3000", 2);
+	m_out.AppendSize(space.FreeBytes());
+	m_out.Append(L"\x3000", 1);
+	m_out.AppendUInt(space.FreeBytes());
+	m_out.Append(L"\n\x2003\x2003\x2003" L"Used:\x3000", 10);
+	m_out.AppendFixed(ts ? (double)(ts - fs) / ts * 100 : 0, 2);
+	m_out.Append(L"%\x3000", 2);
+	m_out.AppendSize(space.UsedBytes());
+	m_out.Append(L"\x3000", 1);
+	m_out.AppendUInt(space.UsedBytes());
+	m_out.Append(L'\n');
+}
+
+void TextReportEmitter::Volume(const VolumeRecord &record, bool selected, const VolumeSpace *space)
+{
+	if (record.status == VolumeQuery::QUERY_FAILED)
+		return;
+	if (record.status != VolumeQuery::QUERY_OK)
+	{
+		// Slow or unreachable volume, with its last known free space
+		m_out.Append(L"\x2001 ", 2);
+		m_out.Append(record.volname);
+		m_out.Append(record.status == VolumeQuery::QUERY_PENDING ? L" (pending)\n" : L" (unreachable)\n");
+		if (space)
+			Space(*space);
+		return;
+	}
+
+	VolumeType type = record.type;
+	if (type == VOLUME_REMOVABLE || type == VOLUME_CDROM || type == VOLUME_FIXED || type == VOLUME_REMOTE || type == VOLUME_RAMDISK)
+	{
+		// Show a '>' for current selected volume
+		m_out.Append(selected ? L"-> " : L"\x2001 ");
+
+		// volume label, or just the type for removable media and CD-ROMs
+		m_out.Append(VolumeRecord::WantInformation(type) ? record.label.c_str() : g_typeNames[type]);
+		m_out.Append(L' ');
+
+		// volume drive letters / mounted paths
+		m_out.Append(L'(');
+		for (auto i = record.paths.begin(); i != record.paths.end(); ++i)
+		{
+			if (i != record.paths.begin())
+				m_out.Append(L'\x2000');
+			m_out.Append(*i);
+		}
+		m_out.Append(L") ", 2);
+
+		// file system
+		if (VolumeRecord::WantInformation(type))
+		{
+			m_out.Append(L'(');
+			m_out.Append(type == VOLUME_FIXED ? record.filesystem.c_str() : g_typeNames[type]);
+			m_out.Append(L") ", 2);
+		}
+
+		// sizes
+		if (space)
+			Space(*space);
+		else
+			m_out.Append(L'\n');
+	}
+
+	if (m_verbose)
+	{
+		m_out.Append(L"\x2003\x2003\x2003" L"Device Name: ");
+		m_out.Append(record.device);
+		m_out.Append(L"\n\x2003\x2003\x2003" L"Volume name: ");
+		m_out.Append(record.volname);
+		m_out.Append(L'\n');
+	}
+}
+
+void TextReportEmitter::Items(const wchar_t *title, const std::vector<ScanItem> &items)
+{
+	if (items.empty())
+		return;
+	m_out.Append(L'\x2003');
+	m_out.Append(title);
+	m_out.Append(L'\n');
+	for (auto i = items.begin(); i != items.end(); ++i)
+	{
+		m_out.Append(L"\x2003\x2003\x2003", 3);
+		m_out.AppendSize(i->bytes);
+		m_out.Append(L'\x3000');
+		m_out.Append(i->path);
+		m_out.Append(L'\n');
+	}
+}
+
+void TextReportEmitter::Folder(const std::wstring &path, const ScanTotals *totals,
+	const std::vector<ScanItem> &topDirs, const std::vector<ScanItem> &topFiles)
+{
+	m_out.Append(L'\n');
+	m_out.Append(path);
+	m_out.Append(L'\x3000');
+	if (!totals)
+	{
+		m_out.Append(L"(scanning)\n");
+		return;
+	}
+	m_out.AppendSize(totals->bytes);
+	m_out.Append(L" in ", 4);
+	m_out.AppendUInt(totals->files);
+	m_out.Append(L" files, ", 8);
+	m_out.AppendUInt(totals->dirs);
+	m_out.Append(L" folders\n", 9);
+	// Sparse and compressed files take less than their size, small ones
+	// more as they are rounded up to whole clusters
+	m_out.Append(L"\x2003On disk: ");
+	m_out.AppendSize(totals->allocated);
+	m_out.Append(L" (", 2);
+	m_out.AppendFixed(totals->AllocationRatio() * 100, 2);
+	m_out.Append(L"% of size)\n");
+	Items(L"Largest folders:", topDirs);
+	Items(L"Largest files:", topFiles);
+}
+
+void TextReportEmitter::Estimate(const std::wstring &path, const SizeEstimate &estimate)
+{
+	if (estimate.exact)
+	{
+		std::vector<ScanItem> none;
+		Folder(path, &estimate.totals, none, none);
+		return;
+	}
+	m_out.Append(L'\n');
+	m_out.Append(path);
+	m_out.Append(L'\x3000');
+	m_out.Append(L"about ", 6);
+	m_out.AppendSize(estimate.totals.bytes);
+	m_out.Append(L" (+/- ", 6);
+	m_out.AppendSize(estimate.error.bytes);
+	m_out.Append(L") in ", 5);
+	m_out.AppendUInt(estimate.totals.files);
+	m_out.Append(L" files, ", 8);
+	m_out.AppendUInt(estimate.totals.dirs);
+	m_out.Append(L" folders (scanning)\n");
+}
+
+void TextReportEmitter::Progress(const std::wstring &path, const ScanProgress &progress)
+{
+	m_out.Append(L'\n');
+	m_out.Append(path);
+	m_out.Append(L'\x3000');
+	m_out.AppendSize(progress.totals.bytes);
+	m_out.Append(L" so far in ", 11);
+	m_out.AppendUInt(progress.totals.files);
+	m_out.Append(L" files, ", 8);
+	m_out.AppendUInt(progress.totals.dirs);
+	m_out.Append(L" folders (scanning, ", 20);
+	m_out.AppendFixed(progress.Done() * 100, 0);
+	m_out.Append(L"% of the folders found)\n");
+	Items(L"Largest folders:", progress.topDirs);
+	Items(L"Largest files:", progress.topFiles);
+}
+
+void TextReportEmitter::End()
+{
+	m_out.TrimLast(L'\n');
+}
+
+#pragma endregion
+
+
+#pragma region JsonReportEmitter
+
+void JsonReportEmitter::String(const std::wstring &str)
+{
+	static const wchar_t hex[] = L"0123456789abcdef";
+	m_out.Append(L'"');
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		wchar_t c = str[i];
+		if (c == L'"' || c == L'\\')
+		{
+			m_out.Append(L'\\');
+			m_out.Append(c);
+		}
+		else if ((unsigned)c < 0x20)
+		{
+			wchar_t escape[] = { L'\\', L'u', L'0', L'0', hex[(c >> 4) & 0xF], hex[c & 0xF] };
+			m_out.Append(escape, 6);
+		}
+		else
+			m_out.Append(c);
+	}
+	m_out.Append(L'"');
+}
+
+void JsonReportEmitter::Begin()
+{
+	m_out.Clear();
+	m_volumes = 0;
+	m_folder = false;
+	if (!m_lines)
+		m_out.Append(L"{\"volumes\":[");
+}
+
+void JsonReportEmitter::Volume(const VolumeRecord &record, bool selected, const VolumeSpace *space)
+{
+	if (m_lines)
+		m_out.Append(L"{\"kind\":\"volume\",\"volname\":");
+	else
+	{
+		if (m_volumes++)
+			m_out.Append(L',');
+		m_out.Append(L"{\"volname\":");
+	}
+	String(record.volname);
+	m_out.Append(L",\"status\":\"");
+	m_out.Append(g_statusKeys[record.status]);
+	m_out.Append(L"\",\"selected\":");
+	m_out.Append(selected ? L"true" : L"false");
+	if (record.status == VolumeQuery::QUERY_OK)
+	{
+		m_out.Append(L",\"device\":");
+		String(record.device);
+		m_out.Append(L",\"type\":\"");
+		m_out.Append(TypeKey(record.type));
+		m_out.Append(L"\",\"paths\":[");
+		for (auto i = record.paths.begin(); i != record.paths.end(); ++i)
+		{
+			if (i != record.paths.begin())
+				m_out.Append(L',');
+			String(*i);
+		}
+		m_out.Append(L']');
+		if (record.hasInformation)
+		{
+			m_out.Append(L",\"label\":");
+			String(record.label);
+			m_out.Append(L",\"filesystem\":");
+			String(record.filesystem);
+		}
+	}
+	if (space)
+	{
+		m_out.Append(L",\"total\":");
+		m_out.AppendUInt(space->TotalBytes());
+		m_out.Append(L",\"free\":");
+		m_out.AppendUInt(space->FreeBytes());
+		m_out.Append(L",\"used\":");
+		m_out.AppendUInt(space->UsedBytes());
+	}
+	m_out.Append(L'}');
+	if (m_lines)
+		m_out.Append(L'\n');
+}
+
+void JsonReportEmitter::Items(const std::vector<ScanItem> &items)
+{
+	m_out.Append(L'[');
+	for (auto i = items.begin(); i != items.end(); ++i)
+	{
+		if (i != items.begin())
+			m_out.Append(L',');
+		m_out.Append(L"{\"path\":");
+		String(i->path);
+		m_out.Append(L",\"bytes\":");
+		m_out.AppendUInt(i->bytes);
+		m_out.Append(L'}');
+	}
+	m_out.Append(L']');
+}
+
+void JsonReportEmitter::Folder(const std::wstring &path, const ScanTotals *totals,
+	const std::vector<ScanItem> &topDirs, const std::vector<ScanItem> &topFiles)
+{
+	if (m_lines)
+		m_out.Append(L"{\"kind\":\"folder\",\"path\":");
+	else
+		m_out.Append(m_folder ? L",\"folder\":{\"path\":" : L"],\"folder\":{\"path\":");
+	String(path);
+	m_out.Append(L",\"scanning\":");
+	m_out.Append(totals ? L"false" : L"true");
+	if (totals)
+	{
+		m_out.Append(L",\"bytes\":");
+		m_out.AppendUInt(totals->bytes);
+		m_out.Append(L",\"allocated\":");
+		m_out.AppendUInt(totals->allocated);
+		m_out.Append(L",\"files\":");
+		m_out.AppendUInt(totals->files);
+		m_out.Append(L",\"dirs\":");
+		m_out.AppendUInt(totals->dirs);
+		m_out.Append(L",\"errors\":");
+		m_out.AppendUInt(totals->errors);
+		m_out.Append(L",\"largestDirs\":");
+		Items(topDirs);
+		m_out.Append(L",\"largestFiles\":");
+		Items(topFiles);
+	}
+	m_out.Append(L'}');
+	if (m_lines)
+		m_out.Append(L'\n');
+	m_folder = true;
+}
+
+void JsonReportEmitter::Estimate(const std::wstring &path, const SizeEstimate &estimate)
+{
+	if (m_lines)
+		m_out.Append(L"{\"kind\":\"estimate\",\"path\":");
+	else
+		m_out.Append(m_folder ? L",\"estimate\":{\"path\":" : L"],\"estimate\":{\"path\":");
+	String(path);
+	m_out.Append(L",\"exact\":");
+	m_out.Append(estimate.exact ? L"true" : L"false");
+	m_out.Append(L",\"bytes\":");
+	m_out.AppendUInt(estimate.totals.bytes);
+	m_out.Append(L",\"bytesError\":");
+	m_out.AppendUInt(estimate.error.bytes);
+	m_out.Append(L",\"allocated\":");
+	m_out.AppendUInt(estimate.totals.allocated);
+	m_out.Append(L",\"allocatedError\":");
+	m_out.AppendUInt(estimate.error.allocated);
+	m_out.Append(L",\"files\":");
+	m_out.AppendUInt(estimate.totals.files);
+	m_out.Append(L",\"filesError\":");
+	m_out.AppendUInt(estimate.error.files);
+	m_out.Append(L",\"dirs\":");
+	m_out.AppendUInt(estimate.totals.dirs);
+	m_out.Append(L",\"dirsError\":");
+	m_out.AppendUInt(estimate.error.dirs);
+	m_out.Append(L",\"walks\":");
+	m_out.AppendUInt(estimate.walks);
+	m_out.Append(L",\"listed\":");
+	m_out.AppendUInt(estimate.listed);
+	m_out.Append(L'}');
+	if (m_lines)
+		m_out.Append(L'\n');
+	m_folder = true;
+}
+
+void JsonReportEmitter::Progress(const std::wstring &path, const ScanProgress &progress)
+{
+	if (!m_lines)
+		return;
+	m_out.Append(L"{\"kind\":\"progress\",\"path\":");
+	String(path);
+	m_out.Append(L",\"bytes\":");
+	m_out.AppendUInt(progress.totals.bytes);
+	m_out.Append(L",\"allocated\":");
+	m_out.AppendUInt(progress.totals.allocated);
+	m_out.Append(L",\"files\":");
+	m_out.AppendUInt(progress.totals.files);
+	m_out.Append(L",\"dirs\":");
+	m_out.AppendUInt(progress.totals.dirs);
+	m_out.Append(L",\"errors\":");
+	m_out.AppendUInt(progress.totals.errors);
+	m_out.Append(L",\"dirsFound\":");
+	m_out.AppendUInt(progress.dirsFound);
+	m_out.Append(L",\"dirsDone\":");
+	m_out.AppendUInt(progress.dirsDone);
+	m_out.Append(L",\"done\":");
+	m_out.AppendFixed(progress.Done(), 4);
+	m_out.Append(L",\"seconds\":");
+	m_out.AppendFixed(progress.seconds, 3);
+	m_out.Append(L",\"largestDirs\":");
+	Items(progress.topDirs);
+	m_out.Append(L",\"largestFiles\":");
+	Items(progress.topFiles);
+	m_out.Append(L"}\n");
+}
+
+void JsonReportEmitter::End()
+{
+	// The volume array is closed by Folder() or Estimate(), if there was one
+	if (!m_lines)
+		m_out.Append(m_folder ? L"}\n" : L"]}\n");
+}
+
+#pragma endregion
+
+
+#pragma region CsvReportEmitter
+
+void CsvReportEmitter::Field(const wchar_t *str)
+{
+	// Quote only fields that need it
+	if (!wcspbrk(str, L",\"\r\n"))
+	{
+		m_out.Append(str);
+		return;
+	}
+	m_out.Append(L'"');
+	for (; *str; ++str)
+	{
+		if (*str == L'"')
+			m_out.Append(L'"');
+		m_out.Append(*str);
+	}
+	m_out.Append(L'"');
+}
+
+void CsvReportEmitter::Field(const std::wstring &str)
+{
+	Field(str.c_str());
+}
+
+void CsvReportEmitter::Begin()
+{
+	m_out.Clear();
+	m_out.Append(L"kind,path,volume,selected,status,type,label,filesystem,bytes,free,allocated,files,dirs,margin,done\r\n");
+}
+
+void CsvReportEmitter::Volume(const VolumeRecord &record, bool selected, const VolumeSpace *space)
+{
+	bool ok = record.status == VolumeQuery::QUERY_OK;
+	m_out.Append(L"volume,", 7);
+	// All paths in one field, separated by semicolons
+	if (ok && !record.paths.empty())
+	{
+		bool quote = false;
+		for (auto i = record.paths.begin(); i != record.paths.end() && !quote; ++i)
+			quote = wcspbrk(i->c_str(), L",\"\r\n;") != NULL;
+		if (quote)
+			m_out.Append(L'"');
+		for (auto i = record.paths.begin(); i != record.paths.end(); ++i)
+		{
+			if (i != record.paths.begin())
+				m_out.Append(L';');
+			for (const wchar_t *c = i->c_str(); *c; ++c)
+			{
+				if (*c == L'"')
+					m_out.Append(L'"');
+				m_out.Append(*c);
+			}
+		}
+		if (quote)
+			m_out.Append(L'"');
+	}
+	m_out.Append(L',');
+	Field(record.volname);
+	m_out.Append(selected ? L",1," : L",0,", 3);
+	m_out.Append(g_statusKeys[record.status]);
+	m_out.Append(L',');
+	if (ok)
+	{
+		m_out.Append(TypeKey(record.type));
+		m_out.Append(L',');
+		if (record.hasInformation)
+			Field(record.label);
+		m_out.Append(L',');
+		if (record.hasInformation)
+			Field(record.filesystem);
+	}
+	else
+		m_out.Append(L",,", 2);
+	m_out.Append(L',');
+	if (space)
+	{
+		m_out.AppendUInt(space->TotalBytes());
+		m_out.Append(L',');
+		m_out.AppendUInt(space->FreeBytes());
+	}
+	else
+		m_out.Append(L',');
+	m_out.Append(L",,,,,\r\n", 7);
+}
+
+void CsvReportEmitter::Folder(const std::wstring &path, const ScanTotals *totals,
+	const std::vector<ScanItem> &topDirs, const std::vector<ScanItem> &topFiles)
+{
+	m_out.Append(L"folder,", 7);
+	Field(path);
+	m_out.Append(L",,,");
+	m_out.Append(totals ? L"ok" : L"scanning");
+	m_out.Append(L",,,,");
+	if (totals)
+	{
+		m_out.AppendUInt(totals->bytes);
+		m_out.Append(L",,", 2);
+		m_out.AppendUInt(totals->allocated);
+		m_out.Append(L',');
+		m_out.AppendUInt(totals->files);
+		m_out.Append(L',');
+		m_out.AppendUInt(totals->dirs);
+	}
+	else
+		m_out.Append(L",,,,", 4);
+	m_out.Append(L",,\r\n", 4);
+
+	const std::vector<ScanItem> *lists[] = { &topDirs, &topFiles };
+	const wchar_t *kinds[] = { L"dir,", L"file," };
+	for (size_t l = 0; l < 2; ++l)
+	{
+		for (auto i = lists[l]->begin(); i != lists[l]->end(); ++i)
+		{
+			m_out.Append(kinds[l]);
+			Field(i->path);
+			m_out.Append(L",,,ok,,,,");
+			m_out.AppendUInt(i->bytes);
+			m_out.Append(L",,,,,,\r\n", 8);
+		}
+	}
+}
+
+void CsvReportEmitter::Estimate(const std::wstring &path, const SizeEstimate &estimate)
+{
+	m_out.Append(L"estimate,", 9);
+	Field(path);
+	m_out.Append(L",,,");
+	m_out.Append(estimate.exact ? L"exact" : L"estimate");
+	m_out.Append(L",,,,");
+	m_out.AppendUInt(estimate.totals.bytes);
+	m_out.Append(L",,", 2);
+	m_out.AppendUInt(estimate.totals.allocated);
+	m_out.Append(L',');
+	m_out.AppendUInt(estimate.totals.files);
+	m_out.Append(L',');
+	m_out.AppendUInt(estimate.totals.dirs);
+	m_out.Append(L',');
+	m_out.AppendUInt(estimate.error.bytes);
+	m_out.Append(L",\r\n", 3);
+}
+
+void CsvReportEmitter::Progress(const std::wstring &path, const ScanProgress &progress)
+{
+	// The largest items so far are left to the folder report
+	m_out.Append(L"progress,", 9);
+	Field(path);
+	m_out.Append(L",,,scanning,,,,");
+	m_out.AppendUInt(progress.totals.bytes);
+	m_out.Append(L",,", 2);
+	m_out.AppendUInt(progress.totals.allocated);
+	m_out.Append(L',');
+	m_out.AppendUInt(progress.totals.files);
+	m_out.Append(L',');
+	m_out.AppendUInt(progress.totals.dirs);
+	m_out.Append(L",,", 2);
+	m_out.AppendFixed(progress.Done(), 4);
+	m_out.Append(L"\r\n", 2);
+}
+
+#pragma endregion
@@ -0,0 +1,172 @@
+/****************************** Module Header ******************************\
+Module Name:  ReportWriter.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares the report renderer, which turns volume records and folder
+reports into text for the detail view or into JSON or CSV for other tools.
+
+Output goes into a ReportBuffer owned by the caller. Numbers are formatted
+by hand straight into it and the buffer keeps its storage across renders,
+so a warmed-up buffer renders without any heap allocation.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "VolumeList.h"
+#include "FolderScanner.h"
+#include "SizeEstimator.h"
+#include <string>
+#include <vector>
+
+// A growable, always terminated wide character buffer. Clear() keeps the
+// storage, so a buffer reused for the next render does not allocate again.
+class ReportBuffer
+{
+public:
+	explicit ReportBuffer(size_t capacity = 4096);
+
+	void Clear() { m_length = 0; m_buf[0] = 0; }
+	const wchar_t *c_str() const { return &m_buf[0]; }
+	size_t Length() const { return m_length; }
+	size_t Capacity() const { return m_buf.size() - 1; }
+
+	void Append(wchar_t c)
+	{
+		if (m_length + 1 >= m_buf.size())
+			Grow(1);
+		m_buf[m_length++] = c;
+		m_buf[m_length] = 0;
+	}
+	void Append(const wchar_t *str, size_t len);
+	void Append(const wchar_t *str);
+	void Append(const std::wstring &str) { Append(str.c_str(), str.size()); }
+
+	// Decimal integer
+	void AppendUInt(unsigned long long value);
+	// value with decimals digits after the point, rounded half up, like
+	// "%0.2f" for decimals 2
+	void AppendFixed(double value, unsigned decimals);
+	// Human readable size, like "1.50 GB", in powers of 1024
+	void AppendSize(unsigned long long bytes);
+
+	// Drop the last character if it is c
+	void TrimLast(wchar_t c)
+	{
+		if (m_length && m_buf[m_length - 1] == c)
+			m_buf[--m_length] = 0;
+	}
+
+private:
+	void Grow(size_t extra);
+
+	std::vector<wchar_t> m_buf;
+	size_t m_length;
+};
+
+// Receives the parts of a report in order: Begin(), the volumes, the folder
+// report or estimate if any, End(). Progress records may come before the
+// folder report they lead up to.
+class ReportEmitter
+{
+public:
+	virtual ~ReportEmitter() {}
+
+	virtual void Begin() = 0;
+	// A volume. selected tells whether the selection is on it. space is the
+	// free space to show, which for volumes that did not answer may be the
+	// last known one, NULL if there is none.
+	virtual void Volume(const VolumeRecord &record, bool selected, const VolumeSpace *space) = 0;
+	// A folder and what takes up its space. totals is NULL while it is
+	// still being scanned.
+	virtual void Folder(const std::wstring &path, const ScanTotals *totals,
+		const std::vector<ScanItem> &topDirs, const std::vector<ScanItem> &topFiles) = 0;
+	// An estimate of a folder not scanned yet
+	virtual void Estimate(const std::wstring &path, const SizeEstimate &estimate) = 0;
+	// What the scan of a folder has found so far
+	virtual void Progress(const std::wstring &path, const ScanProgress &progress) = 0;
+	virtual void End() = 0;
+};
+
+// The detail view text
+class TextReportEmitter : public ReportEmitter
+{
+public:
+	TextReportEmitter(ReportBuffer &out, bool verbose = false) : m_out(out), m_verbose(verbose) {}
+
+	virtual void Begin();
+	virtual void Volume(const VolumeRecord &record, bool selected, const VolumeSpace *space);
+	virtual void Folder(const std::wstring &path, const ScanTotals *totals,
+		const std::vector<ScanItem> &topDirs, const std::vector<ScanItem> &topFiles);
+	virtual void Estimate(const std::wstring &path, const SizeEstimate &estimate);
+	virtual void Progress(const std::wstring &path, const ScanProgress &progress);
+	virtual void End();
+
+private:
+	void Space(const VolumeSpace &space);
+	void Items(const wchar_t *title, const std::vector<ScanItem> &items);
+
+	ReportBuffer &m_out;
+	bool m_verbose;
+};
+
+// A single JSON object: {"volumes": [...], "estimate": {...}, "folder": {...}}.
+// With lines it is JSON lines instead, one object per volume, estimate and
+// folder, told apart by their "kind" member, so that each can be written out
+// as soon as it is rendered. Progress is written as JSON lines only, as the
+// single object holds just how things ended.
+class JsonReportEmitter : public ReportEmitter
+{
+public:
+	explicit JsonReportEmitter(ReportBuffer &out, bool lines = false) :
+		m_out(out), m_lines(lines), m_volumes(0), m_folder(false) {}
+
+	virtual void Begin();
+	virtual void Volume(const VolumeRecord &record, bool selected, const VolumeSpace *space);
+	virtual void Folder(const std::wstring &path, const ScanTotals *totals,
+		const std::vector<ScanItem> &topDirs, const std::vector<ScanItem> &topFiles);
+	virtual void Estimate(const std::wstring &path, const SizeEstimate &estimate);
+	virtual void Progress(const std::wstring &path, const ScanProgress &progress);
+	virtual void End();
+
+private:
+	void String(const std::wstring &str);
+	void Items(const std::vector<ScanItem> &items);
+
+	ReportBuffer &m_out;
+	bool m_lines;
+	unsigned m_volumes;
+	bool m_folder;	// the volume array is closed
+};
+
+// RFC 4180 CSV with a header line. Every volume, estimate and item of a
+// folder report is a row, told apart by the kind column. The margin column
+// is that of the bytes of an estimate, the done column the share of the
+// folders found that a progress row has scanned.
+class CsvReportEmitter : public ReportEmitter
+{
+public:
+	explicit CsvReportEmitter(ReportBuffer &out) : m_out(out) {}
+
+	virtual void Begin();
+	virtual void Volume(const VolumeRecord &record, bool selected, const VolumeSpace *space);
+	virtual void Folder(const std::wstring &path, const ScanTotals *totals,
+		const std::vector<ScanItem> &topDirs, const std::vector<ScanItem> &topFiles);
+	virtual void Estimate(const std::wstring &path, const SizeEstimate &estimate);
+	virtual void Progress(const std::wstring &path, const ScanProgress &progress);
+	virtual void End() {}
+
+private:
+	void Field(const std::wstring &str);
+	void Field(const wchar_t *str);
+
+	ReportBuffer &m_out;
+};
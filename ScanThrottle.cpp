@@ -0,0 +1,198 @@
+/****************************** Module Header ******************************\
+Module Name:  ScanThrottle.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of the scan throttle. A request takes its token even when
+the bucket is empty, leaving it in debt, and sleeps until the refill pays
+that back, so waiting requests are let through in order at exactly the rate
+without polling. A listing only knows how many requests it was once done,
+so it is let through on one token and takes those of its entries after,
+which the next request pays back. The rate is adjusted once per window of
+releases, halved when their median latency per request is over twice the
+baseline and otherwise raised
+by a sixteenth of the configured rate. The median, unlike the mean, is not
+thrown by the odd read missing the cache, and latency under a fifth of a
+millisecond over the baseline is taken for noise whatever the ratio, as
+directories in memory are listed in microseconds.
+
+The baseline is the lowest median of a window, forgotten after 64 windows
+so that a volume that got slower for good, or a workload that never lets
+up, does not keep the scan at its slowest forever.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "ScanThrottle.h"
+#include "Trace.h"
+#include <algorithm>
+#include <thread>
+
+#define WINDOW_REQUESTS 16
+// Latency over this many times the baseline, and over it by at least
+// BACKOFF_MIN_NS, backs the rate off
+#define BACKOFF_LATENCY 2.0
+#define BACKOFF_MIN_NS 200000
+// The rate never goes below the configured one over this
+#define MIN_RATE_DIVISOR 16
+#define RECOVERY_DIVISOR 16
+#define BASELINE_WINDOWS 64
+// Time waited for a token between looks at the cancel flag
+#define CANCEL_CHECK_US 1000
+
+#pragma region ScanThrottle
+
+ScanThrottle::ScanThrottle(unsigned rate, unsigned burst) :
+m_maxRate(std::max(rate, 1u)),
+m_burst(burst ? burst : std::max(m_maxRate / 10, 1.0)),
+m_rate(m_maxRate),
+m_tokens(m_burst),
+m_throttledSeconds(0),
+m_baseline(0),
+m_baselineAge(0),
+m_released(0),
+m_latencySum(0)
+{
+	m_window.reserve(WINDOW_REQUESTS);
+}
+
+bool ScanThrottle::Acquire(const std::atomic<bool> *cancel)
+{
+	Clock::time_point now = Clock::now(), ready;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if (!m_stats.requests++)
+		{
+			m_start = now;
+			m_refilled = now;
+			m_throttledUntil = now;
+		}
+		double elapsed = std::chrono::duration<double>(now - m_refilled).count();
+		m_tokens = std::min(m_burst, m_tokens + elapsed * m_rate) - 1;
+		m_refilled = now;
+		if (m_tokens >= 0)
+			return true;
+
+		ready = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-m_tokens / m_rate));
+		// The time throttled is that covered by the waits of any request,
+		// counted once however many wait at the same time
+		if (ready > m_throttledUntil)
+		{
+			m_throttledSeconds += std::chrono::duration<double>(ready - std::max(now, m_throttledUntil)).count();
+			m_throttledUntil = ready;
+		}
+	}
+	TraceSpan span("Throttle");
+	if (!cancel)
+	{
+		std::this_thread::sleep_until(ready);
+		return true;
+	}
+	while (Clock::now() < ready)
+	{
+		if (*cancel)
+		{
+			// The waits queued behind this one stay as they are
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_tokens += 1;
+			return false;
+		}
+		std::this_thread::sleep_until(std::min(ready, Clock::now() + std::chrono::microseconds(CANCEL_CHECK_US)));
+	}
+	return true;
+}
+
+void ScanThrottle::Release(long long latencyNs, unsigned requests)
+{
+	requests = std::max(requests, 1u);
+	std::lock_guard<std::mutex> lock(m_lock);
+	if (requests > 1)
+	{
+		// Refilled up to now first, so that the burst cap does not swallow
+		// the debt
+		Clock::time_point now = Clock::now();
+		double elapsed = std::chrono::duration<double>(now - m_refilled).count();
+		m_tokens = std::min(m_burst, m_tokens + elapsed * m_rate) - (requests - 1);
+		m_refilled = now;
+		m_stats.requests += requests - 1;
+	}
+	m_released += requests;
+	m_lastReleased = Clock::now();
+	m_latencySum += (double)latencyNs;
+	m_window.push_back((double)latencyNs / requests);
+	if (m_window.size() >= WINDOW_REQUESTS)
+		Adjust();
+}
+
+void ScanThrottle::Adjust()
+{
+	std::nth_element(m_window.begin(), m_window.begin() + m_window.size() / 2, m_window.end());
+	double median = std::max(m_window[m_window.size() / 2], 1.0);
+	m_window.clear();
+	if (!m_baseline || median < m_baseline || ++m_baselineAge >= BASELINE_WINDOWS)
+	{
+		m_baseline = median;
+		m_baselineAge = 0;
+	}
+
+	// The tokens already owed were taken at the old rate and are paid back
+	// at the new one, so a backoff also delays the requests waiting now
+	if (median > BACKOFF_LATENCY * m_baseline && median - m_baseline > BACKOFF_MIN_NS)
+	{
+		m_rate = std::max(m_rate / 2, m_maxRate / MIN_RATE_DIVISOR);
+		++m_stats.backoffs;
+	}
+	else
+		m_rate = std::min(m_rate + m_maxRate / RECOVERY_DIVISOR, m_maxRate);
+}
+
+void ScanThrottle::GetStats(ScanThrottleStats &stats)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	stats = m_stats;
+	stats.seconds = m_released ? std::chrono::duration<double>(m_lastReleased - m_start).count() : 0;
+	stats.requestsPerSecond = stats.seconds > 0 ? stats.requests / stats.seconds : 0;
+	// Not counting the waits still ahead
+	stats.throttledSeconds = m_throttledSeconds;
+	if (stats.requests && m_throttledUntil > Clock::now())
+		stats.throttledSeconds -= std::chrono::duration<double>(m_throttledUntil - Clock::now()).count();
+	stats.rate = m_rate;
+	stats.meanLatencyUs = m_released ? m_latencySum / m_released / 1000 : 0;
+	stats.baselineUs = m_baseline / 1000;
+}
+
+#pragma endregion
+
+
+#pragma region ThrottledFileSystem
+
+bool ThrottledFileSystem::ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+	const std::atomic<bool> *cancel)
+{
+	if (!m_throttle.Acquire(cancel))
+	{
+		entries.clear();
+		return false;
+	}
+	long long start = Trace::Now();
+	bool ok = m_target.ReadDir(path, entries, self, cancel);
+	m_throttle.Release(Trace::Now() - start, 1 + (unsigned)entries.size());
+	return ok;
+}
+
+bool ThrottledFileSystem::Stat(const std::wstring &path, DirEntry &entry)
+{
+	m_throttle.Acquire();
+	long long start = Trace::Now();
+	bool ok = m_target.Stat(path, entry);
+	m_throttle.Release(Trace::Now() - start);
+	return ok;
+}
+
+#pragma endregion
@@ -0,0 +1,107 @@
+/****************************** Module Header ******************************\
+Module Name:  ScanThrottle.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares ScanThrottle, which keeps a scan from taking the I/O of a
+busy volume away from the programs working on it. Directory listings and
+stats take tokens from a bucket refilled at a fixed rate, and the rate is
+halved whenever their latency rises well above what the volume does when
+left alone, which is the sign of other work queueing behind the scan. It
+comes back up step by step while latency stays low.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "FileSystem.h"
+#include <mutex>
+#include <chrono>
+#include <vector>
+
+struct ScanThrottleStats
+{
+	unsigned long long requests;
+	double seconds;				// from the first request to the last one done
+	double requestsPerSecond;	// the effective rate, requests over seconds
+	double throttledSeconds;	// of seconds, those with requests waiting for tokens
+	double rate;				// requests per second allowed now
+	unsigned backoffs;			// times the rate was halved
+	double meanLatencyUs;		// per request, waiting for tokens not included
+	double baselineUs;			// median latency per request of the volume left alone, as learned
+
+	ScanThrottleStats() : requests(0), seconds(0), requestsPerSecond(0), throttledSeconds(0), rate(0),
+		backoffs(0), meanLatencyUs(0), baselineUs(0) {}
+};
+
+// Thread safe
+class ScanThrottle
+{
+public:
+	enum { DEFAULT_RATE = 500 };
+
+	// At most rate requests per second, in bursts of up to burst requests,
+	// 0 for a tenth of a second's worth
+	explicit ScanThrottle(unsigned rate = DEFAULT_RATE, unsigned burst = 0);
+
+	// Wait for a token to make a request, which must be followed by Release().
+	// Returns false, with the token given back, if cancel is set meanwhile.
+	bool Acquire(const std::atomic<bool> *cancel = NULL);
+	// Finish a request that took latencyNs, and back off if it was slow. A
+	// request that turned out to be requests of them, e.g. a listing that
+	// stat'ed each entry, takes the tokens of the others without waiting,
+	// which the next Acquire() waits for, and its latency is judged per
+	// request.
+	void Release(long long latencyNs, unsigned requests = 1);
+
+	void GetStats(ScanThrottleStats &stats);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// Called with m_lock held at the end of a window
+	void Adjust();
+
+	double m_maxRate;
+	double m_burst;
+	std::mutex m_lock;
+	double m_rate;
+	double m_tokens;			// below 0 while requests wait for the tokens they took
+	Clock::time_point m_refilled;
+	Clock::time_point m_start;
+	Clock::time_point m_lastReleased;
+	Clock::time_point m_throttledUntil;	// when the last waiting request gets its token
+	double m_throttledSeconds;
+	std::vector<double> m_window;	// latencies per request of the current window of releases, ns
+	double m_baseline;			// ns, 0 until the first window
+	unsigned m_baselineAge;		// windows since it was last set
+	ScanThrottleStats m_stats;
+	unsigned long long m_released;
+	double m_latencySum;
+
+	ScanThrottle(const ScanThrottle &);
+	ScanThrottle &operator =(const ScanThrottle &);
+};
+
+// A file system whose calls are paced by throttle. A listing is a request
+// for the directory and one for each entry, as each is stat'ed on Linux.
+class ThrottledFileSystem : public FileSystem
+{
+public:
+	ThrottledFileSystem(FileSystem &target, ScanThrottle &throttle) : m_target(target), m_throttle(throttle) {}
+
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *cancel = NULL);
+	virtual bool Stat(const std::wstring &path, DirEntry &entry);
+
+private:
+	FileSystem &m_target;
+	ScanThrottle &m_throttle;
+};
@@ -0,0 +1,211 @@
+/****************************** Module Header ******************************\
+Module Name:  ScanTree.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of NameArena and ScanTree.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "ScanTree.h"
+#include "Utf8.h"
+#include <string.h>
+
+#pragma region NameArena
+
+// 32-bit FNV-1a
+static uint32_t HashName(const unsigned char *p, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; ++i)
+	{
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+NameArena::NameArena() :
+m_used(BLOCK_SIZE),
+m_count(0)
+{
+}
+
+NameArena::~NameArena()
+{
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+		delete[] m_blocks[i];
+}
+
+const unsigned char *NameArena::At(uint32_t id) const
+{
+	return m_blocks[id / BLOCK_SIZE] + id % BLOCK_SIZE;
+}
+
+uint32_t NameArena::Append(const std::string &utf8)
+{
+	size_t need = 2 + utf8.size();
+	if (m_used + need > BLOCK_SIZE)
+	{
+		m_blocks.push_back(new unsigned char[BLOCK_SIZE]);
+		m_used = 0;
+	}
+	uint32_t id = (uint32_t)((m_blocks.size() - 1) * BLOCK_SIZE + m_used);
+	unsigned char *p = m_blocks.back() + m_used;
+	p[0] = (unsigned char)(utf8.size() & 0xff);
+	p[1] = (unsigned char)(utf8.size() >> 8);
+	memcpy(p + 2, utf8.data(), utf8.size());
+	m_used += need;
+	return id;
+}
+
+void NameArena::Grow()
+{
+	std::vector<uint32_t> table(m_table.empty() ? 1024 : m_table.size() * 2, 0);
+	size_t mask = table.size() - 1;
+	for (size_t i = 0; i < m_table.size(); ++i)
+	{
+		if (!m_table[i])
+			continue;
+		const unsigned char *p = At(m_table[i] - 1);
+		size_t slot = HashName(p + 2, p[0] | (p[1] << 8)) & mask;
+		while (table[slot])
+			slot = (slot + 1) & mask;
+		table[slot] = m_table[i];
+	}
+	m_table.swap(table);
+}
+
+uint32_t NameArena::Intern(const std::wstring &name)
+{
+	m_buffer.clear();
+	AppendUtf8(m_buffer, name.c_str(), name.size());
+	if (m_buffer.size() > MAX_NAME)
+		m_buffer.resize(MAX_NAME);
+
+	// At most half full
+	if ((m_count + 1) * 2 > m_table.size())
+		Grow();
+	size_t mask = m_table.size() - 1;
+	size_t slot = HashName((const unsigned char *)m_buffer.data(), m_buffer.size()) & mask;
+	for (; m_table[slot]; slot = (slot + 1) & mask)
+	{
+		const unsigned char *p = At(m_table[slot] - 1);
+		size_t len = p[0] | (p[1] << 8);
+		if (len == m_buffer.size() && memcmp(p + 2, m_buffer.data(), len) == 0)
+			return m_table[slot] - 1;
+	}
+	uint32_t id = Append(m_buffer);
+	m_table[slot] = id + 1;
+	++m_count;
+	return id;
+}
+
+std::wstring NameArena::Name(uint32_t id) const
+{
+	const unsigned char *p = At(id);
+	std::wstring name;
+	AppendWide(name, (const char *)p + 2, p[0] | (p[1] << 8));
+	return name;
+}
+
+void NameArena::Clear()
+{
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+		delete[] m_blocks[i];
+	std::vector<unsigned char *>().swap(m_blocks);
+	std::vector<uint32_t>().swap(m_table);
+	m_used = BLOCK_SIZE;
+	m_count = 0;
+}
+
+#pragma endregion
+
+
+#pragma region ScanTree
+
+void ScanTree::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_rootPath.clear();
+	m_parent.Clear();
+	m_firstChild.Clear();
+	m_childCount.Clear();
+	m_name.Clear();
+	m_bytes.Clear();
+	m_mtime.Clear();
+	m_flags.Clear();
+	m_names.Clear();
+}
+
+ScanTree::Index ScanTree::Add(Index parent, uint32_t name, bool isDir, bool isLink, uint64_t bytes, uint64_t mtime)
+{
+	Index i = (Index)m_parent.Size();
+	m_parent.Push(parent);
+	m_firstChild.Push(NO_INDEX);
+	m_childCount.Push(0);
+	m_name.Push(name);
+	m_bytes.Push(bytes);
+	m_mtime.Push(mtime);
+	m_flags.Push((uint8_t)((isDir ? FLAG_DIR : 0) | (isLink ? FLAG_LINK : 0)));
+	return i;
+}
+
+ScanTree::Index ScanTree::SetRoot(const std::wstring &path)
+{
+	Clear();
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_rootPath = path;
+	return Add(NO_INDEX, ROOT_NAME, true, false, 0, 0);
+}
+
+ScanTree::Index ScanTree::AddChildren(Index parent, const std::vector<DirEntry> &entries)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	Index first = (Index)m_parent.Size();
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		const DirEntry &entry = entries[i];
+		Add(parent, m_names.Intern(entry.name), entry.isDir, entry.isLink, entry.size, entry.mtime);
+	}
+	m_firstChild[parent] = entries.empty() ? NO_INDEX : first;
+	m_childCount[parent] = (uint32_t)entries.size();
+	return first;
+}
+
+void ScanTree::SetBytes(Index i, uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_bytes[i] = bytes;
+}
+
+std::wstring ScanTree::Name(Index i) const
+{
+	return i == 0 ? m_rootPath : m_names.Name(m_name[i]);
+}
+
+std::wstring ScanTree::Path(Index i) const
+{
+	std::vector<Index> chain;
+	for (; i != 0 && i != NO_INDEX; i = m_parent[i])
+		chain.push_back(i);
+	std::wstring path = m_rootPath;
+	for (size_t k = chain.size(); k-- > 0; )
+		path = JoinPath(path, m_names.Name(m_name[chain[k]]));
+	return path;
+}
+
+size_t ScanTree::EntryBytes() const
+{
+	return m_parent.MemoryBytes() + m_firstChild.MemoryBytes() + m_childCount.MemoryBytes() +
+		m_name.MemoryBytes() + m_bytes.MemoryBytes() + m_mtime.MemoryBytes() + m_flags.MemoryBytes();
+}
+
+#pragma endregion
@@ -0,0 +1,169 @@
+/****************************** Module Header ******************************\
+Module Name:  ScanTree.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares ScanTree, the complete result of a folder scan, every file
+and directory with its size, time and place in the tree. Large volumes have
+tens of millions of entries, so the tree is stored as a struct of arrays:
+one column per field, each allocated in fixed chunks, and names interned in
+a bump-pointer arena as UTF-8. The children of a directory are added in one
+go and are contiguous, so a first child index and a count link them up.
+An entry costs 33 bytes plus its share of the (interned) names.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "FileSystem.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+
+// An array growing in chunks of 1 << CHUNK_BITS elements, so that growing
+// never copies and wastes at most one chunk
+template <typename T, unsigned CHUNK_BITS = 12>
+class ChunkedArray
+{
+public:
+	enum { CHUNK_SIZE = 1 << CHUNK_BITS };
+
+	ChunkedArray() : m_size(0) {}
+	~ChunkedArray() { Clear(); }
+
+	size_t Size() const { return m_size; }
+	size_t MemoryBytes() const { return m_chunks.size() * CHUNK_SIZE * sizeof(T) + m_chunks.capacity() * sizeof(T *); }
+
+	T &operator [](size_t i) { return m_chunks[i >> CHUNK_BITS][i & (CHUNK_SIZE - 1)]; }
+	const T &operator [](size_t i) const { return m_chunks[i >> CHUNK_BITS][i & (CHUNK_SIZE - 1)]; }
+
+	void Push(const T &value)
+	{
+		if ((m_size & (CHUNK_SIZE - 1)) == 0 && (m_size >> CHUNK_BITS) == m_chunks.size())
+			m_chunks.push_back(new T[CHUNK_SIZE]);
+		(*this)[m_size++] = value;
+	}
+
+	void Clear()
+	{
+		for (size_t i = 0; i < m_chunks.size(); ++i)
+			delete[] m_chunks[i];
+		m_chunks.clear();
+		m_size = 0;
+	}
+
+private:
+	std::vector<T *> m_chunks;
+	size_t m_size;
+
+	ChunkedArray(const ChunkedArray &);
+	ChunkedArray &operator =(const ChunkedArray &);
+};
+
+// Names stored once each, as a 16-bit length and UTF-8 bytes, in an arena
+// of fixed blocks. A name is identified by its offset in the arena.
+class NameArena
+{
+public:
+	NameArena();
+	~NameArena();
+
+	// Id of name, adding it if it is new. Names longer than MAX_NAME bytes
+	// of UTF-8 are cut, which file systems never need.
+	uint32_t Intern(const std::wstring &name);
+	std::wstring Name(uint32_t id) const;
+
+	// Drop all names and free their memory
+	void Clear();
+
+	// Distinct names stored
+	size_t Count() const { return m_count; }
+	// Memory of the arena blocks and of the intern table
+	size_t ArenaBytes() const { return m_blocks.size() * BLOCK_SIZE; }
+	size_t TableBytes() const { return m_table.capacity() * sizeof(uint32_t); }
+
+	enum { BLOCK_SIZE = 64 * 1024 };
+	// A name and its length prefix fill a block at most
+	enum { MAX_NAME = BLOCK_SIZE - 2 };
+
+private:
+
+	const unsigned char *At(uint32_t id) const;
+	uint32_t Append(const std::string &utf8);
+	void Grow();
+
+	std::vector<unsigned char *> m_blocks;
+	size_t m_used;			// bytes used in the last block
+	std::vector<uint32_t> m_table;	// open addressing, id + 1, 0 is empty
+	size_t m_count;
+	std::string m_buffer;	// reused UTF-8 conversion
+
+	NameArena(const NameArena &);
+	NameArena &operator =(const NameArena &);
+};
+
+class ScanTree
+{
+public:
+	typedef uint32_t Index;
+	enum { NO_INDEX = 0xffffffff };
+
+	ScanTree() {}
+
+	void Clear();
+
+	// Start the tree with its root directory, which gets index 0
+	Index SetRoot(const std::wstring &path);
+
+	// Add the entries of directory parent as its children. Returns the index
+	// of the first one, the others follow in order. Thread safe.
+	Index AddChildren(Index parent, const std::vector<DirEntry> &entries);
+
+	// Set the recursive size of a directory. Thread safe.
+	void SetBytes(Index i, uint64_t bytes);
+
+	size_t Size() const { return m_parent.Size(); }
+	Index Parent(Index i) const { return m_parent[i]; }
+	Index FirstChild(Index i) const { return m_firstChild[i]; }
+	uint32_t ChildCount(Index i) const { return m_childCount[i]; }
+	uint64_t Bytes(Index i) const { return m_bytes[i]; }
+	uint64_t Mtime(Index i) const { return m_mtime[i]; }
+	bool IsDir(Index i) const { return (m_flags[i] & FLAG_DIR) != 0; }
+	bool IsLink(Index i) const { return (m_flags[i] & FLAG_LINK) != 0; }
+	std::wstring Name(Index i) const;
+	std::wstring Path(Index i) const;
+
+	// Memory of the entry columns, and of the names
+	size_t EntryBytes() const;
+	size_t NameBytes() const { return m_names.ArenaBytes() + m_names.TableBytes(); }
+	size_t NameCount() const { return m_names.Count(); }
+
+private:
+	enum { FLAG_DIR = 1, FLAG_LINK = 2 };
+	// Name id of the root, whose name is m_rootPath
+	enum { ROOT_NAME = 0xffffffff };
+
+	Index Add(Index parent, uint32_t name, bool isDir, bool isLink, uint64_t bytes, uint64_t mtime);
+
+	std::mutex m_lock;
+	std::wstring m_rootPath;
+	ChunkedArray<Index> m_parent;
+	ChunkedArray<Index> m_firstChild;
+	ChunkedArray<uint32_t> m_childCount;
+	ChunkedArray<uint32_t> m_name;
+	ChunkedArray<uint64_t> m_bytes;
+	ChunkedArray<uint64_t> m_mtime;
+	ChunkedArray<uint8_t> m_flags;
+	NameArena m_names;
+
+	ScanTree(const ScanTree &);
+	ScanTree &operator =(const ScanTree &);
+};
@@ -0,0 +1,216 @@
+/****************************** Module Header ******************************\
+Module Name:  SimulatedFileSystem.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of SimulatedFileSystem.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "SimulatedFileSystem.h"
+#include <thread>
+#include <chrono>
+#include <stdio.h>
+#include <wchar.h>
+#include <iterator>
+#include <algorithm>
+
+// Simulated listing time between looks at the cancel flag
+#define CANCEL_CHECK_US 1000
+
+SimulatedFileSystem::SimulatedFileSystem(unsigned depth, unsigned fanout, unsigned filesPerDir,
+	unsigned listDelayUs, unsigned statDelayUs) :
+m_depth(depth),
+m_fanout(fanout),
+m_filesPerDir(filesPerDir),
+m_listDelayUs(listDelayUs),
+m_statDelayUs(statDelayUs),
+m_clock(1),
+m_readDirCalls(0),
+m_statCalls(0)
+{
+	Generate(Root(), 0);
+}
+
+std::wstring SimulatedFileSystem::Root()
+{
+#ifdef _WIN32
+	return L"S:\\Simulated";
+#else
+	return L"/simulated";
+#endif
+}
+
+void SimulatedFileSystem::Generate(const std::wstring &path, unsigned level)
+{
+	Directory &dir = m_dirs[path];
+	dir.mtime = m_clock;
+	wchar_t name[32];
+	for (unsigned i = 0; i < m_filesPerDir; ++i)
+	{
+		swprintf(name, sizeof(name) / sizeof(name[0]), L"file%u", i);
+		// Sizes spread over a few orders of magnitude
+		dir.files[name] = (unsigned long long)((m_dirs.size() * 2654435761u + i * 40503u) % 1000) << (i % 20);
+	}
+	if (level >= m_depth)
+		return;
+	for (unsigned i = 0; i < m_fanout; ++i)
+	{
+		swprintf(name, sizeof(name) / sizeof(name[0]), L"dir%u", i);
+		dir.subdirs.push_back(name);
+	}
+	for (unsigned i = 0; i < m_fanout; ++i)
+		Generate(JoinPath(path, dir.subdirs[i]), level + 1);
+}
+
+unsigned SimulatedFileSystem::Mutate(double fraction, unsigned seed)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	unsigned count = (unsigned)(m_dirs.size() * fraction + 0.5);
+	unsigned long long state = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		std::map<std::wstring, Directory>::iterator it = m_dirs.begin();
+		std::advance(it, (size_t)((state >> 33) % m_dirs.size()));
+		Directory &dir = it->second;
+		++m_clock;
+		if (i % 2 == 0 || dir.files.empty())
+		{
+			wchar_t name[32];
+			swprintf(name, sizeof(name) / sizeof(name[0]), L"added%llu", m_clock);
+			dir.files[name] = 4096;
+			dir.mtime = m_clock;
+		}
+		else
+			dir.files.begin()->second += 4096;
+	}
+	return count;
+}
+
+size_t SimulatedFileSystem::Directories()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_dirs.size();
+}
+
+void SimulatedFileSystem::ResetCounters()
+{
+	m_readDirCalls = 0;
+	m_statCalls = 0;
+}
+
+bool SimulatedFileSystem::ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+	const std::atomic<bool> *cancel)
+{
+	++m_readDirCalls;
+	entries.clear();
+	std::unique_lock<std::mutex> lock(m_lock);
+	std::map<std::wstring, Directory>::const_iterator it = m_dirs.find(path);
+	if (it == m_dirs.end())
+		return false;
+	const Directory &dir = it->second;
+	if (self)
+		Fill(dir, *self);
+	unsigned long long delayUs = m_listDelayUs + (unsigned long long)m_statDelayUs * dir.files.size();
+	// No hard links, so no identities either
+	DirEntry entry;
+	entry.isLink = false;
+	entry.isDir = false;
+	entry.device = 0;
+	entry.fileId = 0;
+	entry.links = 0;
+	for (std::map<std::wstring, unsigned long long>::const_iterator f = dir.files.begin(); f != dir.files.end(); ++f)
+	{
+		entry.name = f->first;
+		entry.size = f->second;
+		entry.allocated = Allocated(f->second);
+		entry.mtime = m_clock;
+		entries.push_back(entry);
+	}
+	entry.isDir = true;
+	entry.size = 0;
+	entry.allocated = 0;
+	for (size_t i = 0; i < dir.subdirs.size(); ++i)
+	{
+		entry.name = dir.subdirs[i];
+		entry.mtime = m_dirs.find(JoinPath(path, entry.name))->second.mtime;
+		entries.push_back(entry);
+	}
+	lock.unlock();
+	if (!cancel)
+	{
+		if (delayUs)
+			std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+		return true;
+	}
+	// Slow listings give up part way, as real ones do between entries
+	for (;;)
+	{
+		if (*cancel)
+			return false;
+		if (!delayUs)
+			return true;
+		unsigned long long slice = std::min<unsigned long long>(delayUs, CANCEL_CHECK_US);
+		std::this_thread::sleep_for(std::chrono::microseconds(slice));
+		delayUs -= slice;
+	}
+}
+
+// Whole 4 KB clusters
+unsigned long long SimulatedFileSystem::Allocated(unsigned long long size)
+{
+	return (size + 4095) / 4096 * 4096;
+}
+
+void SimulatedFileSystem::Fill(const Directory &dir, DirEntry &entry)
+{
+	entry.isDir = true;
+	entry.isLink = false;
+	entry.size = 0;
+	entry.allocated = 0;
+	entry.mtime = dir.mtime;
+	entry.device = 0;
+	entry.fileId = 0;
+	entry.links = 0;
+}
+
+bool SimulatedFileSystem::Stat(const std::wstring &path, DirEntry &entry)
+{
+	++m_statCalls;
+	if (m_statDelayUs)
+		std::this_thread::sleep_for(std::chrono::microseconds(m_statDelayUs));
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	entry.isLink = false;
+	entry.device = 0;
+	entry.fileId = 0;
+	entry.links = 0;
+	std::map<std::wstring, Directory>::const_iterator it = m_dirs.find(path);
+	if (it != m_dirs.end())
+	{
+		Fill(it->second, entry);
+		return true;
+	}
+	size_t sep = path.rfind(PATH_SEPARATOR);
+	if (sep == std::wstring::npos)
+		return false;
+	it = m_dirs.find(path.substr(0, sep));
+	if (it == m_dirs.end())
+		return false;
+	std::map<std::wstring, unsigned long long>::const_iterator f = it->second.files.find(path.substr(sep + 1));
+	if (f == it->second.files.end())
+		return false;
+	entry.isDir = false;
+	entry.size = f->second;
+	entry.allocated = Allocated(f->second);
+	entry.mtime = m_clock;
+	return true;
+}
@@ -0,0 +1,75 @@
+/****************************** Module Header ******************************\
+Module Name:  SimulatedFileSystem.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares SimulatedFileSystem, a FileSystem serving a generated
+directory tree from memory with a configurable delay per listing and per
+stat. The tree can be changed in place, so that rescans of a large, slow
+volume can be measured without one.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "FileSystem.h"
+#include <map>
+#include <mutex>
+#include <atomic>
+
+class SimulatedFileSystem : public FileSystem
+{
+public:
+	// A tree depth levels deep below Root(), with fanout subdirectories and
+	// filesPerDir files in every directory. Stat() sleeps statDelayUs
+	// microseconds, ReadDir() listDelayUs plus statDelayUs per entry, as
+	// listings that stat every file do.
+	SimulatedFileSystem(unsigned depth, unsigned fanout, unsigned filesPerDir,
+		unsigned listDelayUs = 0, unsigned statDelayUs = 0);
+
+	static std::wstring Root();
+
+	// Change the tree in about fraction of its directories: add a file to
+	// some, which changes the directory's time, and grow a file in place in
+	// others, which does not. Returns the number of directories changed.
+	unsigned Mutate(double fraction, unsigned seed);
+
+	size_t Directories();
+	unsigned long long ReadDirCalls() const { return m_readDirCalls; }
+	unsigned long long StatCalls() const { return m_statCalls; }
+	void ResetCounters();
+
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *cancel = NULL);
+	virtual bool Stat(const std::wstring &path, DirEntry &entry);
+
+private:
+	struct Directory
+	{
+		unsigned long long mtime;
+		std::map<std::wstring, unsigned long long> files;	// name -> size
+		std::vector<std::wstring> subdirs;
+	};
+
+	void Generate(const std::wstring &path, unsigned level);
+	static void Fill(const Directory &dir, DirEntry &entry);
+	static unsigned long long Allocated(unsigned long long size);
+
+	unsigned m_depth;
+	unsigned m_fanout;
+	unsigned m_filesPerDir;
+	unsigned m_listDelayUs;
+	unsigned m_statDelayUs;
+	std::mutex m_lock;
+	std::map<std::wstring, Directory> m_dirs;
+	unsigned long long m_clock;	// mtime source, ticks on every change
+	std::atomic<unsigned long long> m_readDirCalls;
+	std::atomic<unsigned long long> m_statCalls;
+};
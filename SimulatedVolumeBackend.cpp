@@ -0,0 +1,157 @@
+/****************************** Module Header ******************************\
+Module Name:  SimulatedVolumeBackend.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of SimulatedVolumeBackend.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "SimulatedVolumeBackend.h"
+#include <thread>
+#include <chrono>
+#include <stdio.h>
+#include <wchar.h>
+
+static const wchar_t s_volumePrefix[] = L"\\\\?\\Volume{5107a7ed-0000-0000-0000-";
+
+SimulatedVolumeBackend::SimulatedVolumeBackend(unsigned volumes, unsigned pathsPerVolume, unsigned delayUs) :
+m_volumes(volumes),
+m_pathsPerVolume(pathsPerVolume),
+m_latency(SimulatedLatency::FIXED, delayUs)
+{
+}
+
+void SimulatedVolumeBackend::SetLatency(const SimulatedLatency &latency)
+{
+	std::lock_guard<std::mutex> lock(m_randomLock);
+	m_latency = latency;
+	m_random.seed(5107);
+}
+
+unsigned SimulatedVolumeBackend::DelayUs()
+{
+	std::lock_guard<std::mutex> lock(m_randomLock);
+	if (m_latency.slowFraction > 0 &&
+		std::uniform_real_distribution<double>(0, 1)(m_random) < m_latency.slowFraction)
+		return m_latency.slowUs;
+	switch (m_latency.kind)
+	{
+	case SimulatedLatency::UNIFORM:
+		return std::uniform_int_distribution<unsigned>(0, 2 * m_latency.us)(m_random);
+	case SimulatedLatency::EXPONENTIAL:
+		return m_latency.us ?
+			(unsigned)std::exponential_distribution<double>(1.0 / m_latency.us)(m_random) : 0;
+	default:
+		return m_latency.us;
+	}
+}
+
+std::wstring SimulatedVolumeBackend::VolumeName(unsigned index)
+{
+	wchar_t buf[64];
+	swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"%ls%012u}\\", s_volumePrefix, index);
+	return buf;
+}
+
+int SimulatedVolumeBackend::Lookup(const wchar_t *volname)
+{
+	unsigned delayUs = DelayUs();
+	if (delayUs)
+		std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+
+	size_t prefixlen = sizeof(s_volumePrefix) / sizeof(s_volumePrefix[0]) - 1;
+	if (wcsncmp(volname, s_volumePrefix, prefixlen))
+		return -1;
+	unsigned index = (unsigned)wcstoul(volname + prefixlen, NULL, 10);
+	return index < m_volumes ? (int)index : -1;
+}
+
+bool SimulatedVolumeBackend::EnumVolumes(std::vector<std::wstring> &volnames)
+{
+	volnames.clear();
+	for (unsigned i = 0; i < m_volumes; ++i)
+		volnames.push_back(VolumeName(i));
+	return true;
+}
+
+bool SimulatedVolumeBackend::QueryDevice(const wchar_t *volname, std::wstring &device)
+{
+	int index = Lookup(volname);
+	if (index < 0)
+		return false;
+	wchar_t buf[64];
+	swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"\\Device\\HarddiskVolume%d", index + 1);
+	device = buf;
+	return true;
+}
+
+VolumeType SimulatedVolumeBackend::QueryType(const wchar_t *volname)
+{
+	return Lookup(volname) < 0 ? VOLUME_NO_ROOT_DIR : VOLUME_FIXED;
+}
+
+bool SimulatedVolumeBackend::QueryPaths(const wchar_t *volname, std::vector<std::wstring> &paths)
+{
+	paths.clear();
+	int index = Lookup(volname);
+	if (index < 0)
+		return false;
+	for (unsigned i = 0; i < m_pathsPerVolume; ++i)
+	{
+		wchar_t buf[64];
+		// In the path syntax of the system, so the mount table nests them
+#ifdef _WIN32
+		swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"S:\\Mount\\Volume%d\\Path%u", index, i);
+#else
+		swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"/mnt/sim/Volume%d/Path%u", index, i);
+#endif
+		paths.push_back(buf);
+	}
+	return true;
+}
+
+bool SimulatedVolumeBackend::QuerySpace(const wchar_t *volname, VolumeSpace &space)
+{
+	int index = Lookup(volname);
+	if (index < 0)
+		return false;
+	// Volumes of 1 to 16 TB with 4 KB clusters, filled to various degrees
+	space.sectorsPerCluster = 8;
+	space.bytesPerSector = 512;
+	space.totalClusters = (1ull << 28) * (index % 16 + 1);
+	space.freeClusters = space.totalClusters / 100 * (index * 37 % 100);
+	return true;
+}
+
+bool SimulatedVolumeBackend::QueryInformation(const wchar_t *volname, std::wstring &label, std::wstring &filesystem)
+{
+	int index = Lookup(volname);
+	if (index < 0)
+		return false;
+	wchar_t buf[32];
+	swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"Volume%d", index);
+	label = buf;
+	filesystem = L"NTFS";
+	return true;
+}
+
+bool SimulatedVolumeBackend::QueryDisks(const wchar_t *volname, std::vector<std::wstring> &disks)
+{
+	disks.clear();
+	int index = Lookup(volname);
+	if (index < 0)
+		return false;
+	// Two volumes to a disk
+	wchar_t buf[32];
+	swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"PhysicalDrive%d", index / 2);
+	disks.push_back(buf);
+	return true;
+}
@@ -0,0 +1,79 @@
+/****************************** Module Header ******************************\
+Module Name:  SimulatedVolumeBackend.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares SimulatedVolumeBackend, a VolumeBackend serving a made-up
+set of volumes from memory with a configurable delay per call. It stands in
+for hosts with many (slow) volumes when measuring how the context menu and
+the detail view scale.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "VolumeBackend.h"
+#include <mutex>
+#include <random>
+
+// How long each per-volume call of SimulatedVolumeBackend takes
+struct SimulatedLatency
+{
+	enum Kind
+	{
+		FIXED,			// always us
+		UNIFORM,		// evenly spread over 0 to 2 * us
+		EXPONENTIAL,	// exponentially distributed with a mean of us
+	};
+	Kind kind;
+	unsigned us;
+	// Calls that hit a slow volume instead, e.g. a sleeping disk or a
+	// remote share: slowFraction of them take slowUs
+	double slowFraction;
+	unsigned slowUs;
+
+	SimulatedLatency(Kind kind = FIXED, unsigned us = 0, double slowFraction = 0, unsigned slowUs = 0) :
+		kind(kind), us(us), slowFraction(slowFraction), slowUs(slowUs) {}
+};
+
+class SimulatedVolumeBackend : public VolumeBackend
+{
+public:
+	// volumes volumes, each mounted at pathsPerVolume paths. Every per-volume
+	// call sleeps delayUs microseconds before returning.
+	SimulatedVolumeBackend(unsigned volumes, unsigned pathsPerVolume = 1, unsigned delayUs = 0);
+
+	// Change the delay of the calls from now on. The random delays are drawn
+	// from a fixed seed, so runs are repeatable.
+	void SetLatency(const SimulatedLatency &latency);
+
+	// Name of the index-th simulated volume
+	static std::wstring VolumeName(unsigned index);
+
+	virtual bool EnumVolumes(std::vector<std::wstring> &volnames);
+	virtual bool QueryDevice(const wchar_t *volname, std::wstring &device);
+	virtual VolumeType QueryType(const wchar_t *volname);
+	virtual bool QueryPaths(const wchar_t *volname, std::vector<std::wstring> &paths);
+	virtual bool QuerySpace(const wchar_t *volname, VolumeSpace &space);
+	virtual bool QueryInformation(const wchar_t *volname, std::wstring &label, std::wstring &filesystem);
+	virtual bool QueryDisks(const wchar_t *volname, std::vector<std::wstring> &disks);
+
+private:
+	// Sleep the per-call delay and find the index of volname, -1 if unknown
+	int Lookup(const wchar_t *volname);
+	// Draw the delay of a call
+	unsigned DelayUs();
+
+	unsigned m_volumes;
+	unsigned m_pathsPerVolume;
+	SimulatedLatency m_latency;
+	std::mutex m_randomLock;
+	std::mt19937 m_random;
+};
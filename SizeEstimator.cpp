@@ -0,0 +1,301 @@
+/****************************** Module Header ******************************\
+Module Name:  SizeEstimator.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of the folder size estimator. Walks take subdirectories
+uniformly, whatever was found in them before, so that at every directory
+those listed are an unbiased sample of all of its subdirectories. They
+leave out subdirectories listed to the bottom, where they would learn
+nothing, which does not change the chance of any subdirectory not listed.
+
+A directory with k subdirectories, m of them in the sample with estimates
+t_i, is estimated at its own totals plus k / m times the sum of t_i. The
+variance is that of taking m of k, k^2 (1 - m / k) s^2 / m with s^2 the
+variance of t_i, plus that of the t_i themselves times k / m. With a single
+subdirectory in the sample s^2 is unknown and taken as t_1^2, a spread as
+wide as the value, so the interval stays wide until walks look at another.
+Directories no walk has gone below yet are left out of the sample of their
+parent, which does not bias it as where walks stop has nothing to do with
+what is below.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "SizeEstimator.h"
+#include "Trace.h"
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <thread>
+
+// A walk deeper than this, e.g. down a loop of bind mounts, ends there
+#define MAX_WALK_DEPTH 256
+// Of the normal distribution, for 95% confidence
+#define CONFIDENCE_Z 1.96
+
+typedef std::chrono::steady_clock Clock;
+
+// The totals of ScanTotals, as estimated
+enum { BYTES, ALLOCATED, FILES, DIRS, ERRORS, TOTALS };
+
+struct SizeEstimator::Subtree
+{
+	double total[TOTALS];
+	double variance[TOTALS];
+};
+
+SizeEstimator::SizeEstimator(FileSystem &fs, const std::wstring &root, unsigned threads, unsigned seed) :
+m_fs(fs),
+m_root(root),
+m_threads(threads),
+m_seed(seed),
+m_cancel(false),
+m_stop(NULL),
+m_rootFailed(false),
+m_rootNode(NULL),
+m_runs(0),
+m_walks(0),
+m_listed(0)
+{
+	if (m_threads == 0)
+		m_threads = std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+SizeEstimator::~SizeEstimator()
+{
+	Free(m_rootNode);
+}
+
+void SizeEstimator::Free(Node *node)
+{
+	if (!node)
+		return;
+	for (size_t i = 0; i < node->children.size(); ++i)
+		Free(node->children[i]);
+	delete node;
+}
+
+bool SizeEstimator::Refine(unsigned budgetMs, const std::atomic<bool> *cancel)
+{
+	std::lock_guard<std::mutex> refine(m_refineLock);
+	TraceSpan span("EstimateRefine", m_root.c_str());
+	m_stop = cancel;
+	Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(budgetMs);
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i < m_threads; ++i)
+		threads.push_back(std::thread(&SizeEstimator::Run, this, deadline));
+	Run(deadline);
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+	m_stop = NULL;
+	return !m_rootFailed;
+}
+
+void SizeEstimator::Cancel()
+{
+	m_cancel = true;
+}
+
+void SizeEstimator::Run(Clock::time_point deadline)
+{
+	std::mt19937 random;
+	Node *node;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		random.seed(m_seed * 2654435761u + m_runs++);
+		node = m_rootNode;
+	}
+	std::vector<DirEntry> entries;
+	if (!node)
+	{
+		Node *listed = List(m_root, entries);
+		if (!listed)
+			return;
+		node = Attach(NULL, 0, listed);
+	}
+	if (!node->ok)
+	{
+		m_rootFailed = true;
+		return;
+	}
+	Node *const root = node;
+
+	for (;;)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (!root->unlisted || m_listed >= MAX_LISTED)
+				return;
+		}
+		std::wstring path = m_root;
+		node = root;
+		// A walk cut short leaves the directories it listed, which count for
+		// nothing until another walk goes on below them
+		for (unsigned depth = 0; depth < MAX_WALK_DEPTH; ++depth)
+		{
+			if (m_cancel || (m_stop && *m_stop) || Clock::now() >= deadline)
+				return;
+			size_t index;
+			Node *child;
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				if (!node->unlisted)
+					break;
+				if (node->children.empty())
+					index = std::uniform_int_distribution<size_t>(0, node->subdirs.size() - 1)(random);
+				else
+				{
+					// The n-th of the subdirectories not listed to the bottom
+					size_t open = 0;
+					for (size_t i = 0; i < node->children.size(); ++i)
+						open += !node->children[i] || node->children[i]->unlisted;
+					size_t n = std::uniform_int_distribution<size_t>(0, open - 1)(random);
+					for (index = 0; (node->children[index] && !node->children[index]->unlisted) || n--; ++index)
+						;
+				}
+				child = node->children.empty() ? NULL : node->children[index];
+			}
+			path = JoinPath(path, node->subdirs[index]);
+			if (!child)
+			{
+				Node *listed = List(path, entries);
+				if (!listed)
+					return;
+				child = Attach(node, index, listed);
+			}
+			node = child;
+		}
+		std::lock_guard<std::mutex> lock(m_lock);
+		++m_walks;
+	}
+}
+
+SizeEstimator::Node *SizeEstimator::List(const std::wstring &path, std::vector<DirEntry> &entries)
+{
+	Node *node = new Node;
+	{
+		TraceSpan span("ReadDir", path.c_str());
+		node->ok = m_fs.ReadDir(path, entries, NULL, m_stop ? m_stop : &m_cancel);
+	}
+	// A listing given up is not a directory that cannot be read
+	if (!node->ok && (m_cancel || (m_stop && *m_stop)))
+	{
+		delete node;
+		return NULL;
+	}
+	if (!node->ok)
+		return node;
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		const DirEntry &entry = entries[i];
+		if (entry.isDir)
+		{
+			node->subdirs.push_back(entry.name);
+			continue;
+		}
+		node->own.bytes += entry.size;
+		node->own.allocated += entry.allocated;
+		++node->own.files;
+	}
+	node->own.dirs = node->subdirs.size();
+	return node;
+}
+
+SizeEstimator::Node *SizeEstimator::Attach(Node *parent, size_t index, Node *node)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if (parent && parent->children.empty())
+		parent->children.resize(parent->subdirs.size());
+	Node *&slot = parent ? parent->children[index] : m_rootNode;
+	if (slot)
+	{
+		delete node;
+		return slot;
+	}
+	slot = node;
+	node->parent = parent;
+	node->unlisted = node->subdirs.size();
+	for (Node *above = parent; above; above = above->parent)
+		above->unlisted += node->unlisted - 1;
+	++m_listed;
+	return node;
+}
+
+bool SizeEstimator::Estimate(const Node &node, Subtree &subtree, bool &exact) const
+{
+	for (int t = 0; t < TOTALS; ++t)
+	{
+		subtree.total[t] = 0;
+		subtree.variance[t] = 0;
+	}
+	if (!node.ok)
+	{
+		subtree.total[ERRORS] = 1;
+		return true;
+	}
+	subtree.total[BYTES] = (double)node.own.bytes;
+	subtree.total[ALLOCATED] = (double)node.own.allocated;
+	subtree.total[FILES] = (double)node.own.files;
+	subtree.total[DIRS] = (double)node.own.dirs;
+	if (node.subdirs.empty())
+		return true;
+
+	double sum[TOTALS] = {}, squares[TOTALS] = {}, variances[TOTALS] = {};
+	double sampled = 0;
+	for (size_t i = 0; i < node.children.size(); ++i)
+	{
+		Subtree child;
+		if (!node.children[i] || !Estimate(*node.children[i], child, exact))
+			continue;
+		++sampled;
+		for (int t = 0; t < TOTALS; ++t)
+		{
+			sum[t] += child.total[t];
+			squares[t] += child.total[t] * child.total[t];
+			variances[t] += child.variance[t];
+		}
+	}
+	if (!sampled)
+		return false;
+
+	double count = (double)node.subdirs.size();
+	if (sampled < count)
+		exact = false;
+	for (int t = 0; t < TOTALS; ++t)
+	{
+		double mean = sum[t] / sampled;
+		double spread = sampled > 1 ? std::max(squares[t] - sampled * mean * mean, 0.0) / (sampled - 1) :
+			mean * mean;
+		subtree.total[t] += count / sampled * sum[t];
+		subtree.variance[t] = count * count * (1 - sampled / count) * spread / sampled +
+			count / sampled * variances[t];
+	}
+	return true;
+}
+
+bool SizeEstimator::GetEstimate(SizeEstimate &estimate)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	estimate.walks = m_walks;
+	estimate.listed = m_listed;
+	Subtree root;
+	bool exact = true;
+	if (!m_rootNode || !Estimate(*m_rootNode, root, exact))
+		return false;
+	estimate.exact = exact;
+	unsigned long long ScanTotals::*const totals[TOTALS] = { &ScanTotals::bytes, &ScanTotals::allocated,
+		&ScanTotals::files, &ScanTotals::dirs, &ScanTotals::errors };
+	for (int t = 0; t < TOTALS; ++t)
+	{
+		estimate.totals.*totals[t] = (unsigned long long)(root.total[t] + 0.5);
+		estimate.error.*totals[t] = exact ? 0 : (unsigned long long)(CONFIDENCE_Z * sqrt(root.variance[t]) + 0.5);
+	}
+	return true;
+}
@@ -0,0 +1,127 @@
+/****************************** Module Header ******************************\
+Module Name:  SizeEstimator.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares SizeEstimator, which estimates the totals of a folder far
+too large to scan in time from a sample of it. The sample is grown by random
+walks from the folder down to a directory without subdirectories, taking a
+subdirectory at random at every level and listing those not seen before,
+after Knuth (Estimating the efficiency of backtrack programs, 1975).
+
+Rather than averaging the walks one by one, as Knuth does, the estimate is
+made from all the directories they listed, as a sample in stages (Cochran,
+Sampling Techniques, ch. 10): the subdirectories walks went down are a random
+sample of those of their parent, so the totals of the parent are what it
+holds itself plus those of the sample scaled up to all its subdirectories,
+worked out from the bottom up. How much the sample differs from one
+subdirectory to the next gives the confidence interval. The estimate comes
+out exact once every directory has been listed.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "FileSystem.h"
+#include "FolderScanner.h"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+struct SizeEstimate
+{
+	ScanTotals totals;	// the estimate
+	// Half the width of the 95% confidence interval of each of totals, 0
+	// once exact. Until the sample takes in the few subtrees holding most of
+	// a very uneven tree, the interval is too narrow.
+	ScanTotals error;
+	unsigned long long walks;	// down to a directory without subdirectories
+	unsigned long long listed;	// directories listed for them
+	bool exact;			// every directory has been listed, or a scan was done
+
+	SizeEstimate() : walks(0), listed(0), exact(false) {}
+};
+
+class SizeEstimator
+{
+public:
+	enum { MAX_LISTED = 65536 };
+
+	// Estimate the totals of root, walking on threads threads, 0 for one per
+	// core. The random choices of the walks come from seed.
+	SizeEstimator(FileSystem &fs, const std::wstring &root, unsigned threads = 0, unsigned seed = 0);
+	~SizeEstimator();
+
+	// Walk for budgetMs more, or until Cancel() or cancel is set. Stops early
+	// once every directory is listed, or MAX_LISTED of them, which bounds the
+	// memory and leaves the estimate where it is. The time is only looked at
+	// between listings, so a listing that hangs holds Refine() up with it;
+	// callers with a deadline run it on a thread of its own and read
+	// GetEstimate() meanwhile. Calls from several threads take turns.
+	// Returns false if root cannot be read.
+	bool Refine(unsigned budgetMs, const std::atomic<bool> *cancel = NULL);
+
+	// The estimate as of now. Returns false until the first walk is done.
+	bool GetEstimate(SizeEstimate &estimate);
+
+	// Make a running Refine() return soon, from any thread, and every later
+	// one at once. Listings in progress give up between entries, those of a
+	// Refine() given a cancel flag only once that is set. A caller refining
+	// again later stops each Refine() through its own flag instead.
+	void Cancel();
+
+	const std::wstring &Root() const { return m_root; }
+
+private:
+	// A directory listed by a walk
+	struct Node
+	{
+		bool ok;
+		ScanTotals own;		// files directly in it; dirs is its subdirectory count
+		std::vector<std::wstring> subdirs;	// names
+		std::vector<Node *> children;	// per subdirectory, NULL until listed
+		Node *parent;
+		unsigned long long unlisted;	// directories below not listed yet
+
+		Node() : ok(false), parent(NULL), unlisted(0) {}
+	};
+	struct Subtree;
+
+	void Run(std::chrono::steady_clock::time_point deadline);
+	// NULL if cancelled meanwhile
+	Node *List(const std::wstring &path, std::vector<DirEntry> &entries);
+	// Add the listing of subdirectory index of parent, or of the root if
+	// parent is NULL, unless another walk did already. Returns the one kept.
+	Node *Attach(Node *parent, size_t index, Node *node);
+	// Estimate the subtree of node. Returns false if it is not known yet how
+	// any of its subdirectories go on. Called with m_lock held.
+	bool Estimate(const Node &node, Subtree &subtree, bool &exact) const;
+	static void Free(Node *node);
+
+	FileSystem &m_fs;
+	std::wstring m_root;
+	unsigned m_threads;
+	unsigned m_seed;
+	std::mutex m_refineLock;	// held by Refine() throughout
+	std::atomic<bool> m_cancel;
+	const std::atomic<bool> *m_stop;	// the cancel flag of the running Refine()
+	std::atomic<bool> m_rootFailed;
+
+	std::mutex m_lock;			// guards the nodes and what follows
+	Node *m_rootNode;			// NULL until listed
+	unsigned m_runs;			// walker threads started, which seeds the next one
+	unsigned long long m_walks;
+	unsigned long long m_listed;
+
+	SizeEstimator(const SizeEstimator &);
+	SizeEstimator &operator =(const SizeEstimator &);
+};
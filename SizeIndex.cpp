@@ -0,0 +1,411 @@
+/****************************** Module Header ******************************\
+Module Name:  SizeIndex.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of SizeIndexBuilder and SizeIndex.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "SizeIndex.h"
+#include "Utf8.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <wctype.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Keep the table at most this full, so that probe sequences stay short
+#define SIZE_INDEX_MAX_LOAD_PERCENT 50
+// Old generations looked for at most when deleting them
+#define SIZE_INDEX_MAX_OLD_GENERATIONS 64
+
+uint64_t HashIndexPath(const std::wstring &path)
+{
+	size_t len = path.size();
+	while (len > 1 && (path[len - 1] == L'\\' || path[len - 1] == L'/'))
+		--len;
+#ifdef _WIN32
+	// Windows paths are case insensitive
+	std::wstring folded(path, 0, len);
+	for (size_t i = 0; i < folded.size(); ++i)
+		folded[i] = towlower(folded[i]);
+	std::string bytes;
+	AppendUtf8(bytes, folded.c_str(), folded.size());
+#else
+	std::string bytes;
+	AppendUtf8(bytes, path.c_str(), len);
+#endif
+
+	// 64-bit FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < bytes.size(); ++i)
+	{
+		hash ^= (unsigned char)bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	// 0 marks an empty bucket
+	return hash ? hash : 1;
+}
+
+std::wstring SizeIndexGeneration(const std::wstring &filename, uint64_t generation)
+{
+	wchar_t suffix[32];
+	swprintf(suffix, sizeof(suffix) / sizeof(suffix[0]), L".%llu", (unsigned long long)generation);
+	return filename + suffix;
+}
+
+// Read the pointer of filename. The file is only open for the read, and on
+// Windows shares delete, so that a writer can replace it meanwhile.
+static bool ReadIndexPointer(const std::wstring &filename, SizeIndexPointer &pointer)
+{
+	bool ok;
+#ifdef _WIN32
+	HANDLE hFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD read = 0;
+	ok = ReadFile(hFile, &pointer, sizeof(pointer), &read, NULL) && read == sizeof(pointer);
+	CloseHandle(hFile);
+#else
+	int fd = open(WideToUtf8(filename).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	ok = read(fd, &pointer, sizeof(pointer)) == (ssize_t)sizeof(pointer);
+	close(fd);
+#endif
+	return ok && memcmp(pointer.magic, SIZE_INDEX_POINTER_MAGIC, sizeof(pointer.magic)) == 0 &&
+		pointer.generation && pointer.oldest <= pointer.generation;
+}
+
+#pragma region SizeIndexBuilder
+
+void SizeIndexBuilder::Add(const std::wstring &path, const ScanTotals &totals)
+{
+	SizeIndexEntry entry;
+	entry.hash = HashIndexPath(path);
+	entry.bytes = totals.bytes;
+	entry.allocated = totals.allocated;
+	entry.files = totals.files;
+	entry.dirs = totals.dirs;
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_entries.push_back(entry);
+}
+
+static FILE *OpenIndexFile(const std::wstring &filename, const char *mode)
+{
+#ifdef _WIN32
+	std::wstring wmode(mode, mode + strlen(mode));
+	return _wfopen(filename.c_str(), wmode.c_str());
+#else
+	return fopen(WideToUtf8(filename).c_str(), mode);
+#endif
+}
+
+// Move src over dst, replacing it atomically
+static bool MoveIndexFile(const std::wstring &src, const std::wstring &dst)
+{
+#ifdef _WIN32
+	return MoveFileExW(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(WideToUtf8(src).c_str(), WideToUtf8(dst).c_str()) == 0;
+#endif
+}
+
+// Returns whether filename is gone, false if it is still mapped on Windows
+static bool RemoveIndexFile(const std::wstring &filename)
+{
+#ifdef _WIN32
+	return DeleteFileW(filename.c_str()) || GetLastError() == ERROR_FILE_NOT_FOUND;
+#else
+	return unlink(WideToUtf8(filename).c_str()) == 0 || errno == ENOENT;
+#endif
+}
+
+// Write data, and more after it, to filename. Returns false, with nothing
+// left of the file, if that fails.
+static bool WriteIndexFile(const std::wstring &filename, const void *data, size_t size,
+	const void *more = NULL, size_t moreSize = 0)
+{
+	FILE *fp = OpenIndexFile(filename, "wb");
+	if (!fp)
+		return false;
+	bool ok = fwrite(data, size, 1, fp) == 1 && (!moreSize || fwrite(more, moreSize, 1, fp) == 1);
+	if (fclose(fp) != 0)
+		ok = false;
+	if (!ok)
+		RemoveIndexFile(filename);
+	return ok;
+}
+
+bool SizeIndexBuilder::Write(const std::wstring &filename)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	uint64_t buckets = 16;
+	while (buckets * SIZE_INDEX_MAX_LOAD_PERCENT / 100 < m_entries.size())
+		buckets *= 2;
+	std::vector<SizeIndexEntry> table((size_t)buckets);
+	memset(&table[0], 0, table.size() * sizeof(SizeIndexEntry));
+	uint64_t count = 0;
+	for (size_t i = 0; i < m_entries.size(); ++i)
+	{
+		const SizeIndexEntry &entry = m_entries[i];
+		uint64_t bucket = entry.hash & (buckets - 1);
+		while (table[(size_t)bucket].hash && table[(size_t)bucket].hash != entry.hash)
+			bucket = (bucket + 1) & (buckets - 1);
+		// A path added twice keeps its last totals
+		if (!table[(size_t)bucket].hash)
+			++count;
+		table[(size_t)bucket] = entry;
+	}
+
+	SizeIndexHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SIZE_INDEX_MAGIC, sizeof(header.magic));
+	header.version = SIZE_INDEX_VERSION;
+	header.headerSize = sizeof(SizeIndexHeader);
+	header.entrySize = sizeof(SizeIndexEntry);
+	header.bucketCount = buckets;
+	header.entryCount = count;
+	header.buildTime = (int64_t)time(NULL);
+
+	SizeIndexPointer pointer;
+	uint64_t last = 0, oldest = 0;
+	if (ReadIndexPointer(filename, pointer))
+	{
+		last = pointer.generation;
+		oldest = std::max(pointer.oldest, last - std::min<uint64_t>(last, SIZE_INDEX_MAX_OLD_GENERATIONS));
+	}
+	memset(&pointer, 0, sizeof(pointer));
+	memcpy(pointer.magic, SIZE_INDEX_POINTER_MAGIC, sizeof(pointer.magic));
+	pointer.generation = last + 1;
+	std::wstring generation = SizeIndexGeneration(filename, pointer.generation);
+	if (!WriteIndexFile(generation, &header, sizeof(header), &table[0], table.size() * sizeof(SizeIndexEntry)))
+		return false;
+
+	// The last generation is named by the pointer until it is replaced, so
+	// readers may still be about to map it. The older ones are only still
+	// there while mapped.
+	pointer.oldest = last ? last : pointer.generation;
+	for (uint64_t i = oldest; i < last; ++i)
+	{
+		if (!RemoveIndexFile(SizeIndexGeneration(filename, i)))
+			pointer.oldest = std::min(pointer.oldest, i);
+	}
+
+	std::wstring temp = filename + L".tmp";
+	if (!WriteIndexFile(temp, &pointer, sizeof(pointer)) || !MoveIndexFile(temp, filename))
+	{
+		RemoveIndexFile(temp);
+		RemoveIndexFile(generation);
+		return false;
+	}
+	return true;
+}
+
+#pragma endregion
+
+
+#pragma region SizeIndex
+
+SizeIndex::SizeIndex() :
+m_header(NULL),
+m_entries(NULL),
+m_mapSize(0),
+m_generation(0)
+#ifdef _WIN32
+, m_hFile(INVALID_HANDLE_VALUE),
+m_hMapping(NULL)
+#endif
+{
+}
+
+SizeIndex::~SizeIndex()
+{
+	Close();
+}
+
+bool SizeIndex::Open(const std::wstring &filename)
+{
+	Close();
+	m_filename = filename;
+	SizeIndexPointer pointer;
+	if (!ReadIndexPointer(filename, pointer) || !Map(SizeIndexGeneration(filename, pointer.generation)))
+		return false;
+	m_generation = pointer.generation;
+	return true;
+}
+
+bool SizeIndex::Map(const std::wstring &filename)
+{
+	// The size is taken from the handle mapped, so that it is that of the
+	// file the table is checked against
+	const void *view = NULL;
+	uint64_t size;
+	size_t mapSize;
+#ifdef _WIN32
+	HANDLE hFile = CreateFileW(filename.c_str(), GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	BY_HANDLE_FILE_INFORMATION info;
+	if (!GetFileInformationByHandle(hFile, &info))
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+	size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	mapSize = (size_t)size;
+	if (size < sizeof(SizeIndexHeader) || size != mapSize)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+	HANDLE hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMapping)
+		view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		if (hMapping)
+			CloseHandle(hMapping);
+		CloseHandle(hFile);
+		return false;
+	}
+	m_hFile = hFile;
+	m_hMapping = hMapping;
+#else
+	int fd = open(WideToUtf8(filename).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	size = (uint64_t)st.st_size;
+	mapSize = (size_t)size;
+	if (size < sizeof(SizeIndexHeader) || size != mapSize)
+	{
+		close(fd);
+		return false;
+	}
+	view = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return false;
+#endif
+	m_header = static_cast<const SizeIndexHeader *>(view);
+	m_mapSize = mapSize;
+
+	// Only the header is checked, entries are read on demand. The table must
+	// fill the rest of the file exactly, so that a truncated or padded file
+	// is rejected.
+	const SizeIndexHeader *header = m_header;
+	uint64_t buckets = header->bucketCount;
+	if (memcmp(header->magic, SIZE_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != SIZE_INDEX_VERSION ||
+		header->headerSize != sizeof(SizeIndexHeader) ||
+		header->entrySize != sizeof(SizeIndexEntry) ||
+		buckets == 0 || (buckets & (buckets - 1)) != 0 ||
+		header->entryCount >= buckets ||
+		buckets != (mapSize - sizeof(SizeIndexHeader)) / sizeof(SizeIndexEntry) ||
+		(mapSize - sizeof(SizeIndexHeader)) % sizeof(SizeIndexEntry) != 0)
+	{
+		Close();
+		return false;
+	}
+	m_entries = reinterpret_cast<const SizeIndexEntry *>(
+		static_cast<const char *>(view) + sizeof(SizeIndexHeader));
+	return true;
+}
+
+void SizeIndex::Close()
+{
+	if (m_header)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_header);
+#else
+		munmap(const_cast<SizeIndexHeader *>(m_header), m_mapSize);
+#endif
+	}
+#ifdef _WIN32
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+#endif
+	m_header = NULL;
+	m_entries = NULL;
+	m_mapSize = 0;
+	m_generation = 0;
+}
+
+bool SizeIndex::Reload()
+{
+	if (m_filename.empty())
+		return false;
+	SizeIndexPointer pointer;
+	if (!ReadIndexPointer(m_filename, pointer))
+	{
+		Close();
+		return false;
+	}
+	if (m_header && pointer.generation == m_generation)
+		return true;
+	std::wstring filename = m_filename;
+	return Open(filename);
+}
+
+bool SizeIndex::Lookup(const std::wstring &path, ScanTotals &totals) const
+{
+	if (!m_header)
+		return false;
+	uint64_t hash = HashIndexPath(path);
+	uint64_t mask = m_header->bucketCount - 1;
+	// An empty bucket ends the probe sequence. The table written is never
+	// full, but a damaged one may be, so probe every bucket at most once.
+	uint64_t bucket = hash & mask;
+	for (uint64_t probes = 0; probes <= mask && m_entries[bucket].hash; ++probes, bucket = (bucket + 1) & mask)
+	{
+		const SizeIndexEntry &entry = m_entries[bucket];
+		if (entry.hash == hash)
+		{
+			totals.bytes = entry.bytes;
+			totals.allocated = entry.allocated;
+			totals.files = entry.files;
+			totals.dirs = entry.dirs;
+			totals.errors = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+#pragma endregion
@@ -0,0 +1,135 @@
+/****************************** Module Header ******************************\
+Module Name:  SizeIndex.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares the directory size index: an on-disk hash table from path
+hash to the recursive totals of that directory, written by SizeIndexBuilder
+after a folder scan and read by SizeIndex through a read-only memory mapping.
+Opening needs no parsing, and since the mapping is backed by the file, all
+processes that load the DLL share the same physical pages.
+
+Windows cannot replace a file while a view of it is mapped, so an index is
+never replaced: every write makes a new generation, <filename>.<generation>,
+and then points filename, a small SizeIndexPointer, at it. Generations are
+deleted by later writes once no reader has them mapped any more.
+
+File layout (little endian):
+  SizeIndexHeader
+  SizeIndexEntry[bucketCount]  open addressing, linear probing, hash 0 = empty
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "FolderScanner.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#define SIZE_INDEX_MAGIC    "DUTSIDX"
+#define SIZE_INDEX_VERSION  2
+#define SIZE_INDEX_POINTER_MAGIC "DUTSPTR"
+
+struct SizeIndexHeader
+{
+	char magic[8];			// SIZE_INDEX_MAGIC
+	uint32_t version;		// SIZE_INDEX_VERSION, bumped on any layout change
+	uint32_t headerSize;	// sizeof(SizeIndexHeader)
+	uint32_t entrySize;		// sizeof(SizeIndexEntry)
+	uint32_t reserved;
+	uint64_t bucketCount;	// power of 2
+	uint64_t entryCount;
+	int64_t buildTime;		// seconds since 1970
+	uint64_t reserved2[2];
+};
+
+struct SizeIndexEntry
+{
+	uint64_t hash;			// HashIndexPath() of the directory
+	uint64_t bytes;
+	uint64_t allocated;
+	uint64_t files;
+	uint64_t dirs;
+};
+
+// The file named by the index file name, telling which generation is current
+struct SizeIndexPointer
+{
+	char magic[8];			// SIZE_INDEX_POINTER_MAGIC
+	uint64_t generation;	// current, from 1
+	uint64_t oldest;		// oldest generation that may still be on disk
+};
+
+// File name of a generation of the index filename
+std::wstring SizeIndexGeneration(const std::wstring &filename, uint64_t generation);
+
+// Hash of a directory path as stored in the index. Trailing separators are
+// ignored, and on Windows so is case.
+uint64_t HashIndexPath(const std::wstring &path);
+
+// Collects directory totals, e.g. from FolderScanner's directory callback,
+// and writes them out as an index file
+class SizeIndexBuilder
+{
+public:
+	// Thread safe
+	void Add(const std::wstring &path, const ScanTotals &totals);
+
+	// Write the index as a new generation and point filename at it once it
+	// is complete, so that readers never see a partial index. Generations
+	// before the last one are deleted where no reader has them mapped.
+	bool Write(const std::wstring &filename);
+
+	size_t Size() const { return m_entries.size(); }
+
+private:
+	std::mutex m_lock;
+	std::vector<SizeIndexEntry> m_entries;
+};
+
+// A read-only view of an index file. Lookups are not synchronized with
+// Open(), Reload() or Close().
+class SizeIndex
+{
+public:
+	SizeIndex();
+	~SizeIndex();
+
+	bool Open(const std::wstring &filename);
+	void Close();
+	bool IsOpen() const { return m_header != NULL; }
+
+	// Map the current generation if it is not the one mapped. Returns whether
+	// an index is open afterwards.
+	bool Reload();
+
+	bool Lookup(const std::wstring &path, ScanTotals &totals) const;
+
+	int64_t BuildTime() const { return m_header ? m_header->buildTime : 0; }
+	uint64_t Size() const { return m_header ? m_header->entryCount : 0; }
+
+private:
+	bool Map(const std::wstring &filename);
+
+	std::wstring m_filename;
+	const SizeIndexHeader *m_header;
+	const SizeIndexEntry *m_entries;
+	size_t m_mapSize;
+	uint64_t m_generation;	// of the mapping
+#ifdef _WIN32
+	void *m_hFile;
+	void *m_hMapping;
+#endif
+
+	SizeIndex(const SizeIndex &);
+	SizeIndex &operator =(const SizeIndex &);
+};
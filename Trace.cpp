@@ -0,0 +1,315 @@
+/****************************** Module Header ******************************\
+Module Name:  Trace.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of span tracing. Every thread that records a span while
+tracing is on gets a ring of its own, found through a thread-local pointer
+and written by that thread only. The ring publishes how many spans it has
+taken with a release store, which is all a reader synchronizes on.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "Trace.h"
+#include "Utf8.h"
+#include <vector>
+#include <mutex>
+#include <stdio.h>
+#include <wchar.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Pointers to plain data only, which both compilers support in a DLL
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+#define DETAIL_LENGTH 32	// characters kept of the detail of a span, with the terminator
+
+struct TraceEvent
+{
+	const char *name;
+	long long start;
+	long long end;
+	wchar_t detail[DETAIL_LENGTH];
+};
+
+struct TraceRing
+{
+	unsigned tid;
+	std::atomic<unsigned long long> written;	// spans ever recorded
+	std::atomic<unsigned long long> cleared;	// spans recorded before the last Clear
+	TraceEvent events[Trace::RING_SIZE];
+
+	explicit TraceRing(unsigned tid) : tid(tid), written(0), cleared(0) {}
+};
+
+std::atomic<bool> Trace::s_enabled(false);
+
+// The rings of all threads that ever recorded a span. Never destroyed, the
+// threads of the query workers may still record spans at process exit.
+static std::mutex g_ringLock;
+static std::vector<TraceRing *> *g_rings;
+static std::vector<TraceRing *> *g_freeRings;	// left by threads that exited
+static TRACE_THREAD_LOCAL TraceRing *t_ring;
+
+// Called on the exiting thread. Its spans stay in the ring, to be rendered
+// among those of the next thread using it.
+static void ReleaseRing(TraceRing *ring)
+{
+	t_ring = NULL;
+	std::lock_guard<std::mutex> lock(g_ringLock);
+	g_freeRings->push_back(ring);
+}
+
+#ifdef _MSC_VER
+
+// Visual C++ 2013 has no thread_local objects. The callback of a fiber
+// local slot runs at thread exit as well.
+static DWORD g_ringSlot = FLS_OUT_OF_INDEXES;
+
+static void WINAPI ExitRing(void *ring)
+{
+	if (ring)
+		ReleaseRing(static_cast<TraceRing *>(ring));
+}
+
+// Have ring released when the calling thread exits. Under g_ringLock.
+static void WatchThreadExit(TraceRing *ring)
+{
+	if (g_ringSlot == FLS_OUT_OF_INDEXES)
+		g_ringSlot = FlsAlloc(ExitRing);
+	if (g_ringSlot != FLS_OUT_OF_INDEXES)
+		FlsSetValue(g_ringSlot, ring);
+}
+
+#else
+
+struct RingExit
+{
+	TraceRing *ring;
+
+	RingExit() : ring(NULL) {}
+	~RingExit()
+	{
+		if (ring)
+			ReleaseRing(ring);
+	}
+};
+
+static thread_local RingExit t_ringExit;
+
+static void WatchThreadExit(TraceRing *ring)
+{
+	t_ringExit.ring = ring;
+}
+
+#endif
+
+void Trace::Enable(bool enabled)
+{
+	s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+#ifdef _WIN32
+
+static long long QueryFrequency()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return frequency.QuadPart;
+}
+
+static long long g_frequency = QueryFrequency();
+
+long long Trace::Now()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	// Split up so the multiplication does not overflow
+	long long seconds = counter.QuadPart / g_frequency;
+	long long rest = counter.QuadPart % g_frequency;
+	return seconds * 1000000000 + rest * 1000000000 / g_frequency;
+}
+
+#else
+
+long long Trace::Now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif
+
+void Trace::Record(const char *name, const wchar_t *detail, long long startNs, long long endNs)
+{
+	TraceRing *ring = t_ring;
+	if (!ring)
+	{
+		std::lock_guard<std::mutex> lock(g_ringLock);
+		if (!g_rings)
+		{
+			g_rings = new std::vector<TraceRing *>;
+			g_freeRings = new std::vector<TraceRing *>;
+		}
+		if (!g_freeRings->empty())
+		{
+			ring = g_freeRings->back();
+			g_freeRings->pop_back();
+		}
+		else
+		{
+			ring = new TraceRing((unsigned)g_rings->size() + 1);
+			g_rings->push_back(ring);
+		}
+		WatchThreadExit(ring);
+		t_ring = ring;
+	}
+
+	unsigned long long index = ring->written.load(std::memory_order_relaxed);
+	TraceEvent &event = ring->events[index % RING_SIZE];
+	event.name = name;
+	event.start = startNs;
+	event.end = endNs;
+	event.detail[0] = 0;
+	if (detail)
+	{
+		size_t len = wcslen(detail);
+		if (len >= DETAIL_LENGTH)
+			detail += len - (DETAIL_LENGTH - 1);
+		wcsncpy(event.detail, detail, DETAIL_LENGTH - 1);
+		event.detail[DETAIL_LENGTH - 1] = 0;
+	}
+	ring->written.store(index + 1, std::memory_order_release);
+}
+
+// Append str as a JSON string
+static void AppendJsonString(std::string &json, const std::string &str)
+{
+	json += '"';
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		unsigned char c = (unsigned char)str[i];
+		if (c == '"' || c == '\\')
+		{
+			json += '\\';
+			json += (char)c;
+		}
+		else if (c < 0x20)
+		{
+			char buf[8];
+			sprintf(buf, "\\u%04x", c);
+			json += buf;
+		}
+		else
+			json += (char)c;
+	}
+	json += '"';
+}
+
+void Trace::Render(std::string &json)
+{
+#ifdef _WIN32
+	unsigned long pid = GetCurrentProcessId();
+#else
+	unsigned long pid = (unsigned long)getpid();
+#endif
+	std::vector<TraceRing *> rings;
+	{
+		std::lock_guard<std::mutex> lock(g_ringLock);
+		if (g_rings)
+			rings = *g_rings;
+	}
+
+	json = "{\"traceEvents\":[";
+	bool first = true;
+	std::vector<TraceEvent> events;
+	std::string detail;
+	for (size_t r = 0; r < rings.size(); ++r)
+	{
+		TraceRing &ring = *rings[r];
+		unsigned long long end = ring.written.load(std::memory_order_acquire);
+		unsigned long long begin = ring.cleared.load(std::memory_order_relaxed);
+		if (end - begin > RING_SIZE)
+			begin = end - RING_SIZE;
+		events.clear();
+		for (unsigned long long i = begin; i < end; ++i)
+			events.push_back(ring.events[i % RING_SIZE]);
+		// The thread went on recording while we copied. Whatever it may have
+		// overwritten meanwhile, or be overwriting now, is dropped.
+		unsigned long long now = ring.written.load(std::memory_order_acquire) + 1;
+		size_t skip = now - begin > RING_SIZE ? (size_t)(now - RING_SIZE - begin) : 0;
+
+		for (size_t i = skip; i < events.size(); ++i)
+		{
+			const TraceEvent &event = events[i];
+			json += first ? "\n{\"name\":\"" : ",\n{\"name\":\"";
+			json += event.name;
+			char buf[120];
+			sprintf(buf, "\",\"cat\":\"diskusage\",\"ph\":\"X\",\"pid\":%lu,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+				pid, ring.tid, event.start / 1000.0, (event.end - event.start) / 1000.0);
+			json += buf;
+			if (event.detail[0])
+			{
+				detail.clear();
+				AppendUtf8(detail, event.detail, wcsnlen(event.detail, DETAIL_LENGTH));
+				json += ",\"args\":{\"detail\":";
+				AppendJsonString(json, detail);
+				json += '}';
+			}
+			json += '}';
+			first = false;
+		}
+	}
+	json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+bool Trace::Save(const std::wstring &filename)
+{
+	std::string json;
+	Render(json);
+#ifdef _WIN32
+	FILE *file = _wfopen(filename.c_str(), L"wb");
+#else
+	FILE *file = fopen(WideToUtf8(filename).c_str(), "wb");
+#endif
+	if (!file)
+		return false;
+	bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+	return fclose(file) == 0 && ok;
+}
+
+void Trace::Clear()
+{
+	std::lock_guard<std::mutex> lock(g_ringLock);
+	if (!g_rings)
+		return;
+	for (size_t r = 0; r < g_rings->size(); ++r)
+	{
+		TraceRing &ring = *(*g_rings)[r];
+		ring.cleared.store(ring.written.load(std::memory_order_acquire), std::memory_order_relaxed);
+	}
+}
+
+size_t Trace::Rings()
+{
+	std::lock_guard<std::mutex> lock(g_ringLock);
+	return g_rings ? g_rings->size() : 0;
+}
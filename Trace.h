@@ -0,0 +1,87 @@
+/****************************** Module Header ******************************\
+Module Name:  Trace.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares span tracing of the volume queries, the folder scans and
+the phases of building the menu and the detail view. Each thread records
+its spans into a ring of its own, without locks, which goes to a thread
+started later once it exits, and the spans of all
+threads can be written out at any time as Chrome trace-event JSON, to be
+opened in chrome://tracing or Perfetto. While tracing is off, a span costs
+a relaxed load and a branch that always goes the same way.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <string>
+
+class Trace
+{
+public:
+	// Spans kept per thread. Older ones are overwritten.
+	static const unsigned RING_SIZE = 4096;
+
+	static bool Enabled() { return s_enabled.load(std::memory_order_relaxed); }
+	static void Enable(bool enabled);
+
+	// Time in nanoseconds since an arbitrary point, the clock of the spans
+	static long long Now();
+
+	// Record a span of the calling thread. detail, e.g. the volume queried,
+	// is shortened to its end.
+	static void Record(const char *name, const wchar_t *detail, long long startNs, long long endNs);
+
+	// Render the spans of all threads recorded so far as Chrome trace-event
+	// JSON. Spans being overwritten while rendering are left out.
+	static void Render(std::string &json);
+	// Render the spans into the file filename
+	static bool Save(const std::wstring &filename);
+	// Forget the spans recorded so far
+	static void Clear();
+
+	// Rings allocated so far. A thread that exits leaves its ring to the
+	// next one to record, so this is the most threads ever recording at once.
+	static size_t Rings();
+
+private:
+	static std::atomic<bool> s_enabled;
+};
+
+// A span from construction to destruction of the object, recorded if tracing
+// is enabled when it starts. name and detail must outlive the object.
+class TraceSpan
+{
+public:
+	explicit TraceSpan(const char *name, const wchar_t *detail = NULL)
+	{
+		if (Trace::Enabled())
+		{
+			m_name = name;
+			m_detail = detail;
+			m_start = Trace::Now();
+		}
+		else
+			m_name = NULL;
+	}
+
+	~TraceSpan()
+	{
+		if (m_name)
+			Trace::Record(m_name, m_detail, m_start, Trace::Now());
+	}
+
+private:
+	const char *m_name;
+	const wchar_t *m_detail;
+	long long m_start;
+};
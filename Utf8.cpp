@@ -0,0 +1,104 @@
+/****************************** Module Header ******************************\
+Module Name:  Utf8.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of the UTF-8 conversions.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Utf8.h"
+
+void AppendUtf8(std::string &out, const wchar_t *str, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+	{
+		unsigned long cp = (unsigned long)str[i];
+		if (cp < 0x80)
+		{
+			out += (char)cp;
+			continue;
+		}
+		// Combine UTF-16 surrogate pairs
+		if (sizeof(wchar_t) == 2 && cp >= 0xD800 && cp < 0xDC00 && i + 1 < len &&
+				(unsigned long)str[i + 1] >= 0xDC00 && (unsigned long)str[i + 1] < 0xE000)
+			cp = 0x10000 + ((cp - 0xD800) << 10) + ((unsigned long)str[++i] - 0xDC00);
+		if ((cp >= 0xD800 && cp < 0xE000) || cp > 0x10FFFF)
+			cp = 0xFFFD;	// lone surrogate or out of range
+
+		if (cp < 0x800)
+		{
+			out += (char)(0xC0 | (cp >> 6));
+		}
+		else if (cp < 0x10000)
+		{
+			out += (char)(0xE0 | (cp >> 12));
+			out += (char)(0x80 | ((cp >> 6) & 0x3F));
+		}
+		else
+		{
+			out += (char)(0xF0 | (cp >> 18));
+			out += (char)(0x80 | ((cp >> 12) & 0x3F));
+			out += (char)(0x80 | ((cp >> 6) & 0x3F));
+		}
+		out += (char)(0x80 | (cp & 0x3F));
+	}
+}
+
+std::string WideToUtf8(const std::wstring &str)
+{
+	std::string out;
+	out.reserve(str.size());
+	AppendUtf8(out, str.c_str(), str.size());
+	return out;
+}
+
+void AppendWide(std::wstring &out, const char *str, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)str;
+	const unsigned char *end = p + len;
+	while (p < end)
+	{
+		unsigned long cp = *p++;
+		if (cp >= 0x80)
+		{
+			int extra = cp >= 0xF0 ? 3 : cp >= 0xE0 ? 2 : cp >= 0xC0 ? 1 : -1;
+			unsigned long min = extra == 3 ? 0x10000 : extra == 2 ? 0x800 : 0x80;
+			if (extra < 0 || cp >= 0xF8 || end - p < extra)
+			{
+				out += (wchar_t)0xFFFD;
+				continue;
+			}
+			cp &= 0x3F >> extra;
+			int i;
+			for (i = 0; i < extra && (p[i] & 0xC0) == 0x80; ++i)
+				cp = (cp << 6) | (p[i] & 0x3F);
+			p += i;
+			if (i < extra || cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp < 0xE000))
+				cp = 0xFFFD;
+		}
+		if (sizeof(wchar_t) == 2 && cp >= 0x10000)
+		{
+			cp -= 0x10000;
+			out += (wchar_t)(0xD800 + (cp >> 10));
+			out += (wchar_t)(0xDC00 + (cp & 0x3FF));
+		}
+		else
+			out += (wchar_t)cp;
+	}
+}
+
+std::wstring Utf8ToWide(const std::string &str)
+{
+	std::wstring out;
+	out.reserve(str.size());
+	AppendWide(out, str.c_str(), str.size());
+	return out;
+}
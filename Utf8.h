@@ -0,0 +1,30 @@
+/****************************** Module Header ******************************\
+Module Name:  Utf8.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares conversions between wide strings, which the project uses
+for all paths and texts, and UTF-8, which POSIX file systems and machine
+readable output use. wchar_t is UTF-16 on Windows and UTF-32 elsewhere.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <string>
+
+// Append the UTF-8 form of len wide characters to out
+void AppendUtf8(std::string &out, const wchar_t *str, size_t len);
+std::string WideToUtf8(const std::wstring &str);
+
+// Append the wide form of len bytes of UTF-8 to out. Invalid sequences
+// become U+FFFD.
+void AppendWide(std::wstring &out, const char *str, size_t len);
+std::wstring Utf8ToWide(const std::string &str);
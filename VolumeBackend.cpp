@@ -0,0 +1,176 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeBackend.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of the system volume backend of Windows.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#ifdef _WIN32
+
+#include "VolumeBackend.h"
+#include "Trace.h"
+#include <windows.h>
+#include <winioctl.h>
+#include <stdio.h>
+#include <algorithm>
+
+class Win32VolumeBackend : public VolumeBackend
+{
+public:
+	virtual bool EnumVolumes(std::vector<std::wstring> &volnames)
+	{
+		volnames.clear();
+		TraceSpan span("FindFirstVolumeW");
+		wchar_t volname[MAX_PATH] = L"";
+		HANDLE FindHandle = FindFirstVolumeW(volname, ARRAYSIZE(volname));
+		if (FindHandle == INVALID_HANDLE_VALUE)
+			return false;
+		do
+		{
+			//  Check the \\?\ prefix and the trailing backslash.
+			size_t Index = wcslen(volname) - 1;
+			if (wcsncmp(volname, L"\\\\?\\", 4) || volname[Index] != L'\\')
+			{
+				fwprintf(stderr, L"FindFirstVolume/FindNextVolume returned a bad path: %s\n", volname);
+				continue;
+			}
+			volnames.push_back(volname);
+		} while (FindNextVolumeW(FindHandle, volname, ARRAYSIZE(volname)));
+		FindVolumeClose(FindHandle);
+		return true;
+	}
+
+	virtual bool QueryDevice(const wchar_t *volname, std::wstring &device)
+	{
+		//  QueryDosDevice does not allow the \\?\ prefix and a trailing
+		//  backslash, so remove them.
+		std::wstring name(volname);
+		if (name.size() <= 4)
+			return false;
+		name = name.substr(4, name.size() - 5);
+		WCHAR DeviceName[MAX_PATH] = L"";
+		TraceSpan span("QueryDosDeviceW", volname);
+		if (QueryDosDeviceW(name.c_str(), DeviceName, ARRAYSIZE(DeviceName)) == 0)
+			return false;
+		device = DeviceName;
+		return true;
+	}
+
+	virtual VolumeType QueryType(const wchar_t *volname)
+	{
+		TraceSpan span("GetDriveTypeW", volname);
+		UINT type = GetDriveTypeW(volname);
+		if (type > VOLUME_RAMDISK)
+			return VOLUME_NO_ROOT_DIR;
+		return (VolumeType)type;
+	}
+
+	virtual bool QueryPaths(const wchar_t *volname, std::vector<std::wstring> &paths)
+	{
+		paths.clear();
+		TraceSpan span("GetVolumePathNamesForVolumeNameW", volname);
+		DWORD charcnt = MAX_PATH + 1;
+		std::vector<wchar_t> names(charcnt);
+		BOOL success = FALSE;
+
+		if (!(success = GetVolumePathNamesForVolumeNameW(volname, &names[0], charcnt, &charcnt)) &&
+				GetLastError() == ERROR_MORE_DATA)	// insufficient buffer
+		{
+			// Try again with the new suggested size.
+			names.resize(charcnt);
+			success = GetVolumePathNamesForVolumeNameW(volname, &names[0], charcnt, &charcnt);
+		}
+		if (!success)
+			return false;
+
+		//  Extract the various paths.
+		for (wchar_t *pname = &names[0]; pname[0] != '\0';)
+		{
+			const wchar_t *cname = pname;
+			pname += wcslen(pname) + 1;
+			if (pname[-2] == '\\')
+				pname[-2] = 0;
+			paths.push_back(cname);
+		}
+		return true;
+	}
+
+	virtual bool QuerySpace(const wchar_t *volname, VolumeSpace &space)
+	{
+		DWORD spc, bps, fs, ts;
+		TraceSpan span("GetDiskFreeSpaceW", volname);
+		if (!GetDiskFreeSpaceW(volname, &spc, &bps, &fs, &ts))
+			return false;
+		space.sectorsPerCluster = spc;
+		space.bytesPerSector = bps;
+		space.freeClusters = fs;
+		space.totalClusters = ts;
+		return true;
+	}
+
+	virtual bool QueryInformation(const wchar_t *volname, std::wstring &label, std::wstring &filesystem)
+	{
+		wchar_t labelbuf[MAX_PATH + 1] = L"";
+		wchar_t fsbuf[MAX_PATH + 1] = L"";
+		TraceSpan span("GetVolumeInformationW", volname);
+		if (!GetVolumeInformationW(volname, labelbuf, MAX_PATH + 1, NULL, NULL, NULL, fsbuf, MAX_PATH + 1))
+			return false;
+		label = labelbuf;
+		filesystem = fsbuf;
+		return true;
+	}
+
+	virtual bool QueryDisks(const wchar_t *volname, std::vector<std::wstring> &disks)
+	{
+		disks.clear();
+		//  The volume device is opened without the trailing backslash, which
+		//  would open its root directory instead.
+		std::wstring name(volname);
+		if (name.size() <= 4)
+			return false;
+		name.erase(name.size() - 1);
+		TraceSpan span("IOCTL_VOLUME_GET_VOLUME_DISK_EXTENTS", volname);
+		HANDLE hVolume = CreateFileW(name.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+			OPEN_EXISTING, 0, NULL);
+		if (hVolume == INVALID_HANDLE_VALUE)
+			return false;
+		// Room for a volume spanning 32 disks
+		union
+		{
+			VOLUME_DISK_EXTENTS extents;
+			char buf[sizeof(VOLUME_DISK_EXTENTS) + 31 * sizeof(DISK_EXTENT)];
+		} result;
+		DWORD bytes = 0;
+		BOOL success = DeviceIoControl(hVolume, IOCTL_VOLUME_GET_VOLUME_DISK_EXTENTS, NULL, 0,
+			&result, sizeof(result), &bytes, NULL);
+		CloseHandle(hVolume);
+		if (!success)
+			return false;
+		for (DWORD i = 0; i < result.extents.NumberOfDiskExtents; ++i)
+		{
+			wchar_t disk[32];
+			swprintf(disk, ARRAYSIZE(disk), L"PhysicalDrive%lu", result.extents.Extents[i].DiskNumber);
+			if (std::find(disks.begin(), disks.end(), disk) == disks.end())
+				disks.push_back(disk);
+		}
+		return !disks.empty();
+	}
+};
+
+static Win32VolumeBackend g_systemBackend;
+
+VolumeBackend &SystemVolumeBackend()
+{
+	return g_systemBackend;
+}
+
+#endif
@@ -0,0 +1,87 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeBackend.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares the volume backend, the thin layer through which all volume
+metadata queries (free space etc.) are made, so that callers such as the
+volume cache can be driven by the system or by a substitute backend.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Volume types, same values as the DRIVE_* results of GetDriveTypeW
+enum VolumeType
+{
+	VOLUME_UNKNOWN = 0,
+	VOLUME_NO_ROOT_DIR,
+	VOLUME_REMOVABLE,
+	VOLUME_FIXED,
+	VOLUME_REMOTE,
+	VOLUME_CDROM,
+	VOLUME_RAMDISK,
+};
+
+// Cluster geometry and usage of a volume, as reported by GetDiskFreeSpaceW
+struct VolumeSpace
+{
+	unsigned long sectorsPerCluster;
+	unsigned long bytesPerSector;
+	unsigned long long freeClusters;
+	unsigned long long totalClusters;
+
+	VolumeSpace() : sectorsPerCluster(0), bytesPerSector(0), freeClusters(0), totalClusters(0) {}
+
+	unsigned long long ClusterBytes() const { return (unsigned long long)sectorsPerCluster * bytesPerSector; }
+	unsigned long long TotalBytes() const { return totalClusters * ClusterBytes(); }
+	unsigned long long FreeBytes() const { return freeClusters * ClusterBytes(); }
+	unsigned long long UsedBytes() const { return (totalClusters - freeClusters) * ClusterBytes(); }
+};
+
+class VolumeBackend
+{
+public:
+	virtual ~VolumeBackend() {}
+
+	// List all volumes by name: their GUID paths ("\\?\Volume{...}\") on
+	// Windows, their mount points on Linux
+	virtual bool EnumVolumes(std::vector<std::wstring> &volnames) = 0;
+
+	// Get the device name (e.g. "\Device\HarddiskVolume1", or the mount
+	// source such as "/dev/sda1" on Linux) of a volume
+	virtual bool QueryDevice(const wchar_t *volname, std::wstring &device) = 0;
+
+	virtual VolumeType QueryType(const wchar_t *volname) = 0;
+
+	// Get the drive letters and mounted folders of a volume, without the
+	// trailing backslash
+	virtual bool QueryPaths(const wchar_t *volname, std::vector<std::wstring> &paths) = 0;
+
+	// Get the free space of a volume. volname is a volume GUID path
+	// ("\\?\Volume{...}\") or a drive root ("C:\"), or any mount point on
+	// Linux.
+	virtual bool QuerySpace(const wchar_t *volname, VolumeSpace &space) = 0;
+
+	// Get the label and file system name of a volume
+	virtual bool QueryInformation(const wchar_t *volname, std::wstring &label, std::wstring &filesystem) = 0;
+
+	// Get the physical disks a volume is on, e.g. "PhysicalDrive0" on
+	// Windows or "sda" on Linux, more than one for volumes spanning disks.
+	// Fails for volumes not on local disks.
+	virtual bool QueryDisks(const wchar_t *volname, std::vector<std::wstring> &disks) = 0;
+};
+
+// The backend querying the running system. On Linux every mount point is a
+// volume of its own, found in /proc/self/mountinfo.
+VolumeBackend &SystemVolumeBackend();
@@ -0,0 +1,330 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeBackendLinux.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of the system volume backend of Linux. Every mount point
+listed in /proc/self/mountinfo is a volume named by its path, and its free
+space comes from statvfs.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#ifdef __linux__
+
+#include "VolumeBackend.h"
+#include "MountTable.h"
+#include "Trace.h"
+#include "Utf8.h"
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+
+// File systems by what they are mounted from
+static const char *g_remoteFilesystems[] = { "nfs", "nfs4", "cifs", "smb3", "smbfs", "ncpfs", "afs",
+	"ceph", "glusterfs", "lustre", "gpfs", "9p", "fuse.sshfs", "fuse.glusterfs", "fuse.ceph", NULL };
+static const char *g_ramFilesystems[] = { "tmpfs", "ramfs", "devtmpfs", NULL };
+static const char *g_cdromFilesystems[] = { "iso9660", "udf", NULL };
+// Kernel interfaces, which hold no files of their own
+static const char *g_pseudoFilesystems[] = { "proc", "sysfs", "cgroup", "cgroup2", "devpts", "mqueue",
+	"debugfs", "tracefs", "securityfs", "pstore", "bpf", "configfs", "fusectl", "hugetlbfs", "autofs",
+	"binfmt_misc", "nsfs", "efivarfs", "selinuxfs", "rpc_pipefs", NULL };
+
+static bool IsOneOf(const std::string &name, const char **names)
+{
+	for (; *names; ++names)
+	{
+		if (name == *names)
+			return true;
+	}
+	return false;
+}
+
+static bool ReadTextFile(const char *path, std::string &text)
+{
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return false;
+	text.clear();
+	char buf[4096];
+	size_t len;
+	while ((len = fread(buf, 1, sizeof(buf), file)) > 0)
+		text.append(buf, len);
+	fclose(file);
+	return true;
+}
+
+static std::string RealPath(const std::string &path)
+{
+	char *real = realpath(path.c_str(), NULL);
+	if (!real)
+		return path;
+	std::string result(real);
+	free(real);
+	return result;
+}
+
+// Whether the block device holding the file system of source is removable.
+// Partitions tell it through the disk they are on.
+static bool IsRemovableDevice(const std::string &source)
+{
+	std::string device = RealPath(source);
+	if (device.compare(0, 5, "/dev/") != 0)
+		return false;
+	std::string block = "/sys/class/block/" + device.substr(5);
+	std::string text;
+	if (!ReadTextFile((block + "/removable").c_str(), text) &&
+		!ReadTextFile((RealPath(block) + "/../removable").c_str(), text))
+		return false;
+	return !text.empty() && text[0] == '1';
+}
+
+// Undo the \xHH escapes of a /dev/disk/by-label name
+static std::string UnescapeLabel(const char *name)
+{
+	std::string label;
+	for (; *name; ++name)
+	{
+		unsigned value;
+		if (name[0] == '\\' && name[1] == 'x' && sscanf(name + 2, "%2x", &value) == 1)
+		{
+			label += (char)value;
+			name += 3;
+		}
+		else
+			label += *name;
+	}
+	return label;
+}
+
+// Find the label of the file system on the block device source
+static bool FindLabel(const std::string &source, std::string &label)
+{
+	DIR *dir = opendir("/dev/disk/by-label");
+	if (!dir)
+		return false;
+	std::string device = RealPath(source);
+	bool found = false;
+	while (dirent *entry = readdir(dir))
+	{
+		if (entry->d_name[0] == '.')
+			continue;
+		if (RealPath(std::string("/dev/disk/by-label/") + entry->d_name) == device)
+		{
+			label = UnescapeLabel(entry->d_name);
+			found = true;
+			break;
+		}
+	}
+	closedir(dir);
+	return found;
+}
+
+// Add the disks under the block device block (e.g. "sda1" or "dm-0") to
+// disks. Device mapper and md devices are on the devices in their slaves
+// directory, partitions on the disk whose directory holds theirs.
+static void FindDisks(const std::string &block, std::vector<std::wstring> &disks, int depth)
+{
+	std::string sys = RealPath("/sys/class/block/" + block);
+	bool stacked = false;
+	if (DIR *dir = opendir((sys + "/slaves").c_str()))
+	{
+		while (dirent *entry = readdir(dir))
+		{
+			if (entry->d_name[0] == '.')
+				continue;
+			stacked = true;
+			if (depth < 8)
+				FindDisks(entry->d_name, disks, depth + 1);
+		}
+		closedir(dir);
+	}
+	if (stacked)
+		return;
+	std::string disk = block;
+	struct stat st;
+	if (stat((sys + "/partition").c_str(), &st) == 0)
+	{
+		std::string parent = sys.substr(0, sys.rfind('/'));
+		disk = parent.substr(parent.rfind('/') + 1);
+	}
+	std::wstring name = Utf8ToWide(disk);
+	if (std::find(disks.begin(), disks.end(), name) == disks.end())
+		disks.push_back(name);
+}
+
+class LinuxVolumeBackend : public VolumeBackend
+{
+public:
+	virtual bool EnumVolumes(std::vector<std::wstring> &volnames)
+	{
+		volnames.clear();
+		std::lock_guard<std::mutex> lock(m_lock);
+		if (!Reload())
+			return false;
+		// A later mount at the same path hides the earlier one, which keeps
+		// its place in the list
+		for (size_t i = 0; i < m_entries.size(); ++i)
+		{
+			if (m_mounts[m_entries[i].path] == i)
+				volnames.push_back(m_entries[i].path);
+		}
+		return true;
+	}
+
+	virtual bool QueryDevice(const wchar_t *volname, std::wstring &device)
+	{
+		MountInfoEntry entry;
+		if (!Find(volname, entry))
+			return false;
+		device = entry.source;
+		return true;
+	}
+
+	virtual VolumeType QueryType(const wchar_t *volname)
+	{
+		MountInfoEntry entry;
+		if (!Find(volname, entry))
+			return VOLUME_NO_ROOT_DIR;
+		std::string filesystem = WideToUtf8(entry.filesystem);
+		if (IsOneOf(filesystem, g_remoteFilesystems))
+			return VOLUME_REMOTE;
+		if (IsOneOf(filesystem, g_ramFilesystems))
+			return VOLUME_RAMDISK;
+		if (IsOneOf(filesystem, g_cdromFilesystems))
+			return VOLUME_CDROM;
+		if (IsOneOf(filesystem, g_pseudoFilesystems))
+			return VOLUME_UNKNOWN;
+		TraceSpan span("IsRemovableDevice", volname);
+		if (IsRemovableDevice(WideToUtf8(entry.source)))
+			return VOLUME_REMOVABLE;
+		return VOLUME_FIXED;
+	}
+
+	virtual bool QueryPaths(const wchar_t *volname, std::vector<std::wstring> &paths)
+	{
+		paths.clear();
+		MountInfoEntry entry;
+		if (!Find(volname, entry))
+			return false;
+		paths.push_back(entry.path);
+		return true;
+	}
+
+	virtual bool QuerySpace(const wchar_t *volname, VolumeSpace &space)
+	{
+		struct statvfs st;
+		TraceSpan span("statvfs", volname);
+		if (statvfs(WideToUtf8(volname).c_str(), &st) != 0)
+			return false;
+		// Blocks are the clusters. Free space is what is available to
+		// unprivileged users, as it is to the caller on Windows.
+		space.sectorsPerCluster = 1;
+		space.bytesPerSector = (unsigned long)(st.f_frsize ? st.f_frsize : st.f_bsize);
+		space.freeClusters = st.f_bavail;
+		space.totalClusters = st.f_blocks;
+		return true;
+	}
+
+	virtual bool QueryInformation(const wchar_t *volname, std::wstring &label, std::wstring &filesystem)
+	{
+		MountInfoEntry entry;
+		if (!Find(volname, entry))
+			return false;
+		filesystem = entry.filesystem;
+		TraceSpan span("FindLabel", volname);
+		std::string text;
+		label = FindLabel(WideToUtf8(entry.source), text) ? Utf8ToWide(text) : std::wstring();
+		return true;
+	}
+
+	virtual bool QueryDisks(const wchar_t *volname, std::vector<std::wstring> &disks)
+	{
+		disks.clear();
+		MountInfoEntry entry;
+		if (!Find(volname, entry))
+			return false;
+		TraceSpan span("FindDisks", volname);
+		// The block device mounted, or else the one the mount point reports,
+		// as /dev/root and the like have no node of their own. Sources not
+		// in /dev are remote or virtual and never touched.
+		std::string source = WideToUtf8(entry.source);
+		if (source.compare(0, 5, "/dev/") != 0)
+			return false;
+		std::string block;
+		std::string device = RealPath(source);
+		struct stat st;
+		if (device.compare(0, 5, "/dev/") == 0 && stat(("/sys/class/block/" + device.substr(5)).c_str(), &st) == 0)
+			block = device.substr(5);
+		else if (stat(WideToUtf8(volname).c_str(), &st) == 0)
+		{
+			char sys[64];
+			sprintf(sys, "/sys/dev/block/%u:%u", major(st.st_dev), minor(st.st_dev));
+			std::string real = RealPath(sys);
+			if (real != sys)
+				block = real.substr(real.rfind('/') + 1);
+		}
+		if (block.empty())
+			return false;
+		FindDisks(block, disks, 0);
+		return !disks.empty();
+	}
+
+private:
+	// Read the mounts again. Called with m_lock held.
+	bool Reload()
+	{
+		TraceSpan span("ReadMountInfo");
+		std::string text;
+		if (!ReadTextFile("/proc/self/mountinfo", text))
+			return false;
+		MountTable::ParseMountInfo(text, m_entries);
+		m_mounts.clear();
+		for (size_t i = 0; i < m_entries.size(); ++i)
+			m_mounts[m_entries[i].path] = i;
+		return true;
+	}
+
+	// Get the mount at volname, reading the mounts again if it is not known
+	bool Find(const wchar_t *volname, MountInfoEntry &entry)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		std::map<std::wstring, size_t>::const_iterator mount = m_mounts.find(volname);
+		if (mount == m_mounts.end())
+		{
+			if (!Reload())
+				return false;
+			mount = m_mounts.find(volname);
+			if (mount == m_mounts.end())
+				return false;
+		}
+		entry = m_entries[mount->second];
+		return true;
+	}
+
+	std::mutex m_lock;
+	std::vector<MountInfoEntry> m_entries;
+	std::map<std::wstring, size_t> m_mounts;	// latest entry at each path
+};
+
+static LinuxVolumeBackend g_systemBackend;
+
+VolumeBackend &SystemVolumeBackend()
+{
+	return g_systemBackend;
+}
+
+#endif
@@ -0,0 +1,158 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeCache.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of VolumeCache.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "VolumeCache.h"
+#include <thread>
+
+VolumeCache::VolumeCache(unsigned ttlMs, bool serveStale) :
+m_ttl(std::chrono::milliseconds(ttlMs)),
+m_serveStale(serveStale),
+m_generation(0),
+m_refreshes(0)
+{
+}
+
+VolumeCache::~VolumeCache()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (m_refreshes)
+		m_refreshed.wait(lock);
+}
+
+void VolumeCache::SetTtl(unsigned ttlMs)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_ttl = std::chrono::milliseconds(ttlMs);
+}
+
+void VolumeCache::SetServeStale(bool serveStale)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_serveStale = serveStale;
+}
+
+bool VolumeCache::Get(const std::wstring &volname, const Loader &loader, VolumeCacheEntry &entry)
+{
+	unsigned long long generation;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		generation = m_generation;
+		auto it = m_slots.find(volname);
+		if (it != m_slots.end())
+		{
+			Slot &slot = it->second;
+			if (Clock::now() - slot.loaded < m_ttl)
+			{
+				entry = slot.entry;
+				return true;
+			}
+			if (m_serveStale)
+			{
+				entry = slot.entry;
+				// Only the first caller after expiry starts a reload
+				if (!slot.refreshing)
+				{
+					slot.refreshing = true;
+					++m_refreshes;
+					std::thread(&VolumeCache::Refresh, this, volname, loader, generation).detach();
+				}
+				return true;
+			}
+		}
+	}
+
+	// Missing, or stale and not allowed to be served. Load in place.
+	VolumeCacheEntry loaded;
+	if (loader(volname, loaded))
+	{
+		Store(volname, loaded, generation);
+		entry = loaded;
+		return true;
+	}
+
+	return Peek(volname, entry);
+}
+
+void VolumeCache::Refresh(const std::wstring &volname, Loader loader, unsigned long long generation)
+{
+	VolumeCacheEntry entry;
+	if (loader(volname, entry))
+		Store(volname, entry, generation);
+
+	// On failure the old value is served on, and the next expired Get()
+	// retries
+	std::lock_guard<std::mutex> lock(m_lock);
+	auto it = m_slots.find(volname);
+	if (it != m_slots.end())
+		it->second.refreshing = false;
+	// Notified with the lock held, as the cache may be gone once it is not
+	--m_refreshes;
+	m_refreshed.notify_all();
+}
+
+void VolumeCache::Store(const std::wstring &volname, const VolumeCacheEntry &entry, unsigned long long generation)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if (generation != m_generation)
+		return;
+	Slot &slot = m_slots[volname];
+	slot.entry = entry;
+	slot.loaded = Clock::now();
+	slot.refreshing = false;
+}
+
+bool VolumeCache::Peek(const std::wstring &volname, VolumeCacheEntry &entry)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	auto it = m_slots.find(volname);
+	if (it == m_slots.end())
+		return false;
+	entry = it->second.entry;
+	return true;
+}
+
+void VolumeCache::Put(const std::wstring &volname, const VolumeCacheEntry &entry)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	Slot &slot = m_slots[volname];
+	slot.entry = entry;
+	slot.loaded = Clock::now();
+	slot.refreshing = false;
+}
+
+void VolumeCache::Invalidate(const std::wstring &volname)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	++m_generation;
+	m_slots.erase(volname);
+}
+
+void VolumeCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	++m_generation;
+	m_slots.clear();
+}
+
+// Never destroyed: background reloads may outlive static destruction
+static VolumeCache *g_volumeCache;
+static std::once_flag g_volumeCacheOnce;
+
+VolumeCache &VolumeCache::Global()
+{
+	std::call_once(g_volumeCacheOnce, []() { g_volumeCache = new VolumeCache; });
+	return *g_volumeCache;
+}
@@ -0,0 +1,98 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeCache.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares VolumeCache, a process-wide cache of volume free space
+results keyed by volume GUID name, so that repeatedly right-clicking the same
+volume does not query the disk again until the entry expires.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "VolumeBackend.h"
+#include <string>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+
+struct VolumeCacheEntry
+{
+	VolumeSpace space;
+	std::wstring tip;	// formatted menu text
+};
+
+class VolumeCache
+{
+public:
+	// Fills entry for the volume, returns false if the volume cannot be queried
+	typedef std::function<bool(const std::wstring &volname, VolumeCacheEntry &entry)> Loader;
+
+	enum { DEFAULT_TTL_MS = 10000 };
+
+	VolumeCache(unsigned ttlMs = DEFAULT_TTL_MS, bool serveStale = true);
+	// Waits for the background reloads still running
+	~VolumeCache();
+
+	// Entries older than ttlMs are stale. If serveStale is set, a stale entry
+	// is still returned and reloaded in the background, otherwise it is
+	// reloaded before returning.
+	void SetTtl(unsigned ttlMs);
+	void SetServeStale(bool serveStale);
+
+	// Get the entry of a volume, calling loader if it is missing or stale.
+	// If loader fails the last known entry is returned. Returns false if
+	// there is no entry and loader failed.
+	bool Get(const std::wstring &volname, const Loader &loader, VolumeCacheEntry &entry);
+
+	// Get the last known entry of a volume without loading it, however old
+	bool Peek(const std::wstring &volname, VolumeCacheEntry &entry);
+
+	// Store a freshly loaded entry, e.g. one that arrived after its caller
+	// stopped waiting
+	void Put(const std::wstring &volname, const VolumeCacheEntry &entry);
+
+	// Reloads running meanwhile, in the background or in Get(), are not
+	// stored when they finish
+	void Invalidate(const std::wstring &volname);
+	void Clear();
+
+	// The instance shared by the whole process
+	static VolumeCache &Global();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Slot
+	{
+		VolumeCacheEntry entry;
+		Clock::time_point loaded;
+		bool refreshing;	// a background reload is in progress
+		Slot() : refreshing(false) {}
+	};
+
+	void Refresh(const std::wstring &volname, Loader loader, unsigned long long generation);
+	// Store entry unless the cache was invalidated since generation
+	void Store(const std::wstring &volname, const VolumeCacheEntry &entry, unsigned long long generation);
+
+	std::mutex m_lock;
+	std::condition_variable m_refreshed;
+	std::map<std::wstring, Slot> m_slots;
+	Clock::duration m_ttl;
+	bool m_serveStale;
+	unsigned long long m_generation;	// bumped by Invalidate() and Clear()
+	unsigned m_refreshes;	// background reloads running
+
+	VolumeCache(const VolumeCache &);
+	VolumeCache &operator =(const VolumeCache &);
+};
@@ -0,0 +1,85 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeList.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of CollectVolumes and QueryVolumes.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "VolumeList.h"
+#include "Trace.h"
+#include <memory>
+
+// Run all queries of one volume, on a worker thread
+static bool QueryVolume(VolumeBackend &backend, VolumeRecord &record)
+{
+	const wchar_t *volname = record.volname.c_str();
+	TraceSpan span("QueryVolume", volname);
+	if (!backend.QueryDevice(volname, record.device))
+		return false;
+	record.type = backend.QueryType(volname);
+	backend.QueryPaths(volname, record.paths);
+	if (VolumeRecord::WantInformation(record.type))
+		record.hasInformation = backend.QueryInformation(volname, record.label, record.filesystem);
+	if (VolumeRecord::WantSpace(record.type))
+		record.hasSpace = backend.QuerySpace(volname, record.space);
+	return true;
+}
+
+void QueryVolumes(VolumeBackend &backend, VolumeQuery &query, const std::vector<std::wstring> &volnames,
+	QueryClock::time_point deadline, std::vector<VolumeRecord> &records)
+{
+	records.clear();
+	// Each job fills its own record, which is copied out only once the job
+	// has completed. A job that misses the deadline keeps its record alive.
+	std::vector<std::shared_ptr<VolumeRecord> > results(volnames.size());
+	std::vector<std::shared_ptr<QueryTicket> > tickets(volnames.size());
+	records.resize(volnames.size());
+	for (size_t i = 0; i < volnames.size(); ++i)
+	{
+		records[i].volname = volnames[i];
+		std::shared_ptr<VolumeRecord> result = std::make_shared<VolumeRecord>();
+		result->volname = volnames[i];
+		results[i] = result;
+		VolumeBackend *pbackend = &backend;
+		tickets[i] = query.Start(volnames[i],
+			[pbackend, result]() { return QueryVolume(*pbackend, *result); },
+			records[i].status);
+	}
+
+	// Reassemble in the order asked
+	TraceSpan span("WaitVolumes");
+	for (size_t i = 0; i < volnames.size(); ++i)
+	{
+		if (!tickets[i])
+			continue;	// not started, records[i].status tells why
+		if (!tickets[i]->WaitUntil(deadline))
+		{
+			query.TimedOut(volnames[i]);
+			records[i].status = VolumeQuery::QUERY_PENDING;
+			continue;
+		}
+		records[i] = *results[i];
+		records[i].status = tickets[i]->Succeeded() ? VolumeQuery::QUERY_OK : VolumeQuery::QUERY_FAILED;
+	}
+}
+
+bool CollectVolumes(VolumeBackend &backend, VolumeQuery &query, QueryClock::time_point deadline,
+	std::vector<VolumeRecord> &records)
+{
+	records.clear();
+	TraceSpan span("CollectVolumes");
+	std::vector<std::wstring> volnames;
+	if (!backend.EnumVolumes(volnames))
+		return false;
+	QueryVolumes(backend, query, volnames, deadline, records);
+	return true;
+}
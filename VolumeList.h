@@ -0,0 +1,70 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeList.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares CollectVolumes, which gathers the details of all volumes
+of the system for the detail view, and QueryVolumes, which does the same for
+some of them. The per-volume queries run in parallel on
+the query workers, so collecting takes about as long as the slowest volume
+rather than the sum of all of them.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "VolumeBackend.h"
+#include "VolumeQuery.h"
+#include <string>
+#include <vector>
+
+struct VolumeRecord
+{
+	std::wstring volname;
+	// Outcome of the queries of this volume. Unless QUERY_OK or
+	// QUERY_FAILED, nothing below volname is filled.
+	VolumeQuery::Status status;
+
+	std::wstring device;
+	VolumeType type;
+	std::vector<std::wstring> paths;
+	bool hasInformation;	// label and filesystem are valid
+	std::wstring label;
+	std::wstring filesystem;
+	bool hasSpace;			// space is valid
+	VolumeSpace space;
+
+	VolumeRecord() : status(VolumeQuery::QUERY_PENDING), type(VOLUME_UNKNOWN),
+		hasInformation(false), hasSpace(false) {}
+
+	// Whether the label and file system are queried for a type of volume
+	static bool WantInformation(VolumeType type)
+	{
+		return type == VOLUME_FIXED || type == VOLUME_REMOTE || type == VOLUME_RAMDISK;
+	}
+	// Whether the free space is queried for a type of volume
+	static bool WantSpace(VolumeType type)
+	{
+		return type == VOLUME_FIXED;
+	}
+};
+
+// Query all volumes of backend, one job per volume on query, and wait for
+// them until deadline. records receives one record per volume in enumeration
+// order, whether its job completed or not. Returns false if the volumes
+// could not be enumerated.
+bool CollectVolumes(VolumeBackend &backend, VolumeQuery &query, QueryClock::time_point deadline,
+	std::vector<VolumeRecord> &records);
+
+// Query the volumes volnames like CollectVolumes does, e.g. only those
+// holding some paths. records receives one record per volume in the order
+// of volnames.
+void QueryVolumes(VolumeBackend &backend, VolumeQuery &query, const std::vector<std::wstring> &volnames,
+	QueryClock::time_point deadline, std::vector<VolumeRecord> &records);
@@ -0,0 +1,261 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeQuery.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of QueryWorker and VolumeQuery.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "VolumeQuery.h"
+#include <thread>
+#include <algorithm>
+
+#pragma region QueryTicket
+
+bool QueryTicket::WaitUntil(QueryClock::time_point deadline)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (!m_done)
+	{
+		if (m_cond.wait_until(lock, deadline) == std::cv_status::timeout)
+			return m_done;
+	}
+	return true;
+}
+
+bool QueryTicket::Done()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_done;
+}
+
+bool QueryTicket::Succeeded()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_done && m_ok;
+}
+
+void QueryTicket::Complete(bool ok)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_done = true;
+	m_ok = ok;
+	m_cond.notify_all();
+}
+
+#pragma endregion
+
+
+#pragma region QueryWorker
+
+QueryWorker::QueryWorker(unsigned maxThreads) :
+m_maxThreads(std::max(maxThreads, 1u)),
+m_threads(0),
+m_idle(0),
+m_stop(false)
+{
+}
+
+QueryWorker::~QueryWorker()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_stop = true;
+	m_cond.notify_all();
+	while (m_threads > 0)
+		m_cond.wait(lock);
+}
+
+void QueryWorker::SetMaxThreads(unsigned maxThreads)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_maxThreads = std::max(maxThreads, 1u);
+}
+
+std::shared_ptr<QueryTicket> QueryWorker::Submit(const std::function<bool()> &job)
+{
+	Job item;
+	item.run = job;
+	item.ticket = std::make_shared<QueryTicket>();
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_jobs.push_back(item);
+	// Start another thread only if all existing ones are busy (or hung)
+	if (m_idle < m_jobs.size() && m_threads < m_maxThreads)
+	{
+		++m_threads;
+		std::thread(&QueryWorker::ThreadProc, this).detach();
+	}
+	m_cond.notify_one();
+	return item.ticket;
+}
+
+void QueryWorker::ThreadProc()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	for (;;)
+	{
+		while (m_jobs.empty() && !m_stop)
+		{
+			++m_idle;
+			m_cond.wait(lock);
+			--m_idle;
+		}
+		if (m_stop)
+			break;
+
+		Job job = m_jobs.front();
+		m_jobs.pop_front();
+		lock.unlock();
+		bool ok = false;
+		try
+		{
+			ok = job.run();
+		}
+		catch (...)
+		{
+		}
+		job.ticket->Complete(ok);
+		lock.lock();
+	}
+	--m_threads;
+	m_cond.notify_all();
+}
+
+// Never destroyed: hung queries may still be running at process exit
+static QueryWorker *g_queryWorker;
+static std::once_flag g_queryWorkerOnce;
+
+QueryWorker &QueryWorker::Global()
+{
+	std::call_once(g_queryWorkerOnce, []() { g_queryWorker = new QueryWorker; });
+	return *g_queryWorker;
+}
+
+#pragma endregion
+
+
+#pragma region VolumeQuery
+
+VolumeQuery::VolumeQuery(QueryWorker &worker, unsigned backoffMs, unsigned maxBackoffMs) :
+m_worker(worker),
+m_backoff(std::chrono::milliseconds(backoffMs)),
+m_maxBackoff(std::chrono::milliseconds(maxBackoffMs))
+{
+}
+
+void VolumeQuery::SetBackoff(unsigned backoffMs, unsigned maxBackoffMs)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_backoff = std::chrono::milliseconds(backoffMs);
+	m_maxBackoff = std::chrono::milliseconds(maxBackoffMs);
+}
+
+VolumeQuery::Status VolumeQuery::Run(const std::wstring &volname,
+	const std::function<bool()> &job, QueryClock::time_point deadline)
+{
+	Status status;
+	std::shared_ptr<QueryTicket> ticket = Start(volname, job, status);
+	if (!ticket)
+		return status;
+	if (!ticket->WaitUntil(deadline))
+	{
+		TimedOut(volname);
+		return QUERY_PENDING;
+	}
+	return ticket->Succeeded() ? QUERY_OK : QUERY_FAILED;
+}
+
+std::shared_ptr<QueryTicket> VolumeQuery::Start(const std::wstring &volname,
+	const std::function<bool()> &job, Status &status)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if (m_inflight.count(volname))
+		{
+			status = QUERY_PENDING;
+			return NULL;
+		}
+		auto failure = m_failures.find(volname);
+		if (failure != m_failures.end() && QueryClock::now() < failure->second.retryAt)
+		{
+			status = QUERY_BACKOFF;
+			return NULL;
+		}
+		m_inflight.insert(volname);
+	}
+
+	status = QUERY_PENDING;
+	return m_worker.Submit([this, volname, job]() -> bool {
+		bool ok = false;
+		try
+		{
+			ok = job();
+		}
+		catch (...)
+		{
+		}
+		Finished(volname, ok);
+		return ok;
+	});
+}
+
+void VolumeQuery::Finished(const std::wstring &volname, bool ok)
+{
+	if (!ok)
+		Failed(volname);
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_inflight.erase(volname);
+	if (ok)
+		m_failures.erase(volname);
+}
+
+void VolumeQuery::Failed(const std::wstring &volname)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	Failure &failure = m_failures[volname];
+	if (failure.count < 31)
+		++failure.count;
+	QueryClock::duration wait = m_backoff;
+	for (unsigned i = 1; i < failure.count && wait < m_maxBackoff; ++i)
+		wait *= 2;
+	failure.retryAt = QueryClock::now() + std::min(wait, m_maxBackoff);
+}
+
+void VolumeQuery::TimedOut(const std::wstring &volname)
+{
+	// Count a timeout as a failure so that a hanging volume is backed off.
+	// A late success clears it again.
+	Failed(volname);
+}
+
+void VolumeQuery::Reset(const std::wstring &volname)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_failures.erase(volname);
+}
+
+void VolumeQuery::ResetAll()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_failures.clear();
+}
+
+// Never destroyed, same as the QueryWorker it uses
+static VolumeQuery *g_volumeQuery;
+static std::once_flag g_volumeQueryOnce;
+
+VolumeQuery &VolumeQuery::Global()
+{
+	std::call_once(g_volumeQueryOnce, []() { g_volumeQuery = new VolumeQuery(QueryWorker::Global()); });
+	return *g_volumeQuery;
+}
+
+#pragma endregion
@@ -0,0 +1,162 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeQuery.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares QueryWorker and VolumeQuery. Volume queries (free space,
+label etc.) may block for a long time on slow or unreachable volumes such as
+dead network shares. They are therefore run on worker threads, and callers
+wait for them only up to a deadline. Volumes that keep failing or timing out
+are put into exponential backoff and not queried again until it expires.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+
+typedef std::chrono::steady_clock QueryClock;
+
+// Completion state of a job submitted to a QueryWorker
+class QueryTicket
+{
+public:
+	QueryTicket() : m_done(false), m_ok(false) {}
+
+	// Wait for the job until deadline. Returns true if it has completed.
+	bool WaitUntil(QueryClock::time_point deadline);
+	bool Done();
+	// Result of the job, valid once it has completed
+	bool Succeeded();
+
+private:
+	friend class QueryWorker;
+	void Complete(bool ok);
+
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	bool m_done;
+	bool m_ok;
+};
+
+// A set of threads running blocking jobs. Threads are started on demand up to
+// maxThreads, and a job hanging forever only ever occupies its own thread.
+// The destructor waits for running jobs to return.
+class QueryWorker
+{
+public:
+	enum { DEFAULT_MAX_THREADS = 16 };
+
+	explicit QueryWorker(unsigned maxThreads = DEFAULT_MAX_THREADS);
+	~QueryWorker();
+
+	// Threads already running above a lowered limit are not stopped
+	void SetMaxThreads(unsigned maxThreads);
+
+	// Queue job, which returns whether it succeeded
+	std::shared_ptr<QueryTicket> Submit(const std::function<bool()> &job);
+
+	// The instance shared by the whole process
+	static QueryWorker &Global();
+
+private:
+	struct Job
+	{
+		std::function<bool()> run;
+		std::shared_ptr<QueryTicket> ticket;
+	};
+
+	void ThreadProc();
+
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	std::deque<Job> m_jobs;
+	unsigned m_maxThreads;
+	unsigned m_threads;
+	unsigned m_idle;
+	bool m_stop;
+
+	QueryWorker(const QueryWorker &);
+	QueryWorker &operator =(const QueryWorker &);
+};
+
+// Deadline-bounded queries of volumes with a negative cache of unreachable
+// ones. A volume has at most one query in flight, so a hung volume never
+// occupies more than one worker thread.
+class VolumeQuery
+{
+public:
+	enum Status
+	{
+		QUERY_OK,		// completed in time and succeeded
+		QUERY_FAILED,	// completed in time and failed
+		QUERY_PENDING,	// timed out, or an earlier query is still running
+		QUERY_BACKOFF,	// recently failed, not queried until backoff expires
+	};
+
+	enum { DEFAULT_BACKOFF_MS = 1000, DEFAULT_MAX_BACKOFF_MS = 5 * 60 * 1000 };
+
+	VolumeQuery(QueryWorker &worker, unsigned backoffMs = DEFAULT_BACKOFF_MS,
+		unsigned maxBackoffMs = DEFAULT_MAX_BACKOFF_MS);
+
+	void SetBackoff(unsigned backoffMs, unsigned maxBackoffMs);
+
+	// Run job, which queries volname and returns whether it succeeded, and
+	// wait for it at most until deadline. A job that times out keeps running
+	// and should publish its own result (e.g. into VolumeCache) when done.
+	Status Run(const std::wstring &volname, const std::function<bool()> &job,
+		QueryClock::time_point deadline);
+
+	// Start job without waiting. Returns NULL with the reason in status if it
+	// was not started.
+	std::shared_ptr<QueryTicket> Start(const std::wstring &volname,
+		const std::function<bool()> &job, Status &status);
+
+	// Record that a query started by Start() missed its caller's deadline,
+	// which counts as a failure until the query succeeds after all
+	void TimedOut(const std::wstring &volname);
+
+	// Forget the failure history of a volume, e.g. after it was remounted
+	void Reset(const std::wstring &volname);
+	// Forget the failure history of all volumes, e.g. after mounts changed
+	void ResetAll();
+
+	static VolumeQuery &Global();
+
+private:
+	struct Failure
+	{
+		unsigned count;
+		QueryClock::time_point retryAt;
+		Failure() : count(0) {}
+	};
+
+	void Finished(const std::wstring &volname, bool ok);
+	void Failed(const std::wstring &volname);
+
+	QueryWorker &m_worker;
+	std::mutex m_lock;
+	std::set<std::wstring> m_inflight;
+	std::map<std::wstring, Failure> m_failures;
+	QueryClock::duration m_backoff;
+	QueryClock::duration m_maxBackoff;
+
+	VolumeQuery(const VolumeQuery &);
+	VolumeQuery &operator =(const VolumeQuery &);
+};
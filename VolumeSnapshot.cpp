@@ -0,0 +1,512 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeSnapshot.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Implementation of the volume snapshot. Readers may copy out a snapshot
+while it is being replaced, so everything they read is bounds checked
+before use and thrown away unless the sequence number held still.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "VolumeSnapshot.h"
+#include "Utf8.h"
+#include <algorithm>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// A snapshot older than this many intervals of its collector is stale
+#define SNAPSHOT_STALE_INTERVALS 3
+// and older than this anyway, for collectors publishing very often
+#define SNAPSHOT_MIN_STALE_MS 2000
+// Looking for the segment again while there is no fresh one, at most this often
+#define SNAPSHOT_ATTACH_RETRY_MS 1000
+// Times a reader tries to get a consistent copy before giving up
+#define SNAPSHOT_READ_ATTEMPTS 16
+
+uint64_t SnapshotClockMs()
+{
+#ifdef _WIN32
+	return GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+// The name of the segment for the system. On Linux the segment is per user.
+#ifdef _WIN32
+static std::wstring SegmentName(const std::wstring &name)
+{
+	return L"Local\\" + name;
+}
+#else
+static std::string SegmentName(const std::wstring &name)
+{
+	char uid[16];
+	sprintf(uid, ".%u", (unsigned)getuid());
+	return "/" + WideToUtf8(name) + uid;
+}
+#endif
+
+static bool IsFresh(uint64_t published, uint32_t intervalMs, uint64_t now)
+{
+	uint64_t maxAge = std::max<uint64_t>((uint64_t)intervalMs * SNAPSHOT_STALE_INTERVALS, SNAPSHOT_MIN_STALE_MS);
+	return published && now - published <= maxAge;
+}
+
+#pragma region VolumeSnapshotWriter
+
+VolumeSnapshotWriter::VolumeSnapshotWriter(const std::wstring &name) :
+m_name(name),
+m_header(NULL)
+#ifdef _WIN32
+, m_hMapping(NULL)
+#endif
+{
+}
+
+VolumeSnapshotWriter::~VolumeSnapshotWriter()
+{
+	if (!m_header)
+		return;
+	// Readers notice the snapshot going stale
+#ifdef _WIN32
+	UnmapViewOfFile(m_header);
+	CloseHandle(m_hMapping);
+#else
+	munmap(m_header, VOLUME_SNAPSHOT_SIZE);
+	shm_unlink(SegmentName(m_name).c_str());
+#endif
+}
+
+bool VolumeSnapshotWriter::Create()
+{
+	void *view = NULL;
+#ifdef _WIN32
+	HANDLE hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		0, VOLUME_SNAPSHOT_SIZE, SegmentName(m_name).c_str());
+	if (!hMapping)
+		return false;
+	view = MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, VOLUME_SNAPSHOT_SIZE);
+	if (!view)
+	{
+		CloseHandle(hMapping);
+		return false;
+	}
+	m_hMapping = hMapping;
+#else
+	// A segment left behind by a collector that did not exit cleanly is
+	// taken over, along with its readers
+	int fd = shm_open(SegmentName(m_name).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, VOLUME_SNAPSHOT_SIZE) == 0)
+		view = mmap(NULL, VOLUME_SNAPSHOT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (!view || view == MAP_FAILED)
+		return false;
+#endif
+	m_header = static_cast<VolumeSnapshotHeader *>(view);
+	if (memcmp(m_header->magic, VOLUME_SNAPSHOT_MAGIC, sizeof(m_header->magic)) != 0 ||
+		m_header->version != VOLUME_SNAPSHOT_VERSION)
+	{
+		// New memory is zeroed, so the sequence starts out even
+		m_header->version = VOLUME_SNAPSHOT_VERSION;
+		m_header->headerSize = sizeof(VolumeSnapshotHeader);
+		m_header->entrySize = sizeof(VolumeSnapshotEntry);
+		m_header->charSize = sizeof(wchar_t);
+		m_header->size = VOLUME_SNAPSHOT_SIZE;
+		m_header->instance = SnapshotClockMs() << 20 ^ (uint64_t)
+#ifdef _WIN32
+			GetCurrentProcessId();
+#else
+			getpid();
+#endif
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(m_header->magic, VOLUME_SNAPSHOT_MAGIC, sizeof(m_header->magic));
+	}
+	return true;
+}
+
+// Append str, terminated, to strings and return where it starts
+static uint32_t AddString(std::vector<wchar_t> &strings, const std::wstring &str)
+{
+	uint32_t offset = (uint32_t)strings.size();
+	strings.insert(strings.end(), str.begin(), str.end());
+	strings.push_back(0);
+	return offset;
+}
+
+bool VolumeSnapshotWriter::Publish(const std::vector<VolumeRecord> &records, unsigned intervalMs)
+{
+	if (!m_header && !Create())
+		return false;
+
+	// Lay out the snapshot first, to copy it in quickly
+	std::vector<VolumeSnapshotEntry> entries(records.size());
+	std::vector<uint32_t> order(records.size());
+	std::vector<wchar_t> strings;
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const VolumeRecord &record = records[i];
+		VolumeSnapshotEntry &entry = entries[i];
+		memset(&entry, 0, sizeof(entry));
+		entry.volname = AddString(strings, record.volname);
+		entry.device = AddString(strings, record.device);
+		entry.label = AddString(strings, record.label);
+		entry.filesystem = AddString(strings, record.filesystem);
+		entry.paths = (uint32_t)strings.size();
+		for (size_t p = 0; p < record.paths.size(); ++p)
+			AddString(strings, record.paths[p]);
+		entry.pathCount = (uint32_t)record.paths.size();
+		entry.status = record.status;
+		entry.type = record.type;
+		entry.flags = (record.hasInformation ? VOLUME_SNAPSHOT_HAS_INFORMATION : 0) |
+			(record.hasSpace ? VOLUME_SNAPSHOT_HAS_SPACE : 0);
+		entry.sectorsPerCluster = (uint32_t)record.space.sectorsPerCluster;
+		entry.bytesPerSector = (uint32_t)record.space.bytesPerSector;
+		entry.freeClusters = record.space.freeClusters;
+		entry.totalClusters = record.space.totalClusters;
+		order[i] = (uint32_t)i;
+	}
+	std::sort(order.begin(), order.end(), [&records](uint32_t a, uint32_t b) {
+		return records[a].volname < records[b].volname;
+	});
+
+	size_t size = sizeof(VolumeSnapshotHeader) + entries.size() * (sizeof(VolumeSnapshotEntry) + sizeof(uint32_t)) +
+		strings.size() * sizeof(wchar_t);
+	bool fits = size <= VOLUME_SNAPSHOT_SIZE;
+
+	uint32_t sequence = m_header->sequence.load(std::memory_order_relaxed);
+	m_header->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	if (fits)
+	{
+		char *data = reinterpret_cast<char *>(m_header) + sizeof(VolumeSnapshotHeader);
+		if (!entries.empty())
+		{
+			memcpy(data, &entries[0], entries.size() * sizeof(VolumeSnapshotEntry));
+			data += entries.size() * sizeof(VolumeSnapshotEntry);
+			memcpy(data, &order[0], order.size() * sizeof(uint32_t));
+			data += order.size() * sizeof(uint32_t);
+			memcpy(data, &strings[0], strings.size() * sizeof(wchar_t));
+		}
+		m_header->entryCount = (uint32_t)entries.size();
+		m_header->stringCount = (uint32_t)strings.size();
+		m_header->published = SnapshotClockMs();
+	}
+	else
+	{
+		// Too many volumes, readers had better query them themselves
+		m_header->entryCount = 0;
+		m_header->stringCount = 0;
+		m_header->published = 0;
+	}
+	m_header->intervalMs = intervalMs;
+	m_header->sequence.store(sequence + 2, std::memory_order_release);
+	return fits;
+}
+
+#pragma endregion
+
+
+#pragma region VolumeSnapshot
+
+VolumeSnapshot::VolumeSnapshot(const std::wstring &name) :
+m_name(name),
+m_header(NULL),
+m_lastAttach(0)
+{
+}
+
+// A copy of a snapshot in the making. Everything it hands out is within
+// the segment, but only what was read before Consistent() returned true is
+// meaningful.
+class SnapshotReader
+{
+public:
+	explicit SnapshotReader(const VolumeSnapshotHeader *header) : m_header(header) {}
+
+	// Start reading. Returns false if a snapshot is being written or the
+	// current one is stale or malformed.
+	bool Begin()
+	{
+		m_sequence = m_header->sequence.load(std::memory_order_acquire);
+		if (m_sequence & 1)
+			return false;
+		m_count = m_header->entryCount;
+		m_stringCount = m_header->stringCount;
+		if (!IsFresh(m_header->published, m_header->intervalMs, SnapshotClockMs()))
+			return false;
+		uint64_t size = sizeof(VolumeSnapshotHeader) +
+			(uint64_t)m_count * (sizeof(VolumeSnapshotEntry) + sizeof(uint32_t)) +
+			(uint64_t)m_stringCount * sizeof(wchar_t);
+		if (size > m_header->size)
+			return false;
+		const char *data = reinterpret_cast<const char *>(m_header) + sizeof(VolumeSnapshotHeader);
+		m_entries = reinterpret_cast<const VolumeSnapshotEntry *>(data);
+		m_order = reinterpret_cast<const uint32_t *>(data + m_count * sizeof(VolumeSnapshotEntry));
+		m_strings = reinterpret_cast<const wchar_t *>(data + m_count * (sizeof(VolumeSnapshotEntry) + sizeof(uint32_t)));
+		return true;
+	}
+
+	// Whether what was read since Begin() is a consistent snapshot
+	bool Consistent() const
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return m_header->sequence.load(std::memory_order_relaxed) == m_sequence;
+	}
+
+	uint32_t Count() const { return m_count; }
+	const VolumeSnapshotEntry &Entry(uint32_t index) const { return m_entries[index]; }
+
+	// The index-th entry in the order of volume names
+	const VolumeSnapshotEntry *Sorted(uint32_t index) const
+	{
+		uint32_t entry = m_order[index];
+		return entry < m_count ? &m_entries[entry] : NULL;
+	}
+
+	// Compare the string at offset to str, without copying it
+	int Compare(uint32_t offset, const std::wstring &str) const
+	{
+		for (size_t i = 0;; ++i, ++offset)
+		{
+			wchar_t c = offset < m_stringCount ? m_strings[offset] : 0;
+			wchar_t d = i < str.size() ? str[i] : 0;
+			if (c != d)
+				return c < d ? -1 : 1;
+			if (!c)
+				return 0;
+		}
+	}
+
+	// The string at offset, and where the one after it starts
+	uint32_t String(uint32_t offset, std::wstring &str) const
+	{
+		str.clear();
+		while (offset < m_stringCount && m_strings[offset])
+			str += m_strings[offset++];
+		return offset + 1;
+	}
+
+private:
+	const VolumeSnapshotHeader *m_header;
+	uint32_t m_sequence;
+	uint32_t m_count;
+	uint32_t m_stringCount;
+	const VolumeSnapshotEntry *m_entries;
+	const uint32_t *m_order;
+	const wchar_t *m_strings;
+};
+
+bool VolumeSnapshot::GetSpace(const std::wstring &volname, VolumeSpace &space)
+{
+	const VolumeSnapshotHeader *header = Current();
+	if (!header)
+		return false;
+	SnapshotReader reader(header);
+	for (int attempt = 0; attempt < SNAPSHOT_READ_ATTEMPTS; ++attempt)
+	{
+		if (!reader.Begin())
+		{
+			if (header->sequence.load(std::memory_order_relaxed) & 1)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			return false;
+		}
+		// Binary search by name
+		const VolumeSnapshotEntry *found = NULL;
+		uint32_t lo = 0, hi = reader.Count();
+		while (lo < hi)
+		{
+			uint32_t mid = lo + (hi - lo) / 2;
+			const VolumeSnapshotEntry *entry = reader.Sorted(mid);
+			if (!entry)
+				break;
+			int cmp = reader.Compare(entry->volname, volname);
+			if (cmp == 0)
+			{
+				found = entry;
+				break;
+			}
+			if (cmp < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		VolumeSpace result;
+		bool hasSpace = found && (found->flags & VOLUME_SNAPSHOT_HAS_SPACE);
+		if (hasSpace)
+		{
+			result.sectorsPerCluster = found->sectorsPerCluster;
+			result.bytesPerSector = found->bytesPerSector;
+			result.freeClusters = found->freeClusters;
+			result.totalClusters = found->totalClusters;
+		}
+		if (!reader.Consistent())
+			continue;
+		if (hasSpace)
+			space = result;
+		return hasSpace;
+	}
+	return false;
+}
+
+bool VolumeSnapshot::GetVolumes(std::vector<VolumeRecord> &records)
+{
+	const VolumeSnapshotHeader *header = Current();
+	if (!header)
+		return false;
+	SnapshotReader reader(header);
+	for (int attempt = 0; attempt < SNAPSHOT_READ_ATTEMPTS; ++attempt)
+	{
+		if (!reader.Begin())
+		{
+			if (header->sequence.load(std::memory_order_relaxed) & 1)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			return false;
+		}
+		records.resize(reader.Count());
+		for (uint32_t i = 0; i < reader.Count(); ++i)
+		{
+			const VolumeSnapshotEntry &entry = reader.Entry(i);
+			VolumeRecord &record = records[i];
+			reader.String(entry.volname, record.volname);
+			reader.String(entry.device, record.device);
+			reader.String(entry.label, record.label);
+			reader.String(entry.filesystem, record.filesystem);
+			// A torn count is caught by Consistent(), just don't make it huge
+			uint32_t pathCount = std::min<uint32_t>(entry.pathCount, 1024);
+			record.paths.resize(pathCount);
+			uint32_t offset = entry.paths;
+			for (uint32_t p = 0; p < pathCount; ++p)
+				offset = reader.String(offset, record.paths[p]);
+			record.status = (VolumeQuery::Status)entry.status;
+			record.type = (VolumeType)entry.type;
+			record.hasInformation = (entry.flags & VOLUME_SNAPSHOT_HAS_INFORMATION) != 0;
+			record.hasSpace = (entry.flags & VOLUME_SNAPSHOT_HAS_SPACE) != 0;
+			record.space.sectorsPerCluster = entry.sectorsPerCluster;
+			record.space.bytesPerSector = entry.bytesPerSector;
+			record.space.freeClusters = entry.freeClusters;
+			record.space.totalClusters = entry.totalClusters;
+		}
+		if (reader.Consistent())
+			return true;
+	}
+	records.clear();
+	return false;
+}
+
+const VolumeSnapshotHeader *VolumeSnapshot::Current()
+{
+	const VolumeSnapshotHeader *header = m_header.load(std::memory_order_acquire);
+	if (header && IsFresh(header->published, header->intervalMs, SnapshotClockMs()))
+		return header;
+	if (SnapshotClockMs() - m_lastAttach.load(std::memory_order_relaxed) < SNAPSHOT_ATTACH_RETRY_MS)
+		return header;
+	return Attach();
+}
+
+const VolumeSnapshotHeader *VolumeSnapshot::Attach()
+{
+	std::lock_guard<std::mutex> lock(m_attachLock);
+	const VolumeSnapshotHeader *current = m_header.load(std::memory_order_relaxed);
+	uint64_t now = SnapshotClockMs();
+	if (now - m_lastAttach.load(std::memory_order_relaxed) < SNAPSHOT_ATTACH_RETRY_MS)
+		return current;	// another thread just tried
+	m_lastAttach.store(now, std::memory_order_relaxed);
+
+	const void *view = NULL;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE hMapping = OpenFileMappingW(FILE_MAP_READ, FALSE, SegmentName(m_name).c_str());
+	if (!hMapping)
+		return current;
+	view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(hMapping);	// the view keeps the segment
+	if (!view)
+		return current;
+	MEMORY_BASIC_INFORMATION mbi;
+	if (VirtualQuery(view, &mbi, sizeof(mbi)))
+		size = mbi.RegionSize;
+#else
+	int fd = shm_open(SegmentName(m_name).c_str(), O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+		return current;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		size = (size_t)st.st_size;
+		view = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (view == MAP_FAILED)
+			view = NULL;
+	}
+	close(fd);
+	if (!view)
+		return current;
+#endif
+
+	const VolumeSnapshotHeader *header = static_cast<const VolumeSnapshotHeader *>(view);
+	bool valid = size >= sizeof(VolumeSnapshotHeader) &&
+		memcmp(header->magic, VOLUME_SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+		header->version == VOLUME_SNAPSHOT_VERSION &&
+		header->headerSize == sizeof(VolumeSnapshotHeader) &&
+		header->entrySize == sizeof(VolumeSnapshotEntry) &&
+		header->charSize == sizeof(wchar_t) &&
+		header->size <= size;
+	if (!valid || (current && header->instance == current->instance))
+	{
+		// Not a snapshot, or the one mapped already
+#ifdef _WIN32
+		UnmapViewOfFile(view);
+#else
+		munmap(const_cast<void *>(view), size);
+#endif
+		return current;
+	}
+	// The segment mapped before stays mapped, as readers may still be
+	// looking at it. It is left behind once per collector restart.
+	m_header.store(header, std::memory_order_release);
+	return header;
+}
+
+static std::once_flag g_volumeSnapshotOnce;
+static VolumeSnapshot *g_volumeSnapshot;
+
+VolumeSnapshot &VolumeSnapshot::Global()
+{
+	std::call_once(g_volumeSnapshotOnce, []() { g_volumeSnapshot = new VolumeSnapshot; });
+	return *g_volumeSnapshot;
+}
+
+#pragma endregion
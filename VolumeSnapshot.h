@@ -0,0 +1,141 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeSnapshot.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+The file declares the volume snapshot: the records of all volumes, as a
+collector process (diskusage --collect) queries them on its own schedule,
+published in a named shared memory segment. Every process the extension is
+loaded into can then read them instead of querying the volumes itself.
+
+The collector writes under a seqlock: it makes the sequence number odd,
+copies in the new snapshot and makes it even again. Readers copy out what
+they need and retry if the number changed meanwhile, so reading takes
+neither locks nor system calls once the segment is mapped.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "VolumeList.h"
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define VOLUME_SNAPSHOT_MAGIC    "DUTVSNP"
+#define VOLUME_SNAPSHOT_VERSION  1
+#define VOLUME_SNAPSHOT_NAME     L"DiskUsageTip.VolumeSnapshot"
+// Size of the segment, fixed so readers never see it change. Holds some
+// 20000 volumes.
+#define VOLUME_SNAPSHOT_SIZE     (16 << 20)
+
+// The segment starts with the header, followed by entryCount entries in
+// the order the system lists the volumes, entryCount entry numbers in the
+// order of their volume names, and the strings. The fields from sequence on
+// are written under the seqlock.
+struct VolumeSnapshotHeader
+{
+	char magic[8];			// VOLUME_SNAPSHOT_MAGIC
+	uint32_t version;		// VOLUME_SNAPSHOT_VERSION, bumped on any layout change
+	uint32_t headerSize;	// sizeof(VolumeSnapshotHeader)
+	uint32_t entrySize;		// sizeof(VolumeSnapshotEntry)
+	uint32_t charSize;		// sizeof(wchar_t)
+	uint64_t size;			// of the segment
+	uint64_t instance;		// tells segments made by different collector runs apart
+	std::atomic<uint32_t> sequence;	// odd while a snapshot is written
+	uint32_t entryCount;
+	uint32_t stringCount;	// characters of strings
+	uint32_t intervalMs;	// the collector publishes at least this often
+	uint64_t published;		// SnapshotClockMs() of the last publish
+};
+
+struct VolumeSnapshotEntry
+{
+	// Strings, as offsets in characters from the start of the strings, each
+	// terminated. The paths are pathCount strings in a row.
+	uint32_t volname;
+	uint32_t device;
+	uint32_t label;
+	uint32_t filesystem;
+	uint32_t paths;
+	uint32_t pathCount;
+	uint32_t status;		// VolumeQuery::Status
+	uint32_t type;			// VolumeType
+	uint32_t flags;			// VOLUME_SNAPSHOT_HAS_*
+	uint32_t sectorsPerCluster;
+	uint32_t bytesPerSector;
+	uint32_t reserved;
+	uint64_t freeClusters;
+	uint64_t totalClusters;
+};
+
+#define VOLUME_SNAPSHOT_HAS_INFORMATION  1
+#define VOLUME_SNAPSHOT_HAS_SPACE        2
+
+// Milliseconds since an arbitrary point common to all processes
+uint64_t SnapshotClockMs();
+
+// Publishes snapshots, in the collector
+class VolumeSnapshotWriter
+{
+public:
+	explicit VolumeSnapshotWriter(const std::wstring &name = VOLUME_SNAPSHOT_NAME);
+	~VolumeSnapshotWriter();
+
+	// Replace the snapshot with records, promising the next one within
+	// intervalMs. Creates the segment on first use.
+	bool Publish(const std::vector<VolumeRecord> &records, unsigned intervalMs);
+
+private:
+	bool Create();
+
+	std::wstring m_name;
+	VolumeSnapshotHeader *m_header;
+#ifdef _WIN32
+	void *m_hMapping;
+#endif
+
+	VolumeSnapshotWriter(const VolumeSnapshotWriter &);
+	VolumeSnapshotWriter &operator =(const VolumeSnapshotWriter &);
+};
+
+// Reads the snapshots of a collector. A snapshot the collector has not
+// renewed within a few of its intervals counts as absent, as does one
+// without the volume asked for, and the caller queries the volume itself.
+// Thread safe.
+class VolumeSnapshot
+{
+public:
+	explicit VolumeSnapshot(const std::wstring &name = VOLUME_SNAPSHOT_NAME);
+
+	// Free space of volname, as last published
+	bool GetSpace(const std::wstring &volname, VolumeSpace &space);
+	// All volumes, in the order the system lists them
+	bool GetVolumes(std::vector<VolumeRecord> &records);
+
+	// The snapshot of the collector of the running system
+	static VolumeSnapshot &Global();
+
+private:
+	// The current segment, mapped again if the snapshot is stale as the
+	// collector may have been restarted. NULL if there is none.
+	const VolumeSnapshotHeader *Current();
+	const VolumeSnapshotHeader *Attach();
+
+	std::wstring m_name;
+	std::atomic<const VolumeSnapshotHeader *> m_header;
+	std::mutex m_attachLock;
+	std::atomic<uint64_t> m_lastAttach;	// SnapshotClockMs() of the last attempt to map
+
+	VolumeSnapshot(const VolumeSnapshot &);
+	VolumeSnapshot &operator =(const VolumeSnapshot &);
+};
@@ -0,0 +1,227 @@
+/****************************** Module Header ******************************\
+Module Name:  EstimatorBench.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Checks how fast the folder size estimator converges and whether its
+confidence intervals hold. It estimates synthetic trees, the even tree of
+SimulatedFileSystem and uneven ones whose directory fanout, file counts and
+file sizes follow heavy tailed distributions, as real shares do. Every
+listing takes a fixed delay, as it would on a disk. Each tree is estimated
+over and over with different seeds, and at budgets growing from 10 ms to
+800 ms the bench reports the median error of the estimate of the size and
+of the file count, how wide the interval was and how often it held the true
+totals.
+
+Results go to stderr as a table and to stdout as one JSON object per tree
+and budget. Build with the EstimatorBench target of the CMake build and run:
+./build/EstimatorBench [trials [listDelayUs]]
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "SizeEstimator.h"
+#include "SimulatedFileSystem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <wchar.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <thread>
+
+#define ESTIMATE_THREADS 4
+#define MAX_TREE_DIRECTORIES 100000
+
+static const unsigned g_budgetsMs[] = { 10, 25, 50, 100, 200, 400, 800 };
+
+// A tree generated from seed, uneven in every way: most directories have
+// a few subdirectories and files, some a hundred subdirectories or thousands
+// of files, file sizes span bytes to gigabytes and most of the space is in a
+// handful of files
+class SkewedFileSystem : public FileSystem
+{
+public:
+	SkewedFileSystem(unsigned seed, unsigned listDelayUs) : m_listDelayUs(listDelayUs), m_random(seed)
+	{
+		Generate(Root(), 0);
+	}
+
+	static std::wstring Root() { return SimulatedFileSystem::Root(); }
+
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *)
+	{
+		entries.clear();
+		std::map<std::wstring, Directory>::const_iterator it = m_dirs.find(path);
+		if (it == m_dirs.end())
+			return false;
+		if (self)
+			Fill(*self, true, 0);
+		DirEntry entry;
+		for (size_t i = 0; i < it->second.files.size(); ++i)
+		{
+			Fill(entry, false, it->second.files[i]);
+			entry.name = Name(L"file", i);
+			entries.push_back(entry);
+		}
+		for (unsigned i = 0; i < it->second.subdirs; ++i)
+		{
+			Fill(entry, true, 0);
+			entry.name = Name(L"dir", i);
+			entries.push_back(entry);
+		}
+		if (m_listDelayUs)
+			std::this_thread::sleep_for(std::chrono::microseconds(m_listDelayUs));
+		return true;
+	}
+
+	virtual bool Stat(const std::wstring &path, DirEntry &entry)
+	{
+		if (!m_dirs.count(path))
+			return false;
+		Fill(entry, true, 0);
+		return true;
+	}
+
+private:
+	struct Directory
+	{
+		unsigned subdirs;
+		std::vector<unsigned long long> files;	// sizes
+	};
+
+	static std::wstring Name(const wchar_t *prefix, size_t i)
+	{
+		wchar_t name[32];
+		swprintf(name, sizeof(name) / sizeof(name[0]), L"%ls%u", prefix, (unsigned)i);
+		return name;
+	}
+
+	static void Fill(DirEntry &entry, bool isDir, unsigned long long size)
+	{
+		entry.isDir = isDir;
+		entry.isLink = false;
+		entry.size = size;
+		entry.allocated = (size + 4095) / 4096 * 4096;
+		entry.mtime = 1;
+		entry.device = 0;
+		entry.fileId = 0;
+		entry.links = 0;
+	}
+
+	// Pareto distributed, at least 1 with tail exponent alpha, at most max
+	unsigned Pareto(double alpha, unsigned max)
+	{
+		double u = std::uniform_real_distribution<double>(1e-12, 1)(m_random);
+		return (unsigned)std::min(floor(pow(u, -1 / alpha)), (double)max);
+	}
+
+	void Generate(const std::wstring &path, unsigned level)
+	{
+		Directory &dir = m_dirs[path];
+		unsigned files = Pareto(1.1, 5000) - 1;
+		std::lognormal_distribution<double> size(9, 2.5);
+		for (unsigned i = 0; i < files; ++i)
+			dir.files.push_back((unsigned long long)size(m_random));
+		// A few levels of folders at the top, then fewer subdirectories
+		// deeper down and none past level 10
+		bool leaf = level >= 10 ||
+			(level >= 3 && std::uniform_real_distribution<double>(0, 1)(m_random) < 0.35 + 0.04 * level);
+		dir.subdirs = leaf || m_dirs.size() >= MAX_TREE_DIRECTORIES ? 0 :
+			std::max(Pareto(1.5, 100), level < 3 ? 8u : 1u);
+		for (unsigned i = 0; i < dir.subdirs; ++i)
+			Generate(JoinPath(path, Name(L"dir", i)), level + 1);
+	}
+
+	unsigned m_listDelayUs;
+	std::mt19937 m_random;
+	std::map<std::wstring, Directory> m_dirs;
+};
+
+static double Median(std::vector<double> values)
+{
+	std::sort(values.begin(), values.end());
+	return values.empty() ? 0 : values[values.size() / 2];
+}
+
+// Estimate root of fs trials times and report the convergence
+static void Run(const char *name, FileSystem &fs, const std::wstring &root, unsigned trials)
+{
+	FolderScanner scanner(fs, 16);
+	ScanTotals truth;
+	scanner.Scan(root, truth);
+	fprintf(stderr, "%s: %llu folders, %llu files, %llu bytes\n", name, truth.dirs + 1, truth.files, truth.bytes);
+
+	const size_t budgets = sizeof(g_budgetsMs) / sizeof(g_budgetsMs[0]);
+	std::vector<std::vector<double> > bytesError(budgets), filesError(budgets), width(budgets);
+	std::vector<unsigned> covered(budgets), estimated(budgets), exact(budgets);
+	std::vector<double> walks(budgets), listed(budgets);
+	for (unsigned trial = 0; trial < trials; ++trial)
+	{
+		SizeEstimator estimator(fs, root, ESTIMATE_THREADS, trial);
+		unsigned spent = 0;
+		for (size_t b = 0; b < budgets; ++b)
+		{
+			estimator.Refine(g_budgetsMs[b] - spent);
+			spent = g_budgetsMs[b];
+			SizeEstimate estimate;
+			if (!estimator.GetEstimate(estimate))
+				continue;
+			++estimated[b];
+			exact[b] += estimate.exact;
+			walks[b] += estimate.walks;
+			listed[b] += estimate.listed;
+			bytesError[b].push_back(fabs((double)estimate.totals.bytes - truth.bytes) / truth.bytes);
+			filesError[b].push_back(fabs((double)estimate.totals.files - truth.files) / truth.files);
+			width[b].push_back((double)estimate.error.bytes / truth.bytes);
+			if (estimate.totals.bytes <= truth.bytes + estimate.error.bytes &&
+				truth.bytes <= estimate.totals.bytes + estimate.error.bytes)
+				++covered[b];
+		}
+	}
+
+	for (size_t b = 0; b < budgets; ++b)
+	{
+		unsigned n = std::max(estimated[b], 1u);
+		double coverage = (double)covered[b] / n;
+		fprintf(stderr, "  %4u ms: %6.0f walks, %6.0f listed, size off %6.1f%%, files off %6.1f%%, "
+			"interval +/-%6.1f%%, holds %3.0f%%, exact %3.0f%%\n", g_budgetsMs[b], walks[b] / n, listed[b] / n,
+			Median(bytesError[b]) * 100, Median(filesError[b]) * 100, Median(width[b]) * 100, coverage * 100,
+			(double)exact[b] / n * 100);
+		printf("{\"bench\":\"estimator\",\"tree\":\"%s\",\"budget_ms\":%u,\"trials\":%u,\"walks\":%.0f,"
+			"\"listed\":%.0f,\"bytes_error\":%.4f,\"files_error\":%.4f,\"interval\":%.4f,\"coverage\":%.3f}\n",
+			name, g_budgetsMs[b], estimated[b], walks[b] / n, listed[b] / n, Median(bytesError[b]),
+			Median(filesError[b]), Median(width[b]), coverage);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned trials = argc > 1 ? atoi(argv[1]) : 20;
+	unsigned listDelayUs = argc > 2 ? atoi(argv[2]) : 200;
+	if (!trials)
+	{
+		fprintf(stderr, "usage: EstimatorBench [trials [listDelayUs]]\n");
+		return 2;
+	}
+
+	SimulatedFileSystem even(5, 8, 10, listDelayUs);
+	Run("even", even, SimulatedFileSystem::Root(), trials);
+	for (unsigned seed = 1; seed <= 3; ++seed)
+	{
+		SkewedFileSystem skewed(seed, listDelayUs);
+		char name[32];
+		sprintf(name, "skewed%u", seed);
+		Run(name, skewed, SkewedFileSystem::Root(), trials);
+	}
+	return 0;
+}
@@ -0,0 +1,96 @@
+/****************************** Module Header ******************************\
+Module Name:  IncrementalScanBench.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Measures incremental rescans against full ones. A simulated tree is scanned,
+a small fraction of its directories is changed, and the tree is scanned
+again, in full and incrementally with and without re-stat. The rescans must
+agree with the full scan on the totals wherever they can see the change.
+
+Build with the IncrementalScanBench target of the CMake build and run:
+./build/IncrementalScanBench [depth fanout files fraction]
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "IndexUpdater.h"
+#include "SimulatedFileSystem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#define LIST_DELAY_US 200	// a listing over the network
+#define STAT_DELAY_US 20
+#define SCAN_THREADS 8
+
+struct Result
+{
+	double ms;
+	unsigned long long readDirs;
+	unsigned long long stats;
+	ScanTotals totals;
+};
+
+static void Report(const char *name, const Result &r, const Result &full)
+{
+	printf("%-18s %10.1f ms %8llu lists %8llu stats %16llu bytes %8.1fx\n", name, r.ms,
+		r.readDirs, r.stats, r.totals.bytes, r.ms > 0 ? full.ms / r.ms : 0);
+}
+
+// Scan the root with updater, from scratch or again, and measure it
+static Result Scan(SimulatedFileSystem &fs, IndexUpdater &updater, bool again)
+{
+	Result r;
+	fs.ResetCounters();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (again)
+		updater.Rescan(SimulatedFileSystem::Root());
+	else
+		updater.AddRoot(SimulatedFileSystem::Root());
+	r.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	r.readDirs = fs.ReadDirCalls();
+	r.stats = fs.StatCalls();
+	updater.Lookup(SimulatedFileSystem::Root(), r.totals);
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned depth = argc > 1 ? atoi(argv[1]) : 4;
+	unsigned fanout = argc > 2 ? atoi(argv[2]) : 8;
+	unsigned files = argc > 3 ? atoi(argv[3]) : 20;
+	double fraction = argc > 4 ? atof(argv[4]) : 0.01;
+
+	SimulatedFileSystem fs(depth, fanout, files, LIST_DELAY_US, STAT_DELAY_US);
+	printf("%u directories, %u files each, changing %.1f%%\n",
+		(unsigned)fs.Directories(), files, fraction * 100);
+
+	IndexUpdater plain(fs, SCAN_THREADS);
+	IndexUpdater restat(fs, SCAN_THREADS);
+	restat.SetRestat(true);
+	plain.AddRoot(SimulatedFileSystem::Root());
+	restat.AddRoot(SimulatedFileSystem::Root());
+
+	fs.Mutate(fraction, 1);
+
+	IndexUpdater fresh(fs, SCAN_THREADS);
+	Result full = Scan(fs, fresh, false);
+	Result mtime = Scan(fs, plain, true);
+	Result both = Scan(fs, restat, true);
+	Report("full", full, full);
+	Report("incremental", mtime, full);
+	Report("incremental+restat", both, full);
+
+	// Files grown in place are only seen with re-stat
+	bool ok = both.totals.bytes == full.totals.bytes && both.totals.files == full.totals.files &&
+		mtime.totals.files == full.totals.files && mtime.totals.dirs == full.totals.dirs;
+	printf("%s\n", ok ? "totals agree" : "TOTALS DIFFER");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,278 @@
+/****************************** Module Header ******************************\
+Module Name:  IoSchedulerBench.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Scans three simulated devices at once, a spinning disk serving one request
+at a time, an SSD serving 8 and a network share serving 64 with a long
+round trip, first with a fixed 32 threads per device and then through the
+I/O scheduler. Meanwhile a probe makes a request of each device every few
+milliseconds, past the scheduler, as other programs using the disks would,
+and sees how deep the device queues are.
+
+For each device the bench reports how long its scan took, the latency of
+the scan's requests and of the probe's, and under the scheduler the limit
+it settled on. The scheduler should scan about as fast as the fixed threads
+while keeping the queue of the spinning disk short. Results go to stderr as
+a table and to stdout as one JSON object per device and mode.
+
+Build with the IoSchedulerBench target of the CMake build and run:
+./build/IoSchedulerBench [depth fanout]
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "IoScheduler.h"
+#include "FolderScanner.h"
+#include "SimulatedFileSystem.h"
+#include "SimulatedVolumeBackend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+#define FIXED_THREADS 32
+#define PROBE_INTERVAL_MS 5
+
+// A device with servers requests served at once, each taking serviceUs,
+// and the rest queued in order
+class DeviceModel
+{
+public:
+	DeviceModel(const char *name, unsigned servers, unsigned serviceUs) :
+		m_name(name), m_serviceUs(serviceUs), m_free(servers, Clock::time_point()) {}
+
+	const char *Name() const { return m_name; }
+
+	// Make a request, returning its latency in microseconds
+	double Request()
+	{
+		Clock::time_point now = Clock::now(), done;
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			std::vector<Clock::time_point>::iterator server = std::min_element(m_free.begin(), m_free.end());
+			done = std::max(now, *server) + std::chrono::microseconds(m_serviceUs);
+			*server = done;
+		}
+		std::this_thread::sleep_until(done);
+		return std::chrono::duration<double, std::micro>(Clock::now() - now).count();
+	}
+
+private:
+	const char *m_name;
+	unsigned m_serviceUs;
+	std::mutex m_lock;
+	std::vector<Clock::time_point> m_free;	// when each server is free again
+};
+
+// Latencies in microseconds, from several threads
+class Latencies
+{
+public:
+	void Add(double us)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_us.push_back(us);
+	}
+
+	double Mean()
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		double sum = 0;
+		for (size_t i = 0; i < m_us.size(); ++i)
+			sum += m_us[i];
+		return m_us.empty() ? 0 : sum / m_us.size();
+	}
+
+	double Percentile(double p)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if (m_us.empty())
+			return 0;
+		std::sort(m_us.begin(), m_us.end());
+		return m_us[(size_t)(p / 100 * (m_us.size() - 1) + 0.5)];
+	}
+
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_us.clear();
+	}
+
+private:
+	std::mutex m_lock;
+	std::vector<double> m_us;
+};
+
+// The simulated tree on each device, its paths prefixed with the name of
+// the device and a colon
+class DevicesFileSystem : public FileSystem
+{
+public:
+	DevicesFileSystem(FileSystem &tree, std::vector<DeviceModel *> &devices, std::vector<Latencies *> &latencies) :
+		m_tree(tree), m_devices(devices), m_latencies(latencies) {}
+
+	static std::wstring Root(const DeviceModel &device)
+	{
+		std::string name(device.Name());
+		return std::wstring(name.begin(), name.end()) + L":" + SimulatedFileSystem::Root();
+	}
+
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *cancel)
+	{
+		size_t device = Route(path);
+		m_latencies[device]->Add(m_devices[device]->Request());
+		return m_tree.ReadDir(path.substr(path.find(L':') + 1), entries, self, cancel);
+	}
+
+	virtual bool Stat(const std::wstring &path, DirEntry &entry)
+	{
+		size_t device = Route(path);
+		m_latencies[device]->Add(m_devices[device]->Request());
+		return m_tree.Stat(path.substr(path.find(L':') + 1), entry);
+	}
+
+private:
+	size_t Route(const std::wstring &path)
+	{
+		std::string name(path.begin(), path.begin() + path.find(L':'));
+		for (size_t i = 0; i < m_devices.size(); ++i)
+		{
+			if (name == m_devices[i]->Name())
+				return i;
+		}
+		abort();
+	}
+
+	FileSystem &m_tree;
+	std::vector<DeviceModel *> &m_devices;
+	std::vector<Latencies *> &m_latencies;
+};
+
+// Probe every device until stop is set
+static void Probe(std::vector<DeviceModel *> &devices, std::vector<Latencies *> &latencies, std::atomic<bool> &stop)
+{
+	while (!stop)
+	{
+		for (size_t i = 0; i < devices.size(); ++i)
+			latencies[i]->Add(devices[i]->Request());
+		std::this_thread::sleep_for(std::chrono::milliseconds(PROBE_INTERVAL_MS));
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned depth = argc > 1 ? atoi(argv[1]) : 4;
+	unsigned fanout = argc > 2 ? atoi(argv[2]) : 6;
+	if (!depth || !fanout)
+	{
+		fprintf(stderr, "usage: IoSchedulerBench [depth fanout]\n");
+		return 2;
+	}
+
+	SimulatedFileSystem tree(depth, fanout, 10);
+	DeviceModel hdd("hdd", 1, 500), ssd("ssd", 8, 200), net("net", 64, 3000);
+	std::vector<DeviceModel *> devices;
+	devices.push_back(&hdd);
+	devices.push_back(&ssd);
+	devices.push_back(&net);
+	std::vector<Latencies *> scanLatencies, probeLatencies;
+	for (size_t i = 0; i < devices.size(); ++i)
+	{
+		scanLatencies.push_back(new Latencies);
+		probeLatencies.push_back(new Latencies);
+	}
+	DevicesFileSystem fs(tree, devices, scanLatencies);
+	fprintf(stderr, "%u directories per device\n", (unsigned)tree.Directories());
+
+	for (int mode = 0; mode < 2; ++mode)
+	{
+		const char *modeName = mode ? "scheduled" : "fixed";
+		for (size_t i = 0; i < devices.size(); ++i)
+		{
+			scanLatencies[i]->Clear();
+			probeLatencies[i]->Clear();
+		}
+		std::atomic<bool> stop(false);
+		std::thread probe(Probe, std::ref(devices), std::ref(probeLatencies), std::ref(stop));
+
+		std::vector<double> seconds(devices.size());
+		std::vector<IoDeviceStats> stats;
+		Clock::time_point start = Clock::now();
+		if (!mode)
+		{
+			std::vector<std::thread> scans;
+			for (size_t i = 0; i < devices.size(); ++i)
+			{
+				scans.push_back(std::thread([&, i]() {
+					FolderScanner scanner(fs, FIXED_THREADS);
+					ScanTotals totals;
+					scanner.Scan(DevicesFileSystem::Root(*devices[i]), totals);
+					seconds[i] = std::chrono::duration<double>(Clock::now() - start).count();
+				}));
+			}
+			for (size_t i = 0; i < scans.size(); ++i)
+				scans[i].join();
+		}
+		else
+		{
+			SimulatedVolumeBackend backend(1);
+			IoScheduler scheduler(backend, fs, IoScheduler::DEFAULT_MAX_CONCURRENCY);
+			std::mutex lock;
+			std::condition_variable cond;
+			size_t finished = 0;
+			for (size_t i = 0; i < devices.size(); ++i)
+			{
+				std::string name(devices[i]->Name());
+				scheduler.Submit(std::wstring(name.begin(), name.end()), [&, i](FileSystem &devicefs) {
+					FolderScanner scanner(devicefs, IoScheduler::DEFAULT_MAX_CONCURRENCY);
+					ScanTotals totals;
+					scanner.Scan(DevicesFileSystem::Root(*devices[i]), totals);
+					seconds[i] = std::chrono::duration<double>(Clock::now() - start).count();
+					std::lock_guard<std::mutex> guard(lock);
+					++finished;
+					cond.notify_all();
+				});
+			}
+			std::unique_lock<std::mutex> guard(lock);
+			while (finished < devices.size())
+				cond.wait(guard);
+			guard.unlock();
+			scheduler.GetStats(stats);
+		}
+		stop = true;
+		probe.join();
+
+		for (size_t i = 0; i < devices.size(); ++i)
+		{
+			double scanMean = scanLatencies[i]->Mean(), probeP50 = probeLatencies[i]->Percentile(50),
+				probeP99 = probeLatencies[i]->Percentile(99);
+			// The limit the device settled on, under the scheduler
+			unsigned limit = FIXED_THREADS;
+			for (size_t s = 0; s < stats.size(); ++s)
+			{
+				std::string name(devices[i]->Name());
+				if (stats[s].name == std::wstring(name.begin(), name.end()))
+					limit = stats[s].limit;
+			}
+			fprintf(stderr, "%-9s %-3s %7.3f s, %2u in flight, scan %8.0f us mean, probe %8.0f us p50 %8.0f us p99\n",
+				modeName, devices[i]->Name(), seconds[i], limit, scanMean, probeP50, probeP99);
+			printf("{\"bench\":\"io_scheduler\",\"mode\":\"%s\",\"device\":\"%s\",\"seconds\":%.3f,"
+				"\"limit\":%u,\"scan_mean_us\":%.0f,\"probe_p50_us\":%.0f,\"probe_p99_us\":%.0f}\n",
+				modeName, devices[i]->Name(), seconds[i], limit, scanMean, probeP50, probeP99);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,276 @@
+/****************************** Module Header ******************************\
+Module Name:  MenuBench.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Measures what the shell extension does on the way to showing its menu item
+and its detail view, against simulated volumes: the tip of a single volume
+with a cold and a warm volume cache, the tip of an indexed folder, the tip
+of a selection spanning several volumes, and the detail view of all volumes,
+then the tip and the detail view again as read from the snapshot of a
+collector, with the volume cache cold. The menu itself is inserted by
+Windows and not measured; everything that Initialize and OnShowDetail
+compute is.
+
+Every scenario reports the p50 and p99 latency of a call and the heap
+allocations per call, background query threads included. A table goes to
+stderr and one JSON object per scenario to stdout, to be collected over
+time.
+
+Build with the MenuBench target of the CMake build and run:
+./build/MenuBench [volumes paths latency iterations]
+
+volumes is 1 to 10000, paths the mount paths per volume, latency that of
+every volume query, one of fixed:US, uniform:US (0 to 2 * US), exp:US
+(exponential with a mean of US), each optionally followed by ,FRACTION:US
+for the fraction of queries that hit a slow volume, e.g. exp:200,0.01:50000.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "DiskUsageCore.h"
+#include "SimulatedVolumeBackend.h"
+#include "VolumeList.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#pragma region Allocation counting
+
+static std::atomic<unsigned long long> g_allocations(0);
+
+void *operator new(size_t size)
+{
+	++g_allocations;
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+	free(p);
+}
+
+#pragma endregion
+
+typedef std::chrono::steady_clock Clock;
+
+// Latencies of the calls of a scenario, in microseconds
+struct Samples
+{
+	std::vector<double> us;
+	unsigned long long allocations;
+
+	explicit Samples(unsigned calls) : allocations(0) { us.reserve(calls); }
+
+	double Percentile(double p) const
+	{
+		std::vector<double> sorted(us);
+		std::sort(sorted.begin(), sorted.end());
+		size_t index = (size_t)(p / 100 * (sorted.size() - 1) + 0.5);
+		return sorted[index];
+	}
+
+	double Mean() const
+	{
+		double sum = 0;
+		for (size_t i = 0; i < us.size(); ++i)
+			sum += us[i];
+		return sum / us.size();
+	}
+};
+
+// Time calls of call, with the allocations it makes
+template <typename Call>
+static Samples Measure(unsigned calls, Call call)
+{
+	Samples samples(calls);
+	unsigned long long before = g_allocations;
+	for (unsigned i = 0; i < calls; ++i)
+	{
+		Clock::time_point start = Clock::now();
+		call(i);
+		samples.us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+	}
+	samples.allocations = g_allocations - before;
+	return samples;
+}
+
+// Parse a latency like exp:200,0.01:50000
+static bool ParseLatency(const char *spec, SimulatedLatency &latency)
+{
+	const char *colon = strchr(spec, ':');
+	if (!colon)
+		return false;
+	std::string kind(spec, colon);
+	if (kind == "fixed")
+		latency.kind = SimulatedLatency::FIXED;
+	else if (kind == "uniform")
+		latency.kind = SimulatedLatency::UNIFORM;
+	else if (kind == "exp")
+		latency.kind = SimulatedLatency::EXPONENTIAL;
+	else
+		return false;
+	char *end;
+	latency.us = (unsigned)strtoul(colon + 1, &end, 10);
+	if (*end == ',')
+	{
+		latency.slowFraction = strtod(end + 1, &end);
+		if (*end != ':')
+			return false;
+		latency.slowUs = (unsigned)strtoul(end + 1, &end, 10);
+	}
+	return *end == 0;
+}
+
+static void Report(const char *scenario, unsigned volumes, unsigned paths, const char *latency,
+	const Samples &samples)
+{
+	double p50 = samples.Percentile(50), p99 = samples.Percentile(99), mean = samples.Mean();
+	double allocs = (double)samples.allocations / samples.us.size();
+	fprintf(stderr, "%-16s %8u calls %10.1f us p50 %10.1f us p99 %10.1f us mean %8.1f allocs\n",
+		scenario, (unsigned)samples.us.size(), p50, p99, mean, allocs);
+	printf("{\"bench\":\"menu\",\"scenario\":\"%s\",\"volumes\":%u,\"paths\":%u,\"latency\":\"%s\","
+		"\"calls\":%u,\"p50_us\":%.1f,\"p99_us\":%.1f,\"mean_us\":%.1f,\"allocs_per_call\":%.1f}\n",
+		scenario, volumes, paths, latency, (unsigned)samples.us.size(), p50, p99, mean, allocs);
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned volumes = argc > 1 ? atoi(argv[1]) : 100;
+	unsigned paths = argc > 2 ? atoi(argv[2]) : 1;
+	const char *latencySpec = argc > 3 ? argv[3] : "fixed:50";
+	unsigned iterations = argc > 4 ? atoi(argv[4]) : 1000;
+	SimulatedLatency latency;
+	if (volumes < 1 || volumes > 10000 || paths < 1 || !ParseLatency(latencySpec, latency) || !iterations)
+	{
+		fprintf(stderr, "usage: MenuBench [volumes(1-10000) paths latency iterations]\n"
+			"latency: fixed:US | uniform:US | exp:US, optionally followed by ,FRACTION:US\n");
+		return 2;
+	}
+
+	// The mount table and the mount paths are read before the latency is
+	// set, the extension has them in memory as well
+	SimulatedVolumeBackend backend(volumes, paths);
+	MountTable table;
+	table.Load(backend);
+	std::vector<std::wstring> volnames, mounts;
+	backend.EnumVolumes(volnames);
+	for (size_t i = 0; i < volnames.size(); ++i)
+	{
+		std::vector<std::wstring> volpaths;
+		backend.QueryPaths(volnames[i].c_str(), volpaths);
+		mounts.push_back(volpaths.back());
+	}
+	backend.SetLatency(latency);
+
+	TipSettings settings;
+#ifdef _WIN32
+	const wchar_t *folderSuffix = L"\\Folder";
+#else
+	const wchar_t *folderSuffix = L"/Folder";
+#endif
+	FolderIndexLookup index = [](const std::wstring &, ScanTotals &totals) -> bool {
+		totals.bytes = 123456789012ull;
+		totals.allocated = 123470000000ull;
+		totals.files = 123456;
+		totals.dirs = 1234;
+		return true;
+	};
+
+	fprintf(stderr, "%u volumes, %u paths each, latency %s\n", volumes, paths, latencySpec);
+	std::wstring volname, tip;
+
+	// A volume the cache has not seen, or has expired
+	Samples cold = Measure(iterations, [&](unsigned i) {
+		const std::wstring &mount = mounts[i % mounts.size()];
+		VolumeCache::Global().Invalidate(volnames[i % volnames.size()]);
+		BuildItemTip(backend, table, settings, index, mount, volname, tip);
+	});
+	Report("menu-cold", volumes, paths, latencySpec, cold);
+
+	// The same volumes again, served from the cache
+	for (size_t i = 0; i < mounts.size() && i < iterations; ++i)
+		BuildItemTip(backend, table, settings, index, mounts[i], volname, tip);
+	Samples warm = Measure(iterations, [&](unsigned i) {
+		BuildItemTip(backend, table, settings, index, mounts[i % mounts.size()], volname, tip);
+	});
+	Report("menu-warm", volumes, paths, latencySpec, warm);
+
+	// A folder found in the size index
+	std::vector<std::wstring> folders;
+	for (size_t i = 0; i < mounts.size(); ++i)
+		folders.push_back(mounts[i] + folderSuffix);
+	Samples folder = Measure(iterations, [&](unsigned i) {
+		BuildItemTip(backend, table, settings, index, folders[i % folders.size()], volname, tip);
+	});
+	Report("menu-folder", volumes, paths, latencySpec, folder);
+
+	// Items on up to 10 volumes, none of them cached
+	std::set<std::wstring> selected;
+	for (size_t i = 0; i < volnames.size() && i < 10; ++i)
+		selected.insert(volnames[i * volnames.size() / std::min<size_t>(volnames.size(), 10)]);
+	Samples selection = Measure(iterations, [&](unsigned) {
+		for (auto v = selected.begin(); v != selected.end(); ++v)
+			VolumeCache::Global().Invalidate(*v);
+		BuildSelectionTip(backend, settings, selected, tip);
+	});
+	Report("menu-selection", volumes, paths, latencySpec, selection);
+
+	// The detail view of all volumes, into a buffer reused across calls as
+	// the extension would if it kept one
+	ReportBuffer outbuf;
+	TextReportEmitter report(outbuf);
+	unsigned detailCalls = std::max(3u, iterations / 50);
+	Samples detail = Measure(detailCalls, [&](unsigned) {
+		BuildDetailReport(backend, settings, selected, NULL, report);
+	});
+	Report("detail", volumes, paths, latencySpec, detail);
+
+	// The same from the snapshot of a collector, in a segment of the bench's
+	// own so a running collector is left alone
+	std::vector<VolumeRecord> records;
+	CollectVolumes(backend, VolumeQuery::Global(), QueryClock::now() + std::chrono::hours(1), records);
+	VolumeSnapshotWriter writer(L"DiskUsageTip.MenuBench");
+	if (!writer.Publish(records, 60000))
+	{
+		fprintf(stderr, "cannot publish the snapshot\n");
+		return 1;
+	}
+	VolumeSnapshot snapshot(L"DiskUsageTip.MenuBench");
+	settings.snapshot = &snapshot;
+	Samples snapshotTip = Measure(iterations, [&](unsigned i) {
+		VolumeCache::Global().Invalidate(volnames[i % volnames.size()]);
+		BuildItemTip(backend, table, settings, index, mounts[i % mounts.size()], volname, tip);
+	});
+	Report("menu-snapshot", volumes, paths, latencySpec, snapshotTip);
+
+	Samples snapshotDetail = Measure(detailCalls, [&](unsigned) {
+		BuildDetailReport(backend, settings, selected, NULL, report);
+	});
+	Report("detail-snapshot", volumes, paths, latencySpec, snapshotDetail);
+	return 0;
+}
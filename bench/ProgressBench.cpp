@@ -0,0 +1,208 @@
+/****************************** Module Header ******************************\
+Module Name:  ProgressBench.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Measures the progress and cancellation of folder scans against a simulated
+tree: what publishing progress costs a scan, whether the published totals
+only grow and stay within the final ones, and how long a cancelled scan
+takes to return, with listings slow, with a throttle holding the workers
+back and with their listings queued for a device that is busy. The bench exits with 1 if a cancel takes longer than its
+budget or the progress went wrong, so it can gate changes to the scanner.
+
+Results go to stderr as a table and to stdout as one JSON object per
+measurement.
+
+Build with the ProgressBench target of the CMake build and run:
+./build/ProgressBench [threads interval-ms]
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "FolderScanner.h"
+#include "SimulatedFileSystem.h"
+#include "ScanThrottle.h"
+#include "IoScheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+// From Cancel() to Scan() returning, at most
+#define CANCEL_BUDGET_MS 20.0
+#define CANCEL_ROUNDS 10
+// How long the device stays busy in the queued case
+#define DEVICE_BUSY_MS 200
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(Clock::duration d)
+{
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+// Scan the whole tree, milliseconds. With intervalMs, check the progress
+// published on the way against the final totals.
+static double ScanTime(FileSystem &fs, unsigned threads, unsigned intervalMs, unsigned &snapshots, bool &consistent)
+{
+	FolderScanner scanner(fs, threads);
+	scanner.SetTopCount(10);
+	ScanProgress last;
+	snapshots = 0;
+	consistent = true;
+	if (intervalMs)
+	{
+		scanner.SetProgressCallback([&](const ScanProgress &progress) {
+			if (progress.totals.files < last.totals.files || progress.totals.bytes < last.totals.bytes ||
+				progress.dirsFound < last.dirsFound || progress.dirsDone > progress.dirsFound ||
+				progress.topFiles.size() > 10 || progress.topDirs.size() > 10)
+				consistent = false;
+			last = progress;
+			++snapshots;
+		}, intervalMs);
+	}
+	ScanTotals totals;
+	Clock::time_point start = Clock::now();
+	bool ok = scanner.Scan(SimulatedFileSystem::Root(), totals);
+	double ms = Milliseconds(Clock::now() - start);
+	if (!ok || last.totals.files > totals.files || last.totals.bytes > totals.bytes ||
+		last.totals.dirs > totals.dirs)
+		consistent = false;
+	return ms;
+}
+
+// Cancel scans at spread out times, the longest milliseconds to return
+static double CancelTime(FileSystem &fs, unsigned threads, double &mean)
+{
+	double worst = 0;
+	mean = 0;
+	for (unsigned round = 0; round < CANCEL_ROUNDS; ++round)
+	{
+		FolderScanner scanner(fs, threads);
+		scanner.SetTopCount(10);
+		scanner.SetProgressCallback([](const ScanProgress &) {}, 10);
+		ScanTotals totals;
+		Clock::time_point returned;
+		std::thread scan([&]() {
+			scanner.Scan(SimulatedFileSystem::Root(), totals);
+			returned = Clock::now();
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50 + 17 * round));
+		Clock::time_point cancelled = Clock::now();
+		scanner.Cancel();
+		scan.join();
+		double ms = Milliseconds(returned - cancelled);
+		worst = std::max(worst, ms);
+		mean += ms / CANCEL_ROUNDS;
+	}
+	return worst;
+}
+
+// Listings of threads threads queued for a device whose one turn is taken,
+// cancelled while they wait, the longest milliseconds to return
+static double CancelQueuedTime(FileSystem &fs, unsigned threads, double &mean)
+{
+	double worst = 0;
+	mean = 0;
+	for (unsigned round = 0; round < CANCEL_ROUNDS; ++round)
+	{
+		IoDevice device(L"bench", 1);
+		ScheduledFileSystem scheduled(fs, device);
+		device.Acquire();
+		// Returns the turn only well past the budget, so that waiting for it
+		// shows
+		std::thread busy([&device]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(DEVICE_BUSY_MS));
+			device.Release(DEVICE_BUSY_MS * 1000000LL);
+		});
+		std::atomic<bool> cancel(false);
+		std::vector<Clock::time_point> returned(threads);
+		std::vector<std::thread> listers;
+		for (unsigned i = 0; i < threads; ++i)
+		{
+			listers.push_back(std::thread([&, i]() {
+				std::vector<DirEntry> entries;
+				scheduled.ReadDir(SimulatedFileSystem::Root(), entries, NULL, &cancel);
+				returned[i] = Clock::now();
+			}));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10 + 3 * round));
+		Clock::time_point cancelled = Clock::now();
+		cancel = true;
+		for (unsigned i = 0; i < threads; ++i)
+			listers[i].join();
+		busy.join();
+		double ms = Milliseconds(*std::max_element(returned.begin(), returned.end()) - cancelled);
+		worst = std::max(worst, ms);
+		mean += ms / CANCEL_ROUNDS;
+	}
+	return worst;
+}
+
+static void Report(const char *name, double ms, double budget)
+{
+	fprintf(stderr, "%-24s %10.2f ms", name, ms);
+	if (budget)
+		fprintf(stderr, " (budget %.1f ms)%s", budget, ms > budget ? " EXCEEDED" : "");
+	fputc('\n', stderr);
+	printf("{\"bench\":\"progress\",\"measure\":\"%s\",\"ms\":%.2f", name, ms);
+	if (budget)
+		printf(",\"budget_ms\":%.1f", budget);
+	printf("}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned threads = argc > 1 ? atoi(argv[1]) : 8;
+	unsigned intervalMs = argc > 2 ? atoi(argv[2]) : 10;
+	if (!threads || !intervalMs)
+	{
+		fprintf(stderr, "usage: ProgressBench [threads interval-ms]\n");
+		return 2;
+	}
+
+	// About 37000 directories, listed as fast as memory allows
+	SimulatedFileSystem fast(5, 8, 20);
+	double quiet = 1e30, published = 1e30;
+	unsigned snapshots = 0, ignored;
+	bool consistent = true, ok;
+	for (int round = 0; round < 3; ++round)
+	{
+		quiet = std::min(quiet, ScanTime(fast, threads, 0, ignored, ok));
+		published = std::min(published, ScanTime(fast, threads, intervalMs, snapshots, ok));
+		consistent = consistent && ok;
+	}
+	Report("scan-quiet", quiet, 0);
+	Report("scan-with-progress", published, 0);
+	fprintf(stderr, "%-24s %10u%s\n", "snapshots", snapshots, consistent ? "" : " INCONSISTENT");
+	printf("{\"bench\":\"progress\",\"measure\":\"snapshots\",\"count\":%u,\"consistent\":%s}\n",
+		snapshots, consistent ? "true" : "false");
+
+	// Listings of 20 ms and more, as of a slow share
+	SimulatedFileSystem slow(4, 8, 20, 20000, 500);
+	double slowMean, slowWorst = CancelTime(slow, threads, slowMean);
+	Report("cancel-slow-listing", slowWorst, CANCEL_BUDGET_MS);
+	Report("cancel-slow-listing-mean", slowMean, 0);
+
+	// The workers mostly waiting for tokens
+	ScanThrottle throttle(20, 1);
+	ThrottledFileSystem throttled(fast, throttle);
+	double throttledMean, throttledWorst = CancelTime(throttled, threads, throttledMean);
+	Report("cancel-throttled", throttledWorst, CANCEL_BUDGET_MS);
+	Report("cancel-throttled-mean", throttledMean, 0);
+
+	// The workers waiting for a turn of a busy device
+	double queuedMean, queuedWorst = CancelQueuedTime(fast, threads, queuedMean);
+	Report("cancel-device-queued", queuedWorst, CANCEL_BUDGET_MS);
+	Report("cancel-device-queued-mean", queuedMean, 0);
+
+	return !consistent || slowWorst > CANCEL_BUDGET_MS || throttledWorst > CANCEL_BUDGET_MS ||
+		queuedWorst > CANCEL_BUDGET_MS ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+/****************************** Module Header ******************************\
+Module Name:  ReportBench.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Measures rendering the detail view text of many volumes with the report
+renderer against the vecwprintf code it replaced, which grew a vector and
+formatted every size into a string of its own. Both render the same
+synthetic volume records into a buffer reused across rounds.
+
+Build with the ReportBench target of the CMake build and run:
+./build/ReportBench [volumes rounds]
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "ReportWriter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <wchar.h>
+#include <chrono>
+
+#ifndef _WIN32
+// vswprintf fails on truncation just like _vsnwprintf_s with a count
+#define _vsnwprintf_s(buf, size, count, format, args) vswprintf(buf, size, format, args)
+#define _snwprintf_s(buf, size, count, format, ...) swprintf(buf, size, format, __VA_ARGS__)
+#define _TRUNCATE 0
+#endif
+
+#pragma region The replaced renderer
+
+static std::wstring formatsize(unsigned long long size)
+{
+	static const wchar_t * suffix[] = { L"", L"K", L"M", L"G", L"T", L"P", L"E", L"Z", L"Y" };
+	size_t idx = 0;
+	double dsize = (double)size;
+	for (idx = 0; idx < sizeof(suffix) / sizeof(suffix[0]) - 1; ++idx)
+	{
+		if (dsize >= 1024)
+			dsize /= 1024;
+		else
+			break;
+	}
+	wchar_t buf[40];
+	_snwprintf_s(buf, 40, _TRUNCATE, L"%0.2f %lsB", dsize, suffix[idx]);
+	return buf;
+}
+
+static int vecwprintf(std::vector<wchar_t> &buf, size_t &pos, const wchar_t *format, ...)
+{
+	while (buf.size() <= pos + wcslen(format))
+		buf.resize(buf.size() / 2 + buf.size() + 10);
+	int res = -1;
+	while (res < 0)
+	{
+		va_list vlist;
+		va_start(vlist, format);
+		res = _vsnwprintf_s(&buf[pos], buf.size() - pos, buf.size() - pos - 1, format, vlist);
+		va_end(vlist);
+		if (res < 0)
+			buf.resize(buf.size() / 2 + buf.size());
+	}
+	pos += res;
+	return 0;
+}
+
+static void PrintSpace(std::vector<wchar_t> &outbuf, size_t &outpos, const VolumeSpace &space)
+{
+	unsigned long long fs = space.freeClusters;
+	unsigned long long ts = space.totalClusters;
+	std::wstring tb = formatsize(space.TotalBytes());
+	std::wstring ub = formatsize(space.UsedBytes());
+	std::wstring fb = formatsize(space.FreeBytes());
+	vecwprintf(outbuf, outpos,
+		L"\x2003%ls\x3000%llu\n"
+		L"\x2003\x2003\x2003" L"Free:\x2000\x3000%0.2f%%\x3000%ls\x3000%llu\n"
+		L"\x2003\x2003\x2003Used:\x3000%0.2f%%\x3000%ls\x3000%llu\n",
+		tb.c_str(), space.TotalBytes(),
+		(float)fs / ts * 100, fb.c_str(), space.FreeBytes(),
+		(float)(ts - fs) / ts * 100, ub.c_str(), space.UsedBytes());
+}
+
+static void RenderOld(const std::vector<VolumeRecord> &records, std::vector<wchar_t> &outbuf, size_t &outpos)
+{
+	outpos = 0;
+	for (auto rec = records.begin(); rec != records.end(); ++rec)
+	{
+		vecwprintf(outbuf, outpos, L"%ls ", L"\x2001");
+		vecwprintf(outbuf, outpos, L"%ls ", rec->label.c_str());
+		vecwprintf(outbuf, outpos, L"(");
+		for (auto i = rec->paths.begin(); i != rec->paths.end(); ++i)
+			vecwprintf(outbuf, outpos, L"%ls%ls", i == rec->paths.begin() ? L"" : L"\x2000", i->c_str());
+		vecwprintf(outbuf, outpos, L") ");
+		vecwprintf(outbuf, outpos, L"(%ls) ", rec->filesystem.c_str());
+		PrintSpace(outbuf, outpos, rec->space);
+	}
+}
+
+#pragma endregion
+
+static void RenderNew(const std::vector<VolumeRecord> &records, ReportEmitter &report)
+{
+	report.Begin();
+	for (auto rec = records.begin(); rec != records.end(); ++rec)
+		report.Volume(*rec, false, &rec->space);
+	report.End();
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double Elapsed(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned volumes = argc > 1 ? atoi(argv[1]) : 10000;
+	unsigned rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+	std::vector<VolumeRecord> records(volumes);
+	for (unsigned i = 0; i < volumes; ++i)
+	{
+		VolumeRecord &rec = records[i];
+		wchar_t buf[64];
+		swprintf(buf, 64, L"\\\\?\\Volume{%08x-0000-0000-0000-000000000000}\\", i);
+		rec.volname = buf;
+		rec.status = VolumeQuery::QUERY_OK;
+		rec.type = VOLUME_FIXED;
+		swprintf(buf, 64, L"Data %u", i);
+		rec.label = buf;
+		rec.filesystem = L"NTFS";
+		swprintf(buf, 64, L"C:\\Mount\\%u", i);
+		rec.paths.push_back(buf);
+		rec.hasInformation = true;
+		rec.hasSpace = true;
+		rec.space.sectorsPerCluster = 8;
+		rec.space.bytesPerSector = 512;
+		rec.space.totalClusters = 244190000ULL + i * 7919ULL;
+		rec.space.freeClusters = rec.space.totalClusters / (2 + i % 5);
+	}
+
+	std::vector<wchar_t> oldbuf(300);
+	size_t oldpos = 0;
+	ReportBuffer text, json, csv;
+	TextReportEmitter textReport(text);
+	JsonReportEmitter jsonReport(json);
+	CsvReportEmitter csvReport(csv);
+
+	// One round each to size the buffers
+	RenderOld(records, oldbuf, oldpos);
+	RenderNew(records, textReport);
+	RenderNew(records, jsonReport);
+	RenderNew(records, csvReport);
+
+	Clock::time_point start = Clock::now();
+	for (unsigned r = 0; r < rounds; ++r)
+		RenderOld(records, oldbuf, oldpos);
+	double oldMs = Elapsed(start) / rounds;
+
+	start = Clock::now();
+	for (unsigned r = 0; r < rounds; ++r)
+		RenderNew(records, textReport);
+	double textMs = Elapsed(start) / rounds;
+
+	start = Clock::now();
+	for (unsigned r = 0; r < rounds; ++r)
+		RenderNew(records, jsonReport);
+	double jsonMs = Elapsed(start) / rounds;
+
+	start = Clock::now();
+	for (unsigned r = 0; r < rounds; ++r)
+		RenderNew(records, csvReport);
+	double csvMs = Elapsed(start) / rounds;
+
+	printf("%u volumes, %u rounds\n", volumes, rounds);
+	printf("vecwprintf        %8.2f ms %10u chars\n", oldMs, (unsigned)oldpos);
+	printf("text              %8.2f ms %10u chars %6.1fx\n", textMs, (unsigned)text.Length(), oldMs / textMs);
+	printf("json              %8.2f ms %10u chars\n", jsonMs, (unsigned)json.Length());
+	printf("csv               %8.2f ms %10u chars\n", csvMs, (unsigned)csv.Length());
+	return 0;
+}
@@ -0,0 +1,71 @@
+/****************************** Module Header ******************************\
+Module Name:  ScanTreeBench.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Measures the memory ScanTree takes per entry. It records synthetic trees of
+growing size, or a real folder if one is given. The target is under 40
+bytes per entry, names not included.
+
+Build with the ScanTreeBench target of the CMake build and run:
+./build/ScanTreeBench [folder]
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "FolderScanner.h"
+#include "SimulatedFileSystem.h"
+#include "Utf8.h"
+#include <stdio.h>
+
+#define TARGET_BYTES_PER_ENTRY 40
+
+// Scan root into a tree and report its memory. Returns whether the entries
+// stay within the target.
+static bool Measure(const char *name, FileSystem &fs, const std::wstring &root)
+{
+	ScanTree tree;
+	FolderScanner scanner(fs);
+	scanner.SetTree(&tree);
+	ScanTotals totals;
+	scanner.Scan(root, totals);
+
+	size_t entries = tree.Size();
+	double entryBytes = (double)tree.EntryBytes() / entries;
+	double nameBytes = (double)tree.NameBytes() / entries;
+	bool ok = entryBytes < TARGET_BYTES_PER_ENTRY && tree.Bytes(0) == totals.bytes;
+	printf("%-24s %10u entries %8u names %6.1f B/entry %6.1f name B/entry %s\n", name,
+		(unsigned)entries, (unsigned)tree.NameCount(), entryBytes, nameBytes, ok ? "ok" : "OVER");
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1)
+	{
+		std::wstring root = Utf8ToWide(argv[1]);
+		return Measure(argv[1], SystemFileSystem(), root) ? 0 : 1;
+	}
+
+	static const unsigned shapes[][3] = {	// depth, fanout, files per directory
+		{ 3, 8, 20 },
+		{ 4, 8, 20 },
+		{ 5, 8, 20 },
+		{ 3, 10, 500 },
+	};
+	bool ok = true;
+	for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); ++i)
+	{
+		SimulatedFileSystem fs(shapes[i][0], shapes[i][1], shapes[i][2]);
+		char name[64];
+		snprintf(name, sizeof(name), "depth %u fanout %u files %u", shapes[i][0], shapes[i][1], shapes[i][2]);
+		ok &= Measure(name, fs, SimulatedFileSystem::Root());
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+/****************************** Module Header ******************************\
+Module Name:  TraceBench.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Measures what span tracing costs, on its own and on the tip of a cached
+volume, the cheapest path through the menu, against simulated volumes. A
+span must stay within a fixed budget both while tracing is off, which is
+how every user runs, and while it is on. The bench exits with 1 if either
+is exceeded, so it can gate changes to the tracing, and writes the trace of
+the traced run for a look in chrome://tracing.
+
+Results go to stderr as a table and to stdout as one JSON object per
+measurement.
+
+Build with the TraceBench target of the CMake build and run:
+./build/TraceBench [spans trace-file]
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "DiskUsageCore.h"
+#include "SimulatedVolumeBackend.h"
+#include "Trace.h"
+#include "Utf8.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+// Budgets of a single span, in nanoseconds
+#define DISABLED_SPAN_BUDGET_NS  5.0
+#define ENABLED_SPAN_BUDGET_NS   500.0
+
+// Open and close spans, nanoseconds per span
+static double SpanCost(unsigned spans)
+{
+	long long start = Trace::Now();
+	for (unsigned i = 0; i < spans; ++i)
+	{
+		TraceSpan span("TraceBench", L"detail");
+	}
+	return (double)(Trace::Now() - start) / spans;
+}
+
+// Build the tip of a cached volume, nanoseconds per call
+static double WarmTipCost(VolumeBackend &backend, const MountTable &table, const std::wstring &mount,
+	unsigned calls)
+{
+	TipSettings settings;
+	std::wstring volname, tip;
+	BuildItemTip(backend, table, settings, FolderIndexLookup(), mount, volname, tip);
+	long long start = Trace::Now();
+	for (unsigned i = 0; i < calls; ++i)
+		BuildItemTip(backend, table, settings, FolderIndexLookup(), mount, volname, tip);
+	return (double)(Trace::Now() - start) / calls;
+}
+
+static void Report(const char *name, double ns, double budget)
+{
+	fprintf(stderr, "%-20s %10.1f ns", name, ns);
+	if (budget)
+		fprintf(stderr, " (budget %.1f ns)%s", budget, ns > budget ? " EXCEEDED" : "");
+	fputc('\n', stderr);
+	printf("{\"bench\":\"trace\",\"measure\":\"%s\",\"ns\":%.1f", name, ns);
+	if (budget)
+		printf(",\"budget_ns\":%.1f", budget);
+	printf("}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned spans = argc > 1 ? atoi(argv[1]) : 10000000;
+	const char *traceFile = argc > 2 ? argv[2] : "trace-bench.json";
+	if (!spans)
+	{
+		fprintf(stderr, "usage: TraceBench [spans trace-file]\n");
+		return 2;
+	}
+	unsigned calls = spans / 100 ? spans / 100 : 1;
+
+	SimulatedVolumeBackend backend(100);
+	MountTable table;
+	table.Load(backend);
+	std::vector<std::wstring> paths;
+	backend.QueryPaths(SimulatedVolumeBackend::VolumeName(7).c_str(), paths);
+
+	// The best of three, as the budgets are about the code and not about
+	// what else the machine is doing
+	double disabled = 1e30, enabled = 1e30, tipOff = 1e30, tipOn = 1e30;
+	for (int round = 0; round < 3; ++round)
+	{
+		Trace::Enable(false);
+		disabled = std::min(disabled, SpanCost(spans));
+		tipOff = std::min(tipOff, WarmTipCost(backend, table, paths[0], calls));
+		Trace::Enable(true);
+		enabled = std::min(enabled, SpanCost(spans));
+		tipOn = std::min(tipOn, WarmTipCost(backend, table, paths[0], calls));
+	}
+	Trace::Enable(false);
+
+	Report("span-disabled", disabled, DISABLED_SPAN_BUDGET_NS);
+	Report("span-enabled", enabled, ENABLED_SPAN_BUDGET_NS);
+	Report("menu-warm-untraced", tipOff, 0);
+	Report("menu-warm-traced", tipOn, 0);
+
+	if (!Trace::Save(Utf8ToWide(traceFile)))
+		fprintf(stderr, "cannot write %s\n", traceFile);
+	return disabled > DISABLED_SPAN_BUDGET_NS || enabled > ENABLED_SPAN_BUDGET_NS ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+/****************************** Module Header ******************************\
+Module Name:  UringBench.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Compares the folder scans of the POSIX file system, which stats one file at
+a time per thread, with those of the io_uring one, which keeps a ring of
+stats in flight per thread. Both scan the same synthetic tree, made on disk
+in a directory given, at a few thread counts. The bench reports entries per
+second and exits with 1 if the two backends disagree on any total.
+
+With cold, the page cache is dropped before every scan, which takes root,
+so that the stats go to the disk. Otherwise the tree is in the cache after
+the first scan, and the numbers are those of the system calls alone.
+
+Results go to stderr as a table and to stdout as one JSON object per
+measurement.
+
+Build with the UringBench target of the CMake build and run (Linux only):
+./build/UringBench [dir depth fanout files [cold]]
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "FolderScanner.h"
+#include "Utf8.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#endif
+
+#define ROUNDS 3
+
+#ifndef _WIN32
+
+typedef std::chrono::steady_clock Clock;
+
+// depth levels of fanout subdirectories below path, with files sparse files
+// in each directory. Returns false if any could not be made.
+static bool MakeTree(const std::string &path, unsigned depth, unsigned fanout, unsigned files, unsigned &made)
+{
+	if (mkdir(path.c_str(), 0755) != 0)
+		return false;
+	char name[32];
+	for (unsigned i = 0; i < files; ++i)
+	{
+		sprintf(name, "/file%u", i);
+		int fd = open((path + name).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0)
+			return false;
+		// Sizes spread over a few orders of magnitude, taking no space
+		bool sized = ftruncate(fd, (off_t)(((made + i) * 2654435761u) % 1000) << (i % 20)) == 0;
+		close(fd);
+		if (!sized)
+			return false;
+	}
+	++made;
+	for (unsigned i = 0; depth && i < fanout; ++i)
+	{
+		sprintf(name, "/dir%u", i);
+		if (!MakeTree(path + name, depth - 1, fanout, files, made))
+			return false;
+	}
+	return true;
+}
+
+static int RemoveEntry(const char *path, const struct stat *, int, struct FTW *)
+{
+	return remove(path);
+}
+
+static bool DropCaches()
+{
+	sync();
+	FILE *f = fopen("/proc/sys/vm/drop_caches", "w");
+	if (!f)
+		return false;
+	bool ok = fputs("3", f) >= 0;
+	return fclose(f) == 0 && ok;
+}
+
+// The best of ROUNDS scans of root, seconds
+static double ScanTime(FileSystem &fs, const std::wstring &root, unsigned threads, bool cold, ScanTotals &totals)
+{
+	double best = 1e30;
+	for (int round = 0; round < ROUNDS; ++round)
+	{
+		if (cold)
+			DropCaches();
+		FolderScanner scanner(fs, threads);
+		Clock::time_point start = Clock::now();
+		scanner.Scan(root, totals);
+		best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+	}
+	return best;
+}
+
+static void Report(const char *backend, unsigned threads, double seconds, const ScanTotals &totals, double gain)
+{
+	double entries = (double)(totals.files + totals.dirs + 1);
+	fprintf(stderr, "%-6s %3u threads %9.1f ms %12.0f entries/s", backend, threads, seconds * 1000, entries / seconds);
+	if (gain)
+		fprintf(stderr, "  x%.2f", gain);
+	fputc('\n', stderr);
+	printf("{\"bench\":\"uring\",\"backend\":\"%s\",\"threads\":%u,\"ms\":%.1f,\"entries_per_s\":%.0f",
+		backend, threads, seconds * 1000, entries / seconds);
+	if (gain)
+		printf(",\"gain\":%.2f", gain);
+	printf("}\n");
+}
+
+static bool SameTotals(const ScanTotals &a, const ScanTotals &b)
+{
+	return a.bytes == b.bytes && a.allocated == b.allocated && a.files == b.files && a.dirs == b.dirs &&
+		a.errors == b.errors;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = argc > 1 ? argv[1] : "/tmp";
+	unsigned depth = argc > 2 ? atoi(argv[2]) : 3;
+	unsigned fanout = argc > 3 ? atoi(argv[3]) : 8;
+	unsigned files = argc > 4 ? atoi(argv[4]) : 100;
+	bool cold = argc > 5 && strcmp(argv[5], "cold") == 0;
+	if (!fanout)
+	{
+		fprintf(stderr, "usage: UringBench [dir depth fanout files [cold]]\n");
+		return 2;
+	}
+	if (&UringFileSystem() == &SystemFileSystem())
+		fprintf(stderr, "io_uring is not available, both backends are the POSIX one\n");
+	if (cold && !DropCaches())
+	{
+		fprintf(stderr, "cannot drop the page cache, measuring warm\n");
+		cold = false;
+	}
+
+	char name[64];
+	sprintf(name, "/UringBench.%d", (int)getpid());
+	std::string root = std::string(dir) + name;
+	unsigned made = 0;
+	bool ok = MakeTree(root, depth, fanout, files, made);
+	int result = 0;
+	if (!ok)
+	{
+		fprintf(stderr, "cannot make the tree in %s\n", dir);
+		result = 2;
+	}
+	else
+	{
+		fprintf(stderr, "%u directories, %u files, %s\n", made, made * files, cold ? "cold" : "warm");
+		const unsigned threads[] = { 1, 4, 16 };
+		for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i)
+		{
+			ScanTotals posix, uring;
+			double posixSeconds = ScanTime(SystemFileSystem(), Utf8ToWide(root), threads[i], cold, posix);
+			double uringSeconds = ScanTime(UringFileSystem(), Utf8ToWide(root), threads[i], cold, uring);
+			Report("posix", threads[i], posixSeconds, posix, 0);
+			Report("uring", threads[i], uringSeconds, uring, posixSeconds / uringSeconds);
+			if (!SameTotals(posix, uring))
+			{
+				fprintf(stderr, "the totals differ: %llu/%llu bytes, %llu/%llu allocated, %llu/%llu files, "
+					"%llu/%llu dirs\n", posix.bytes, uring.bytes, posix.allocated, uring.allocated,
+					posix.files, uring.files, posix.dirs, uring.dirs);
+				result = 1;
+			}
+		}
+	}
+	nftw(root.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+	return result;
+}
+
+#else
+
+int main()
+{
+	fprintf(stderr, "UringBench runs on Linux only\n");
+	return 2;
+}
+
+#endif
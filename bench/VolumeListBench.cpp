@@ -0,0 +1,113 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeListBench.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Measures how long the detail view takes to collect its volumes, against
+simulated volumes whose every call is delayed, over a range of volume counts
+and delays. Each point is collected three ways: one volume alone, which is
+the least the view can take, all volumes through a single query thread, as
+the view did before it queried volumes in parallel, and all volumes through
+the query workers. The pooled time should stay close to that of one volume
+until the volumes outnumber the workers.
+
+Results go to stderr as a table and to stdout as one JSON object per point.
+
+Build with the VolumeListBench target of the CMake build and run:
+./build/VolumeListBench [volumes,... delays,... threads]
+
+e.g. ./build/VolumeListBench 1,10,40,100 0,1000,20000 16 with the delays in
+microseconds per call.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "VolumeList.h"
+#include "SimulatedVolumeBackend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Parse a list like 1,10,40
+static bool ParseList(const char *spec, std::vector<unsigned> &values)
+{
+	values.clear();
+	for (;;)
+	{
+		char *end;
+		values.push_back((unsigned)strtoul(spec, &end, 10));
+		if (end == spec)
+			return false;
+		if (!*end)
+			return true;
+		if (*end != ',')
+			return false;
+		spec = end + 1;
+	}
+}
+
+// Collect the volumes of backend with threads query threads, in
+// milliseconds. complete tells whether every volume completed.
+static double Collect(VolumeBackend &backend, unsigned threads, bool &complete)
+{
+	QueryWorker worker(threads);
+	VolumeQuery query(worker);
+	std::vector<VolumeRecord> records;
+	Clock::time_point start = Clock::now();
+	complete = CollectVolumes(backend, query, QueryClock::now() + std::chrono::minutes(10), records);
+	double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	for (size_t i = 0; i < records.size(); ++i)
+		complete = complete && records[i].status == VolumeQuery::QUERY_OK;
+	return ms;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<unsigned> volumeCounts, delays;
+	unsigned threads = argc > 3 ? atoi(argv[3]) : QueryWorker::DEFAULT_MAX_THREADS;
+	if (!ParseList(argc > 1 ? argv[1] : "1,10,40,100", volumeCounts) ||
+		!ParseList(argc > 2 ? argv[2] : "0,1000,20000", delays) || !threads)
+	{
+		fprintf(stderr, "usage: VolumeListBench [volumes,... delays,... threads]\n");
+		return 2;
+	}
+
+	fprintf(stderr, "%8s %10s %12s %12s %12s %8s\n", "volumes", "delay us", "one ms", "serial ms",
+		"pooled ms", "speedup");
+	int result = 0;
+	for (size_t v = 0; v < volumeCounts.size(); ++v)
+	{
+		for (size_t d = 0; d < delays.size(); ++d)
+		{
+			unsigned volumes = volumeCounts[v] ? volumeCounts[v] : 1, delay = delays[d];
+			SimulatedVolumeBackend one(1, 1, delay), all(volumes, 1, delay);
+			bool oneOk, serialOk, pooledOk;
+			double oneMs = Collect(one, 1, oneOk);
+			double serialMs = Collect(all, 1, serialOk);
+			double pooledMs = Collect(all, threads, pooledOk);
+			if (!oneOk || !serialOk || !pooledOk)
+			{
+				fprintf(stderr, "%u volumes at %u us: a volume did not complete\n", volumes, delay);
+				result = 1;
+			}
+			double speedup = pooledMs > 0 ? serialMs / pooledMs : 0;
+			fprintf(stderr, "%8u %10u %12.2f %12.2f %12.2f %7.1fx\n", volumes, delay, oneMs, serialMs,
+				pooledMs, speedup);
+			printf("{\"bench\":\"volumelist\",\"volumes\":%u,\"delay_us\":%u,\"threads\":%u,"
+				"\"one_ms\":%.2f,\"serial_ms\":%.2f,\"pooled_ms\":%.2f}\n",
+				volumes, delay, threads, oneMs, serialMs, pooledMs);
+			fflush(stdout);
+		}
+	}
+	return result;
+}
@@ -0,0 +1,142 @@
+/****************************** Module Header ******************************\
+Module Name:  ChangeWatcherTest.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Tests of the inotify change watcher together with IndexUpdater on a real
+tree in a temporary directory: files created, grown and deleted, and
+directories made below the watched ones, all end up in the totals, also
+when a directory is replaced by another of the same name between two waits.
+When not run as root, a directory that cannot be watched must be reported as an
+overflow, so that it is rescanned. Linux only.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Test.h"
+#include "TempDir.h"
+#include "ChangeWatcher.h"
+#include "IndexUpdater.h"
+#include "FileSystem.h"
+#include <stdio.h>
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+// Apply the events of the watcher until the totals of path are bytes and
+// files, for up to 2 seconds
+static bool Settle(ChangeWatcher &watcher, IndexUpdater &updater, const std::wstring &path,
+	unsigned long long bytes, unsigned long long files)
+{
+	Clock::time_point end = Clock::now() + std::chrono::seconds(2);
+	ScanTotals totals;
+	do
+	{
+		std::vector<ChangeEvent> events;
+		if (!watcher.Wait(50, events))
+			return false;
+		updater.Apply(events);
+		if (updater.Lookup(path, totals) && totals.bytes == bytes && totals.files == files)
+			return true;
+	} while (Clock::now() < end);
+	fprintf(stderr, "%s: %llu bytes, %llu files\n", WideToUtf8(path).c_str(), totals.bytes, totals.files);
+	return false;
+}
+
+TEST(CreateGrowDelete)
+{
+	TempDir dir("ChangeWatcherTest");
+	CHECK(dir.Made());
+	CHECK(dir.MakeDir("a"));
+	CHECK(dir.MakeFile("a/f1", 100));
+	IndexUpdater updater(SystemFileSystem(), 2);
+	CHECK(updater.AddRoot(dir.WidePath()));
+	std::unique_ptr<ChangeWatcher> watcher = CreateSystemChangeWatcher();
+	CHECK(watcher->Watch(dir.WidePath()));
+	std::wstring root = dir.WidePath(), a = Utf8ToWide(dir("a"));
+
+	ScanTotals totals;
+	CHECK(updater.Lookup(root, totals) && totals.bytes == 100 && totals.files == 1);
+
+	CHECK(dir.MakeFile("f2", 50));
+	CHECK(Settle(*watcher, updater, root, 150, 2));
+
+	CHECK(dir.Append("a/f1", 900));
+	CHECK(Settle(*watcher, updater, root, 1050, 2));
+	CHECK(updater.Lookup(a, totals) && totals.bytes == 1000);
+
+	CHECK(remove(dir("f2").c_str()) == 0);
+	CHECK(Settle(*watcher, updater, root, 1000, 1));
+
+	// A new directory is watched too, and what is made in it at once counted
+	CHECK(dir.MakeDir("a/b"));
+	CHECK(dir.MakeFile("a/b/g", 10));
+	CHECK(Settle(*watcher, updater, root, 1010, 2));
+	CHECK(dir.MakeFile("a/b/h", 20));
+	CHECK(Settle(*watcher, updater, Utf8ToWide(dir("a/b")), 30, 2));
+	CHECK(Settle(*watcher, updater, root, 1030, 3));
+
+	CHECK(remove(dir("a/b/g").c_str()) == 0);
+	CHECK(remove(dir("a/b/h").c_str()) == 0);
+	CHECK(remove(dir("a/b").c_str()) == 0);
+	CHECK(Settle(*watcher, updater, root, 1000, 1));
+}
+
+TEST(DirectoryReplacedInOneBatch)
+{
+	TempDir dir("ChangeWatcherTest"), outside("ChangeWatcherTest");
+	CHECK(dir.Made() && outside.Made());
+	CHECK(dir.MakeDir("a"));
+	CHECK(dir.MakeDir("a/x"));
+	CHECK(dir.MakeFile("a/x/f", 100));
+	IndexUpdater updater(SystemFileSystem(), 2);
+	CHECK(updater.AddRoot(dir.WidePath()));
+	std::unique_ptr<ChangeWatcher> watcher = CreateSystemChangeWatcher();
+	CHECK(watcher->Watch(dir.WidePath()));
+
+	// Moved out of the tree, so that nothing is reported from within it, and
+	// a new one made and filled before the watcher sees either
+	CHECK(rename(dir("a/x").c_str(), outside("x").c_str()) == 0);
+	CHECK(dir.MakeDir("a/x"));
+	CHECK(dir.MakeFile("a/x/g", 7));
+	CHECK(Settle(*watcher, updater, dir.WidePath(), 7, 1));
+	CHECK(Settle(*watcher, updater, Utf8ToWide(dir("a/x")), 7, 1));
+}
+
+TEST(UnwatchableDirectoryOverflows)
+{
+	// Root reads and watches any directory
+	if (geteuid() == 0)
+	{
+		fprintf(stderr, "running as root, skipped\n");
+		return;
+	}
+	TempDir dir("ChangeWatcherTest");
+	CHECK(dir.Made());
+	CHECK(dir.MakeDir("closed"));
+	CHECK(chmod(dir("closed").c_str(), 0) == 0);
+	std::unique_ptr<ChangeWatcher> watcher = CreateSystemChangeWatcher();
+	CHECK(watcher->Watch(dir.WidePath()));
+	std::vector<ChangeEvent> events;
+	CHECK(watcher->Wait(1000, events));
+	bool reported = false;
+	for (size_t i = 0; i < events.size(); ++i)
+		reported |= events[i].overflow && events[i].path == Utf8ToWide(dir("closed"));
+	CHECK(reported);
+	// Once only
+	events.clear();
+	CHECK(watcher->Wait(10, events));
+	CHECK(events.empty());
+	chmod(dir("closed").c_str(), 0755);
+}
+
+int main()
+{
+	return RUN_TESTS();
+}
@@ -0,0 +1,141 @@
+/****************************** Module Header ******************************\
+Module Name:  FaultInjectionTest.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Unit tests of the latency bound of volume queries, with faults injected
+into simulated volumes: a hung volume does not hold the others, nor the
+caller past its deadline, a volume that keeps failing is backed off for
+twice as long every time, and a query that succeeds after its caller gave
+up on it clears the backoff.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Test.h"
+#include "DiskUsageCore.h"
+#include "FaultInjectingBackend.h"
+#include "SimulatedVolumeBackend.h"
+#include <stdio.h>
+#include <thread>
+#include <chrono>
+
+// Volumes are cached process wide, so every test queries volumes of its own
+#define VOLUMES 8
+
+static double Milliseconds(QueryClock::duration d)
+{
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+// Query the space of volname through backend as the menu does
+static VolumeQuery::Status QuerySpace(VolumeQuery &query, VolumeBackend &backend, const std::wstring &volname,
+	unsigned timeoutMs)
+{
+	return query.Run(volname, [&backend, volname]() {
+			VolumeSpace space;
+			return backend.QuerySpace(volname.c_str(), space);
+		},
+		QueryClock::now() + std::chrono::milliseconds(timeoutMs));
+}
+
+TEST(HungVolumeReturnsByDeadline)
+{
+	SimulatedVolumeBackend volumes(VOLUMES);
+	FaultInjectingBackend faults(volumes);
+	std::vector<std::wstring> volnames;
+	for (unsigned i = 0; i < 3; ++i)
+		volnames.push_back(SimulatedVolumeBackend::VolumeName(i));
+	faults.SetFault(volnames[1], FaultInjectingBackend::FAULT_HANG);
+
+	std::vector<VolumeCacheEntry> entries;
+	std::vector<VolumeQuery::Status> statuses;
+	QueryClock::time_point start = QueryClock::now();
+	GetVolumeEntries(faults, TipSettings().volumeFormat, volnames, 100, entries, statuses);
+	double ms = Milliseconds(QueryClock::now() - start);
+	if (ms >= 150)
+		fprintf(stderr, "%.1f ms for a deadline of 100 ms\n", ms);
+	CHECK(ms >= 100 && ms < 150);
+	CHECK(statuses[0] == VolumeQuery::QUERY_OK && !entries[0].tip.empty());
+	CHECK(statuses[1] == VolumeQuery::QUERY_PENDING);
+	CHECK(statuses[2] == VolumeQuery::QUERY_OK && !entries[2].tip.empty());
+	CHECK(faults.Blocked() == 1);
+
+	// The hung query still holds the volume, which is not queried again
+	start = QueryClock::now();
+	GetVolumeEntries(faults, TipSettings().volumeFormat, volnames, 100, entries, statuses);
+	CHECK(Milliseconds(QueryClock::now() - start) < 50);
+	CHECK(statuses[1] == VolumeQuery::QUERY_PENDING || statuses[1] == VolumeQuery::QUERY_BACKOFF);
+	CHECK(faults.Blocked() == 1);
+}
+
+TEST(FailuresBackOffExponentially)
+{
+	SimulatedVolumeBackend volumes(VOLUMES);
+	FaultInjectingBackend faults(volumes);
+	std::wstring volname = SimulatedVolumeBackend::VolumeName(3);
+	faults.SetFault(volname, FaultInjectingBackend::FAULT_FAIL);
+	QueryWorker worker;
+	VolumeQuery query(worker, 40, 10000);
+
+	// How long each failure keeps the volume from being queried again
+	double backoffs[4];
+	CHECK(QuerySpace(query, faults, volname, 1000) == VolumeQuery::QUERY_FAILED);
+	for (int i = 0; i < 4; ++i)
+	{
+		QueryClock::time_point failed = QueryClock::now();
+		VolumeQuery::Status status;
+		while ((status = QuerySpace(query, faults, volname, 1000)) == VolumeQuery::QUERY_BACKOFF)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		backoffs[i] = Milliseconds(QueryClock::now() - failed);
+		CHECK(status == VolumeQuery::QUERY_FAILED);
+	}
+	fprintf(stderr, "backoffs %.0f %.0f %.0f %.0f ms\n", backoffs[0], backoffs[1], backoffs[2], backoffs[3]);
+	for (int i = 0; i < 4; ++i)
+	{
+		double expected = 40 << i;
+		CHECK(backoffs[i] >= expected - 1 && backoffs[i] < expected + 30);
+	}
+}
+
+TEST(LateSuccessClearsBackoff)
+{
+	SimulatedVolumeBackend volumes(VOLUMES);
+	FaultInjectingBackend faults(volumes);
+	std::wstring volname = SimulatedVolumeBackend::VolumeName(4);
+	faults.SetFault(volname, FaultInjectingBackend::FAULT_DELAY, 100);
+	QueryWorker worker;
+	// Far longer than the test, so only the success can end it
+	VolumeQuery query(worker, 60000, 60000);
+
+	CHECK(QuerySpace(query, faults, volname, 10) == VolumeQuery::QUERY_PENDING);
+	faults.ClearFaults();
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	// Still running, and backed off as a timeout once it is done
+	CHECK(QuerySpace(query, faults, volname, 10) == VolumeQuery::QUERY_PENDING);
+	while (faults.Blocked())
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	CHECK(QuerySpace(query, faults, volname, 1000) == VolumeQuery::QUERY_OK);
+
+	// Whereas a hung query that fails in the end leaves it backed off
+	volname = SimulatedVolumeBackend::VolumeName(5);
+	faults.SetFault(volname, FaultInjectingBackend::FAULT_HANG);
+	CHECK(QuerySpace(query, faults, volname, 10) == VolumeQuery::QUERY_PENDING);
+	faults.Release();
+	while (faults.Blocked())
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	CHECK(QuerySpace(query, faults, volname, 1000) == VolumeQuery::QUERY_BACKOFF);
+}
+
+int main()
+{
+	return RUN_TESTS();
+}
@@ -0,0 +1,78 @@
+/****************************** Module Header ******************************\
+Module Name:  FolderQueryTest.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Unit tests of the folder scans of the engine as volume queries: a scan or
+report that times out does not back off, nor hold up, the queries of the
+volume named like the folder, as the volume of every mount point is.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Test.h"
+#include "TempDir.h"
+#include "DiskUsageCore.h"
+#include <stdio.h>
+
+// 20 directories of 20 directories of 5 files, too many to scan in no time
+static bool MakeTree(const TempDir &dir)
+{
+	char name[64];
+	for (unsigned i = 0; i < 20; ++i)
+	{
+		sprintf(name, "d%u", i);
+		if (!dir.MakeDir(name))
+			return false;
+		for (unsigned j = 0; j < 20; ++j)
+		{
+			sprintf(name, "d%u/d%u", i, j);
+			if (!dir.MakeDir(name))
+				return false;
+			for (unsigned k = 0; k < 5; ++k)
+			{
+				sprintf(name, "d%u/d%u/f%u", i, j, k);
+				if (!dir.MakeFile(name, 100))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+// A query of the volume named path, as one of its free space
+static VolumeQuery::Status QueryVolume(const std::wstring &path)
+{
+	return VolumeQuery::Global().Run(path, []() { return true; },
+		QueryClock::now() + std::chrono::seconds(1));
+}
+
+TEST(TimedOutScanDoesNotBackOffVolume)
+{
+	TempDir dir("FolderQueryTest");
+	CHECK(MakeTree(dir));
+	ScanTotals totals;
+	CHECK(!ScanFolder(dir.WidePath(), 1, 0, totals));
+	CHECK(QueryVolume(dir.WidePath()) == VolumeQuery::QUERY_OK);
+}
+
+TEST(TimedOutReportDoesNotBackOffVolume)
+{
+	TempDir dir("FolderQueryTest");
+	CHECK(MakeTree(dir));
+	FolderReport report;
+	CHECK(!GetFolderReport(dir.WidePath(), 1, 10, 0, report));
+	// The report scan is still running, and the volume is queried meanwhile
+	CHECK(QueryVolume(dir.WidePath()) == VolumeQuery::QUERY_OK);
+}
+
+int main()
+{
+	return RUN_TESTS();
+}
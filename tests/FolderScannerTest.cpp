@@ -0,0 +1,54 @@
+/****************************** Module Header ******************************\
+Module Name:  FolderScannerTest.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Unit tests of the folder scanner's cancellation: a Cancel() that comes
+before Scan() has started, as from a query still queued or a front end
+that let go of its lock, is not lost, and the scan returns false at once.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Test.h"
+#include "FolderScanner.h"
+#include "SimulatedFileSystem.h"
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+TEST(CancelBeforeScanStops)
+{
+	// Listings of 20 ms, about 6 s for the whole tree on one thread
+	SimulatedFileSystem fs(3, 8, 10, 20000);
+	FolderScanner scanner(fs, 1);
+	scanner.Cancel();
+	ScanTotals totals;
+	Clock::time_point start = Clock::now();
+	CHECK(!scanner.Scan(SimulatedFileSystem::Root(), totals));
+	CHECK(Clock::now() - start < std::chrono::milliseconds(50));
+	CHECK(fs.ReadDirCalls() <= 1);
+}
+
+TEST(CancelledScannerStaysCancelled)
+{
+	SimulatedFileSystem fs(2, 4, 10);
+	FolderScanner scanner(fs, 4);
+	ScanTotals totals;
+	CHECK(scanner.Scan(SimulatedFileSystem::Root(), totals));
+	CHECK(totals.dirs == 4 + 16);
+	scanner.Cancel();
+	CHECK(!scanner.Scan(SimulatedFileSystem::Root(), totals));
+	CHECK(!scanner.Scan(SimulatedFileSystem::Root(), totals));
+}
+
+int main()
+{
+	return RUN_TESTS();
+}
@@ -0,0 +1,136 @@
+/****************************** Module Header ******************************\
+Module Name:  LinkLoopTest.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Tests of FolderScanner on real trees with links in a temporary directory: a
+file with several hard links is counted once, whichever link a thread finds
+first, so the totals are the same at every thread count; symbolic links to
+a parent, to the directory itself or to the root are not followed; and a
+directory bind mounted below itself is seen as a loop. Bind mounts take
+root, the test of them is skipped without it. Linux only.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Test.h"
+#include "TempDir.h"
+#include "FolderScanner.h"
+#include <stdio.h>
+#include <sys/mount.h>
+
+#define DIRS 8
+#define FILES 10
+// Files of each directory with a second link in the next directory
+#define LINKED 5
+
+// DIRS directories of FILES files, LINKED of them in each also linked from
+// the next directory, one linked three times from its own directory, and
+// symbolic links that would loop if followed. Returns the bytes of the
+// distinct files.
+static bool MakeLinkedTree(const TempDir &dir, unsigned long long &bytes)
+{
+	char name[64], link[64];
+	bytes = 0;
+	for (unsigned i = 0; i < DIRS; ++i)
+	{
+		sprintf(name, "d%u", i);
+		if (!dir.MakeDir(name))
+			return false;
+		for (unsigned j = 0; j < FILES; ++j)
+		{
+			sprintf(name, "d%u/f%u", i, j);
+			size_t size = (i * FILES + j + 1) * 100;
+			if (!dir.MakeFile(name, size))
+				return false;
+			bytes += size;
+		}
+	}
+	for (unsigned i = 0; i < DIRS; ++i)
+	{
+		for (unsigned j = 0; j < LINKED; ++j)
+		{
+			sprintf(name, "d%u/f%u", i, j);
+			sprintf(link, "d%u/l%u", (i + 1) % DIRS, j);
+			if (::link(dir(name).c_str(), dir(link).c_str()) != 0)
+				return false;
+		}
+	}
+	if (::link(dir("d0/f9").c_str(), dir("d0/again1").c_str()) != 0 ||
+		::link(dir("d0/f9").c_str(), dir("d0/again2").c_str()) != 0)
+		return false;
+	return symlink("..", dir("d0/up").c_str()) == 0 &&
+		symlink(".", dir("d1/self").c_str()) == 0 &&
+		symlink(dir.Path().c_str(), dir("d2/root").c_str()) == 0 &&
+		symlink("d3", dir("d3/sibling").c_str()) == 0;
+}
+
+#define LINKS (DIRS * LINKED + 2)
+#define SYMLINKS 4
+
+TEST(LinksCountedOnceAtAnyThreadCount)
+{
+	TempDir dir("LinkLoopTest");
+	CHECK(dir.Made());
+	unsigned long long bytes;
+	CHECK(MakeLinkedTree(dir, bytes));
+
+	ScanTotals first;
+	const unsigned threads[] = { 1, 2, 4, 8, 16 };
+	for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i)
+	{
+		// A few rounds each, as which link is found first varies
+		for (int round = 0; round < 5; ++round)
+		{
+			FolderScanner scanner(SystemFileSystem(), threads[i]);
+			ScanTotals totals;
+			CHECK(scanner.Scan(dir.WidePath(), totals));
+			// Symbolic links count as files of no size
+			CHECK(totals.files == DIRS * FILES + SYMLINKS);
+			CHECK(totals.bytes == bytes);
+			CHECK(totals.dirs == DIRS);
+			CHECK(totals.errors == 0);
+			CHECK(scanner.Duplicates() == LINKS);
+			CHECK(scanner.Loops() == 0);
+			if (i == 0 && round == 0)
+				first = totals;
+			CHECK(totals.allocated == first.allocated);
+		}
+	}
+}
+
+TEST(BindMountLoopIsNotFollowed)
+{
+	TempDir dir("LinkLoopTest");
+	CHECK(dir.Made());
+	CHECK(dir.MakeFile("file", 1000));
+	CHECK(dir.MakeDir("sub"));
+	CHECK(dir.MakeDir("sub/bind"));
+	if (mount(dir.Path().c_str(), dir("sub/bind").c_str(), NULL, MS_BIND, NULL) != 0)
+	{
+		fprintf(stderr, "cannot bind mount, skipped\n");
+		return;
+	}
+	const unsigned threads[] = { 1, 4 };
+	for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i)
+	{
+		FolderScanner scanner(SystemFileSystem(), threads[i]);
+		ScanTotals totals;
+		CHECK(scanner.Scan(dir.WidePath(), totals));
+		CHECK(totals.files == 1);
+		CHECK(totals.bytes == 1000);
+		CHECK(scanner.Loops() == 1);
+	}
+	CHECK(umount2(dir("sub/bind").c_str(), MNT_DETACH) == 0);
+}
+
+int main()
+{
+	return RUN_TESTS();
+}
@@ -0,0 +1,114 @@
+/****************************** Module Header ******************************\
+Module Name:  ScanThrottleTest.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Unit tests of the scan throttle: a throttled scan reads at most the rate of
+folders and files per second, each entry of a listing counted, and listings
+that take long only because they are large do not back the rate off, as
+their latency is judged per entry.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Test.h"
+#include "ScanThrottle.h"
+#include "FolderScanner.h"
+#include "SimulatedFileSystem.h"
+#include <stdio.h>
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+// Directories /d0 to /d63 below the root, the odd ones of 200 files and the
+// even ones of 1. Listings take ENTRY_US per entry and one more for the
+// directory, spun rather than slept so that it is exact.
+#define ENTRY_US 20
+
+class ListSizeFileSystem : public FileSystem
+{
+public:
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *)
+	{
+		entries.clear();
+		if (self)
+			*self = DirEntry();
+		bool root = path == L"/";
+		unsigned count = root ? 64 : wcstoul(path.c_str() + 2, NULL, 10) % 2 ? 200 : 1;
+		for (unsigned i = 0; i < count; ++i)
+		{
+			DirEntry entry;
+			entry.name = (root ? L"d" : L"f") + std::to_wstring(i);
+			entry.isDir = root;
+			entry.isLink = false;
+			entry.size = entry.allocated = root ? 0 : 100;
+			entry.mtime = entry.device = entry.fileId = 0;
+			entry.links = 1;
+			entries.push_back(entry);
+		}
+		Clock::time_point until = Clock::now() + std::chrono::microseconds(ENTRY_US * (1 + count));
+		while (Clock::now() < until)
+			;
+		return true;
+	}
+
+	virtual bool Stat(const std::wstring &, DirEntry &)
+	{
+		return false;
+	}
+};
+
+TEST(RateCountsEveryEntry)
+{
+	// 1 + 4 + 16 directories of 20 files: 21 listings of 440 entries in all
+	SimulatedFileSystem fs(2, 4, 20);
+	const unsigned rate = 2000, burst = 20;
+	ScanThrottle throttle(rate, burst);
+	ThrottledFileSystem throttled(fs, throttle);
+	FolderScanner scanner(throttled, 4);
+	ScanTotals totals;
+	Clock::time_point start = Clock::now();
+	CHECK(scanner.Scan(SimulatedFileSystem::Root(), totals));
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	CHECK(totals.files == 21 * 20 && totals.dirs == 20);
+
+	ScanThrottleStats stats;
+	throttle.GetStats(stats);
+	CHECK(stats.requests == 21 + 440);
+	// Besides the burst, the last listing of each thread takes the tokens of
+	// its entries without waiting for them
+	double least = (461.0 - burst - 4 * 21) / rate;
+	if (seconds < least)
+		fprintf(stderr, "%.3f s, at least %.3f s\n", seconds, least);
+	CHECK(seconds >= least);
+	CHECK(stats.backoffs == 0);
+}
+
+TEST(LargeListingsDoNotBackOff)
+{
+	ListSizeFileSystem fs;
+	ScanThrottle throttle(1000000);
+	ThrottledFileSystem throttled(fs, throttle);
+	FolderScanner scanner(throttled, 1);
+	ScanTotals totals;
+	CHECK(scanner.Scan(L"/", totals));
+	CHECK(totals.files == 32 * 200 + 32 && totals.dirs == 64);
+	ScanThrottleStats stats;
+	throttle.GetStats(stats);
+	if (stats.backoffs)
+		fprintf(stderr, "%u backoffs, baseline %.1f us\n", stats.backoffs, stats.baselineUs);
+	CHECK(stats.backoffs == 0);
+	CHECK(stats.meanLatencyUs >= ENTRY_US && stats.meanLatencyUs < ENTRY_US * 2);
+}
+
+int main()
+{
+	return RUN_TESTS();
+}
@@ -0,0 +1,127 @@
+/****************************** Module Header ******************************\
+Module Name:  ScanTreeTest.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Unit tests of ScanTree and its NameArena: names are stored once and read
+back, names too long for an arena block are cut to fit it, the root path is
+kept apart from the names, and clearing a tree drops its names.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Test.h"
+#include "ScanTree.h"
+
+static DirEntry Entry(const std::wstring &name, bool isDir, unsigned long long size)
+{
+	DirEntry entry;
+	entry.name = name;
+	entry.isDir = isDir;
+	entry.isLink = false;
+	entry.size = size;
+	entry.allocated = size;
+	entry.mtime = 0;
+	entry.device = entry.fileId = 0;
+	entry.links = 1;
+	return entry;
+}
+
+TEST(NamesAreInternedOnce)
+{
+	NameArena names;
+	uint32_t a = names.Intern(L"alpha");
+	uint32_t b = names.Intern(L"beta");
+	CHECK(a != b);
+	CHECK(names.Intern(L"alpha") == a);
+	CHECK(names.Name(a) == L"alpha");
+	CHECK(names.Name(b) == L"beta");
+	CHECK(names.Intern(L"") == names.Intern(L""));
+	CHECK(names.Count() == 3);
+}
+
+TEST(LongNamesAreCutToABlock)
+{
+	NameArena names;
+	// Fill part of a block first, so that the long names need a new one
+	names.Intern(L"short");
+	std::wstring longest(NameArena::MAX_NAME, L'x');
+	std::wstring longer(NameArena::MAX_NAME + 1000, L'y');
+	std::wstring cut(NameArena::MAX_NAME, L'y');
+	uint32_t a = names.Intern(longest);
+	uint32_t b = names.Intern(longer);
+	uint32_t c = names.Intern(L"after");
+	CHECK(names.Name(a) == longest);
+	CHECK(names.Name(b) == cut);
+	CHECK(names.Intern(cut) == b);
+	CHECK(names.Name(c) == L"after");
+	CHECK(names.Name(names.Intern(L"short")) == L"short");
+}
+
+TEST(ClearDropsNames)
+{
+	NameArena names;
+	for (int i = 0; i < 10000; ++i)
+		names.Intern(std::to_wstring(i));
+	CHECK(names.Count() == 10000);
+	CHECK(names.ArenaBytes() > 0);
+	names.Clear();
+	CHECK(names.Count() == 0);
+	CHECK(names.ArenaBytes() == 0);
+	CHECK(names.TableBytes() == 0);
+	uint32_t id = names.Intern(L"again");
+	CHECK(names.Name(id) == L"again");
+	CHECK(names.Count() == 1);
+}
+
+TEST(TreeKeepsRootApart)
+{
+	ScanTree tree;
+	CHECK(tree.SetRoot(L"/some/root") == 0);
+	CHECK(tree.NameCount() == 0);
+	std::vector<DirEntry> entries;
+	entries.push_back(Entry(L"dir", true, 0));
+	entries.push_back(Entry(L"file", false, 10));
+	ScanTree::Index first = tree.AddChildren(0, entries);
+	CHECK(tree.NameCount() == 2);
+	CHECK(tree.Size() == 3);
+	CHECK(tree.Name(0) == L"/some/root");
+	CHECK(tree.Name(first) == L"dir");
+	CHECK(tree.Name(first + 1) == L"file");
+	CHECK(tree.Parent(first + 1) == 0);
+	CHECK(tree.IsDir(first) && !tree.IsDir(first + 1));
+	CHECK(tree.Bytes(first + 1) == 10);
+}
+
+TEST(TreeClearDropsNames)
+{
+	ScanTree tree;
+	tree.SetRoot(L"/first");
+	std::vector<DirEntry> entries;
+	for (int i = 0; i < 1000; ++i)
+		entries.push_back(Entry(L"first" + std::to_wstring(i), false, 1));
+	tree.AddChildren(0, entries);
+	CHECK(tree.NameCount() == 1000);
+	tree.Clear();
+	CHECK(tree.Size() == 0);
+	CHECK(tree.NameCount() == 0);
+	// A new root starts afresh as well
+	tree.SetRoot(L"/second");
+	entries.resize(1);
+	entries[0].name = L"only";
+	tree.AddChildren(0, entries);
+	CHECK(tree.NameCount() == 1);
+	CHECK(tree.Name(1) == L"only");
+	CHECK(tree.Name(0) == L"/second");
+}
+
+int main()
+{
+	return RUN_TESTS();
+}
@@ -0,0 +1,345 @@
+/****************************** Module Header ******************************\
+Module Name:  SizeEstimatorTest.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Tests of the folder size estimator on real trees in a temporary directory:
+estimates from part of an uneven tree are close to the totals of a full
+scan, those of a heavy-tailed one get closer as the budget grows, and once
+every directory is listed they are the totals. A listing that hangs must
+not hold up the estimate: it is readable meanwhile, Cancel() ends the
+listing, and the menu text of a folder too large to scan in its window is
+an estimate made within the window. Linux only.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Test.h"
+#include "TempDir.h"
+#include "SizeEstimator.h"
+#include "DiskUsageCore.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+#define SEEDS 21
+#define CONVERGENCE_SEEDS 11
+
+// Directories of 0 to 5 subdirectories down to depth, each of 0 to 20 files
+// of sizes spread over three orders of magnitude
+static bool MakeUnevenTree(const TempDir &dir, const std::string &path, unsigned depth, std::mt19937 &random)
+{
+	unsigned files = std::uniform_int_distribution<unsigned>(0, 20)(random);
+	for (unsigned i = 0; i < files; ++i)
+	{
+		size_t size = (size_t)(100 * pow(10.0, std::uniform_real_distribution<double>(0, 3)(random)));
+		if (!dir.MakeFile(path + "/f" + std::to_string(i), size))
+			return false;
+	}
+	unsigned subdirs = depth ? std::uniform_int_distribution<unsigned>(depth > 2 ? 3 : 0, 5)(random) : 0;
+	for (unsigned i = 0; i < subdirs; ++i)
+	{
+		std::string sub = path + "/d" + std::to_string(i);
+		if (!dir.MakeDir(sub) || !MakeUnevenTree(dir, sub, depth - 1, random))
+			return false;
+	}
+	return true;
+}
+
+static bool MakeTree(TempDir &dir, ScanTotals &exact)
+{
+	std::mt19937 random(12345);
+	if (!dir.Made() || !dir.MakeDir("tree") || !MakeUnevenTree(dir, "tree", 4, random))
+		return false;
+	FolderScanner scanner(SystemFileSystem(), 4);
+	return scanner.Scan(Utf8ToWide(dir("tree")), exact);
+}
+
+// Directories of 0, 1, 2 or 6 subdirectories, so that a few deep subtrees
+// hold most of the tree, and of files of Pareto distributed sizes from 1 KB,
+// so that a few files hold most of the bytes. The files are sparse, which
+// keeps those of gigabytes cheap. Stops at maxDirs directories.
+static bool MakeSkewedTree(const TempDir &dir, const std::string &path, unsigned depth, unsigned maxDirs,
+	std::mt19937 &random, unsigned &dirs)
+{
+	unsigned files = std::uniform_int_distribution<unsigned>(0, 8)(random);
+	for (unsigned i = 0; i < files; ++i)
+	{
+		double u = std::uniform_real_distribution<double>(1e-9, 1)(random);
+		off_t size = (off_t)std::min(1000 * pow(u, -1 / 1.1), 1e11);
+		if (!dir.MakeSparseFile(path + "/f" + std::to_string(i), size))
+			return false;
+	}
+	static const unsigned fanouts[] = { 0, 0, 1, 1, 2, 6 };
+	unsigned subdirs = depth ? fanouts[std::uniform_int_distribution<unsigned>(0, 5)(random)] : 0;
+	for (unsigned i = 0; i < subdirs && dirs < maxDirs; ++i)
+	{
+		std::string sub = path + "/d" + std::to_string(i);
+		++dirs;
+		if (!dir.MakeDir(sub) || !MakeSkewedTree(dir, sub, depth - 1, maxDirs, random, dirs))
+			return false;
+	}
+	return true;
+}
+
+// A tree of fanout subdirectories in every directory down to depth, each
+// holding a file of a megabyte
+static bool MakeWideTree(const TempDir &dir, const std::string &path, unsigned depth, unsigned fanout)
+{
+	if (!dir.MakeSparseFile(path + "/f", 1 << 20))
+		return false;
+	for (unsigned i = 0; depth && i < fanout; ++i)
+	{
+		std::string sub = path + "/d" + std::to_string(i);
+		if (!dir.MakeDir(sub) || !MakeWideTree(dir, sub, depth - 1, fanout))
+			return false;
+	}
+	return true;
+}
+
+static double Median(std::vector<double> values)
+{
+	std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+	return values[values.size() / 2];
+}
+
+// Listings of the system file system slowed down to those of a disk
+class SlowFileSystem : public FileSystem
+{
+public:
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *self,
+		const std::atomic<bool> *cancel)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return SystemFileSystem().ReadDir(path, entries, self, cancel);
+	}
+
+	virtual bool Stat(const std::wstring &path, DirEntry &entry)
+	{
+		return SystemFileSystem().Stat(path, entry);
+	}
+};
+
+// Listings that hang until cancelled, of one subdirectory each below the root
+class HangingFileSystem : public FileSystem
+{
+public:
+	HangingFileSystem() : m_hung(0) {}
+
+	virtual bool ReadDir(const std::wstring &path, std::vector<DirEntry> &entries, DirEntry *,
+		const std::atomic<bool> *cancel)
+	{
+		entries.clear();
+		if (path == L"/")
+		{
+			DirEntry entry;
+			entry.name = L"hang";
+			entry.isDir = true;
+			entry.isLink = false;
+			entry.size = entry.allocated = entry.mtime = entry.device = entry.fileId = 0;
+			entry.links = 1;
+			entries.push_back(entry);
+			entry.name = L"file";
+			entry.isDir = false;
+			entry.size = entry.allocated = 1000;
+			entries.push_back(entry);
+			return true;
+		}
+		++m_hung;
+		while (!cancel || !*cancel)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return false;
+	}
+
+	virtual bool Stat(const std::wstring &, DirEntry &)
+	{
+		return false;
+	}
+
+	std::atomic<unsigned> m_hung;
+};
+
+TEST(PartialEstimatesAreClose)
+{
+	TempDir dir("SizeEstimatorTest");
+	ScanTotals exact;
+	CHECK(MakeTree(dir, exact));
+	CHECK(exact.dirs > 100);
+
+	// With listings of a millisecond, the budget lists a fraction of the tree
+	SlowFileSystem fs;
+	std::vector<double> errors;
+	unsigned held = 0, estimated = 0;
+	for (unsigned seed = 0; seed < SEEDS; ++seed)
+	{
+		SizeEstimator estimator(fs, Utf8ToWide(dir("tree")), 2, seed);
+		SizeEstimate estimate;
+		CHECK(estimator.Refine(30));
+		if (!estimator.GetEstimate(estimate) || estimate.exact)
+			continue;
+		++estimated;
+		double error = fabs((double)estimate.totals.bytes - exact.bytes) / exact.bytes;
+		errors.push_back(error);
+		if (fabs((double)estimate.totals.bytes - exact.bytes) <= estimate.error.bytes)
+			++held;
+	}
+	CHECK(estimated >= SEEDS / 2);
+	if (errors.empty())
+		return;
+	double median = Median(errors);
+	fprintf(stderr, "%u estimates, median error %.1f%%, %u within their interval\n", estimated, median * 100, held);
+	CHECK(median < 0.35);
+	CHECK(held * 2 >= estimated);
+}
+
+TEST(ErrorShrinksWithBudget)
+{
+	TempDir dir("SizeEstimatorTest");
+	std::mt19937 random(777);
+	unsigned dirs = 0;
+	CHECK(dir.Made() && dir.MakeDir("tree"));
+	// Six subtrees below the root, however few subdirectories it would draw
+	for (unsigned i = 0; i < 6; ++i)
+	{
+		std::string sub = "tree/d" + std::to_string(i);
+		CHECK(dir.MakeDir(sub) && MakeSkewedTree(dir, sub, 12, 2000, random, dirs));
+	}
+	ScanTotals exact;
+	FolderScanner scanner(SystemFileSystem(), 4);
+	CHECK(scanner.Scan(Utf8ToWide(dir("tree")), exact));
+
+	// Budgets of walks of the same estimator, each refining the last
+	SlowFileSystem fs;
+	const unsigned budgets[] = { 10, 40, 160 };
+	const size_t count = sizeof(budgets) / sizeof(budgets[0]);
+	std::vector<double> errors[count];
+	for (unsigned seed = 0; seed < CONVERGENCE_SEEDS; ++seed)
+	{
+		SizeEstimator estimator(fs, Utf8ToWide(dir("tree")), 2, seed);
+		unsigned spent = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			CHECK(estimator.Refine(budgets[i] - spent));
+			spent = budgets[i];
+			SizeEstimate estimate;
+			CHECK(estimator.GetEstimate(estimate));
+			errors[i].push_back(fabs((double)estimate.totals.bytes - exact.bytes) / exact.bytes);
+		}
+	}
+	double medians[count];
+	for (size_t i = 0; i < count; ++i)
+		medians[i] = Median(errors[i]);
+	fprintf(stderr, "%llu directories, median error %.1f%% at %u ms, %.1f%% at %u ms, %.1f%% at %u ms\n",
+		exact.dirs + 1, medians[0] * 100, budgets[0], medians[1] * 100, budgets[1], medians[2] * 100, budgets[2]);
+	CHECK(exact.dirs > 300);
+	CHECK(medians[1] <= medians[0]);
+	CHECK(medians[2] < medians[1]);
+	CHECK(medians[2] < medians[0] / 2);
+}
+
+TEST(FullEstimateIsExact)
+{
+	TempDir dir("SizeEstimatorTest");
+	ScanTotals exact;
+	CHECK(MakeTree(dir, exact));
+	SizeEstimator estimator(SystemFileSystem(), Utf8ToWide(dir("tree")), 4);
+	// Until every directory is listed, as the tree is far below MAX_LISTED
+	for (int i = 0; i < 100; ++i)
+	{
+		CHECK(estimator.Refine(100));
+		SizeEstimate estimate;
+		if (estimator.GetEstimate(estimate) && estimate.exact)
+			break;
+	}
+	SizeEstimate estimate;
+	CHECK(estimator.GetEstimate(estimate));
+	CHECK(estimate.exact);
+	CHECK(estimate.totals.bytes == exact.bytes);
+	CHECK(estimate.totals.allocated == exact.allocated);
+	CHECK(estimate.totals.files == exact.files);
+	CHECK(estimate.totals.dirs == exact.dirs);
+	CHECK(estimate.listed == exact.dirs + 1);
+	CHECK(estimate.error.bytes == 0);
+}
+
+TEST(HungListingIsCancelled)
+{
+	HangingFileSystem fs;
+	SizeEstimator estimator(fs, L"/", 1);
+	bool refined = false;
+	std::thread refine([&]() { refined = estimator.Refine(60000); });
+	while (!fs.m_hung)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	// No estimate yet, as no walk got below the root
+	SizeEstimate estimate;
+	CHECK(!estimator.GetEstimate(estimate));
+	Clock::time_point cancelled = Clock::now();
+	estimator.Cancel();
+	refine.join();
+	CHECK(Clock::now() - cancelled < std::chrono::milliseconds(100));
+	CHECK(refined);
+	// The listing given up is not taken for an unreadable directory
+	CHECK(!estimator.GetEstimate(estimate));
+}
+
+TEST(CancelBeforeRefineStops)
+{
+	HangingFileSystem fs;
+	SizeEstimator estimator(fs, L"/", 1);
+	estimator.Cancel();
+	Clock::time_point start = Clock::now();
+	estimator.Refine(60000);
+	CHECK(Clock::now() - start < std::chrono::milliseconds(100));
+	CHECK(fs.m_hung == 0);
+}
+
+TEST(StoppedRefineLeavesEstimatorUsable)
+{
+	HangingFileSystem fs;
+	SizeEstimator estimator(fs, L"/", 1);
+	for (unsigned round = 1; round <= 2; ++round)
+	{
+		std::atomic<bool> stop(false);
+		std::thread refine([&]() { estimator.Refine(60000, &stop); });
+		while (fs.m_hung < round)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		Clock::time_point stopped = Clock::now();
+		stop = true;
+		refine.join();
+		CHECK(Clock::now() - stopped < std::chrono::milliseconds(100));
+	}
+}
+
+TEST(MenuTipEstimatesWithinItsWindow)
+{
+	// About 9300 directories, far more than can be scanned in the window
+	TempDir dir("SizeEstimatorTest");
+	CHECK(dir.Made() && dir.MakeDir("tree") && MakeWideTree(dir, "tree", 5, 6));
+	TipSettings settings;
+	settings.folderScanTimeout = 20;
+	settings.snapshot = NULL;
+	std::wstring volname, tip;
+	Clock::time_point start = Clock::now();
+	CHECK(BuildItemTip(SystemVolumeBackend(), *MountTable::Current(), settings, FolderIndexLookup(),
+		Utf8ToWide(dir("tree")), volname, tip));
+	double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	fprintf(stderr, "%.1f ms: %s\n", ms, WideToUtf8(tip).c_str());
+	CHECK(ms < settings.folderScanTimeout + 50);
+	CHECK(tip.compare(0, 13, L"Folder: about") == 0);
+}
+
+int main()
+{
+	return RUN_TESTS();
+}
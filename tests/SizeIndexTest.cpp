@@ -0,0 +1,277 @@
+/****************************** Module Header ******************************\
+Module Name:  SizeIndexTest.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Unit tests of the size index file: totals written by SizeIndexBuilder are
+found again by SizeIndex, a new generation is picked up by Reload() while
+the old one stays readable until then and is deleted by a later write, and
+files that are truncated, padded, of another format or with a table damaged
+so that no bucket is empty are rejected or looked up without hanging.
+
+The index files are written to the current directory, the build directory
+under ctest.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Test.h"
+#include "SizeIndex.h"
+#include "Utf8.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define INDEX_FILE "SizeIndexTest.idx"
+
+static std::wstring IndexFile()
+{
+	return Utf8ToWide(INDEX_FILE);
+}
+
+static ScanTotals Totals(unsigned long long bytes, unsigned long long files, unsigned long long dirs)
+{
+	ScanTotals totals;
+	totals.bytes = bytes;
+	totals.allocated = bytes + 4096;
+	totals.files = files;
+	totals.dirs = dirs;
+	return totals;
+}
+
+static bool ReadPointer(SizeIndexPointer &pointer)
+{
+	FILE *fp = fopen(INDEX_FILE, "rb");
+	if (!fp)
+		return false;
+	bool ok = fread(&pointer, sizeof(pointer), 1, fp) == 1;
+	fclose(fp);
+	return ok;
+}
+
+static std::string GenerationFile(uint64_t generation)
+{
+	return WideToUtf8(SizeIndexGeneration(IndexFile(), generation));
+}
+
+static bool Exists(const std::string &filename)
+{
+	FILE *fp = fopen(filename.c_str(), "rb");
+	if (fp)
+		fclose(fp);
+	return fp != NULL;
+}
+
+// The current generation of the index
+static std::string DataFile()
+{
+	SizeIndexPointer pointer;
+	return ReadPointer(pointer) ? GenerationFile(pointer.generation) : std::string();
+}
+
+// The pointer and every generation
+static void RemoveIndex()
+{
+	SizeIndexPointer pointer;
+	if (ReadPointer(pointer))
+	{
+		for (uint64_t i = pointer.oldest; i <= pointer.generation; ++i)
+			remove(GenerationFile(i).c_str());
+	}
+	remove(INDEX_FILE);
+}
+
+static bool ReadFile(std::vector<char> &data)
+{
+	FILE *fp = fopen(DataFile().c_str(), "rb");
+	if (!fp)
+		return false;
+	fseek(fp, 0, SEEK_END);
+	data.resize((size_t)ftell(fp));
+	fseek(fp, 0, SEEK_SET);
+	bool ok = data.empty() || fread(&data[0], data.size(), 1, fp) == 1;
+	fclose(fp);
+	return ok;
+}
+
+// Overwrite the current generation in place
+static bool WriteFile(const std::vector<char> &data)
+{
+	FILE *fp = fopen(DataFile().c_str(), "wb");
+	if (!fp)
+		return false;
+	bool ok = data.empty() || fwrite(&data[0], data.size(), 1, fp) == 1;
+	return fclose(fp) == 0 && ok;
+}
+
+// An index of dirs directories /d0 to /d<dirs - 1>, /di holding i files
+static bool WriteIndex(unsigned dirs)
+{
+	SizeIndexBuilder builder;
+	for (unsigned i = 0; i < dirs; ++i)
+	{
+		wchar_t path[32];
+		swprintf(path, 32, L"/d%u", i);
+		builder.Add(path, Totals(i * 1000ull, i, 1));
+	}
+	return builder.Write(IndexFile());
+}
+
+TEST(RoundTrip)
+{
+	CHECK(WriteIndex(1000));
+	SizeIndex index;
+	CHECK(index.Open(IndexFile()));
+	CHECK(index.Size() == 1000);
+	bool all = true;
+	for (unsigned i = 0; i < 1000; ++i)
+	{
+		wchar_t path[32];
+		swprintf(path, 32, L"/d%u", i);
+		ScanTotals totals;
+		all = all && index.Lookup(path, totals) && totals.bytes == i * 1000ull &&
+			totals.allocated == i * 1000ull + 4096 && totals.files == i && totals.dirs == 1;
+	}
+	CHECK(all);
+	ScanTotals totals;
+	// Trailing separators do not matter
+	CHECK(index.Lookup(L"/d7/", totals) && totals.files == 7);
+	CHECK(!index.Lookup(L"/d1000", totals));
+	CHECK(!index.Lookup(L"/elsewhere", totals));
+	RemoveIndex();
+}
+
+TEST(ReloadPicksUpReplacement)
+{
+	CHECK(WriteIndex(10));
+	SizeIndex index;
+	CHECK(index.Open(IndexFile()));
+	ScanTotals totals;
+	CHECK(!index.Lookup(L"/d15", totals));
+	CHECK(WriteIndex(20));
+	CHECK(index.Reload());
+	CHECK(index.Lookup(L"/d15", totals) && totals.files == 15);
+	RemoveIndex();
+	CHECK(!index.Reload());
+	CHECK(!index.IsOpen());
+}
+
+TEST(OldGenerationsAreDeleted)
+{
+	RemoveIndex();
+	CHECK(WriteIndex(10));
+	SizeIndex index;
+	CHECK(index.Open(IndexFile()));
+	CHECK(WriteIndex(20));
+	CHECK(WriteIndex(30));
+	// The generation mapped still reads as it did
+	ScanTotals totals;
+	CHECK(index.Lookup(L"/d5", totals) && totals.files == 5);
+	CHECK(!index.Lookup(L"/d15", totals));
+	// The last one is kept for readers about to map it, the older deleted
+	SizeIndexPointer pointer;
+	CHECK(ReadPointer(pointer) && pointer.generation == 3 && pointer.oldest == 2);
+	CHECK(!Exists(GenerationFile(1)));
+	CHECK(Exists(GenerationFile(2)) && Exists(GenerationFile(3)));
+	CHECK(index.Reload());
+	CHECK(index.Lookup(L"/d25", totals) && totals.files == 25);
+	RemoveIndex();
+}
+
+TEST(TruncatedFileIsRejected)
+{
+	CHECK(WriteIndex(100));
+	std::vector<char> data;
+	CHECK(ReadFile(data));
+	SizeIndex index;
+	// Cut within the table, within the header and to nothing
+	size_t lengths[] = { data.size() - sizeof(SizeIndexEntry), data.size() - 1, sizeof(SizeIndexHeader) + 1,
+		sizeof(SizeIndexHeader) - 1, 0 };
+	for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i)
+	{
+		std::vector<char> cut(data.begin(), data.begin() + lengths[i]);
+		CHECK(WriteFile(cut));
+		CHECK(!index.Open(IndexFile()));
+		CHECK(!index.IsOpen());
+	}
+	RemoveIndex();
+}
+
+TEST(PaddedFileIsRejected)
+{
+	CHECK(WriteIndex(100));
+	std::vector<char> data;
+	CHECK(ReadFile(data));
+	data.resize(data.size() + sizeof(SizeIndexEntry));
+	CHECK(WriteFile(data));
+	SizeIndex index;
+	CHECK(!index.Open(IndexFile()));
+	RemoveIndex();
+}
+
+TEST(CorruptHeaderIsRejected)
+{
+	CHECK(WriteIndex(100));
+	std::vector<char> data;
+	CHECK(ReadFile(data));
+	SizeIndex index;
+
+	std::vector<char> bad = data;
+	bad[0] ^= 1;
+	CHECK(WriteFile(bad));
+	CHECK(!index.Open(IndexFile()));
+
+	bad = data;
+	reinterpret_cast<SizeIndexHeader *>(&bad[0])->version = SIZE_INDEX_VERSION + 1;
+	CHECK(WriteFile(bad));
+	CHECK(!index.Open(IndexFile()));
+
+	// Not a power of 2
+	bad = data;
+	reinterpret_cast<SizeIndexHeader *>(&bad[0])->bucketCount -= 1;
+	CHECK(WriteFile(bad));
+	CHECK(!index.Open(IndexFile()));
+
+	// More buckets than the file holds
+	bad = data;
+	reinterpret_cast<SizeIndexHeader *>(&bad[0])->bucketCount *= 2;
+	CHECK(WriteFile(bad));
+	CHECK(!index.Open(IndexFile()));
+
+	CHECK(WriteFile(data));
+	CHECK(index.Open(IndexFile()));
+	RemoveIndex();
+}
+
+TEST(FullTableLookupEnds)
+{
+	CHECK(WriteIndex(4));
+	std::vector<char> data;
+	CHECK(ReadFile(data));
+	// Fill every empty bucket with an entry no path hashes to
+	SizeIndexHeader *header = reinterpret_cast<SizeIndexHeader *>(&data[0]);
+	SizeIndexEntry *entries = reinterpret_cast<SizeIndexEntry *>(&data[0] + sizeof(SizeIndexHeader));
+	for (uint64_t i = 0; i < header->bucketCount; ++i)
+	{
+		if (!entries[i].hash)
+			entries[i].hash = HashIndexPath(L"/nowhere") ^ (i + 1);
+	}
+	CHECK(WriteFile(data));
+	SizeIndex index;
+	CHECK(index.Open(IndexFile()));
+	ScanTotals totals;
+	CHECK(index.Lookup(L"/d3", totals) && totals.files == 3);
+	CHECK(!index.Lookup(L"/nowhere", totals));
+	RemoveIndex();
+}
+
+int main()
+{
+	return RUN_TESTS();
+}
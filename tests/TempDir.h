@@ -0,0 +1,111 @@
+/****************************** Module Header ******************************\
+Module Name:  TempDir.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+A directory made under $TMPDIR, or /tmp, for the tests that scan or watch a
+real tree, with helpers to fill it. The directory and everything in it are
+removed when the TempDir goes away. Linux only.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "Utf8.h"
+#include <stdlib.h>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+class TempDir
+{
+public:
+	explicit TempDir(const char *prefix)
+	{
+		const char *tmp = getenv("TMPDIR");
+		std::string pattern = std::string(tmp && *tmp ? tmp : "/tmp") + "/" + prefix + ".XXXXXX";
+		if (mkdtemp(&pattern[0]))
+			m_path = pattern;
+	}
+
+	~TempDir()
+	{
+		if (!m_path.empty())
+			nftw(m_path.c_str(), Remove, 16, FTW_DEPTH | FTW_PHYS | FTW_MOUNT);
+	}
+
+	bool Made() const { return !m_path.empty(); }
+	const std::string &Path() const { return m_path; }
+	std::wstring WidePath() const { return Utf8ToWide(m_path); }
+
+	// Absolute path of name, relative to the directory
+	std::string operator ()(const std::string &name) const { return m_path + "/" + name; }
+
+	bool MakeDir(const std::string &name) const
+	{
+		return mkdir((*this)(name).c_str(), 0755) == 0;
+	}
+
+	// Make or replace name with size bytes of data, which takes up space
+	bool MakeFile(const std::string &name, size_t size) const
+	{
+		int fd = open((*this)(name).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0)
+			return false;
+		bool ok = Fill(fd, size);
+		return close(fd) == 0 && ok;
+	}
+
+	// Make or replace name, size bytes long but taking no space
+	bool MakeSparseFile(const std::string &name, off_t size) const
+	{
+		int fd = open((*this)(name).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0)
+			return false;
+		bool ok = ftruncate(fd, size) == 0;
+		return close(fd) == 0 && ok;
+	}
+
+	// Add size bytes to the end of name
+	bool Append(const std::string &name, size_t size) const
+	{
+		int fd = open((*this)(name).c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+		if (fd < 0)
+			return false;
+		bool ok = Fill(fd, size);
+		return close(fd) == 0 && ok;
+	}
+
+private:
+	static bool Fill(int fd, size_t size)
+	{
+		char block[4096] = { 0 };
+		while (size)
+		{
+			size_t n = size < sizeof(block) ? size : sizeof(block);
+			if (write(fd, block, n) != (ssize_t)n)
+				return false;
+			size -= n;
+		}
+		return true;
+	}
+
+	static int Remove(const char *path, const struct stat *, int, struct FTW *)
+	{
+		return remove(path);
+	}
+
+	std::string m_path;
+
+	TempDir(const TempDir &);
+	TempDir &operator =(const TempDir &);
+};
@@ -0,0 +1,84 @@
+/****************************** Module Header ******************************\
+Module Name:  Test.h
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+A minimal harness for the unit tests in tests/. Each test is a function
+registered with TEST(), CHECK() records a failure with its line and lets the
+test go on, and RUN_TESTS() runs them all and returns the exit code, so that
+every test source is one executable run by ctest.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+namespace Test
+{
+	typedef void (*Function)();
+
+	struct Case
+	{
+		const char *name;
+		Function function;
+	};
+
+	// Function-local so that tests register in any static init order
+	inline std::vector<Case> &Cases()
+	{
+		static std::vector<Case> cases;
+		return cases;
+	}
+
+	inline unsigned &Failures()
+	{
+		static unsigned failures = 0;
+		return failures;
+	}
+
+	struct Registrar
+	{
+		Registrar(const char *name, Function function)
+		{
+			Case c = { name, function };
+			Cases().push_back(c);
+		}
+	};
+
+	inline void Fail(const char *file, int line, const char *expression)
+	{
+		fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+		++Failures();
+	}
+
+	// Runs every test, 0 if all checks held
+	inline int Run()
+	{
+		for (size_t i = 0; i < Cases().size(); ++i)
+		{
+			unsigned before = Failures();
+			Cases()[i].function();
+			fprintf(stderr, "%-40s %s\n", Cases()[i].name, Failures() == before ? "ok" : "FAILED");
+		}
+		return Failures() ? 1 : 0;
+	}
+}
+
+#define TEST(name) \
+	static void name(); \
+	static Test::Registrar name##Registrar(#name, name); \
+	static void name()
+
+#define CHECK(expression) \
+	do { if (!(expression)) Test::Fail(__FILE__, __LINE__, #expression); } while (0)
+
+#define RUN_TESTS() Test::Run()
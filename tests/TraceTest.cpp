@@ -0,0 +1,71 @@
+/****************************** Module Header ******************************\
+Module Name:  TraceTest.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Unit tests of span tracing: the spans of many short-lived threads are all
+rendered, and the rings of threads that exited are reused by later ones, so
+that the rings allocated follow the threads recording at once rather than
+all threads ever started.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Test.h"
+#include "Trace.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+#define BATCHES 50
+#define BATCH_THREADS 4
+#define SPANS 10
+
+static size_t CountSpans(const std::string &json, const char *name)
+{
+	std::string key = std::string("{\"name\":\"") + name + "\"";
+	size_t count = 0;
+	for (size_t at = json.find(key); at != std::string::npos; at = json.find(key, at + 1))
+		++count;
+	return count;
+}
+
+TEST(RingsOfExitedThreadsAreReused)
+{
+	Trace::Enable(true);
+	Trace::Clear();
+	size_t before = Trace::Rings();
+	for (int batch = 0; batch < BATCHES; ++batch)
+	{
+		std::vector<std::thread> threads;
+		for (int i = 0; i < BATCH_THREADS; ++i)
+		{
+			threads.push_back(std::thread([]() {
+				for (int span = 0; span < SPANS; ++span)
+					TraceSpan trace("test-span");
+			}));
+		}
+		for (size_t i = 0; i < threads.size(); ++i)
+			threads[i].join();
+	}
+	CHECK(Trace::Rings() <= before + BATCH_THREADS);
+
+	std::string json;
+	Trace::Render(json);
+	CHECK(CountSpans(json, "test-span") == BATCHES * BATCH_THREADS * SPANS);
+	Trace::Clear();
+	Trace::Render(json);
+	CHECK(CountSpans(json, "test-span") == 0);
+	Trace::Enable(false);
+}
+
+int main()
+{
+	return RUN_TESTS();
+}
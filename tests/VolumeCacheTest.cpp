@@ -0,0 +1,236 @@
+/****************************** Module Header ******************************\
+Module Name:  VolumeCacheTest.cpp
+Project:      DiskUsageTip
+Copyright (c) Aulddays.
+
+Unit tests of VolumeCache against a simulated volume backend whose free
+space changes and whose queries can be held back: entries expire after the
+TTL, stale entries are served while one reload runs in the background,
+reloads finishing after Clear() or Invalidate() are dropped, and a cache
+destroyed with a reload in flight waits for it.
+
+This source is subject to the Microsoft Public License.
+See http://www.microsoft.com/opensource/licenses.mspx#Ms-PL.
+All other rights reserved.
+
+THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include "Test.h"
+#include "VolumeCache.h"
+#include "SimulatedVolumeBackend.h"
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+// A simulated volume whose free clusters are set by the test, and whose
+// queries wait while the backend is held
+class FakeSpaceBackend : public SimulatedVolumeBackend
+{
+public:
+	FakeSpaceBackend() : SimulatedVolumeBackend(1), m_free(0), m_held(false), m_queries(0), m_waiting(0) {}
+
+	void SetFree(unsigned long long free)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_free = free;
+	}
+
+	void Hold()
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_held = true;
+	}
+
+	void Release()
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_held = false;
+		m_changed.notify_all();
+	}
+
+	// Wait until a query is held back, false after a second
+	bool WaitHeldQuery()
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		return m_changed.wait_for(lock, std::chrono::seconds(1), [this]() { return m_waiting > 0; });
+	}
+
+	unsigned Queries()
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		return m_queries;
+	}
+
+	virtual bool QuerySpace(const wchar_t *volname, VolumeSpace &space)
+	{
+		if (!SimulatedVolumeBackend::QuerySpace(volname, space))
+			return false;
+		std::unique_lock<std::mutex> lock(m_lock);
+		++m_queries;
+		++m_waiting;
+		m_changed.notify_all();
+		while (m_held)
+			m_changed.wait(lock);
+		--m_waiting;
+		space.freeClusters = m_free;
+		return true;
+	}
+
+private:
+	std::mutex m_lock;
+	std::condition_variable m_changed;
+	unsigned long long m_free;
+	bool m_held;
+	unsigned m_queries;
+	unsigned m_waiting;
+};
+
+static VolumeCache::Loader SpaceLoader(FakeSpaceBackend &backend)
+{
+	return [&backend](const std::wstring &volname, VolumeCacheEntry &entry) {
+		return backend.QuerySpace(volname.c_str(), entry.space);
+	};
+}
+
+static unsigned long long CachedFree(VolumeCache &cache, FakeSpaceBackend &backend)
+{
+	VolumeCacheEntry entry;
+	if (!cache.Get(SimulatedVolumeBackend::VolumeName(0), SpaceLoader(backend), entry))
+		return ~0ull;
+	return entry.space.freeClusters;
+}
+
+static void SleepMs(unsigned ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// Poll for up to a second until the cache has free clusters
+static bool EventuallyFree(VolumeCache &cache, FakeSpaceBackend &backend, unsigned long long free)
+{
+	for (int i = 0; i < 1000; ++i)
+	{
+		VolumeCacheEntry entry;
+		if (cache.Peek(SimulatedVolumeBackend::VolumeName(0), entry) && entry.space.freeClusters == free)
+			return true;
+		SleepMs(1);
+	}
+	return false;
+}
+
+TEST(FreshEntryIsNotReloaded)
+{
+	FakeSpaceBackend backend;
+	VolumeCache cache(60000);
+	backend.SetFree(1);
+	CHECK(CachedFree(cache, backend) == 1);
+	backend.SetFree(2);
+	CHECK(CachedFree(cache, backend) == 1);
+	CHECK(backend.Queries() == 1);
+}
+
+TEST(ExpiredEntryIsReloadedInPlace)
+{
+	FakeSpaceBackend backend;
+	VolumeCache cache(20, false);
+	backend.SetFree(1);
+	CHECK(CachedFree(cache, backend) == 1);
+	backend.SetFree(2);
+	SleepMs(40);
+	// Without serving stale entries the reload is done before Get() returns
+	CHECK(CachedFree(cache, backend) == 2);
+	CHECK(backend.Queries() == 2);
+}
+
+TEST(StaleEntryIsServedWhileReloading)
+{
+	FakeSpaceBackend backend;
+	VolumeCache cache(20, true);
+	backend.SetFree(1);
+	CHECK(CachedFree(cache, backend) == 1);
+	backend.SetFree(2);
+	backend.Hold();
+	SleepMs(40);
+	// Served at once, the reload waits in the background
+	CHECK(CachedFree(cache, backend) == 1);
+	CHECK(backend.WaitHeldQuery());
+	// Further callers neither wait nor start another reload
+	CHECK(CachedFree(cache, backend) == 1);
+	CHECK(backend.Queries() == 2);
+	backend.Release();
+	CHECK(EventuallyFree(cache, backend, 2));
+	CHECK(CachedFree(cache, backend) == 2);
+	CHECK(backend.Queries() == 2);
+}
+
+TEST(ReloadAfterClearIsDropped)
+{
+	FakeSpaceBackend backend;
+	VolumeCache cache(20, true);
+	backend.SetFree(1);
+	CHECK(CachedFree(cache, backend) == 1);
+	backend.SetFree(2);
+	backend.Hold();
+	SleepMs(40);
+	CHECK(CachedFree(cache, backend) == 1);
+	CHECK(backend.WaitHeldQuery());
+	cache.Clear();
+	backend.Release();
+	// Give the reload time to finish, it must not fill the cache
+	SleepMs(50);
+	VolumeCacheEntry entry;
+	CHECK(!cache.Peek(SimulatedVolumeBackend::VolumeName(0), entry));
+}
+
+TEST(ReloadAfterInvalidateIsDropped)
+{
+	FakeSpaceBackend backend;
+	VolumeCache cache(20, true);
+	backend.SetFree(1);
+	CHECK(CachedFree(cache, backend) == 1);
+	backend.SetFree(2);
+	backend.Hold();
+	SleepMs(40);
+	CHECK(CachedFree(cache, backend) == 1);
+	CHECK(backend.WaitHeldQuery());
+	cache.Invalidate(SimulatedVolumeBackend::VolumeName(0));
+	backend.Release();
+	SleepMs(50);
+	VolumeCacheEntry entry;
+	CHECK(!cache.Peek(SimulatedVolumeBackend::VolumeName(0), entry));
+	// The next Get() loads afresh
+	backend.SetFree(3);
+	CHECK(CachedFree(cache, backend) == 3);
+}
+
+TEST(DestructorWaitsForReload)
+{
+	FakeSpaceBackend backend;
+	std::unique_ptr<VolumeCache> cache(new VolumeCache(20, true));
+	backend.SetFree(1);
+	CHECK(CachedFree(*cache, backend) == 1);
+	backend.Hold();
+	SleepMs(40);
+	CHECK(CachedFree(*cache, backend) == 1);
+	CHECK(backend.WaitHeldQuery());
+	std::thread release([&backend]() {
+		SleepMs(50);
+		backend.Release();
+	});
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	cache.reset();
+	// Returned only once the reload was released and done with the cache
+	CHECK(Clock::now() - start >= std::chrono::milliseconds(40));
+	release.join();
+}
+
+int main()
+{
+	return RUN_TESTS();
+}